@@ -51,9 +51,11 @@ check_include_file(sys/un.h HAVE_SYS_UN_H)
 check_include_file(poll.h HAVE_POLL_H)
 check_include_file(sys/poll.h HAVE_SYS_POLL_H)
 check_include_file(sys/select.h HAVE_SYS_SELECT_H)
+check_include_file(sys/eventfd.h HAVE_SYS_EVENTFD_H)
 check_include_file(sched.h HAVE_SCHED_H)
 check_include_file(string.h HAVE_STRING_H)
 check_include_file(strings.h HAVE_STRINGS_H)
+check_include_file(linux/io_uring.h HAVE_LINUX_IO_URING_H)
 
 # Check for afunix.h on Windows (since Windows 10 Insider Build 17063):
 check_cxx_source_compiles(
@@ -82,6 +84,11 @@ check_cxx_source_compiles(
   STRERROR_R_CHAR_P)
 
 
+# Optional libraries, see DefineOptions.cmake
+set(HAVE_ZSTD ${WITH_ZSTD})
+set(HAVE_LZ4 ${WITH_LZ4})
+set(HAVE_SNAPPY ${WITH_SNAPPY})
+
 set(PACKAGE ${PACKAGE_NAME})
 set(PACKAGE_STRING "${PACKAGE_NAME} ${PACKAGE_VERSION}")
 set(VERSION ${thrift_VERSION})
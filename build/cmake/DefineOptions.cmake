@@ -67,6 +67,19 @@ if(WITH_CPP)
     find_package(ZLIB QUIET)
     CMAKE_DEPENDENT_OPTION(WITH_ZLIB "Build with ZLIB support" ON
                            "ZLIB_FOUND" OFF)
+    # Compression transforms for THeaderTransport, which is built with ZLIB
+    find_path(ZSTD_INCLUDE_DIR zstd.h)
+    find_library(ZSTD_LIBRARY NAMES zstd)
+    CMAKE_DEPENDENT_OPTION(WITH_ZSTD "Build with zstd support" ON
+                           "WITH_ZLIB;ZSTD_INCLUDE_DIR;ZSTD_LIBRARY" OFF)
+    find_path(LZ4_INCLUDE_DIR lz4.h)
+    find_library(LZ4_LIBRARY NAMES lz4)
+    CMAKE_DEPENDENT_OPTION(WITH_LZ4 "Build with lz4 support" ON
+                           "WITH_ZLIB;LZ4_INCLUDE_DIR;LZ4_LIBRARY" OFF)
+    find_path(SNAPPY_INCLUDE_DIR snappy-c.h)
+    find_library(SNAPPY_LIBRARY NAMES snappy)
+    CMAKE_DEPENDENT_OPTION(WITH_SNAPPY "Build with snappy support" ON
+                           "WITH_ZLIB;SNAPPY_INCLUDE_DIR;SNAPPY_LIBRARY" OFF)
     find_package(Libevent QUIET)
     CMAKE_DEPENDENT_OPTION(WITH_LIBEVENT "Build with libevent support" ON
                            "Libevent_FOUND" OFF)
@@ -188,6 +201,9 @@ if (BUILD_CPP)
     message(STATUS "    Build with libevent support:              ${WITH_LIBEVENT}")
     message(STATUS "    Build with Qt5 support:                   ${WITH_QT5}")
     message(STATUS "    Build with ZLIB support:                  ${WITH_ZLIB}")
+    message(STATUS "    Build with zstd support:                  ${WITH_ZSTD}")
+    message(STATUS "    Build with lz4 support:                   ${WITH_LZ4}")
+    message(STATUS "    Build with snappy support:                ${WITH_SNAPPY}")
 endif ()
 message(STATUS)
 message(STATUS "  Build C (GLib) library:                     ${BUILD_C_GLIB}")
@@ -27,6 +27,7 @@
 #include <iomanip>
 #include <iostream>
 #include <limits>
+#include <set>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -60,6 +61,7 @@ public:
     gen_enum_class_ = false;
     use_include_prefix_ = false;
     gen_cob_style_ = false;
+    gen_coroutines_ = false;
     gen_no_client_completion_ = false;
     gen_no_default_operators_ = false;
     gen_templates_ = false;
@@ -71,6 +73,8 @@ public:
     gen_no_skeleton_ = false;
     gen_no_constructors_ = false;
     gen_private_optional_ = false;
+    gen_arena_ = false;
+    gen_lazy_ = false;
     has_members_ = false;
 
     for( iter = parsed_options.begin(); iter != parsed_options.end(); ++iter) {
@@ -83,6 +87,9 @@ public:
         use_include_prefix_ = true;
       } else if( iter->first.compare("cob_style") == 0) {
         gen_cob_style_ = true;
+      } else if( iter->first.compare("coroutines") == 0) {
+        gen_coroutines_ = true;
+        gen_cob_style_ = true;
       } else if( iter->first.compare("no_client_completion") == 0) {
         gen_no_client_completion_ = true;
       } else if( iter->first.compare("no_default_operators") == 0) {
@@ -105,6 +112,10 @@ public:
         gen_no_constructors_ = true;
       } else if ( iter->first.compare("private_optional") == 0) {
         gen_private_optional_ = true;
+      } else if ( iter->first.compare("arena") == 0) {
+        gen_arena_ = true;
+      } else if ( iter->first.compare("lazy") == 0) {
+        gen_lazy_ = true;
       } else {
         throw "unknown option cpp:" + iter->first;
       }
@@ -179,6 +190,7 @@ public:
   void generate_struct_result_writer(std::ostream& out, t_struct* tstruct, bool pointers = false);
   void generate_struct_swap(std::ostream& out, t_struct* tstruct);
   void generate_struct_swap_decl(std::ostream& out, t_struct* tstruct);
+  void generate_lazy_field_codecs(std::ostream& out, t_struct* tstruct);
   void generate_struct_print_method(std::ostream& out, t_struct* tstruct);
   void generate_exception_what_method(std::ostream& out, t_struct* tstruct);
 
@@ -200,6 +212,8 @@ public:
                                  bool specialized = false);
   void generate_function_helpers(t_service* tservice, t_function* tfunction);
   void generate_service_async_skeleton(t_service* tservice);
+  void generate_service_coro_adapter(t_service* tservice);
+  void generate_service_coro_client(t_service* tservice);
 
   /**
    * Serialization constructs
@@ -245,6 +259,8 @@ public:
 
   void generate_serialize_list_element(std::ostream& out, t_list* tlist, std::string iter);
 
+  std::string bulk_list_type(t_list* tlist);
+
   void generate_function_call(ostream& out,
                               t_function* tfunction,
                               string target,
@@ -289,6 +305,13 @@ public:
 
   bool is_reference(t_field* tfield) { return tfield->get_reference(); }
 
+  /**
+   * True if the field is held in a TLazyField, see find_lazy_fields().
+   */
+  bool is_lazy(t_field* tfield) const { return lazy_fields_.count(tfield) != 0; }
+
+  void find_lazy_fields();
+
   bool is_complex_type(t_type* ttype) {
     ttype = get_true_type(ttype);
 
@@ -371,6 +394,23 @@ private:
    */
   bool gen_moveable_;
 
+  /**
+   * True if strings and containers should use arena allocators, and
+   * processors should deserialize each call into a per-call TArena.
+   */
+  bool gen_arena_;
+
+  /**
+   * True if struct and container fields of user structs should be parsed
+   * lazily (see TLazyField.h), unless annotated cpp.lazy = "false".
+   */
+  bool gen_lazy_;
+
+  /**
+   * Fields of user structs that are parsed lazily.
+   */
+  std::set<t_field*> lazy_fields_;
+
   /**
    * True if we should generate setters with perfect forwarding for non-primitive types.
    */
@@ -397,6 +437,12 @@ private:
    */
   bool gen_cob_style_;
 
+  /**
+   * True if we should generate C++20 coroutine clients and handler
+   * interfaces on top of the cob-style classes.
+   */
+  bool gen_coroutines_;
+
   /**
    * True if we should omit calls to completion__() in CobClient class.
    */
@@ -499,6 +545,13 @@ void t_cpp_generator::init_generator() {
            << "#include <thrift/protocol/TProtocol.h>" << '\n'
            << "#include <thrift/transport/TTransport.h>" << '\n'
            << '\n';
+  if (gen_arena_) {
+    f_types_ << "#include <thrift/TArena.h>" << '\n' << '\n';
+  }
+  find_lazy_fields();
+  if (!lazy_fields_.empty()) {
+    f_types_ << "#include <thrift/TLazyField.h>" << '\n' << '\n';
+  }
   // Include C++xx compatibility header
   f_types_ << "#include <functional>" << '\n';
   f_types_ << "#include <memory>" << '\n';
@@ -1035,6 +1088,33 @@ void t_cpp_generator::generate_forward_declaration(t_struct* tstruct) {
   f_types_ << indent() << "class " << tstruct->get_name() << ";" << '\n' << '\n';
 }
 
+/**
+ * Picks the fields of user structs that are read lazily: struct and
+ * container fields without a default value, under the lazy option or when
+ * annotated cpp.lazy.  Fields of service argument and result structs are
+ * never lazy since handlers take them by reference.
+ */
+void t_cpp_generator::find_lazy_fields() {
+  const vector<t_struct*>& objects = program_->get_objects();
+  for (auto tstruct : objects) {
+    for (auto tfield : tstruct->get_members()) {
+      t_type* type = get_true_type(tfield->get_type());
+      if (!(type->is_struct() || type->is_container()) || type->is_xception()
+          || is_reference(tfield) || tfield->get_value() != nullptr) {
+        continue;
+      }
+      bool lazy = gen_lazy_;
+      auto it = tfield->annotations_.find("cpp.lazy");
+      if (it != tfield->annotations_.end()) {
+        lazy = it->second.empty() || it->second.back() != "false";
+      }
+      if (lazy) {
+        lazy_fields_.insert(tfield);
+      }
+    }
+  }
+}
+
 /**
  * Generates a struct definition for a thrift data type. This is a class
  * with data members and a read/write() function, plus a mirroring isset
@@ -1049,6 +1129,7 @@ void t_cpp_generator::generate_cpp_struct(t_struct* tstruct, bool is_exception)
   std::ostream& out = (gen_templates_ ? f_types_tcc_ : f_types_impl_);
   generate_struct_reader(out, tstruct);
   generate_struct_writer(out, tstruct);
+  generate_lazy_field_codecs(f_types_impl_, tstruct);
   
   // Generate forward setter template implementations in .tcc file
   if (gen_forward_setter_) {
@@ -1440,6 +1521,29 @@ void t_cpp_generator::generate_struct_declaration(ostream& out,
     out << "~" << tstruct->get_name() << "() noexcept;\n";
   }
 
+  // Declare the codecs of lazy fields ahead of the fields
+  bool has_lazy_fields = false;
+  for (m_iter = members.begin(); m_iter != members.end(); ++m_iter) {
+    if (!is_lazy(*m_iter)) {
+      continue;
+    }
+    has_lazy_fields = true;
+    string value_type = type_name((*m_iter)->get_type());
+    out << '\n' << indent() << "struct _" << (*m_iter)->get_name() << "__codec {" << '\n';
+    indent_up();
+    indent(out) << "static const ::apache::thrift::protocol::TType type = "
+                << type_to_enum((*m_iter)->get_type()) << ";" << '\n';
+    indent(out) << "static uint32_t read(::apache::thrift::protocol::TProtocol* iprot, "
+                << value_type << "& val);" << '\n';
+    indent(out) << "static uint32_t write(::apache::thrift::protocol::TProtocol* oprot, const "
+                << value_type << "& val);" << '\n';
+    indent_down();
+    indent(out) << "};" << '\n';
+  }
+  if (has_lazy_fields) {
+    out << '\n';
+  }
+
   // Declare all fields
   if (gen_private_optional_ && !pointers) {
     // When private_optional is enabled, declare non-optional fields first in public section
@@ -1808,6 +1912,8 @@ void t_cpp_generator::generate_struct_reader(ostream& out, t_struct* tstruct, bo
 
       if (pointers && !(*f_iter)->get_type()->is_xception()) {
         generate_deserialize_field(out, *f_iter, "(*(this->", "))");
+      } else if (is_lazy(*f_iter)) {
+        indent(out) << "xfer += this->" << (*f_iter)->get_name() << ".read(iprot);" << '\n';
       } else {
         generate_deserialize_field(out, *f_iter, "this->");
       }
@@ -1893,6 +1999,8 @@ void t_cpp_generator::generate_struct_writer(ostream& out, t_struct* tstruct, bo
     // Write field contents
     if (pointers && !(*f_iter)->get_type()->is_xception()) {
       generate_serialize_field(out, *f_iter, "(*(this->", "))");
+    } else if (is_lazy(*f_iter)) {
+      indent(out) << "xfer += this->" << (*f_iter)->get_name() << ".write(oprot);" << '\n';
     } else {
       generate_serialize_field(out, *f_iter, "this->");
     }
@@ -1915,6 +2023,46 @@ void t_cpp_generator::generate_struct_writer(ostream& out, t_struct* tstruct, bo
   indent(out) << "}" << '\n' << '\n';
 }
 
+/**
+ * Generates the read and write functions of the codecs of lazy fields,
+ * which decode and encode the value of a field as the struct reader and
+ * writer would.
+ *
+ * @param out Stream to write to
+ * @param tstruct The struct
+ */
+void t_cpp_generator::generate_lazy_field_codecs(ostream& out, t_struct* tstruct) {
+  const vector<t_field*>& fields = tstruct->get_members();
+  vector<t_field*>::const_iterator f_iter;
+
+  for (f_iter = fields.begin(); f_iter != fields.end(); ++f_iter) {
+    if (!is_lazy(*f_iter)) {
+      continue;
+    }
+    string codec = tstruct->get_name() + "::_" + (*f_iter)->get_name() + "__codec";
+    string value_type = type_name((*f_iter)->get_type());
+    t_field val((*f_iter)->get_type(), "val");
+
+    indent(out) << "uint32_t " << codec << "::read(::apache::thrift::protocol::TProtocol* iprot, "
+                << value_type << "& val) {" << '\n';
+    indent_up();
+    indent(out) << "uint32_t xfer = 0;" << '\n';
+    generate_deserialize_field(out, &val, "");
+    indent(out) << "return xfer;" << '\n';
+    indent_down();
+    indent(out) << "}" << '\n' << '\n';
+
+    indent(out) << "uint32_t " << codec << "::write(::apache::thrift::protocol::TProtocol* oprot, "
+                << "const " << value_type << "& val) {" << '\n';
+    indent_up();
+    indent(out) << "uint32_t xfer = 0;" << '\n';
+    generate_serialize_field(out, &val, "");
+    indent(out) << "return xfer;" << '\n';
+    indent_down();
+    indent(out) << "}" << '\n' << '\n';
+  }
+}
+
 /**
  * Struct writer for result of a function, which can have only one of its
  * fields set and does a conditional if else look up into the __isset field
@@ -2270,6 +2418,9 @@ void t_cpp_generator::generate_service(t_service* tservice) {
   if (gen_cob_style_) {
     f_header_ << "#include <thrift/async/TAsyncDispatchProcessor.h>" << '\n';
   }
+  if (gen_coroutines_) {
+    f_header_ << "#include <thrift/async/TCoroutine.h>" << '\n';
+  }
   f_header_ << "#include <thrift/async/TConcurrentClientSyncInfo.h>" << '\n';
   f_header_ << "#include <memory>" << '\n';
   f_header_ << "#include \"" << get_include_prefix(*get_program()) << program_name_ << "_types.h\""
@@ -2347,6 +2498,13 @@ void t_cpp_generator::generate_service(t_service* tservice) {
 
   }
 
+  // Generate the coroutine components
+  if (gen_coroutines_) {
+    generate_service_interface(tservice, "CoroSv");
+    generate_service_coro_adapter(tservice);
+    generate_service_coro_client(tservice);
+  }
+
   f_header_ << "#ifdef _MSC_VER\n"
                "  #pragma warning( pop )\n"
                "#endif\n\n";
@@ -2714,6 +2872,213 @@ void t_cpp_generator::generate_service_async_skeleton(t_service* tservice) {
   f_skeleton << "}" << '\n' << '\n';
 }
 
+/**
+ * Generates an adapter that serves a coroutine handler through the cob-style
+ * processor: each CobSv method starts the handler's task and hands its
+ * outcome to cob or exn_cob.
+ *
+ * @param tservice The service to generate an adapter for.
+ */
+void t_cpp_generator::generate_service_coro_adapter(t_service* tservice) {
+  string adapter_name = service_name_ + "CoroSvAdapter";
+  string if_name = service_name_ + "CoroSvIf";
+  string extends = "";
+  string extends_adapter = "";
+  if (tservice->get_extends() != nullptr) {
+    extends = type_name(tservice->get_extends());
+    extends_adapter = ", public " + extends + "CoroSvAdapter";
+  }
+
+  f_header_ << "class " << adapter_name << " : "
+            << "virtual public " << service_name_ << "CobSvIf" << extends_adapter << " {" << '\n'
+            << " public:" << '\n';
+  indent_up();
+  f_header_ << indent() << adapter_name << "(::std::shared_ptr<" << if_name << "> iface) :";
+  if (!extends.empty()) {
+    f_header_ << '\n' << indent() << "  " << extends << "CoroSvAdapter(iface),";
+  }
+  f_header_ << '\n' << indent() << "  iface_(iface) {}" << '\n' << indent() << "virtual ~"
+            << adapter_name << "() {}" << '\n';
+
+  vector<t_function*> functions = tservice->get_functions();
+  vector<t_function*>::const_iterator f_iter;
+  for (f_iter = functions.begin(); f_iter != functions.end(); ++f_iter) {
+    f_header_ << indent() << function_signature(*f_iter, "CobSv") << " override;" << '\n';
+  }
+  indent_down();
+
+  f_header_ << " protected:" << '\n' << indent() << "  ::std::shared_ptr<" << if_name
+            << "> iface_;" << '\n' << "};" << '\n' << '\n';
+
+  for (f_iter = functions.begin(); f_iter != functions.end(); ++f_iter) {
+    f_service_ << function_signature(*f_iter, "CobSv", adapter_name + "::") << '\n';
+    scope_up(f_service_);
+    f_service_ << indent() << "::apache::thrift::async::completeTask(iface_->"
+               << (*f_iter)->get_name() << "(";
+    const vector<t_field*>& fields = (*f_iter)->get_arglist()->get_members();
+    vector<t_field*>::const_iterator fld_iter;
+    for (fld_iter = fields.begin(); fld_iter != fields.end(); ++fld_iter) {
+      if (fld_iter != fields.begin()) {
+        f_service_ << ", ";
+      }
+      f_service_ << (*fld_iter)->get_name();
+    }
+    f_service_ << "), cob" << ((*f_iter)->is_oneway() ? "" : ", exn_cob") << ");" << '\n';
+    scope_down(f_service_);
+    f_service_ << '\n';
+  }
+}
+
+/**
+ * Generates a coroutine client.  Unlike the cob-style client, every call has
+ * its own buffers, so any number of calls can be in flight on the channel.
+ *
+ * @param tservice The service to generate a client for.
+ */
+void t_cpp_generator::generate_service_coro_client(t_service* tservice) {
+  string client_name = service_name_ + "CoroClient";
+  string extends = "";
+  string extends_client = "";
+  if (tservice->get_extends() != nullptr) {
+    extends = type_name(tservice->get_extends());
+    extends_client = " : public " + extends + "CoroClient";
+  }
+
+  generate_java_doc(f_header_, tservice);
+  f_header_ << "class " << client_name << extends_client << " {" << '\n' << " public:" << '\n';
+  indent_up();
+  f_header_ << indent() << client_name
+            << "(std::shared_ptr< ::apache::thrift::async::TAsyncChannel> channel, "
+            << "std::shared_ptr< ::apache::thrift::protocol::TProtocolFactory> protocolFactory) :"
+            << '\n';
+  if (extends.empty()) {
+    f_header_ << indent() << "  channel_(channel)," << '\n' << indent()
+              << "  protocolFactory_(protocolFactory) {}" << '\n';
+  } else {
+    f_header_ << indent() << "  " << extends << "CoroClient(channel, protocolFactory) {}" << '\n';
+  }
+  f_header_ << indent() << "virtual ~" << client_name << "() {}" << '\n';
+  if (extends.empty()) {
+    f_header_ << indent()
+              << "std::shared_ptr< ::apache::thrift::async::TAsyncChannel> getChannel() {" << '\n'
+              << indent() << "  return channel_;" << '\n' << indent() << "}" << '\n';
+  }
+
+  vector<t_function*> functions = tservice->get_functions();
+  vector<t_function*>::const_iterator f_iter;
+  for (f_iter = functions.begin(); f_iter != functions.end(); ++f_iter) {
+    generate_java_doc(f_header_, *f_iter);
+    indent(f_header_) << function_signature(*f_iter, "CoroCl") << ";" << '\n';
+  }
+  indent_down();
+
+  if (extends.empty()) {
+    f_header_ << " protected:" << '\n';
+    indent_up();
+    f_header_ << indent() << "std::shared_ptr< ::apache::thrift::async::TAsyncChannel> channel_;"
+              << '\n' << indent()
+              << "std::shared_ptr< ::apache::thrift::protocol::TProtocolFactory> protocolFactory_;"
+              << '\n';
+    indent_down();
+  }
+  f_header_ << "};" << '\n' << '\n';
+
+  string scope = client_name + "::";
+  for (f_iter = functions.begin(); f_iter != functions.end(); ++f_iter) {
+    t_function* tfunction = *f_iter;
+    t_type* returntype = tfunction->get_returntype();
+    string argsname = tservice->get_name() + "_" + tfunction->get_name() + "_pargs";
+    string resultname = tservice->get_name() + "_" + tfunction->get_name() + "_presult";
+
+    f_service_ << function_signature(tfunction, "CoroCl", scope) << '\n';
+    scope_up(f_service_);
+
+    // Serialize the request
+    f_service_ << indent() << "std::shared_ptr< ::apache::thrift::transport::TMemoryBuffer> "
+               << "otrans(new ::apache::thrift::transport::TMemoryBuffer());" << '\n' << indent()
+               << "std::shared_ptr< ::apache::thrift::protocol::TProtocol> oprot = "
+               << "protocolFactory_->getProtocol(otrans);" << '\n' << indent()
+               << "int32_t cseqid = 0;" << '\n' << indent() << "oprot->writeMessageBegin(\""
+               << tfunction->get_name() << "\", ::apache::thrift::protocol::"
+               << (tfunction->is_oneway() ? "T_ONEWAY" : "T_CALL") << ", cseqid);" << '\n'
+               << '\n' << indent() << argsname << " args;" << '\n';
+    const vector<t_field*>& fields = tfunction->get_arglist()->get_members();
+    vector<t_field*>::const_iterator fld_iter;
+    for (fld_iter = fields.begin(); fld_iter != fields.end(); ++fld_iter) {
+      f_service_ << indent() << "args." << (*fld_iter)->get_name() << " = &"
+                 << (*fld_iter)->get_name() << ";" << '\n';
+    }
+    f_service_ << indent() << "args.write(oprot.get());" << '\n' << '\n' << indent()
+               << "oprot->writeMessageEnd();" << '\n' << indent()
+               << "oprot->getTransport()->writeEnd();" << '\n' << indent()
+               << "oprot->getTransport()->flush();" << '\n' << '\n';
+
+    if (tfunction->is_oneway()) {
+      f_service_ << indent() << "co_await ::apache::thrift::async::TChannelSend(*channel_, "
+                 << "otrans.get());" << '\n';
+      scope_down(f_service_);
+      f_service_ << '\n';
+      continue;
+    }
+
+    f_service_ << indent() << "std::shared_ptr< ::apache::thrift::transport::TMemoryBuffer> "
+               << "itrans(new ::apache::thrift::transport::TMemoryBuffer());" << '\n' << indent()
+               << "co_await ::apache::thrift::async::TChannelSendAndRecv(*channel_, "
+               << "otrans.get(), itrans.get());" << '\n' << '\n';
+
+    // Deserialize the response
+    f_service_ << indent() << "std::shared_ptr< ::apache::thrift::protocol::TProtocol> iprot = "
+               << "protocolFactory_->getProtocol(itrans);" << '\n' << indent()
+               << "int32_t rseqid = 0;" << '\n' << indent() << "std::string fname;" << '\n'
+               << indent() << "::apache::thrift::protocol::TMessageType mtype;" << '\n' << '\n'
+               << indent() << "iprot->readMessageBegin(fname, mtype, rseqid);" << '\n' << indent()
+               << "if (mtype == ::apache::thrift::protocol::T_EXCEPTION) {" << '\n' << indent()
+               << "  ::apache::thrift::TApplicationException x;" << '\n' << indent()
+               << "  x.read(iprot.get());" << '\n' << indent() << "  iprot->readMessageEnd();"
+               << '\n' << indent() << "  iprot->getTransport()->readEnd();" << '\n' << indent()
+               << "  throw x;" << '\n' << indent() << "}" << '\n' << indent()
+               << "if (mtype != ::apache::thrift::protocol::T_REPLY) {" << '\n' << indent()
+               << "  throw ::apache::thrift::TApplicationException("
+               << "::apache::thrift::TApplicationException::INVALID_MESSAGE_TYPE);" << '\n'
+               << indent() << "}" << '\n' << indent() << "if (fname.compare(\""
+               << tfunction->get_name() << "\") != 0) {" << '\n' << indent()
+               << "  throw ::apache::thrift::TApplicationException("
+               << "::apache::thrift::TApplicationException::WRONG_METHOD_NAME);" << '\n'
+               << indent() << "}" << '\n';
+
+    if (!returntype->is_void()) {
+      t_field returnfield(returntype, "_return");
+      f_service_ << indent() << declare_field(&returnfield, true) << '\n';
+    }
+    f_service_ << indent() << resultname << " result;" << '\n';
+    if (!returntype->is_void()) {
+      f_service_ << indent() << "result.success = &_return;" << '\n';
+    }
+    f_service_ << indent() << "result.read(iprot.get());" << '\n' << indent()
+               << "iprot->readMessageEnd();" << '\n' << indent()
+               << "iprot->getTransport()->readEnd();" << '\n' << '\n';
+
+    if (!returntype->is_void()) {
+      f_service_ << indent() << "if (result.__isset.success) {" << '\n' << indent()
+                 << "  co_return std::move(_return);" << '\n' << indent() << "}" << '\n';
+    }
+    const vector<t_field*>& xceptions = tfunction->get_xceptions()->get_members();
+    vector<t_field*>::const_iterator x_iter;
+    for (x_iter = xceptions.begin(); x_iter != xceptions.end(); ++x_iter) {
+      f_service_ << indent() << "if (result.__isset." << (*x_iter)->get_name() << ") {" << '\n'
+                 << indent() << "  throw result." << (*x_iter)->get_name() << ";" << '\n'
+                 << indent() << "}" << '\n';
+    }
+    if (!returntype->is_void()) {
+      f_service_ << indent() << "throw ::apache::thrift::TApplicationException("
+                 << "::apache::thrift::TApplicationException::MISSING_RESULT, \""
+                 << tfunction->get_name() << " failed: unknown result\");" << '\n';
+    }
+    scope_down(f_service_);
+    f_service_ << '\n';
+  }
+}
+
 /**
  * Generates a multiface, which is a single server that just takes a set
  * of objects implementing the interface and calls them all, returning the
@@ -3905,7 +4270,16 @@ void t_cpp_generator::generate_process_function(t_service* tservice,
         << "this->eventHandler_.get(), ctx, " << service_func_name << ");" << '\n' << '\n'
         << indent() << "if (this->eventHandler_.get() != nullptr) {" << '\n' << indent()
         << "  this->eventHandler_->preRead(ctx, " << service_func_name << ");" << '\n' << indent()
-        << "}" << '\n' << '\n' << indent() << argsname << " args;" << '\n' << indent()
+        << "}" << '\n' << '\n';
+
+    if (gen_arena_) {
+      // The args and result graphs, and anything the handler builds from
+      // arena types, live until this call returns.
+      out << indent() << "::apache::thrift::TArena arena;" << '\n' << indent()
+          << "::apache::thrift::TArenaScope arenaScope(&arena);" << '\n';
+    }
+
+    out << indent() << argsname << " args;" << '\n' << indent()
         << "args.read(iprot);" << '\n' << indent() << "iprot->readMessageEnd();" << '\n' << indent()
         << "uint32_t bytes = iprot->getTransport()->readEnd();" << '\n' << '\n' << indent()
         << "if (this->eventHandler_.get() != nullptr) {" << '\n' << indent()
@@ -4021,6 +4395,9 @@ void t_cpp_generator::generate_process_function(t_service* tservice,
 
   // Cob style.
   else {
+    // coroutine handlers report every failure through exn_cob
+    bool has_exn_cob = !xceptions.empty() || gen_coroutines_;
+
     // Processor entry point.
     // TODO(edhall) update for callContext when TEventServer is ready
     if (gen_templates_) {
@@ -4103,7 +4480,7 @@ void t_cpp_generator::generate_process_function(t_service* tservice,
           << ") =" << '\n';
       out << indent() << "  &" << tservice->get_name() << "AsyncProcessor" << class_suffix
           << "::return_" << tfunction->get_name() << ";" << '\n';
-      if (!xceptions.empty()) {
+      if (has_exn_cob) {
         out << indent() << "void (" << tservice->get_name() << "AsyncProcessor" << class_suffix
             << "::*throw_fn)(::std::function<void(bool ok)> "
             << "cob, int32_t seqid, " << prot_type << "* oprot, void* ctx, "
@@ -4117,7 +4494,7 @@ void t_cpp_generator::generate_process_function(t_service* tservice,
       indent_up();
       out << indent() << "::std::bind(return_fn, this, cob, seqid, oprot, ctx" << ret_placeholder
           << ")";
-      if (!xceptions.empty()) {
+      if (has_exn_cob) {
         out << ',' << '\n' << indent() << "::std::bind(throw_fn, this, cob, seqid, oprot, "
             << "ctx, ::std::placeholders::_1)";
       }
@@ -4187,7 +4564,7 @@ void t_cpp_generator::generate_process_function(t_service* tservice,
     }
 
     // Exception return.
-    if (!tfunction->is_oneway() && !xceptions.empty()) {
+    if (!tfunction->is_oneway() && has_exn_cob) {
       if (gen_templates_) {
         out << indent() << "template <class Protocol_>" << '\n';
       }
@@ -4465,6 +4842,14 @@ void t_cpp_generator::generate_deserialize_container(ostream& out, t_type* ttype
         << "xfer += iprot->readListBegin(" << etype << ", " << size << ");" << '\n';
     if (!use_push) {
       indent(out) << prefix << ".resize(" << size << ");" << '\n';
+      string bulk = bulk_list_type((t_list*)ttype);
+      if (!bulk.empty()) {
+        indent(out) << "xfer += iprot->read" << bulk << "Array(" << prefix << ".data(), " << size
+                    << ");" << '\n';
+        indent(out) << "xfer += iprot->readListEnd();" << '\n';
+        scope_down(out);
+        return;
+      }
     }
   }
 
@@ -4657,6 +5042,14 @@ void t_cpp_generator::generate_serialize_container(ostream& out, t_type* ttype,
     indent(out) << "xfer += oprot->writeListBegin("
                 << type_to_enum(((t_list*)ttype)->get_elem_type()) << ", "
                 << "static_cast<uint32_t>(" << prefix << ".size()));" << '\n';
+    string bulk = bulk_list_type((t_list*)ttype);
+    if (!bulk.empty()) {
+      indent(out) << "xfer += oprot->write" << bulk << "Array(" << prefix << ".data(), "
+                  << "static_cast<uint32_t>(" << prefix << ".size()));" << '\n';
+      indent(out) << "xfer += oprot->writeListEnd();" << '\n';
+      scope_down(out);
+      return;
+    }
   }
 
   string iter = tmp("_iter");
@@ -4712,6 +5105,39 @@ void t_cpp_generator::generate_serialize_list_element(ostream& out, t_list* tlis
   generate_serialize_field(out, &efield, "");
 }
 
+/**
+ * Returns the element type name of the readXxxArray() / writeXxxArray()
+ * protocol methods that can transfer a list in one call, or "" if the list
+ * has to go element by element.  This needs contiguous storage holding
+ * exactly the protocol's element type.
+ */
+string t_cpp_generator::bulk_list_type(t_list* tlist) {
+  if (tlist->has_cpp_name()) {
+    return "";
+  }
+  t_type* elem_type = get_true_type(tlist->get_elem_type());
+  if (!elem_type->is_base_type()) {
+    return "";
+  }
+  t_base_type::t_base tbase = ((t_base_type*)elem_type)->get_base();
+  if (type_name(elem_type) != base_type_name(tbase)) {
+    // cpp.type annotation
+    return "";
+  }
+  switch (tbase) {
+  case t_base_type::TYPE_I16:
+    return "I16";
+  case t_base_type::TYPE_I32:
+    return "I32";
+  case t_base_type::TYPE_I64:
+    return "I64";
+  case t_base_type::TYPE_DOUBLE:
+    return "Double";
+  default:
+    return "";
+  }
+}
+
 /**
  * Makes a :: prefix for a namespace
  *
@@ -4823,14 +5249,22 @@ string t_cpp_generator::type_name(t_type* ttype, bool in_typedef, bool arg) {
       cname = tcontainer->get_cpp_name();
     } else if (ttype->is_map()) {
       t_map* tmap = (t_map*)ttype;
-      cname = "std::map<" + type_name(tmap->get_key_type(), in_typedef) + ", "
+      cname = (gen_arena_ ? "::apache::thrift::TArenaMap<" : "std::map<")
+              + type_name(tmap->get_key_type(), in_typedef) + ", "
               + type_name(tmap->get_val_type(), in_typedef) + "> ";
     } else if (ttype->is_set()) {
       t_set* tset = (t_set*)ttype;
-      cname = "std::set<" + type_name(tset->get_elem_type(), in_typedef) + "> ";
+      cname = (gen_arena_ ? "::apache::thrift::TArenaSet<" : "std::set<")
+              + type_name(tset->get_elem_type(), in_typedef) + "> ";
     } else if (ttype->is_list()) {
       t_list* tlist = (t_list*)ttype;
-      cname = "std::vector<" + type_name(tlist->get_elem_type(), in_typedef) + "> ";
+      t_type* elem_type = get_true_type(tlist->get_elem_type());
+      // list<bool> stays a std::vector<bool>: protocols read into its
+      // std::vector<bool>::reference, which depends on the allocator.
+      bool is_bool_list = elem_type->is_base_type()
+                          && ((t_base_type*)elem_type)->get_base() == t_base_type::TYPE_BOOL;
+      cname = (gen_arena_ && !is_bool_list ? "::apache::thrift::TArenaVector<" : "std::vector<")
+              + type_name(tlist->get_elem_type(), in_typedef) + "> ";
     }
 
     if (arg) {
@@ -4880,7 +5314,7 @@ string t_cpp_generator::base_type_name(t_base_type::t_base tbase) {
   case t_base_type::TYPE_VOID:
     return "void";
   case t_base_type::TYPE_STRING:
-    return "std::string";
+    return gen_arena_ ? "::apache::thrift::TArenaString" : "std::string";
   case t_base_type::TYPE_BOOL:
     return "bool";
   case t_base_type::TYPE_I8:
@@ -4919,6 +5353,8 @@ string t_cpp_generator::declare_field(t_field* tfield,
   result += type_name(tfield->get_type());
   if (is_reference(tfield)) {
     result = "::std::shared_ptr<" + result + ">";
+  } else if (is_lazy(tfield)) {
+    result = "::apache::thrift::TLazyField<" + result + ", _" + tfield->get_name() + "__codec>";
   }
   if (pointer) {
     result += "*";
@@ -4979,6 +5415,8 @@ string t_cpp_generator::function_signature(t_function* tfunction,
   t_type* ttype = tfunction->get_returntype();
   t_struct* arglist = tfunction->get_arglist();
   bool has_xceptions = !tfunction->get_xceptions()->get_members().empty();
+  // coroutine handlers report every failure through exn_cob
+  bool has_exn_cob = has_xceptions || (gen_coroutines_ && !tfunction->is_oneway());
 
   if (style == "") {
     if (is_complex_type(ttype)) {
@@ -5000,9 +5438,10 @@ string t_cpp_generator::function_signature(t_function* tfunction,
       cob_type += "* client)";
     } else if (style == "CobSv") {
       cob_type = (ttype->is_void() ? "()" : ("(" + type_name(ttype) + " const& _return)"));
-      if (has_xceptions) {
-        exn_cob
-            = ", ::std::function<void(::apache::thrift::TDelayedException* _throw)> /* exn_cob */";
+      if (has_exn_cob) {
+        // only the coroutine adapter uses the parameter
+        exn_cob = string(", ::std::function<void(::apache::thrift::TDelayedException* _throw)> ")
+                  + (name_params && gen_coroutines_ ? "exn_cob" : "/* exn_cob */");
       }
     } else {
       throw "UNKNOWN STYLE";
@@ -5010,6 +5449,25 @@ string t_cpp_generator::function_signature(t_function* tfunction,
 
     return "void " + prefix + tfunction->get_name() + "(::std::function<void" + cob_type + "> cob"
            + exn_cob + argument_list(arglist, name_params, true) + ")";
+  } else if (style == "CoroCl" || style == "CoroSv") {
+    string args;
+    if (style == "CoroCl") {
+      // a client call serializes its arguments before it first suspends
+      args = argument_list(arglist, name_params);
+    } else {
+      // a handler may still use its arguments after the processor's copy is gone
+      const vector<t_field*>& fields = arglist->get_members();
+      vector<t_field*>::const_iterator f_iter;
+      for (f_iter = fields.begin(); f_iter != fields.end(); ++f_iter) {
+        if (f_iter != fields.begin()) {
+          args += ", ";
+        }
+        args += type_name((*f_iter)->get_type()) + " "
+                + (name_params ? (*f_iter)->get_name() : "/* " + (*f_iter)->get_name() + " */");
+      }
+    }
+    return "::apache::thrift::async::TTask<" + type_name(ttype) + "> " + prefix
+           + tfunction->get_name() + "(" + args + ")";
   } else {
     throw "UNKNOWN STYLE";
   }
@@ -5096,6 +5554,8 @@ bool t_cpp_generator::is_struct_storage_not_throwing(t_struct* tstruct) const {
   for(size_t i=0; i < members.size(); ++i)  {
     t_type* type = get_true_type(members[i]->get_type());
 
+    if(is_lazy(members[i]))
+      return false;
     if(type->is_enum())
       continue;
     if(type->is_xception())
@@ -5170,6 +5630,9 @@ THRIFT_REGISTER_GENERATOR(
     cpp,
     "C++",
     "    cob_style:       Generate \"Continuation OBject\"-style classes.\n"
+    "    coroutines:      Also generate C++20 coroutine clients and handler interfaces\n"
+    "                     (requires C++20; implies cob_style, whose handlers then all\n"
+    "                     take an exn_cob).\n"
     "    no_client_completion:\n"
     "                     Omit calls to completion__() in CobClient class.\n"
     "    no_default_operators:\n"
@@ -5183,4 +5646,10 @@ THRIFT_REGISTER_GENERATOR(
     "                     with perfect forwarding for non-primitive types.\n"
     "    no_ostream_operators:\n"
     "                     Omit generation of ostream definitions.\n"
-    "    no_skeleton:     Omits generation of skeleton.\n")
+    "    no_skeleton:     Omits generation of skeleton.\n"
+    "    arena:           Use arena allocated strings and containers, and deserialize each\n"
+    "                     processed call into a per-call arena released when it returns.\n"
+    "                     Handlers must copy, not move, arena values they keep.\n"
+    "    lazy:            Parse struct and container fields of structs on first access, and\n"
+    "                     write them back verbatim while unchanged (see TLazyField.h).\n"
+    "                     Fields can opt in or out with the cpp.lazy annotation.\n")
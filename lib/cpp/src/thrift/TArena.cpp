@@ -0,0 +1,107 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/TArena.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace apache {
+namespace thrift {
+
+thread_local TArena* TArena::current_ = nullptr;
+
+namespace {
+// Keep the first byte of every block suitably aligned for any type.
+const size_t BLOCK_HEADER_SIZE
+    = (sizeof(void*) + sizeof(size_t) + alignof(std::max_align_t) - 1)
+      & ~(alignof(std::max_align_t) - 1);
+}
+
+TArena::TArena(size_t initialBlockSize)
+  : blocks_(nullptr),
+    cur_(nullptr),
+    end_(nullptr),
+    nextBlockSize_((std::max)(initialBlockSize, static_cast<size_t>(64))),
+    bytesAllocated_(0),
+    bytesReserved_(0) {
+}
+
+TArena::~TArena() {
+  freeBlocks(blocks_);
+}
+
+void TArena::freeBlocks(Block* block) {
+  while (block != nullptr) {
+    Block* next = block->next;
+    bytesReserved_ -= block->size;
+    std::free(block);
+    block = next;
+  }
+}
+
+void* TArena::allocateSlow(size_t size, size_t align) {
+  size_t need = size + align;
+  size_t blockSize = nextBlockSize_;
+  if (need > blockSize / 2) {
+    // Large requests get a block to themselves so the remainder of the
+    // current block isn't wasted.
+    blockSize = need;
+  } else {
+    nextBlockSize_ = (std::min)(nextBlockSize_ * 2, static_cast<size_t>(MAX_BLOCK_SIZE));
+  }
+
+  void* mem = std::malloc(BLOCK_HEADER_SIZE + blockSize);
+  if (mem == nullptr) {
+    throw std::bad_alloc();
+  }
+  auto* block = static_cast<Block*>(mem);
+  block->size = BLOCK_HEADER_SIZE + blockSize;
+  bytesReserved_ += block->size;
+
+  uint8_t* begin = static_cast<uint8_t*>(mem) + BLOCK_HEADER_SIZE;
+  uint8_t* end = begin + blockSize;
+  auto p = (reinterpret_cast<uintptr_t>(begin) + (align - 1)) & ~static_cast<uintptr_t>(align - 1);
+
+  if (blockSize == need && blocks_ != nullptr) {
+    // Dedicated block: link it behind the current one so the current
+    // block stays in use for the small allocations that follow.
+    block->next = blocks_->next;
+    blocks_->next = block;
+  } else {
+    block->next = blocks_;
+    blocks_ = block;
+    cur_ = reinterpret_cast<uint8_t*>(p + size);
+    end_ = end;
+  }
+  bytesAllocated_ += size;
+  return reinterpret_cast<void*>(p);
+}
+
+void TArena::reset() {
+  if (blocks_ != nullptr) {
+    freeBlocks(blocks_->next);
+    blocks_->next = nullptr;
+    cur_ = reinterpret_cast<uint8_t*>(blocks_) + BLOCK_HEADER_SIZE;
+    end_ = reinterpret_cast<uint8_t*>(blocks_) + blocks_->size;
+  }
+  bytesAllocated_ = 0;
+}
+}
+} // apache::thrift
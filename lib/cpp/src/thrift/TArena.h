@@ -0,0 +1,224 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TARENA_H_
+#define _THRIFT_TARENA_H_ 1
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <new>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace apache {
+namespace thrift {
+
+/**
+ * A monotonic memory arena.
+ *
+ * Memory is carved sequentially out of large blocks and is only returned
+ * when the arena is reset or destroyed, so allocating is a pointer bump and
+ * deallocating is free.  This suits a request or response object graph that
+ * is built while deserializing and dropped as a whole once the call is done.
+ *
+ * A TArena is not thread safe; use one per call (or per thread).
+ */
+class TArena {
+public:
+  /// Default size of the first block
+  static const size_t DEFAULT_BLOCK_SIZE = 4096;
+
+  /// Blocks never grow beyond this size (bigger requests get their own block)
+  static const size_t MAX_BLOCK_SIZE = 1024 * 1024;
+
+  explicit TArena(size_t initialBlockSize = DEFAULT_BLOCK_SIZE);
+  ~TArena();
+
+  TArena(const TArena&) = delete;
+  TArena& operator=(const TArena&) = delete;
+
+  /**
+   * Returns size bytes aligned to align (a power of two).
+   *
+   * @throws std::bad_alloc if the system is out of memory
+   */
+  void* allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+    auto p = (reinterpret_cast<uintptr_t>(cur_) + (align - 1)) & ~static_cast<uintptr_t>(align - 1);
+    if (cur_ != nullptr && p + size <= reinterpret_cast<uintptr_t>(end_)) {
+      cur_ = reinterpret_cast<uint8_t*>(p + size);
+      bytesAllocated_ += size;
+      return reinterpret_cast<void*>(p);
+    }
+    return allocateSlow(size, align);
+  }
+
+  /**
+   * Releases everything allocated so far.  The most recent block is kept
+   * for reuse, so an arena reset between calls quickly stops allocating.
+   */
+  void reset();
+
+  /// Bytes handed out since construction or the last reset()
+  size_t getBytesAllocated() const { return bytesAllocated_; }
+
+  /// Bytes currently held from the system
+  size_t getBytesReserved() const { return bytesReserved_; }
+
+  /**
+   * Returns the arena installed for the calling thread by TArenaScope, or
+   * nullptr when there is none.
+   */
+  static TArena* current() { return current_; }
+
+private:
+  friend class TArenaScope;
+
+  struct Block {
+    Block* next;
+    size_t size;
+  };
+
+  void* allocateSlow(size_t size, size_t align);
+  void freeBlocks(Block* block);
+
+  Block* blocks_;
+  uint8_t* cur_;
+  uint8_t* end_;
+  size_t nextBlockSize_;
+  size_t bytesAllocated_;
+  size_t bytesReserved_;
+
+  static thread_local TArena* current_;
+};
+
+/**
+ * Makes an arena the current one for the calling thread for as long as the
+ * scope object lives, restoring the previous one afterwards.  Containers and
+ * strings using TArenaAllocator that are constructed within the scope take
+ * their memory from the arena.  Passing nullptr selects the heap.
+ */
+class TArenaScope {
+public:
+  explicit TArenaScope(TArena* arena) : previous_(TArena::current_) { TArena::current_ = arena; }
+  ~TArenaScope() { TArena::current_ = previous_; }
+
+  TArenaScope(const TArenaScope&) = delete;
+  TArenaScope& operator=(const TArenaScope&) = delete;
+
+private:
+  TArena* previous_;
+};
+
+/**
+ * A C++11 allocator that takes memory from a TArena, or from the heap when
+ * it has no arena.
+ *
+ * A default constructed allocator binds to TArena::current(), which lets
+ * generated structs pick up the arena of the call that creates them without
+ * any constructor plumbing.  Elements are constructed with the container's
+ * arena made current, so nested strings and containers land in the same
+ * arena as their parent.  Assignment never moves the allocator: assigning
+ * into an object keeps the memory source it was constructed with, which
+ * keeps long-lived objects safe from being pointed into a per-call arena.
+ */
+template <typename T>
+class TArenaAllocator {
+public:
+  typedef T value_type;
+  typedef std::true_type propagate_on_container_swap;
+  typedef std::false_type propagate_on_container_copy_assignment;
+  typedef std::false_type propagate_on_container_move_assignment;
+
+  TArenaAllocator() noexcept : arena_(TArena::current()) {}
+  explicit TArenaAllocator(TArena* arena) noexcept : arena_(arena) {}
+
+  template <typename U>
+  TArenaAllocator(const TArenaAllocator<U>& other) noexcept : arena_(other.arena()) {}
+
+  T* allocate(size_t n) {
+    if (arena_ != nullptr) {
+      return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+    }
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t) noexcept {
+    if (arena_ == nullptr) {
+      ::operator delete(p);
+    }
+  }
+
+  template <typename U, typename... Args>
+  void construct(U* p, Args&&... args) {
+    doConstruct(typename std::is_scalar<U>::type(), p, std::forward<Args>(args)...);
+  }
+
+  /// Copies go to whichever arena is current where the copy is made.
+  TArenaAllocator select_on_container_copy_construction() const { return TArenaAllocator(); }
+
+  TArena* arena() const { return arena_; }
+
+private:
+  template <typename U, typename... Args>
+  void doConstruct(std::true_type, U* p, Args&&... args) {
+    // scalars have no allocator of their own to pass the arena on to
+    ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+  }
+
+  template <typename U, typename... Args>
+  void doConstruct(std::false_type, U* p, Args&&... args) {
+    TArenaScope scope(arena_);
+    ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+  }
+
+  TArena* arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const TArenaAllocator<T>& a, const TArenaAllocator<U>& b) {
+  return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const TArenaAllocator<T>& a, const TArenaAllocator<U>& b) {
+  return a.arena() != b.arena();
+}
+
+/*
+ * Container types used by code generated with the cpp:arena option.
+ */
+typedef std::basic_string<char, std::char_traits<char>, TArenaAllocator<char> > TArenaString;
+
+template <typename T>
+using TArenaVector = std::vector<T, TArenaAllocator<T> >;
+
+template <typename T>
+using TArenaSet = std::set<T, std::less<T>, TArenaAllocator<T> >;
+
+template <typename K, typename V>
+using TArenaMap = std::map<K, V, std::less<K>, TArenaAllocator<std::pair<const K, V> > >;
+}
+} // apache::thrift
+
+#endif // #ifndef _THRIFT_TARENA_H_
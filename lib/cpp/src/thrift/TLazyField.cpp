@@ -0,0 +1,137 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/TLazyField.h>
+#include <thrift/transport/TBufferTransports.h>
+
+#include <typeinfo>
+
+namespace apache {
+namespace thrift {
+
+using protocol::TProtocol;
+using protocol::TType;
+using transport::TBufferBase;
+using transport::TTransport;
+using transport::TTransportException;
+
+namespace {
+
+/**
+ * A read only window on bytes owned by someone else.  Unlike a
+ * TMemoryBuffer it can be pointed elsewhere without allocating.
+ */
+class TLazyWindow : public transport::TVirtualTransport<TLazyWindow, TBufferBase> {
+public:
+  TLazyWindow(const uint8_t* data, uint32_t size) { reset(data, size); }
+
+  void reset(const uint8_t* data, uint32_t size) {
+    setReadBuffer(const_cast<uint8_t*>(data), size);
+    resetConsumedMessageSize();
+  }
+
+  bool isOpen() const override { return true; }
+
+  uint32_t available() const { return static_cast<uint32_t>(rBound_ - rBase_); }
+
+protected:
+  uint32_t readSlow(uint8_t* /* buf */, uint32_t /* len */) override { return 0; }
+
+  void writeSlow(const uint8_t* /* buf */, uint32_t /* len */) override {
+    throw TTransportException(TTransportException::BAD_ARGS, "TLazyWindow is read only");
+  }
+
+  const uint8_t* borrowSlow(uint8_t* /* buf */, uint32_t* /* len */) override { return nullptr; }
+};
+
+/**
+ * The protocol used to scan values on this thread, kept from one lazy
+ * field to the next while they come from the same input protocol with the
+ * same settings (see TProtocol::getGeneration()).
+ */
+struct Scanner {
+  uint64_t generation = 0;
+  std::shared_ptr<TLazyWindow> window;
+  std::shared_ptr<TProtocol> protocol;
+};
+
+thread_local Scanner scanner;
+}
+
+bool TLazyFieldBase::capture(TProtocol* iprot, TType type, uint32_t& xfer) {
+  TTransport* trans = iprot->getTransport().get();
+  uint32_t len = 1;
+  const uint8_t* window = trans->borrow(nullptr, &len);
+  if (window == nullptr) {
+    return false;
+  }
+
+  uint64_t generation = iprot->getGeneration();
+  if (scanner.generation != generation) {
+    scanner.window = std::make_shared<TLazyWindow>(window, len);
+    scanner.protocol = iprot->cloneForTransport(scanner.window);
+    scanner.generation = generation;
+  }
+  if (!scanner.protocol) {
+    return false;
+  }
+
+  scanner.window->reset(window, len);
+  try {
+    scanner.protocol->skip(type);
+  } catch (TTransportException&) {
+    // the value does not fit in what the transport can lend; a protocol
+    // left in the middle of a value must not scan the next one
+    scanner = Scanner();
+    return false;
+  } catch (...) {
+    scanner = Scanner();
+    throw;
+  }
+
+  uint32_t size = len - scanner.window->available();
+  raw_.assign(reinterpret_cast<const char*>(window), size);
+  prototype_ = scanner.protocol;
+  trans->consume(size);
+  xfer += size;
+  return true;
+}
+
+std::shared_ptr<TProtocol> TLazyFieldBase::parser() const {
+  auto window = std::make_shared<TLazyWindow>(reinterpret_cast<const uint8_t*>(raw_.data()),
+                                              static_cast<uint32_t>(raw_.size()));
+  return prototype_->cloneForTransport(window);
+}
+
+bool TLazyFieldBase::writeRaw(TProtocol* oprot, uint32_t& xfer) const {
+  if (!prototype_ || typeid(*oprot) != typeid(*prototype_)) {
+    return false;
+  }
+  oprot->getTransport()->write(reinterpret_cast<const uint8_t*>(raw_.data()),
+                               static_cast<uint32_t>(raw_.size()));
+  xfer += static_cast<uint32_t>(raw_.size());
+  return true;
+}
+
+bool TLazyFieldBase::sameRaw(const TLazyFieldBase& other) const {
+  return prototype_ && other.prototype_ && typeid(*prototype_) == typeid(*other.prototype_)
+         && raw_ == other.raw_;
+}
+}
+} // apache::thrift
@@ -0,0 +1,185 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TLAZYFIELD_H_
+#define _THRIFT_TLAZYFIELD_H_ 1
+
+#include <thrift/protocol/TProtocol.h>
+#include <thrift/TPrintTo.h>
+#include <thrift/TToString.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace apache {
+namespace thrift {
+
+/**
+ * The part of TLazyField that does not depend on the value type: capturing
+ * the encoded bytes of a value, and writing them back out.
+ */
+class TLazyFieldBase {
+public:
+  /// True while the field holds the bytes its value was read from
+  bool hasRaw() const { return prototype_ != nullptr; }
+
+  /// True once the value has been parsed (or was never read lazily)
+  bool isParsed() const { return parsed_; }
+
+protected:
+  TLazyFieldBase() : parsed_(true) {}
+
+  /**
+   * Copies the next value, of the given type, out of the transport of iprot
+   * without parsing it.  Returns false, having read nothing, if the
+   * protocol cannot be cloned or the transport cannot lend the whole value
+   * through borrow().
+   */
+  bool capture(protocol::TProtocol* iprot, protocol::TType type, uint32_t& xfer);
+
+  /// Returns a protocol reading the captured bytes
+  std::shared_ptr<protocol::TProtocol> parser() const;
+
+  /**
+   * Writes the captured bytes as they are if oprot encodes values the same
+   * way as the protocol they were read with.
+   */
+  bool writeRaw(protocol::TProtocol* oprot, uint32_t& xfer) const;
+
+  /// True if both fields hold the same bytes in the same encoding
+  bool sameRaw(const TLazyFieldBase& other) const;
+
+  void dropRaw() {
+    raw_.clear();
+    prototype_.reset();
+  }
+
+  std::string raw_;
+  std::shared_ptr<protocol::TProtocol> prototype_;
+  mutable bool parsed_;
+};
+
+/**
+ * A field of a generated struct that is only parsed when it is first used.
+ *
+ * Reading the struct copies the bytes of the field without decoding them
+ * (see TProtocol::cloneForTransport()).  The value is parsed on the first
+ * call to get(), so parse errors are thrown from there rather than from
+ * read().  Until the value is changed through mutate() or assignment, write()
+ * emits the copied bytes verbatim when the output protocol has the same
+ * encoding as the input one, so a struct that is read, inspected and passed
+ * on never decodes or re-encodes the fields it does not look at.  Where
+ * bytes cannot be captured (e.g. protocols other than binary and compact, or
+ * unbuffered transports) the field is read eagerly.
+ *
+ * Codec is generated along with the struct: it holds the TType of the field
+ * and static read() and write() functions for its value.
+ *
+ * Like the rest of a generated struct, a TLazyField is not thread safe, and
+ * this includes const access, which may parse.
+ */
+template <typename T, typename Codec>
+class TLazyField : public TLazyFieldBase {
+public:
+  typedef T value_type;
+
+  TLazyField() : value_() {}
+  TLazyField(const T& value) : value_(value) {}
+  TLazyField(T&& value) : value_(std::move(value)) {}
+
+  TLazyField& operator=(const T& value) {
+    value_ = value;
+    parsed_ = true;
+    dropRaw();
+    return *this;
+  }
+
+  TLazyField& operator=(T&& value) {
+    value_ = std::move(value);
+    parsed_ = true;
+    dropRaw();
+    return *this;
+  }
+
+  /// Returns the value, parsing it first if needed
+  const T& get() const {
+    if (!parsed_) {
+      parse();
+    }
+    return value_;
+  }
+
+  /// Returns the value for changing; the copied bytes are dropped
+  T& mutate() {
+    get();
+    dropRaw();
+    return value_;
+  }
+
+  operator const T&() const { return get(); }
+  const T* operator->() const { return &get(); }
+
+  bool operator==(const TLazyField& rhs) const {
+    return sameRaw(rhs) || get() == rhs.get();
+  }
+  bool operator!=(const TLazyField& rhs) const { return !(*this == rhs); }
+
+  uint32_t read(protocol::TProtocol* iprot) {
+    uint32_t xfer = 0;
+    if (capture(iprot, Codec::type, xfer)) {
+      parsed_ = false;
+      return xfer;
+    }
+    dropRaw();
+    parsed_ = true;
+    return Codec::read(iprot, value_);
+  }
+
+  uint32_t write(protocol::TProtocol* oprot) const {
+    uint32_t xfer = 0;
+    if (writeRaw(oprot, xfer)) {
+      return xfer;
+    }
+    return Codec::write(oprot, get());
+  }
+
+private:
+  void parse() const {
+    std::shared_ptr<protocol::TProtocol> iprot = parser();
+    Codec::read(iprot.get(), value_);
+    parsed_ = true;
+  }
+
+  mutable T value_;
+};
+
+template <typename T, typename Codec>
+std::string to_string(const TLazyField<T, Codec>& field) {
+  return to_string(field.get());
+}
+
+template <typename OStream, typename T, typename Codec>
+void printTo(OStream& out, const TLazyField<T, Codec>& field) {
+  printTo(out, field.get());
+}
+}
+} // apache::thrift
+
+#endif // #ifndef _THRIFT_TLAZYFIELD_H_
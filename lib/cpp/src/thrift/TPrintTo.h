@@ -40,14 +40,14 @@ void printTo(OStream& out, const int8_t& t) {
 }
 
 // Forward declarations for collection types
-template <typename OStream, typename K, typename V>
-void printTo(OStream& out, const std::map<K, V>& m);
+template <typename OStream, typename K, typename V, typename C, typename A>
+void printTo(OStream& out, const std::map<K, V, C, A>& m);
 
-template <typename OStream, typename T>
-void printTo(OStream& out, const std::set<T>& s);
+template <typename OStream, typename T, typename C, typename A>
+void printTo(OStream& out, const std::set<T, C, A>& s);
 
-template <typename OStream, typename T>
-void printTo(OStream& out, const std::vector<T>& t);
+template <typename OStream, typename T, typename A>
+void printTo(OStream& out, const std::vector<T, A>& t);
 
 // Pair support
 template <typename OStream, typename K, typename V>
@@ -68,24 +68,24 @@ void printTo(OStream& out, Iterator beg, Iterator end) {
 }
 
 // Vector support
-template <typename OStream, typename T>
-void printTo(OStream& out, const std::vector<T>& t) {
+template <typename OStream, typename T, typename A>
+void printTo(OStream& out, const std::vector<T, A>& t) {
   out << "[";
   printTo(out, t.begin(), t.end());
   out << "]";
 }
 
 // Map support
-template <typename OStream, typename K, typename V>
-void printTo(OStream& out, const std::map<K, V>& m) {
+template <typename OStream, typename K, typename V, typename C, typename A>
+void printTo(OStream& out, const std::map<K, V, C, A>& m) {
   out << "{";
   printTo(out, m.begin(), m.end());
   out << "}";
 }
 
 // Set support
-template <typename OStream, typename T>
-void printTo(OStream& out, const std::set<T>& s) {
+template <typename OStream, typename T, typename C, typename A>
+void printTo(OStream& out, const std::set<T, C, A>& s) {
   out << "{";
   printTo(out, s.begin(), s.end());
   out << "}";
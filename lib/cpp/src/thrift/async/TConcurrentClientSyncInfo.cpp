@@ -19,30 +19,105 @@
 
 #include <limits>
 #include <memory>
+#include <thread>
 #include <thrift/TApplicationException.h>
 #include <thrift/async/TConcurrentClientSyncInfo.h>
+#include <thrift/concurrency/Monitor.h>
 #include <thrift/transport/TTransportException.h>
 
 namespace apache { namespace thrift { namespace async {
 
 using namespace ::apache::thrift::concurrency;
 
-TConcurrentClientSyncInfo::TConcurrentClientSyncInfo() :
+namespace {
+// Slot state flags
+const uint32_t TOKEN = 1;    // the slot's thread holds the read token
+const uint32_t NOTIFIED = 2; // the read token was released, try to take it
+const uint32_t WAITING = 4;  // the slot's thread waits for the read token
+const uint32_t PARKED = 8;   // the slot's thread is blocked on the monitor
+}
+
+struct TConcurrentClientSyncInfo::Slot
+{
+  Slot() : inUse(false), seqid(0), state(0) {}
+
+  std::atomic<bool> inUse;
+  std::atomic<int32_t> seqid;
+  std::atomic<uint32_t> state;
+  Monitor monitor;
+};
+
+TConcurrentClientSyncInfo::TConcurrentClientSyncInfo(size_t maxPendingCalls) :
   stop_(false),
-  seqidMutex_(),
   // test rollover all the time
-  nextseqid_((std::numeric_limits<int32_t>::max)()-10),
-  seqidToMonitorMap_(),
-  freeMonitors_(),
-  writeMutex_(),
-  readMutex_(),
+  nextseqid_(static_cast<uint32_t>((std::numeric_limits<int32_t>::max)()-10)),
+  slots_(),
+  slotMask_(0),
+  // spinning only delays the reading thread when it has no processor of its own
+  spinCount_(std::thread::hardware_concurrency() > 1 ? SPIN_COUNT : 0),
+  overflowMutex_(),
+  overflow_(),
+  overflowSize_(0),
+  readerBusy_(false),
+  waiters_(0),
+  reader_(nullptr),
   recvPending_(false),
-  wakeupSomeone_(false),
   seqidPending_(0),
   fnamePending_(),
-  mtypePending_(::apache::thrift::protocol::T_CALL)
+  mtypePending_(::apache::thrift::protocol::T_CALL),
+  writeMutex_(),
+  readMutex_()
+{
+  uint32_t slotCount = 1;
+  while(slotCount < maxPendingCalls && slotCount < (1u << 30))
+    slotCount <<= 1;
+  slots_.reset(new Slot[slotCount]);
+  slotMask_ = slotCount - 1;
+}
+
+TConcurrentClientSyncInfo::~TConcurrentClientSyncInfo() = default;
+
+TConcurrentClientSyncInfo::Slot* TConcurrentClientSyncInfo::tableSlot_(int32_t seqid)
+{
+  Slot& slot = slots_[static_cast<uint32_t>(seqid) & slotMask_];
+  if(slot.inUse && slot.seqid == seqid)
+    return &slot;
+  return nullptr;
+}
+
+TConcurrentClientSyncInfo::SlotPtr TConcurrentClientSyncInfo::overflowSlot_(int32_t seqid)
+{
+  if(overflowSize_ == 0)
+    return SlotPtr();
+  Guard overflowGuard(overflowMutex_);
+  auto i = overflow_.find(seqid);
+  if(i == overflow_.end())
+    return SlotPtr();
+  return i->second;
+}
+
+TConcurrentClientSyncInfo::Slot& TConcurrentClientSyncInfo::slotFor_(int32_t seqid)
 {
-  freeMonitors_.reserve(MONITOR_CACHE_SIZE);
+  // Only the thread that owns the call frees a heap slot, so the caller can
+  // keep using it after the lookup.
+  Slot* slot = tableSlot_(seqid);
+  if(slot)
+    return *slot;
+  return *overflowSlot_(seqid);
+}
+
+void TConcurrentClientSyncInfo::releaseSlot_(int32_t seqid)
+{
+  Slot* slot = tableSlot_(seqid);
+  if(slot)
+  {
+    slot->state = 0;
+    slot->inUse = false;
+    return;
+  }
+  Guard overflowGuard(overflowMutex_);
+  overflow_.erase(seqid);
+  overflowSize_ = overflow_.size();
 }
 
 bool TConcurrentClientSyncInfo::getPending(
@@ -52,7 +127,6 @@ bool TConcurrentClientSyncInfo::getPending(
 {
   if(stop_)
     throwDeadConnection_();
-  wakeupSomeone_ = false;
   if(recvPending_)
   {
     recvPending_ = false;
@@ -69,41 +143,106 @@ void TConcurrentClientSyncInfo::updatePending(
   ::apache::thrift::protocol::TMessageType mtype,
   int32_t rseqid)
 {
+  // Keeps a heap slot alive until the handover is done; its call may
+  // complete and free it as soon as it sees the token.
+  SlotPtr overflowTarget;
+  Slot* target = tableSlot_(rseqid);
+  if(!target)
+  {
+    overflowTarget = overflowSlot_(rseqid);
+    target = overflowTarget.get();
+  }
+  if(!target)
+    throwBadSeqId_();
   recvPending_ = true;
   seqidPending_ = rseqid;
   fnamePending_ = fname;
   mtypePending_ = mtype;
-  MonitorPtr monitor;
-  {
-    Guard seqidGuard(seqidMutex_);
-    auto i = seqidToMonitorMap_.find(rseqid);
-    if(i == seqidToMonitorMap_.end())
-      throwBadSeqId_();
-    monitor = i->second;
-  }
-  monitor->notify();
+
+  // hand the message and the read token straight to its call
+  Slot* self = reader_;
+  reader_ = target;
+  self->state.fetch_and(~TOKEN);
+  wake_(*target, TOKEN);
 }
 
 void TConcurrentClientSyncInfo::waitForWork(int32_t seqid)
 {
-  MonitorPtr m;
-  {
-    Guard seqidGuard(seqidMutex_);
-    m = seqidToMonitorMap_[seqid];
-  }
+  // Returns once the read token comes back, either with a message for
+  // this call or because the reading thread left.
+  if(!acquireReader_(slotFor_(seqid)))
+    throwDeadConnection_();
+}
+
+bool TConcurrentClientSyncInfo::acquireReader_(Slot& slot)
+{
   while(true)
   {
-    // be very careful about setting state in this loop that affects waking up.  You may exit
-    // this function, attempt to grab some work, and someone else could have beaten you (or not
-    // left) the read mutex, and that will put you right back in this loop, with the mangled
-    // state you left behind.
+    if(slot.state & TOKEN)
+      return true;
     if(stop_)
-      throwDeadConnection_();
-    if(wakeupSomeone_)
-      return;
-    if(recvPending_ && seqidPending_ == seqid)
+      return false;
+
+    bool expected = false;
+    if(readerBusy_.compare_exchange_strong(expected, true))
+    {
+      reader_ = &slot;
+      slot.state.fetch_or(TOKEN);
+      return true;
+    }
+
+    // Announce ourselves before looking at readerBusy_; releaseReader_()
+    // clears readerBusy_ before looking for waiters, so one of us sees
+    // the other.
+    slot.state.fetch_and(~NOTIFIED);
+    slot.state.fetch_or(WAITING);
+    ++waiters_;
+    expected = false;
+    bool acquired = readerBusy_.compare_exchange_strong(expected, true);
+    if(acquired)
+    {
+      reader_ = &slot;
+      slot.state.fetch_or(TOKEN);
+    }
+    else
+    {
+      park_(slot);
+    }
+    slot.state.fetch_and(~WAITING);
+    --waiters_;
+  }
+}
+
+void TConcurrentClientSyncInfo::releaseReader_(Slot& slot)
+{
+  slot.state.fetch_and(~TOKEN);
+  reader_ = nullptr;
+  readerBusy_ = false;
+  wakeupAnyone_();
+}
+
+void TConcurrentClientSyncInfo::park_(Slot& slot)
+{
+  for(int i = 0; i < spinCount_; ++i)
+  {
+    if((slot.state & (TOKEN | NOTIFIED)) || stop_)
       return;
-    m->waitForever();
+  }
+
+  Synchronized s(slot.monitor);
+  slot.state.fetch_or(PARKED);
+  while(!(slot.state & (TOKEN | NOTIFIED)) && !stop_)
+    slot.monitor.waitForever();
+  slot.state.fetch_and(~PARKED);
+}
+
+void TConcurrentClientSyncInfo::wake_(Slot& slot, uint32_t flag)
+{
+  // only a blocked thread needs the monitor, a spinning one sees the flag
+  if(slot.state.fetch_or(flag) & PARKED)
+  {
+    Synchronized s(slot.monitor);
+    slot.monitor.notify();
   }
 }
 
@@ -121,75 +260,71 @@ void TConcurrentClientSyncInfo::throwDeadConnection_()
     "this client died on another thread, and is now in an unusable state");
 }
 
-void TConcurrentClientSyncInfo::wakeupAnyone_(const Guard &)
+void TConcurrentClientSyncInfo::wakeupAnyone_()
 {
-  wakeupSomeone_ = true;
-  if(!seqidToMonitorMap_.empty())
+  if(waiters_ == 0)
+    return;
+  // We are trying to guess which thread will have its message complete next, so we are picking
+  // the most recent. The oldest message is likely to be some polling, long lived message.
+  // If we guess right, the thread we wake up will handle the message that comes in.
+  // If we guess wrong, the thread we wake up will hand off the work to the correct thread,
+  // costing us an extra context switch.
+  uint32_t newest = nextseqid_ - 1;
+  for(uint32_t i = 0; i <= slotMask_; ++i)
   {
-    // The monitor map maps integers to monitors.  Larger integers are more recent
-    // messages.  Since this is ordered, it means that the last element is the most recent.
-    // We are trying to guess which thread will have its message complete next, so we are picking
-    // the most recent. The oldest message is likely to be some polling, long lived message.
-    // If we guess right, the thread we wake up will handle the message that comes in.
-    // If we guess wrong, the thread we wake up will hand off the work to the correct thread,
-    // costing us an extra context switch.
-    seqidToMonitorMap_.rbegin()->second->notify();
+    Slot& slot = slots_[(newest - i) & slotMask_];
+    if(slot.state & WAITING)
+    {
+      wake_(slot, NOTIFIED);
+      return;
+    }
+  }
+  if(overflowSize_ == 0)
+    return;
+  Guard overflowGuard(overflowMutex_);
+  for(auto i = overflow_.rbegin(); i != overflow_.rend(); ++i)
+  {
+    if(i->second->state & WAITING)
+    {
+      wake_(*i->second, NOTIFIED);
+      return;
+    }
   }
 }
 
-void TConcurrentClientSyncInfo::markBad_(const Guard &)
+void TConcurrentClientSyncInfo::markBad_()
 {
-  wakeupSomeone_ = true;
   stop_ = true;
-  for(auto & i : seqidToMonitorMap_)
-    i.second->notify();
-}
-
-TConcurrentClientSyncInfo::MonitorPtr
-TConcurrentClientSyncInfo::newMonitor_(const Guard &)
-{
-  if(freeMonitors_.empty())
-    return std::make_shared<Monitor>(&readMutex_);
-  MonitorPtr retval;
-  //swapping to avoid an atomic operation
-  retval.swap(freeMonitors_.back());
-  freeMonitors_.pop_back();
-  return retval;
-}
-
-void TConcurrentClientSyncInfo::deleteMonitor_(
-  const Guard &,
-  TConcurrentClientSyncInfo::MonitorPtr &m) /*noexcept*/
-{
-  if(freeMonitors_.size() > MONITOR_CACHE_SIZE)
-  {
-    m.reset();
-    return;
-  }
-  //freeMonitors_ was reserved up to MONITOR_CACHE_SIZE in the ctor,
-  //so this shouldn't throw
-  freeMonitors_.push_back(TConcurrentClientSyncInfo::MonitorPtr());
-  //swapping to avoid an atomic operation
-  m.swap(freeMonitors_.back());
+  for(uint32_t i = 0; i <= slotMask_; ++i)
+    if(slots_[i].inUse)
+      wake_(slots_[i], NOTIFIED);
+  Guard overflowGuard(overflowMutex_);
+  for(auto & i : overflow_)
+    wake_(*i.second, NOTIFIED);
 }
 
 int32_t TConcurrentClientSyncInfo::generateSeqId()
 {
-  Guard seqidGuard(seqidMutex_);
   if(stop_)
     throwDeadConnection_();
 
-  if(!seqidToMonitorMap_.empty())
-    if(nextseqid_ == seqidToMonitorMap_.begin()->first)
-      throw apache::thrift::TApplicationException(
-        TApplicationException::BAD_SEQUENCE_ID,
-        "about to repeat a seqid");
-  int32_t newSeqId = nextseqid_;
-  if (nextseqid_ == (std::numeric_limits<int32_t>::max)())
-    nextseqid_ = (std::numeric_limits<int32_t>::min)();
-  else
-    ++nextseqid_;
-  seqidToMonitorMap_[newSeqId] = newMonitor_(seqidGuard);
+  auto newSeqId = static_cast<int32_t>(nextseqid_++);
+  Slot& slot = slots_[static_cast<uint32_t>(newSeqId) & slotMask_];
+  bool expected = false;
+  if(slot.inUse.compare_exchange_strong(expected, true))
+  {
+    slot.seqid = newSeqId;
+    return newSeqId;
+  }
+
+  // The table slot is still taken by an older call, which may never come
+  // to receive its response (send_X() without recv_X()).
+  SlotPtr overflow = std::make_shared<Slot>();
+  overflow->inUse = true;
+  overflow->seqid = newSeqId;
+  Guard overflowGuard(overflowMutex_);
+  overflow_[newSeqId] = overflow;
+  overflowSize_ = overflow_.size();
   return newSeqId;
 }
 
@@ -198,22 +333,18 @@ TConcurrentRecvSentry::TConcurrentRecvSentry(TConcurrentClientSyncInfo *sync, in
   seqid_(seqid),
   committed_(false)
 {
-  sync_.getReadMutex().lock();
+  // a dead client is reported by getPending()
+  sync_.acquireReader_(sync_.slotFor_(seqid_));
 }
 
 TConcurrentRecvSentry::~TConcurrentRecvSentry()
 {
-  {
-    Guard seqidGuard(sync_.seqidMutex_);
-    sync_.deleteMonitor_(seqidGuard, sync_.seqidToMonitorMap_[seqid_]);
-
-    sync_.seqidToMonitorMap_.erase(seqid_);
-    if(committed_)
-      sync_.wakeupAnyone_(seqidGuard);
-    else
-      sync_.markBad_(seqidGuard);
-  }
-  sync_.getReadMutex().unlock();
+  TConcurrentClientSyncInfo::Slot& slot = sync_.slotFor_(seqid_);
+  if(!committed_)
+    sync_.markBad_();
+  if(slot.state & TOKEN)
+    sync_.releaseReader_(slot);
+  sync_.releaseSlot_(seqid_);
 }
 
 void TConcurrentRecvSentry::commit()
@@ -231,10 +362,7 @@ TConcurrentSendSentry::TConcurrentSendSentry(TConcurrentClientSyncInfo *sync) :
 TConcurrentSendSentry::~TConcurrentSendSentry()
 {
   if(!committed_)
-  {
-    Guard seqidGuard(sync_.seqidMutex_);
-    sync_.markBad_(seqidGuard);
-  }
+    sync_.markBad_();
   sync_.getWriteMutex().unlock();
 }
 
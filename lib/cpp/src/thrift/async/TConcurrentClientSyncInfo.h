@@ -21,11 +21,10 @@
 
 #include <thrift/protocol/TProtocol.h>
 #include <thrift/concurrency/Mutex.h>
-#include <thrift/concurrency/Monitor.h>
+#include <atomic>
+#include <map>
 #include <memory>
-#include <vector>
 #include <string>
-#include <map>
 
 namespace apache {
 namespace thrift {
@@ -58,63 +57,100 @@ private:
   bool committed_;
 };
 
+/**
+ * Synchronizes the threads that share a concurrent client (and thus one
+ * connection).  Calls that wait for a response occupy a slot of a fixed
+ * size table indexed by seqid; a call whose table slot is still taken by
+ * an older call (one that was sent and never received, for instance) gets
+ * a slot allocated on the heap instead.  At any time one of them holds the
+ * read token and reads from the connection; a message for another call is
+ * handed directly to the slot of that call, together with the token, so
+ * only the thread the message belongs to is woken up.  On multiprocessor
+ * machines waiting threads spin briefly before they block, and are only
+ * signalled when blocked.
+ */
 class TConcurrentClientSyncInfo {
-private: // typedefs
-  typedef std::shared_ptr< ::apache::thrift::concurrency::Monitor> MonitorPtr;
-  typedef std::map<int32_t, MonitorPtr> MonitorMap;
-
 public:
-  TConcurrentClientSyncInfo();
+  /// Default size of the slot table
+  static const size_t DEFAULT_MAX_PENDING_CALLS = 1024;
+
+  /**
+   * @param maxPendingCalls the size of the slot table, the number of calls
+   *        that may be waiting for a response at once without allocating
+   *        (rounded up to a power of two).
+   */
+  explicit TConcurrentClientSyncInfo(size_t maxPendingCalls = DEFAULT_MAX_PENDING_CALLS);
+  ~TConcurrentClientSyncInfo();
 
   int32_t generateSeqId();
 
   bool getPending(std::string& fname,
                   ::apache::thrift::protocol::TMessageType& mtype,
-                  int32_t& rseqid); /* requires readMutex_ */
+                  int32_t& rseqid); /* requires the read token */
 
   void updatePending(const std::string& fname,
                      ::apache::thrift::protocol::TMessageType mtype,
-                     int32_t rseqid); /* requires readMutex_ */
+                     int32_t rseqid); /* requires the read token */
 
-  void waitForWork(int32_t seqid); /* requires readMutex_ */
+  void waitForWork(int32_t seqid); /* gives up the read token */
 
-  ::apache::thrift::concurrency::Mutex& getReadMutex() { return readMutex_; }
   ::apache::thrift::concurrency::Mutex& getWriteMutex() { return writeMutex_; }
 
+  /**
+   * @deprecated Receiving threads are serialized by the read token rather
+   * than by a mutex; the returned mutex no longer guards anything.
+   */
+  ::apache::thrift::concurrency::Mutex& getReadMutex() { return readMutex_; }
+
+private: // types
+  struct Slot;
+  typedef std::shared_ptr<Slot> SlotPtr;
+
 private: // constants
-  enum { MONITOR_CACHE_SIZE = 10 };
+  enum { SPIN_COUNT = 100 };
 
 private: // functions
-  MonitorPtr newMonitor_(
-      const ::apache::thrift::concurrency::Guard& seqidGuard); /* requires seqidMutex_ */
-  void deleteMonitor_(const ::apache::thrift::concurrency::Guard& seqidGuard, MonitorPtr& m);
-      /*noexcept*/ /* requires seqidMutex_ */
-  void wakeupAnyone_(
-      const ::apache::thrift::concurrency::Guard& seqidGuard);           /* requires seqidMutex_ */
-  void markBad_(const ::apache::thrift::concurrency::Guard& seqidGuard); /* requires seqidMutex_ */
+  Slot& slotFor_(int32_t seqid); /* the slot of a call of this thread */
+  Slot* tableSlot_(int32_t seqid); /* nullptr if seqid is on the heap */
+  SlotPtr overflowSlot_(int32_t seqid);
+  void releaseSlot_(int32_t seqid);
+  bool acquireReader_(Slot& slot); /* returns false once the client is dead */
+  void releaseReader_(Slot& slot); /* requires the read token */
+  void park_(Slot& slot);
+  void wake_(Slot& slot, uint32_t flag);
+  void wakeupAnyone_();
+  void markBad_();
   void throwBadSeqId_();
   void throwDeadConnection_();
 
+  TConcurrentClientSyncInfo(const TConcurrentClientSyncInfo&) = delete;
+  TConcurrentClientSyncInfo& operator=(const TConcurrentClientSyncInfo&) = delete;
+
 private: // data members
-  volatile bool stop_;
+  std::atomic<bool> stop_;
 
-  ::apache::thrift::concurrency::Mutex seqidMutex_;
-  // begin seqidMutex_ protected members
-  int32_t nextseqid_;
-  MonitorMap seqidToMonitorMap_;
-  std::vector<MonitorPtr> freeMonitors_;
-  // end seqidMutex_ protected members
+  std::atomic<uint32_t> nextseqid_;
+  std::unique_ptr<Slot[]> slots_;
+  uint32_t slotMask_;
+  int spinCount_;
 
-  ::apache::thrift::concurrency::Mutex writeMutex_;
+  ::apache::thrift::concurrency::Mutex overflowMutex_;
+  std::map<int32_t, SlotPtr> overflow_; /* guarded by overflowMutex_ */
+  std::atomic<size_t> overflowSize_;
 
-  ::apache::thrift::concurrency::Mutex readMutex_;
-  // begin readMutex_ protected members
+  std::atomic<bool> readerBusy_;
+  std::atomic<uint32_t> waiters_;
+
+  // begin read token protected members
+  Slot* reader_;
   bool recvPending_;
-  bool wakeupSomeone_;
   int32_t seqidPending_;
   std::string fnamePending_;
   ::apache::thrift::protocol::TMessageType mtypePending_;
-  // end readMutex_ protected members
+  // end read token protected members
+
+  ::apache::thrift::concurrency::Mutex writeMutex_;
+  ::apache::thrift::concurrency::Mutex readMutex_;
 
   friend class TConcurrentSendSentry;
   friend class TConcurrentRecvSentry;
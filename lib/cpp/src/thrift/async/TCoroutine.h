@@ -0,0 +1,367 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_ASYNC_TCOROUTINE_H_
+#define _THRIFT_ASYNC_TCOROUTINE_H_ 1
+
+/*
+ * C++20 coroutine support for code generated with the cpp:coroutines option.
+ * Everything else in the library builds as C++11; only translation units
+ * that include this header need a C++20 compiler.
+ */
+
+#if !defined(__cpp_impl_coroutine) || !__has_include(<coroutine>)
+#error "thrift/async/TCoroutine.h requires a compiler with C++20 coroutine support"
+#endif
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <utility>
+
+#include <thrift/Thrift.h>
+#include <thrift/async/TAsyncChannel.h>
+
+namespace apache {
+namespace thrift {
+namespace async {
+
+template <typename T = void>
+class TTask;
+
+namespace detail {
+
+/**
+ * State shared by all task promises.  A task starts running as soon as it is
+ * created; state_ records whether it finished, was abandoned by its owner,
+ * or which coroutine is waiting for it.
+ */
+class TTaskPromiseBase {
+public:
+  std::suspend_never initial_suspend() noexcept { return {}; }
+
+  struct FinalAwaiter {
+    bool await_ready() const noexcept { return false; }
+
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> self) noexcept {
+      void* waiter = self.promise().state_.exchange(done(), std::memory_order_acq_rel);
+      if (waiter == detached()) {
+        self.destroy();
+      } else if (waiter != nullptr) {
+        return std::coroutine_handle<>::from_address(waiter);
+      }
+      return std::noop_coroutine();
+    }
+
+    void await_resume() const noexcept {}
+  };
+
+  FinalAwaiter final_suspend() noexcept { return {}; }
+
+  void unhandled_exception() noexcept { exception_ = std::current_exception(); }
+
+  bool finished() const { return state_.load(std::memory_order_acquire) == done(); }
+
+  /**
+   * Registers the coroutine to resume once the task finishes.  Returns false
+   * if it already has, in which case the waiter should simply carry on.
+   */
+  bool await(std::coroutine_handle<> waiter) {
+    void* expected = nullptr;
+    return state_.compare_exchange_strong(expected,
+                                          waiter.address(),
+                                          std::memory_order_acq_rel,
+                                          std::memory_order_acquire);
+  }
+
+  /**
+   * Lets a running task free itself when it finishes.  Returns false if it
+   * already has, in which case the caller must destroy it.
+   */
+  bool detach() {
+    void* expected = nullptr;
+    return state_.compare_exchange_strong(expected,
+                                          detached(),
+                                          std::memory_order_acq_rel,
+                                          std::memory_order_acquire);
+  }
+
+protected:
+  void rethrowIfFailed() const {
+    if (exception_) {
+      std::rethrow_exception(exception_);
+    }
+  }
+
+private:
+  static void* done() {
+    static char tag;
+    return &tag;
+  }
+
+  static void* detached() {
+    static char tag;
+    return &tag;
+  }
+
+  std::atomic<void*> state_{nullptr};
+  std::exception_ptr exception_;
+};
+
+template <typename T>
+class TTaskPromise : public TTaskPromiseBase {
+public:
+  TTask<T> get_return_object() noexcept;
+
+  template <typename U>
+  void return_value(U&& value) {
+    value_.emplace(std::forward<U>(value));
+  }
+
+  T result() {
+    rethrowIfFailed();
+    return std::move(*value_);
+  }
+
+private:
+  std::optional<T> value_;
+};
+
+template <>
+class TTaskPromise<void> : public TTaskPromiseBase {
+public:
+  TTask<void> get_return_object() noexcept;
+
+  void return_void() noexcept {}
+
+  void result() const { rethrowIfFailed(); }
+};
+
+/**
+ * A fire and forget coroutine, used to hand a task's outcome to callbacks.
+ */
+struct TDetachedTask {
+  struct promise_type {
+    TDetachedTask get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept {
+      try {
+        throw;
+      } catch (const std::exception& e) {
+        TOutput::instance().printf("TTask completion callback threw: %s", e.what());
+      } catch (...) {
+        TOutput::instance()("TTask completion callback threw an unknown exception");
+      }
+    }
+  };
+};
+
+/**
+ * Carries an arbitrary exception through a TDelayedException.
+ */
+class TExceptionPtrWrapper : public TDelayedException {
+public:
+  explicit TExceptionPtrWrapper(std::exception_ptr e) : e_(std::move(e)) {}
+  void throw_it() override {
+    std::exception_ptr temp(e_);
+    delete this;
+    std::rethrow_exception(temp);
+  }
+
+private:
+  std::exception_ptr e_;
+};
+}
+
+/**
+ * The result of a coroutine RPC: a client call or a handler method.
+ *
+ * A task starts running when it is created and runs up to its first
+ * suspension before the call returns, so a client call has serialized its
+ * arguments and queued its request by then.  Several calls can therefore be
+ * started back to back and awaited afterwards, which keeps them all in
+ * flight on one channel.  Awaiting a task yields its value or rethrows its
+ * exception; a task may be awaited once.  Dropping a task that has not
+ * finished lets it run to completion and discards its outcome.
+ */
+template <typename T>
+class TTask {
+public:
+  typedef detail::TTaskPromise<T> promise_type;
+
+  TTask(TTask&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+
+  TTask& operator=(TTask&& other) noexcept {
+    if (this != &other) {
+      release();
+      handle_ = std::exchange(other.handle_, nullptr);
+    }
+    return *this;
+  }
+
+  TTask(const TTask&) = delete;
+  TTask& operator=(const TTask&) = delete;
+
+  ~TTask() { release(); }
+
+  /// Whether the task has produced its value or exception
+  bool done() const { return handle_.promise().finished(); }
+
+  auto operator co_await() noexcept {
+    struct Awaiter {
+      std::coroutine_handle<promise_type> handle;
+      bool await_ready() const { return handle.promise().finished(); }
+      bool await_suspend(std::coroutine_handle<> waiter) { return handle.promise().await(waiter); }
+      T await_resume() { return handle.promise().result(); }
+    };
+    return Awaiter{handle_};
+  }
+
+private:
+  friend class detail::TTaskPromise<T>;
+
+  explicit TTask(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+  void release() {
+    if (handle_ && !handle_.promise().detach()) {
+      handle_.destroy();
+    }
+    handle_ = nullptr;
+  }
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail {
+
+template <typename T>
+TTask<T> TTaskPromise<T>::get_return_object() noexcept {
+  return TTask<T>(std::coroutine_handle<TTaskPromise<T> >::from_promise(*this));
+}
+
+inline TTask<void> TTaskPromise<void>::get_return_object() noexcept {
+  return TTask<void>(std::coroutine_handle<TTaskPromise<void> >::from_promise(*this));
+}
+}
+
+/**
+ * Awaitable form of TAsyncChannel::sendAndRecvMessage().  The awaiting
+ * coroutine resumes from the channel's completion callback.
+ */
+class TChannelSendAndRecv {
+public:
+  TChannelSendAndRecv(TAsyncChannel& channel, TMemoryBuffer* sendBuf, TMemoryBuffer* recvBuf)
+    : channel_(channel), sendBuf_(sendBuf), recvBuf_(recvBuf) {}
+
+  bool await_ready() const noexcept { return false; }
+
+  void await_suspend(std::coroutine_handle<> waiter) {
+    channel_.sendAndRecvMessage([waiter]() { waiter.resume(); }, sendBuf_, recvBuf_);
+  }
+
+  void await_resume() const noexcept {}
+
+private:
+  TAsyncChannel& channel_;
+  TMemoryBuffer* sendBuf_;
+  TMemoryBuffer* recvBuf_;
+};
+
+/**
+ * Awaitable form of TAsyncChannel::sendMessage(), for oneway calls.
+ */
+class TChannelSend {
+public:
+  TChannelSend(TAsyncChannel& channel, TMemoryBuffer* message)
+    : channel_(channel), message_(message) {}
+
+  bool await_ready() const noexcept { return false; }
+
+  void await_suspend(std::coroutine_handle<> waiter) {
+    channel_.sendMessage([waiter]() { waiter.resume(); }, message_);
+  }
+
+  void await_resume() const noexcept {}
+
+private:
+  TAsyncChannel& channel_;
+  TMemoryBuffer* message_;
+};
+
+/**
+ * Hands the outcome of a handler task to the callbacks of a CobSv method:
+ * the value to cob, any exception to exn_cob.
+ */
+template <typename T>
+detail::TDetachedTask completeTask(TTask<T> task,
+                                   std::function<void(const T&)> cob,
+                                   std::function<void(TDelayedException*)> exnCob) {
+  std::optional<T> result;
+  std::exception_ptr error;
+  try {
+    result.emplace(co_await task);
+  } catch (...) {
+    error = std::current_exception();
+  }
+  if (error) {
+    exnCob(new detail::TExceptionPtrWrapper(error));
+  } else {
+    cob(*result);
+  }
+}
+
+inline detail::TDetachedTask completeTask(TTask<void> task,
+                                          std::function<void()> cob,
+                                          std::function<void(TDelayedException*)> exnCob) {
+  std::exception_ptr error;
+  try {
+    co_await task;
+  } catch (...) {
+    error = std::current_exception();
+  }
+  if (error) {
+    exnCob(new detail::TExceptionPtrWrapper(error));
+  } else {
+    cob();
+  }
+}
+
+/**
+ * Oneway flavour: there is nobody to report a failure to, so it is logged.
+ */
+inline detail::TDetachedTask completeTask(TTask<void> task, std::function<void()> cob) {
+  try {
+    co_await task;
+  } catch (const std::exception& e) {
+    TOutput::instance().printf("oneway handler threw: %s", e.what());
+  } catch (...) {
+    TOutput::instance()("oneway handler threw an unknown exception");
+  }
+  cob();
+}
+}
+}
+} // apache::thrift::async
+
+#endif // #ifndef _THRIFT_ASYNC_TCOROUTINE_H_
@@ -0,0 +1,341 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <thrift/async/TFramedClientChannel.h>
+
+#include <cstring>
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+
+#include <thrift/TConfiguration.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/protocol/TProtocolTypes.h>
+#include <thrift/transport/PlatformSocket.h>
+#include <thrift/transport/TBufferTransports.h>
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+using apache::thrift::protocol::TMessageType;
+using apache::thrift::protocol::TProtocolException;
+using apache::thrift::protocol::TProtocolFactory;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TTransportException;
+
+namespace apache {
+namespace thrift {
+namespace async {
+
+namespace {
+
+// THeaderTransport frame layout after the length: magic (2 bytes), flags
+// (2), seqid (4), header size in words (2), then the header itself
+const uint16_t HEADER_MAGIC = 0x0FFF;
+const uint32_t HEADER_FIXED_SIZE = 10;
+
+// Our own headers hold the protocol id and a transform count of zero, both
+// one byte varints, padded to a word as THeaderTransport does
+const uint32_t HEADER_SIZE = 4;
+
+uint32_t readVarint32(const uint8_t*& p, const uint8_t* end) {
+  uint32_t value = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (p == end) {
+      break;
+    }
+    uint8_t byte = *p++;
+    value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return value;
+    }
+  }
+  throw TTransportException(TTransportException::CORRUPTED_DATA, "Bad THeader varint");
+}
+}
+
+TFramedClientChannel::TFramedClientChannel(const std::string& host,
+                                           int port,
+                                           struct event_base* eb,
+                                           std::shared_ptr<TProtocolFactory> protocolFactory,
+                                           Framing framing,
+                                           struct evdns_base* dnsbase)
+  : protocolFactory_(protocolFactory),
+    framing_(framing),
+    eb_(eb),
+    bev_(nullptr),
+    maxFrameSize_(TConfiguration::DEFAULT_MAX_FRAME_SIZE),
+    error_(false),
+    nextSeqid_(0),
+    in_(new TMemoryBuffer()),
+    out_(new TMemoryBuffer()) {
+  iprot_ = protocolFactory_->getProtocol(in_);
+  oprot_ = protocolFactory_->getProtocol(out_);
+
+  bev_ = bufferevent_socket_new(eb, -1, BEV_OPT_CLOSE_ON_FREE);
+  if (bev_ == nullptr) {
+    throw TException("bufferevent_socket_new failed");
+  }
+  bufferevent_setcb(bev_, readCallback, nullptr, eventCallback, this);
+  if (bufferevent_enable(bev_, EV_READ | EV_WRITE) != 0
+      || bufferevent_socket_connect_hostname(bev_, dnsbase, AF_UNSPEC, host.c_str(), port) != 0) {
+    bufferevent_free(bev_);
+    throw TException("connect to " + host + " failed");
+  }
+}
+
+TFramedClientChannel::~TFramedClientChannel() {
+  bufferevent_free(bev_);
+}
+
+void TFramedClientChannel::sendAndRecvMessage(const VoidCallback& cob,
+                                              TMemoryBuffer* sendBuf,
+                                              TMemoryBuffer* recvBuf) {
+  int32_t seqid = nextSeqid();
+  Pending pending;
+  pending.cob = cob;
+  pending.recvBuf = recvBuf;
+  pending.seqid = send(sendBuf, seqid);
+  pending_[seqid] = pending;
+}
+
+void TFramedClientChannel::sendMessage(const VoidCallback& cob, TMemoryBuffer* message) {
+  send(message, nextSeqid());
+  auto* deferred = new VoidCallback(cob);
+  if (event_base_once(eb_, -1, EV_TIMEOUT, deferredCallback, deferred, nullptr) != 0) {
+    delete deferred;
+    throw TException("event_base_once failed");
+  }
+}
+
+void TFramedClientChannel::recvMessage(const VoidCallback& cob, TMemoryBuffer* message) {
+  (void)cob;
+  (void)message;
+  throw TProtocolException(TProtocolException::NOT_IMPLEMENTED,
+                           "Unexpected call to TFramedClientChannel::recvMessage");
+}
+
+int32_t TFramedClientChannel::nextSeqid() {
+  int32_t seqid = nextSeqid_;
+  nextSeqid_ = static_cast<int32_t>(static_cast<uint32_t>(nextSeqid_) + 1);
+  return seqid;
+}
+
+/**
+ * Writes message to the connection with its seqid replaced, returning the
+ * seqid it had.
+ */
+int32_t TFramedClientChannel::send(TMemoryBuffer* message, int32_t seqid) {
+  if (error_) {
+    throw TTransportException(TTransportException::NOT_OPEN, "Connection failed");
+  }
+
+  uint8_t* msg;
+  uint32_t msgLen;
+  message->getBuffer(&msg, &msgLen);
+  in_->resetBuffer(msg, msgLen);
+  std::string name;
+  TMessageType type;
+  int32_t callerSeqid;
+  iprot_->readMessageBegin(name, type, callerSeqid);
+  uint32_t bodyLen = in_->available_read();
+  const uint8_t* body = msg + (msgLen - bodyLen);
+
+  out_->resetBuffer();
+  oprot_->writeMessageBegin(name, type, seqid);
+  uint8_t* head;
+  uint32_t headLen;
+  out_->getBuffer(&head, &headLen);
+
+  uint8_t prefix[4 + HEADER_FIXED_SIZE + HEADER_SIZE];
+  uint32_t prefixLen = 4;
+  uint32_t frameLen = headLen + bodyLen;
+  if (framing_ == HEADER) {
+    uint16_t magicN = htons(HEADER_MAGIC);
+    uint16_t flagsN = 0;
+    uint32_t seqidN = htonl(static_cast<uint32_t>(seqid));
+    uint16_t headerWordsN = htons(HEADER_SIZE / 4);
+    std::memcpy(prefix + 4, &magicN, 2);
+    std::memcpy(prefix + 6, &flagsN, 2);
+    std::memcpy(prefix + 8, &seqidN, 4);
+    std::memcpy(prefix + 12, &headerWordsN, 2);
+    prefix[14] = static_cast<int8_t>(head[0]) == protocol::TCompactProtocol::PROTOCOL_ID
+                     ? protocol::T_COMPACT_PROTOCOL
+                     : protocol::T_BINARY_PROTOCOL;
+    prefix[15] = 0; // no transforms
+    prefix[16] = 0; // padding
+    prefix[17] = 0;
+    prefixLen += HEADER_FIXED_SIZE + HEADER_SIZE;
+    frameLen += HEADER_FIXED_SIZE + HEADER_SIZE;
+  }
+  uint32_t frameLenN = htonl(frameLen);
+  std::memcpy(prefix, &frameLenN, 4);
+
+  struct evbuffer* output = bufferevent_get_output(bev_);
+  if (evbuffer_add(output, prefix, prefixLen) != 0 || evbuffer_add(output, head, headLen) != 0
+      || evbuffer_add(output, body, bodyLen) != 0) {
+    throw TException("evbuffer_add failed");
+  }
+  return callerSeqid;
+}
+
+/**
+ * Puts the response in frame into the buffer of the request it answers,
+ * with the caller's seqid restored.  Returns false if no request has the
+ * response's seqid.
+ */
+bool TFramedClientChannel::receive(const uint8_t* frame, uint32_t size, Pending& done) {
+  const uint8_t* msg = frame;
+  uint32_t msgLen = size;
+  if (framing_ == HEADER) {
+    uint16_t magicN;
+    uint16_t headerWordsN;
+    if (size < HEADER_FIXED_SIZE) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA, "THeader frame too small");
+    }
+    std::memcpy(&magicN, frame, 2);
+    std::memcpy(&headerWordsN, frame + 8, 2);
+    uint32_t headerLen = ntohs(headerWordsN) * 4u;
+    if (ntohs(magicN) != HEADER_MAGIC || HEADER_FIXED_SIZE + headerLen > size) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA, "Bad THeader frame");
+    }
+    const uint8_t* p = frame + HEADER_FIXED_SIZE;
+    const uint8_t* headerEnd = p + headerLen;
+    readVarint32(p, headerEnd); // protocol id, as we sent it
+    if (readVarint32(p, headerEnd) != 0) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                "THeader transforms are not supported");
+    }
+    msg = headerEnd;
+    msgLen = size - HEADER_FIXED_SIZE - headerLen;
+  }
+
+  in_->resetBuffer(const_cast<uint8_t*>(msg), msgLen);
+  std::string name;
+  TMessageType type;
+  int32_t seqid;
+  iprot_->readMessageBegin(name, type, seqid);
+  auto it = pending_.find(seqid);
+  if (it == pending_.end()) {
+    return false;
+  }
+  done = it->second;
+  pending_.erase(it);
+
+  uint32_t bodyLen = in_->available_read();
+  out_->resetBuffer();
+  oprot_->writeMessageBegin(name, type, done.seqid);
+  uint8_t* head;
+  uint32_t headLen;
+  out_->getBuffer(&head, &headLen);
+  done.recvBuf->resetBuffer(headLen + bodyLen);
+  done.recvBuf->write(head, headLen);
+  done.recvBuf->write(msg + (msgLen - bodyLen), bodyLen);
+  return true;
+}
+
+void TFramedClientChannel::readFrames() {
+  struct evbuffer* input = bufferevent_get_input(bev_);
+  while (!error_) {
+    size_t available = evbuffer_get_length(input);
+    uint32_t sizeN;
+    if (available < sizeof(sizeN)) {
+      return;
+    }
+    evbuffer_copyout(input, &sizeN, sizeof(sizeN));
+    uint32_t size = ntohl(sizeN);
+    if (size > maxFrameSize_) {
+      fail();
+      return;
+    }
+    if (available < sizeof(sizeN) + size) {
+      return;
+    }
+
+    Pending done;
+    bool found;
+    try {
+      const uint8_t* frame = evbuffer_pullup(input, sizeof(sizeN) + size);
+      found = receive(frame + sizeof(sizeN), size, done);
+    } catch (const TException&) {
+      found = false;
+    }
+    if (!found) {
+      fail();
+      return;
+    }
+    evbuffer_drain(input, sizeof(sizeN) + size);
+    done.cob();
+  }
+}
+
+/**
+ * Fails the connection, running every outstanding callback with an empty
+ * receive buffer.
+ */
+void TFramedClientChannel::fail() {
+  if (error_) {
+    return;
+  }
+  error_ = true;
+  bufferevent_disable(bev_, EV_READ | EV_WRITE);
+
+  std::unordered_map<int32_t, Pending> failed;
+  failed.swap(pending_);
+  for (auto& it : failed) {
+    it.second.recvBuf->resetBuffer();
+    it.second.cob();
+  }
+}
+
+void TFramedClientChannel::readCallback(struct bufferevent* bev, void* arg) {
+  (void)bev;
+  static_cast<TFramedClientChannel*>(arg)->readFrames();
+}
+
+void TFramedClientChannel::eventCallback(struct bufferevent* bev, short what, void* arg) {
+  auto* self = static_cast<TFramedClientChannel*>(arg);
+  if (what & BEV_EVENT_CONNECTED) {
+    int v = 1;
+    setsockopt(bufferevent_getfd(bev),
+               IPPROTO_TCP,
+               TCP_NODELAY,
+               reinterpret_cast<const char*>(&v),
+               sizeof(v));
+    return;
+  }
+  if (what & (BEV_EVENT_EOF | BEV_EVENT_ERROR)) {
+    self->fail();
+  }
+}
+
+void TFramedClientChannel::deferredCallback(evutil_socket_t fd, short what, void* arg) {
+  (void)fd;
+  (void)what;
+  std::unique_ptr<VoidCallback> cob(static_cast<VoidCallback*>(arg));
+  (*cob)();
+}
+}
+}
+} // apache::thrift::async
@@ -0,0 +1,156 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_ASYNC_TFRAMEDCLIENTCHANNEL_H_
+#define _THRIFT_ASYNC_TFRAMEDCLIENTCHANNEL_H_ 1
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <event2/util.h>
+#include <thrift/async/TAsyncChannel.h>
+#include <thrift/protocol/TProtocol.h>
+
+struct event_base;
+struct evdns_base;
+struct bufferevent;
+
+namespace apache {
+namespace thrift {
+namespace transport {
+class TMemoryBuffer;
+}
+}
+}
+
+namespace apache {
+namespace thrift {
+namespace async {
+
+/**
+ * A TAsyncChannel over a plain TCP connection, for talking to servers such
+ * as TNonblockingServer without HTTP in between.  Messages go out in
+ * TFramedTransport frames, or in THeaderTransport frames (with no
+ * transforms or info headers), which lets a server that allows it answer
+ * out of order.
+ *
+ * Any number of requests may be outstanding.  Every request is sent with a
+ * sequence id of the channel's choosing, so responses are matched however
+ * they are ordered and callers need not pick distinct ids themselves (the
+ * generated cob clients always send 0).  The caller's id is put back into
+ * the response before its callback runs.  Rewriting ids means parsing
+ * message headers, so the channel must be given the protocol factory its
+ * clients write messages with.
+ *
+ * The channel runs on a libevent event_base and must only be used from the
+ * thread running it.  It must not be destroyed from within one of its
+ * callbacks; callbacks still pending when it is destroyed are never run.
+ */
+class TFramedClientChannel : public TAsyncChannel {
+public:
+  using TAsyncChannel::VoidCallback;
+
+  enum Framing {
+    FRAMED, ///< 4 byte length prefix, as TFramedTransport
+    HEADER  ///< THeaderTransport frames
+  };
+
+  /**
+   * Starts connecting to host:port; requests may be sent right away and are
+   * written once the connection is up.
+   *
+   * @throws TException if the connection attempt cannot be started
+   */
+  TFramedClientChannel(const std::string& host,
+                       int port,
+                       struct event_base* eb,
+                       std::shared_ptr<apache::thrift::protocol::TProtocolFactory> protocolFactory,
+                       Framing framing = FRAMED,
+                       struct evdns_base* dnsbase = nullptr);
+  ~TFramedClientChannel() override;
+
+  void sendAndRecvMessage(const VoidCallback& cob,
+                          apache::thrift::transport::TMemoryBuffer* sendBuf,
+                          apache::thrift::transport::TMemoryBuffer* recvBuf) override;
+
+  /**
+   * Sends a oneway message.  cob runs from the event loop once the message
+   * is queued on the connection.
+   */
+  void sendMessage(const VoidCallback& cob,
+                   apache::thrift::transport::TMemoryBuffer* message) override;
+
+  /// Not supported: responses are only delivered to sendAndRecvMessage()
+  void recvMessage(const VoidCallback& cob,
+                   apache::thrift::transport::TMemoryBuffer* message) override;
+
+  /**
+   * Once the connection fails every outstanding callback runs with an
+   * empty receive buffer, and further requests throw.
+   */
+  bool good() const override { return !error_; }
+  bool error() const override { return error_; }
+  bool timedOut() const override { return false; }
+
+  /// Number of requests still waiting for a response
+  size_t getPendingCount() const { return pending_.size(); }
+
+  /// Largest response frame accepted; a bigger one fails the connection
+  void setMaxFrameSize(uint32_t maxFrameSize) { maxFrameSize_ = maxFrameSize; }
+  uint32_t getMaxFrameSize() const { return maxFrameSize_; }
+
+private:
+  struct Pending {
+    VoidCallback cob;
+    apache::thrift::transport::TMemoryBuffer* recvBuf;
+    int32_t seqid;
+  };
+
+  int32_t nextSeqid();
+  int32_t send(apache::thrift::transport::TMemoryBuffer* message, int32_t seqid);
+  bool receive(const uint8_t* frame, uint32_t size, Pending& done);
+  void readFrames();
+  void fail();
+
+  static void readCallback(struct bufferevent* bev, void* arg);
+  static void eventCallback(struct bufferevent* bev, short what, void* arg);
+  static void deferredCallback(evutil_socket_t fd, short what, void* arg);
+
+  std::shared_ptr<apache::thrift::protocol::TProtocolFactory> protocolFactory_;
+  Framing framing_;
+  struct event_base* eb_;
+  struct bufferevent* bev_;
+  uint32_t maxFrameSize_;
+  bool error_;
+  int32_t nextSeqid_;
+  std::unordered_map<int32_t, Pending> pending_;
+
+  // views of the messages being restamped, and scratch space for their new
+  // message headers
+  std::shared_ptr<apache::thrift::transport::TMemoryBuffer> in_;
+  std::shared_ptr<apache::thrift::protocol::TProtocol> iprot_;
+  std::shared_ptr<apache::thrift::transport::TMemoryBuffer> out_;
+  std::shared_ptr<apache::thrift::protocol::TProtocol> oprot_;
+};
+}
+}
+} // apache::thrift::async
+
+#endif // #ifndef _THRIFT_ASYNC_TFRAMEDCLIENTCHANNEL_H_
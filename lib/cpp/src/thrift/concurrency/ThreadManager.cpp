@@ -23,7 +23,11 @@
 #include <thrift/concurrency/Exception.h>
 #include <thrift/concurrency/Monitor.h>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <thread>
+#include <vector>
 
 #include <stdexcept>
 #include <deque>
@@ -572,6 +576,576 @@ private:
   const size_t pendingTaskCountMax_;
 };
 
+/**
+ * ThreadManager with a task deque per worker, see
+ * ThreadManager::newWorkStealingThreadManager().
+ *
+ * Adding and taking tasks only locks the deque involved.  The pending task
+ * count is kept in an atomic so pendingTaskCountMax can be enforced without
+ * a global lock; mutex_ is only used to add and remove workers.
+ *
+ * Deques are never destroyed before the manager is: a worker that exits
+ * returns its deque to freeQueues_ for the next worker, and the others keep
+ * stealing whatever was left in it.
+ */
+class WorkStealingThreadManager : public ThreadManager {
+
+public:
+  WorkStealingThreadManager(size_t workerCount, size_t pendingTaskCountMax)
+    : initialWorkerCount_(workerCount),
+      pendingTaskCountMax_(pendingTaskCountMax),
+      workerCount_(0),
+      workerMaxCount_(0),
+      idleCount_(0),
+      sleeperCount_(0),
+      maxWaiterCount_(0),
+      pendingCount_(0),
+      expiredCount_(0),
+      nextQueue_(0),
+      queues_(nullptr),
+      queueCount_(0),
+      queueCapacity_(0),
+      state_(ThreadManager::UNINITIALIZED),
+      workerMonitor_(&mutex_),
+      sleepMonitor_(&sleepMutex_),
+      maxMonitor_(&maxMutex_) {}
+
+  ~WorkStealingThreadManager() override { stop(); }
+
+  void start() override;
+  void stop() override;
+
+  ThreadManager::STATE state() const override { return state_; }
+
+  shared_ptr<ThreadFactory> threadFactory() const override {
+    Guard g(mutex_);
+    return threadFactory_;
+  }
+
+  void threadFactory(shared_ptr<ThreadFactory> value) override {
+    Guard g(mutex_);
+    if (threadFactory_ && threadFactory_->isDetached() != value->isDetached()) {
+      throw InvalidArgumentException();
+    }
+    threadFactory_ = value;
+  }
+
+  void addWorker(size_t value) override;
+
+  void removeWorker(size_t value) override {
+    Guard g(mutex_);
+    removeWorkersUnderLock(value);
+  }
+
+  size_t idleWorkerCount() const override { return idleCount_; }
+
+  size_t workerCount() const override { return workerCount_; }
+
+  size_t pendingTaskCount() const override { return pendingCount_; }
+
+  size_t totalTaskCount() const override {
+    size_t pending = pendingCount_;
+    size_t workers = workerCount_;
+    size_t idle = idleCount_;
+    return pending + (workers > idle ? workers - idle : 0);
+  }
+
+  size_t pendingTaskCountMax() const override { return pendingTaskCountMax_; }
+
+  size_t expiredTaskCount() const override { return expiredCount_; }
+
+  void add(shared_ptr<Runnable> value, int64_t timeout, int64_t expiration) override;
+
+  void remove(shared_ptr<Runnable> task) override;
+
+  shared_ptr<Runnable> removeNextPending() override;
+
+  void removeExpiredTasks() override { removeExpired(false); }
+
+  void setExpireCallback(ExpireCallback expireCallback) override {
+    Guard g(mutex_);
+    expireCallback_ = expireCallback;
+  }
+
+private:
+  class Worker;
+  friend class Worker;
+
+  /// # of times an idle worker looks for work to steal before sleeping
+  static const int STEAL_ATTEMPTS = 8;
+
+  struct Task {
+    Task() : hasExpireTime(false) {}
+    Task(shared_ptr<Runnable> r, int64_t expiration)
+      : runnable(std::move(r)), hasExpireTime(expiration != 0) {
+      if (hasExpireTime) {
+        expireTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(expiration);
+      }
+    }
+
+    bool isExpired(const std::chrono::steady_clock::time_point& now) const {
+      return hasExpireTime && expireTime < now;
+    }
+
+    shared_ptr<Runnable> runnable;
+    bool hasExpireTime;
+    std::chrono::steady_clock::time_point expireTime;
+  };
+
+  struct TaskQueue {
+    TaskQueue() : size(0) {}
+
+    Mutex mutex;
+    std::deque<Task> tasks;
+    std::atomic<size_t> size; // readable without the lock to skip empty deques
+  };
+
+  /// Takes the oldest task from queue, returns false if it was empty.
+  static bool pop(TaskQueue* queue, Task& task);
+
+  /// Takes a task from deque self, or steals one from another deque.
+  bool take(size_t self, Task& task);
+
+  /// Accounts for a task having left the deques.
+  void released(size_t count);
+
+  /// Reserves room for one pending task, honouring pendingTaskCountMax.
+  bool reserve();
+
+  /// Returns a deque for a new worker.  The caller must hold mutex_.
+  size_t acquireQueueUnderLock();
+
+  void removeExpired(bool justOne);
+
+  void expire(const shared_ptr<Runnable>& runnable);
+
+  /// \\returns whether it is acceptable to block, depending on the current thread
+  bool canSleep() const;
+
+  void removeWorkersUnderLock(size_t value);
+
+  const size_t initialWorkerCount_;
+  const size_t pendingTaskCountMax_;
+
+  std::atomic<size_t> workerCount_;     // modified under mutex_
+  std::atomic<size_t> workerMaxCount_;  // modified under mutex_
+  std::atomic<size_t> idleCount_;
+  std::atomic<size_t> sleeperCount_;
+  std::atomic<size_t> maxWaiterCount_;
+  std::atomic<size_t> pendingCount_;
+  std::atomic<size_t> expiredCount_;
+  std::atomic<size_t> nextQueue_;
+
+  // queues_[0..queueCount_) may be read without a lock; the arrays are only
+  // ever replaced by larger copies, which are kept alive in queueArrays_.
+  std::atomic<TaskQueue**> queues_;
+  std::atomic<size_t> queueCount_;
+  size_t queueCapacity_;
+  std::vector<unique_ptr<TaskQueue*[]> > queueArrays_;
+  std::vector<unique_ptr<TaskQueue> > queueStorage_;
+  std::vector<size_t> freeQueues_;
+
+  std::atomic<ThreadManager::STATE> state_;
+  shared_ptr<ThreadFactory> threadFactory_;
+  ExpireCallback expireCallback_;
+
+  Mutex mutex_;
+  Monitor workerMonitor_; // used to synchronize changes in worker count
+  Mutex sleepMutex_;
+  Monitor sleepMonitor_;  // idle workers wait here for tasks
+  Mutex maxMutex_;
+  Monitor maxMonitor_;    // add() waits here while pendingTaskCountMax is reached
+
+  std::set<shared_ptr<Thread> > workers_;
+  std::set<shared_ptr<Thread> > deadWorkers_;
+
+  // the manager and deque of the worker running on the current thread
+  static thread_local WorkStealingThreadManager* currentManager_;
+  static thread_local size_t currentQueue_;
+};
+
+thread_local WorkStealingThreadManager* WorkStealingThreadManager::currentManager_ = nullptr;
+thread_local size_t WorkStealingThreadManager::currentQueue_ = 0;
+
+class WorkStealingThreadManager::Worker : public Runnable {
+public:
+  Worker(WorkStealingThreadManager* manager) : manager_(manager) {}
+
+  ~Worker() override = default;
+
+  void run() override {
+    size_t self;
+    {
+      Guard g(manager_->mutex_);
+      if (manager_->workerCount_ >= manager_->workerMaxCount_) {
+        manager_->deadWorkers_.insert(this->thread());
+        return;
+      }
+      self = manager_->acquireQueueUnderLock();
+      ++manager_->idleCount_;
+      if (++manager_->workerCount_ == manager_->workerMaxCount_) {
+        manager_->workerMonitor_.notify();
+      }
+    }
+
+    currentManager_ = manager_;
+    currentQueue_ = self;
+
+    Task task;
+    while (true) {
+      if (!isActive()) {
+        // re-check under the lock so that only as many workers as needed exit
+        Guard g(manager_->mutex_);
+        if (!isActive()) {
+          manager_->freeQueues_.push_back(self);
+          manager_->deadWorkers_.insert(this->thread());
+          --manager_->idleCount_;
+          if (--manager_->workerCount_ == manager_->workerMaxCount_) {
+            manager_->workerMonitor_.notify();
+          }
+          break;
+        }
+      }
+
+      bool found = false;
+      for (int i = 0; i < STEAL_ATTEMPTS && !found; ++i) {
+        found = manager_->take(self, task);
+        if (!found && i + 1 < STEAL_ATTEMPTS) {
+          std::this_thread::yield();
+        }
+      }
+
+      if (!found) {
+        Guard g(manager_->sleepMutex_);
+        ++manager_->sleeperCount_;
+        while (manager_->pendingCount_ == 0
+               && manager_->workerCount_ <= manager_->workerMaxCount_) {
+          manager_->sleepMonitor_.wait();
+        }
+        --manager_->sleeperCount_;
+        continue;
+      }
+
+      if (!task.isExpired(std::chrono::steady_clock::now())) {
+        try {
+          task.runnable->run();
+        } catch (const std::exception& e) {
+          TOutput::instance().printf("[ERROR] task->run() raised an exception: %s", e.what());
+        } catch (...) {
+          TOutput::instance().printf("[ERROR] task->run() raised an unknown exception");
+        }
+      } else {
+        manager_->expire(task.runnable);
+      }
+      task.runnable.reset();
+      ++manager_->idleCount_;
+    }
+
+    currentManager_ = nullptr;
+  }
+
+private:
+  bool isActive() const {
+    return (manager_->workerCount_ <= manager_->workerMaxCount_)
+           || (manager_->state_ == JOINING && manager_->pendingCount_ > 0);
+  }
+
+  WorkStealingThreadManager* manager_;
+};
+
+bool WorkStealingThreadManager::pop(TaskQueue* queue, Task& task) {
+  if (queue->size.load(std::memory_order_relaxed) == 0) {
+    return false;
+  }
+  Guard g(queue->mutex);
+  if (queue->tasks.empty()) {
+    return false;
+  }
+  task = std::move(queue->tasks.front());
+  queue->tasks.pop_front();
+  queue->size.store(queue->tasks.size(), std::memory_order_relaxed);
+  return true;
+}
+
+bool WorkStealingThreadManager::take(size_t self, Task& task) {
+  size_t count = queueCount_.load(std::memory_order_acquire);
+  TaskQueue** queues = queues_.load(std::memory_order_acquire);
+  for (size_t i = 0; i < count; ++i) {
+    if (pop(queues[(self + i) % count], task)) {
+      // no longer idle before no longer pending, see totalTaskCount()
+      --idleCount_;
+      released(1);
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingThreadManager::released(size_t count) {
+  pendingCount_ -= count;
+  if (pendingTaskCountMax_ != 0 && maxWaiterCount_ > 0) {
+    Guard g(maxMutex_);
+    maxMonitor_.notifyAll();
+  }
+}
+
+bool WorkStealingThreadManager::reserve() {
+  if (pendingTaskCountMax_ == 0) {
+    ++pendingCount_;
+    return true;
+  }
+  size_t pending = pendingCount_;
+  while (pending < pendingTaskCountMax_) {
+    if (pendingCount_.compare_exchange_weak(pending, pending + 1)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t WorkStealingThreadManager::acquireQueueUnderLock() {
+  if (!freeQueues_.empty()) {
+    size_t index = freeQueues_.back();
+    freeQueues_.pop_back();
+    return index;
+  }
+
+  size_t count = queueCount_;
+  if (count == queueCapacity_) {
+    size_t capacity = (std::max)(queueCapacity_ * 2, static_cast<size_t>(8));
+    unique_ptr<TaskQueue*[]> queues(new TaskQueue*[capacity]);
+    std::copy(queues_.load(), queues_.load() + count, queues.get());
+    queues_.store(queues.get(), std::memory_order_release);
+    queueArrays_.push_back(std::move(queues));
+    queueCapacity_ = capacity;
+  }
+  queueStorage_.emplace_back(new TaskQueue());
+  queues_.load()[count] = queueStorage_.back().get();
+  queueCount_.store(count + 1, std::memory_order_release);
+  return count;
+}
+
+void WorkStealingThreadManager::addWorker(size_t value) {
+  std::set<shared_ptr<Thread> > newThreads;
+  for (size_t ix = 0; ix < value; ix++) {
+    newThreads.insert(threadFactory_->newThread(std::make_shared<Worker>(this)));
+  }
+
+  Guard g(mutex_);
+  workerMaxCount_ += value;
+  workers_.insert(newThreads.begin(), newThreads.end());
+
+  for (const auto& newThread : newThreads) {
+    newThread->start();
+  }
+
+  while (workerCount_ != workerMaxCount_) {
+    workerMonitor_.wait();
+  }
+}
+
+void WorkStealingThreadManager::start() {
+  {
+    Guard g(mutex_);
+    if (state_ != ThreadManager::UNINITIALIZED) {
+      return;
+    }
+    if (!threadFactory_) {
+      throw InvalidArgumentException();
+    }
+    // tasks added before any worker exists need somewhere to wait
+    freeQueues_.push_back(acquireQueueUnderLock());
+    state_ = ThreadManager::STARTED;
+  }
+  addWorker(initialWorkerCount_);
+}
+
+void WorkStealingThreadManager::stop() {
+  Guard g(mutex_);
+  bool doStop = false;
+
+  if (state_ != ThreadManager::STOPPING && state_ != ThreadManager::JOINING
+      && state_ != ThreadManager::STOPPED) {
+    doStop = true;
+    state_ = ThreadManager::JOINING;
+  }
+
+  if (doStop) {
+    removeWorkersUnderLock(workerCount_);
+  }
+
+  state_ = ThreadManager::STOPPED;
+}
+
+void WorkStealingThreadManager::removeWorkersUnderLock(size_t value) {
+  if (value > workerMaxCount_) {
+    throw InvalidArgumentException();
+  }
+
+  workerMaxCount_ -= value;
+
+  {
+    Guard s(sleepMutex_);
+    sleepMonitor_.notifyAll();
+  }
+
+  while (workerCount_ != workerMaxCount_) {
+    workerMonitor_.wait();
+  }
+
+  for (const auto& deadWorker : deadWorkers_) {
+    // when used with a joinable thread factory, we join the threads as we remove them
+    if (!threadFactory_->isDetached()) {
+      deadWorker->join();
+    }
+    workers_.erase(deadWorker);
+  }
+
+  deadWorkers_.clear();
+}
+
+bool WorkStealingThreadManager::canSleep() const {
+  return currentManager_ != this;
+}
+
+void WorkStealingThreadManager::add(shared_ptr<Runnable> value,
+                                    int64_t timeout,
+                                    int64_t expiration) {
+  if (state_ != ThreadManager::STARTED) {
+    throw IllegalStateException(
+        "WorkStealingThreadManager::add ThreadManager "
+        "not started");
+  }
+
+  if (!reserve()) {
+    // if we're at a limit, remove an expired task to see if the limit clears
+    removeExpired(true);
+
+    if (!reserve()) {
+      if (!canSleep() || timeout < 0) {
+        throw TooManyPendingTasksException();
+      }
+      Guard g(maxMutex_);
+      ++maxWaiterCount_;
+      try {
+        while (!reserve()) {
+          maxMonitor_.wait(timeout);
+        }
+      } catch (...) {
+        --maxWaiterCount_;
+        throw;
+      }
+      --maxWaiterCount_;
+    }
+  }
+
+  size_t count = queueCount_.load(std::memory_order_acquire);
+  TaskQueue** queues = queues_.load(std::memory_order_acquire);
+  TaskQueue* queue = (currentManager_ == this)
+                         ? queues[currentQueue_]
+                         : queues[nextQueue_.fetch_add(1, std::memory_order_relaxed) % count];
+  {
+    Guard g(queue->mutex);
+    queue->tasks.emplace_back(std::move(value), expiration);
+    queue->size.store(queue->tasks.size(), std::memory_order_relaxed);
+  }
+
+  // If idle thread is available notify it, otherwise all worker threads are
+  // running and will get around to this task in time.
+  if (sleeperCount_ > 0) {
+    Guard g(sleepMutex_);
+    sleepMonitor_.notify();
+  }
+}
+
+void WorkStealingThreadManager::remove(shared_ptr<Runnable> task) {
+  if (state_ != ThreadManager::STARTED) {
+    throw IllegalStateException(
+        "WorkStealingThreadManager::remove ThreadManager not "
+        "started");
+  }
+
+  size_t count = queueCount_.load(std::memory_order_acquire);
+  TaskQueue** queues = queues_.load(std::memory_order_acquire);
+  for (size_t i = 0; i < count; ++i) {
+    TaskQueue* queue = queues[i];
+    Guard g(queue->mutex);
+    for (auto it = queue->tasks.begin(); it != queue->tasks.end(); ++it) {
+      if (it->runnable == task) {
+        queue->tasks.erase(it);
+        queue->size.store(queue->tasks.size(), std::memory_order_relaxed);
+        released(1);
+        return;
+      }
+    }
+  }
+}
+
+shared_ptr<Runnable> WorkStealingThreadManager::removeNextPending() {
+  if (state_ != ThreadManager::STARTED) {
+    throw IllegalStateException(
+        "WorkStealingThreadManager::removeNextPending "
+        "ThreadManager not started");
+  }
+
+  size_t count = queueCount_.load(std::memory_order_acquire);
+  TaskQueue** queues = queues_.load(std::memory_order_acquire);
+  Task task;
+  for (size_t i = 0; i < count; ++i) {
+    if (pop(queues[i], task)) {
+      released(1);
+      return task.runnable;
+    }
+  }
+  return shared_ptr<Runnable>();
+}
+
+void WorkStealingThreadManager::removeExpired(bool justOne) {
+  auto now = std::chrono::steady_clock::now();
+  std::vector<shared_ptr<Runnable> > expired;
+
+  size_t count = queueCount_.load(std::memory_order_acquire);
+  TaskQueue** queues = queues_.load(std::memory_order_acquire);
+  for (size_t i = 0; i < count && !(justOne && !expired.empty()); ++i) {
+    TaskQueue* queue = queues[i];
+    if (queue->size.load(std::memory_order_relaxed) == 0) {
+      continue;
+    }
+    Guard g(queue->mutex);
+    for (auto it = queue->tasks.begin(); it != queue->tasks.end();) {
+      if (it->isExpired(now)) {
+        expired.push_back(std::move(it->runnable));
+        it = queue->tasks.erase(it);
+        if (justOne) {
+          break;
+        }
+      } else {
+        ++it;
+      }
+    }
+    queue->size.store(queue->tasks.size(), std::memory_order_relaxed);
+  }
+
+  if (!expired.empty()) {
+    released(expired.size());
+    for (const auto& runnable : expired) {
+      expire(runnable);
+    }
+  }
+}
+
+void WorkStealingThreadManager::expire(const shared_ptr<Runnable>& runnable) {
+  ExpireCallback expireCallback;
+  {
+    Guard g(mutex_);
+    expireCallback = expireCallback_;
+  }
+  if (expireCallback) {
+    expireCallback(runnable);
+  }
+  ++expiredCount_;
+}
+
 shared_ptr<ThreadManager> ThreadManager::newThreadManager() {
   return shared_ptr<ThreadManager>(new ThreadManager::Impl());
 }
@@ -580,6 +1154,11 @@ shared_ptr<ThreadManager> ThreadManager::newSimpleThreadManager(size_t count,
                                                                 size_t pendingTaskCountMax) {
   return shared_ptr<ThreadManager>(new SimpleThreadManager(count, pendingTaskCountMax));
 }
+
+shared_ptr<ThreadManager> ThreadManager::newWorkStealingThreadManager(size_t count,
+                                                                     size_t pendingTaskCountMax) {
+  return shared_ptr<ThreadManager>(new WorkStealingThreadManager(count, pendingTaskCountMax));
+}
 }
 }
 } // apache::thrift::concurrency
@@ -200,6 +200,21 @@ public:
   static std::shared_ptr<ThreadManager> newSimpleThreadManager(size_t count = 4,
                                                                  size_t pendingTaskCountMax = 0);
 
+  /**
+   * Creates a thread manager like newSimpleThreadManager() that keeps a task
+   * deque per worker thread instead of one shared queue.  Tasks added from a
+   * worker thread go to that worker's deque, other tasks are spread over the
+   * deques round robin, and a worker whose deque is empty steals from the
+   * others before going to sleep.  This avoids serializing every add() and
+   * dequeue on a single lock when there are many workers.
+   *
+   * Tasks run roughly, not strictly, in the order they were added.
+   * pendingTaskCountMax and task expiration behave as for
+   * newSimpleThreadManager().
+   */
+  static std::shared_ptr<ThreadManager> newWorkStealingThreadManager(size_t count = 4,
+                                                                       size_t pendingTaskCountMax = 0);
+
   class Task;
 
   class Worker;
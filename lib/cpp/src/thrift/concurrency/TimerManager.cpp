@@ -22,6 +22,7 @@
 
 #include <assert.h>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <set>
 
@@ -42,7 +43,8 @@ class TimerManager::Task : public Runnable {
 public:
   enum STATE { WAITING, EXECUTING, CANCELLED, COMPLETE };
 
-  Task(shared_ptr<Runnable> runnable) : runnable_(runnable), state_(WAITING) {}
+  Task(shared_ptr<Runnable> runnable)
+    : pprev_(nullptr), next_(nullptr), expires_(0), runnable_(runnable), state_(WAITING) {}
 
   ~Task() override = default;
 
@@ -57,9 +59,17 @@ public:
 
   task_iterator it_;
 
+  // Slot list links used by TimerWheelManager.  While a task is linked into
+  // the wheel, self_ holds the reference that the multimap holds above.
+  Task** pprev_;
+  Task* next_;
+  uint64_t expires_;
+  shared_ptr<Task> self_;
+
 private:
   shared_ptr<Runnable> runnable_;
   friend class TimerManager::Dispatcher;
+  friend class TimerWheelManager;
   STATE state_;
 };
 
@@ -316,6 +326,356 @@ void TimerManager::remove(Timer handle) {
 TimerManager::STATE TimerManager::state() const {
   return state_;
 }
+
+class TimerWheelManager::Dispatcher : public Runnable {
+
+public:
+  Dispatcher(TimerWheelManager* manager) : manager_(manager) {}
+
+  ~Dispatcher() override = default;
+
+  /**
+   * Dispatcher entry point
+   *
+   * Turns the wheel up to the current tick, runs whatever expired and sleeps
+   * until the next occupied tick or the next time a level has to cascade.
+   */
+  void run() override {
+    {
+      Synchronized s(manager_->monitor_);
+      if (manager_->state_ == TimerManager::STARTING) {
+        manager_->state_ = TimerManager::STARTED;
+        manager_->monitor_.notifyAll();
+      }
+    }
+
+    do {
+      std::vector<shared_ptr<TimerManager::Task> > expiredTasks;
+      {
+        Synchronized s(manager_->monitor_);
+        while (manager_->state_ == TimerManager::STARTED) {
+          auto now = std::chrono::steady_clock::now();
+          manager_->advance((now - manager_->epoch_) / manager_->tick_, expiredTasks);
+          if (!expiredTasks.empty()) {
+            break;
+          }
+          manager_->wakeup_ = manager_->nextWakeup();
+          if (manager_->wakeup_ == (std::numeric_limits<uint64_t>::max)()) {
+            manager_->monitor_.waitForever();
+          } else {
+            manager_->monitor_.waitForTime(manager_->timeOf(manager_->wakeup_));
+          }
+        }
+        // Not sleeping any more, so add() need not wake us up
+        manager_->wakeup_ = 0;
+      }
+
+      for (const auto& expiredTask : expiredTasks) {
+        expiredTask->run();
+      }
+
+    } while (manager_->state_ == TimerManager::STARTED);
+
+    {
+      Synchronized s(manager_->monitor_);
+      if (manager_->state_ == TimerManager::STOPPING) {
+        manager_->state_ = TimerManager::STOPPED;
+        manager_->monitor_.notifyAll();
+      }
+    }
+  }
+
+private:
+  TimerWheelManager* manager_;
+  friend class TimerWheelManager;
+};
+
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable : 4355) // 'this' used in base member initializer list
+#endif
+
+TimerWheelManager::TimerWheelManager(const std::chrono::milliseconds& tick)
+  : tick_(tick.count() > 0 ? tick : std::chrono::milliseconds(1)),
+    epoch_(std::chrono::steady_clock::now()),
+    current_(0),
+    wakeup_(0),
+    taskCount_(0),
+    state_(TimerManager::UNINITIALIZED),
+    dispatcher_(std::make_shared<Dispatcher>(this)) {
+  for (auto& level : wheel_) {
+    for (auto& slot : level) {
+      slot = nullptr;
+    }
+  }
+}
+
+#if defined(_MSC_VER)
+#pragma warning(pop)
+#endif
+
+TimerWheelManager::~TimerWheelManager() {
+  if (state_ != STOPPED) {
+    try {
+      stop();
+    } catch (...) {
+      // We're really hosed.
+    }
+  }
+}
+
+void TimerWheelManager::start() {
+  bool doStart = false;
+  shared_ptr<const ThreadFactory> factory = threadFactory();
+  {
+    Synchronized s(monitor_);
+    if (!factory) {
+      throw InvalidArgumentException();
+    }
+    if (state_ == TimerManager::UNINITIALIZED) {
+      state_ = TimerManager::STARTING;
+      doStart = true;
+    }
+  }
+
+  if (doStart) {
+    dispatcherThread_ = factory->newThread(dispatcher_);
+    dispatcherThread_->start();
+  }
+
+  {
+    Synchronized s(monitor_);
+    while (state_ == TimerManager::STARTING) {
+      monitor_.wait();
+    }
+    assert(state_ != TimerManager::STARTING);
+  }
+}
+
+void TimerWheelManager::stop() {
+  bool doStop = false;
+  {
+    Synchronized s(monitor_);
+    if (state_ == TimerManager::UNINITIALIZED) {
+      state_ = TimerManager::STOPPED;
+    } else if (state_ != STOPPING && state_ != STOPPED) {
+      doStop = true;
+      state_ = STOPPING;
+      monitor_.notifyAll();
+    }
+    while (state_ != STOPPED) {
+      monitor_.wait();
+    }
+  }
+
+  if (doStop) {
+    // Clean up any outstanding tasks
+    clear();
+
+    // Remove dispatcher's reference to us.
+    dispatcher_->manager_ = nullptr;
+  }
+}
+
+size_t TimerWheelManager::taskCount() const {
+  return taskCount_;
+}
+
+TimerManager::Timer TimerWheelManager::add(shared_ptr<Runnable> task,
+    const std::chrono::time_point<std::chrono::steady_clock>& abstime) {
+  auto now = std::chrono::steady_clock::now();
+
+  if (abstime < now) {
+    throw InvalidArgumentException();
+  }
+  Synchronized s(monitor_);
+  if (state_ != TimerManager::STARTED) {
+    throw IllegalStateException();
+  }
+
+  shared_ptr<Task> timer(new Task(task));
+  timer->expires_ = tickOf(abstime);
+  timer->self_ = timer;
+  link(timer.get());
+  taskCount_++;
+
+  // Kick the dispatcher if it is asleep and would wake up too late
+  if (timer->expires_ < wakeup_) {
+    monitor_.notify();
+  }
+
+  return timer;
+}
+
+void TimerWheelManager::remove(shared_ptr<Runnable> task) {
+  Synchronized s(monitor_);
+  if (state_ != TimerManager::STARTED) {
+    throw IllegalStateException();
+  }
+  bool found = false;
+  for (auto& level : wheel_) {
+    for (auto& slot : level) {
+      for (Task* ix = slot; ix != nullptr;) {
+        Task* next = ix->next_;
+        if (*ix == task) {
+          found = true;
+          taskCount_--;
+          unlink(ix);
+          ix->self_.reset();
+        }
+        ix = next;
+      }
+    }
+  }
+  if (!found) {
+    throw NoSuchTaskException();
+  }
+}
+
+void TimerWheelManager::remove(Timer handle) {
+  Synchronized s(monitor_);
+  if (state_ != TimerManager::STARTED) {
+    throw IllegalStateException();
+  }
+
+  shared_ptr<Task> task = handle.lock();
+  if (!task) {
+    throw NoSuchTaskException();
+  }
+
+  if (task->pprev_ == nullptr) {
+    // Task is being executed
+    throw UncancellableTaskException();
+  }
+
+  unlink(task.get());
+  task->self_.reset();
+  taskCount_--;
+}
+
+TimerManager::STATE TimerWheelManager::state() const {
+  return state_;
+}
+
+uint64_t TimerWheelManager::tickOf(
+    const std::chrono::time_point<std::chrono::steady_clock>& abstime) const {
+  if (abstime <= epoch_) {
+    return 0;
+  }
+  // round up so that a task never runs before its time
+  return static_cast<uint64_t>((abstime - epoch_ + tick_ - std::chrono::steady_clock::duration(1))
+                               / tick_);
+}
+
+std::chrono::time_point<std::chrono::steady_clock> TimerWheelManager::timeOf(uint64_t tick) const {
+  return epoch_ + tick_ * static_cast<std::chrono::steady_clock::rep>(tick);
+}
+
+void TimerWheelManager::link(Task* task) {
+  if (task->expires_ < current_) {
+    task->expires_ = current_;
+  }
+
+  // Level n holds the tasks due within 256^(n+1) ticks; the top level also
+  // takes everything further out than the wheel can represent.
+  uint64_t delta = task->expires_ - current_;
+  uint32_t level = 0;
+  while (level < WHEEL_LEVELS - 1 && (delta >> (8 * (level + 1))) != 0) {
+    ++level;
+  }
+  if (level == WHEEL_LEVELS - 1 && (delta >> (8 * WHEEL_LEVELS)) != 0) {
+    task->expires_ = current_ + (uint64_t(1) << (8 * WHEEL_LEVELS)) - 1;
+  }
+
+  Task*& head = wheel_[level][(task->expires_ >> (8 * level)) & (WHEEL_SIZE - 1)];
+  task->next_ = head;
+  if (head != nullptr) {
+    head->pprev_ = &task->next_;
+  }
+  task->pprev_ = &head;
+  head = task;
+}
+
+void TimerWheelManager::unlink(Task* task) {
+  *task->pprev_ = task->next_;
+  if (task->next_ != nullptr) {
+    task->next_->pprev_ = task->pprev_;
+  }
+  task->pprev_ = nullptr;
+  task->next_ = nullptr;
+}
+
+void TimerWheelManager::cascade(uint32_t level) {
+  Task*& head = wheel_[level][(current_ >> (8 * level)) & (WHEEL_SIZE - 1)];
+  Task* task = head;
+  head = nullptr;
+  while (task != nullptr) {
+    Task* next = task->next_;
+    task->pprev_ = nullptr;
+    task->next_ = nullptr;
+    link(task);
+    task = next;
+  }
+}
+
+void TimerWheelManager::advance(uint64_t nowTick,
+                                std::vector<shared_ptr<Task> >& expired) {
+  while (current_ <= nowTick) {
+    if (taskCount_ == 0) {
+      // nothing to cascade or expire, skip straight to now
+      current_ = nowTick + 1;
+      break;
+    }
+
+    uint32_t index = current_ & (WHEEL_SIZE - 1);
+    if (index == 0) {
+      for (uint32_t level = 1; level < WHEEL_LEVELS; ++level) {
+        cascade(level);
+        if (((current_ >> (8 * level)) & (WHEEL_SIZE - 1)) != 0) {
+          break;
+        }
+      }
+    }
+
+    Task*& head = wheel_[0][index];
+    while (head != nullptr) {
+      Task* task = head;
+      unlink(task);
+      if (task->state_ == TimerManager::Task::WAITING) {
+        task->state_ = TimerManager::Task::EXECUTING;
+      }
+      expired.push_back(std::move(task->self_));
+      taskCount_--;
+    }
+    ++current_;
+  }
+}
+
+uint64_t TimerWheelManager::nextWakeup() const {
+  if (taskCount_ == 0) {
+    return (std::numeric_limits<uint64_t>::max)();
+  }
+  // The higher levels only change when the first one wraps around, so the
+  // earliest interesting tick is the next occupied slot or that wrap.
+  uint64_t tick = current_;
+  while ((tick & (WHEEL_SIZE - 1)) != 0 && wheel_[0][tick & (WHEEL_SIZE - 1)] == nullptr) {
+    ++tick;
+  }
+  return tick;
+}
+
+void TimerWheelManager::clear() {
+  for (auto& level : wheel_) {
+    for (auto& slot : level) {
+      while (slot != nullptr) {
+        Task* task = slot;
+        unlink(task);
+        task->self_.reset();
+      }
+    }
+  }
+  taskCount_ = 0;
+}
 }
 }
 } // apache::thrift::concurrency
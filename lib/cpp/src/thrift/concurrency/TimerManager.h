@@ -25,6 +25,7 @@
 
 #include <memory>
 #include <map>
+#include <vector>
 
 namespace apache {
 namespace thrift {
@@ -130,6 +131,77 @@ private:
   using task_iterator = decltype(taskMap_)::iterator;
   typedef std::pair<task_iterator, task_iterator> task_range;
 };
+
+/**
+ * Timer Manager backed by a hierarchical timer wheel
+ *
+ * Time is divided into ticks and pending tasks hang off four levels of 256
+ * slots each, the first covering the next 256 ticks and every further level
+ * 256 times the span of the one below.  Adding and removing a single timer
+ * links or unlinks it from a slot list, so both are O(1) no matter how many
+ * timers are pending, and the dispatcher expires a whole slot at a time.
+ * Tasks in the higher levels are moved down a level as the wheel turns.
+ *
+ * Timeouts are rounded up to a whole number of ticks, so a task never fires
+ * early but may fire up to one tick late.  Timeouts longer than 2^32 ticks
+ * are clamped.  Removing by Runnable has to visit every pending task.
+ */
+class TimerWheelManager : public TimerManager {
+
+public:
+  /// Number of slots in each level of the wheel
+  static const uint32_t WHEEL_SIZE = 256;
+
+  /// Number of levels in the wheel
+  static const uint32_t WHEEL_LEVELS = 4;
+
+  /**
+   * @param tick Resolution of the wheel; should be at least one millisecond.
+   */
+  explicit TimerWheelManager(const std::chrono::milliseconds& tick = std::chrono::milliseconds(1));
+
+  ~TimerWheelManager() override;
+
+  void start() override;
+
+  void stop() override;
+
+  size_t taskCount() const override;
+
+  using TimerManager::add;
+
+  Timer add(std::shared_ptr<Runnable> task,
+            const std::chrono::time_point<std::chrono::steady_clock>& abstime) override;
+
+  void remove(std::shared_ptr<Runnable> task) override;
+
+  void remove(Timer timer) override;
+
+  STATE state() const override;
+
+private:
+  uint64_t tickOf(const std::chrono::time_point<std::chrono::steady_clock>& abstime) const;
+  std::chrono::time_point<std::chrono::steady_clock> timeOf(uint64_t tick) const;
+  void link(Task* task);
+  void unlink(Task* task);
+  void cascade(uint32_t level);
+  void advance(uint64_t nowTick, std::vector<std::shared_ptr<Task> >& expired);
+  uint64_t nextWakeup() const;
+  void clear();
+
+  const std::chrono::steady_clock::duration tick_;
+  const std::chrono::time_point<std::chrono::steady_clock> epoch_;
+  Task* wheel_[WHEEL_LEVELS][WHEEL_SIZE];
+  uint64_t current_;
+  uint64_t wakeup_;
+  size_t taskCount_;
+  Monitor monitor_;
+  STATE state_;
+  class Dispatcher;
+  friend class Dispatcher;
+  std::shared_ptr<Dispatcher> dispatcher_;
+  std::shared_ptr<Thread> dispatcherThread_;
+};
 }
 }
 } // apache::thrift::concurrency
@@ -0,0 +1,395 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/processor/TProxyProcessor.h>
+
+#include <typeinfo>
+
+#include <thrift/TApplicationException.h>
+#include <thrift/TUuid.h>
+#include <thrift/transport/TBufferTransports.h>
+
+using namespace apache::thrift::protocol;
+using namespace apache::thrift::transport;
+using apache::thrift::concurrency::Guard;
+
+namespace apache {
+namespace thrift {
+namespace processor {
+
+namespace {
+
+/**
+ * Returns the bytes of the value of the given type that comes next in from,
+ * without consuming them, or nullptr if the transport cannot lend all of
+ * them or the protocol cannot be scanned (see
+ * TProtocol::cloneForTransport()).
+ */
+const uint8_t* lend(TProtocol* from, TType type, uint32_t& size) {
+  TTransport* trans = from->getTransport().get();
+  uint32_t len = 1;
+  const uint8_t* data = trans->borrow(nullptr, &len);
+  if (data == nullptr) {
+    return nullptr;
+  }
+
+  std::shared_ptr<TMemoryBuffer> window(new TMemoryBuffer(const_cast<uint8_t*>(data), len));
+  std::shared_ptr<TProtocol> scanner = from->cloneForTransport(window);
+  if (!scanner) {
+    return nullptr;
+  }
+  if (type == T_STRUCT && dynamic_cast<TFramedTransport*>(trans) != nullptr) {
+    // a frame holds one message, and the messages of the protocols that can
+    // be scanned end with their struct: the rest of the frame is the value
+    size = len;
+    return data;
+  }
+  try {
+    scanner->skip(type);
+  } catch (TTransportException&) {
+    return nullptr;
+  }
+  size = len - window->available_read();
+  return data;
+}
+
+/**
+ * Reads a value from one protocol and writes it to another.
+ */
+void copy(TProtocol* from, TProtocol* to, TType type) {
+  TInputRecursionTracker tracker(*from);
+
+  switch (type) {
+  case T_BOOL: {
+    bool value;
+    from->readBool(value);
+    to->writeBool(value);
+    return;
+  }
+  case T_BYTE: {
+    int8_t value;
+    from->readByte(value);
+    to->writeByte(value);
+    return;
+  }
+  case T_I16: {
+    int16_t value;
+    from->readI16(value);
+    to->writeI16(value);
+    return;
+  }
+  case T_I32: {
+    int32_t value;
+    from->readI32(value);
+    to->writeI32(value);
+    return;
+  }
+  case T_I64: {
+    int64_t value;
+    from->readI64(value);
+    to->writeI64(value);
+    return;
+  }
+  case T_DOUBLE: {
+    double value;
+    from->readDouble(value);
+    to->writeDouble(value);
+    return;
+  }
+  case T_STRING: {
+    std::string value;
+    from->readBinary(value);
+    to->writeBinary(value);
+    return;
+  }
+  case T_UUID: {
+    TUuid value;
+    from->readUUID(value);
+    to->writeUUID(value);
+    return;
+  }
+  case T_STRUCT: {
+    std::string name;
+    TType ftype;
+    int16_t fid;
+    from->readStructBegin(name);
+    to->writeStructBegin(name.c_str());
+    while (true) {
+      from->readFieldBegin(name, ftype, fid);
+      if (ftype == T_STOP) {
+        break;
+      }
+      to->writeFieldBegin(name.c_str(), ftype, fid);
+      copy(from, to, ftype);
+      from->readFieldEnd();
+      to->writeFieldEnd();
+    }
+    to->writeFieldStop();
+    from->readStructEnd();
+    to->writeStructEnd();
+    return;
+  }
+  case T_MAP: {
+    TType keyType;
+    TType valType;
+    uint32_t size;
+    from->readMapBegin(keyType, valType, size);
+    to->writeMapBegin(keyType, valType, size);
+    for (uint32_t i = 0; i < size; ++i) {
+      copy(from, to, keyType);
+      copy(from, to, valType);
+    }
+    from->readMapEnd();
+    to->writeMapEnd();
+    return;
+  }
+  case T_SET: {
+    TType elemType;
+    uint32_t size;
+    from->readSetBegin(elemType, size);
+    to->writeSetBegin(elemType, size);
+    for (uint32_t i = 0; i < size; ++i) {
+      copy(from, to, elemType);
+    }
+    from->readSetEnd();
+    to->writeSetEnd();
+    return;
+  }
+  case T_LIST: {
+    TType elemType;
+    uint32_t size;
+    from->readListBegin(elemType, size);
+    to->writeListBegin(elemType, size);
+    for (uint32_t i = 0; i < size; ++i) {
+      copy(from, to, elemType);
+    }
+    from->readListEnd();
+    to->writeListEnd();
+    return;
+  }
+  default:
+    break;
+  }
+
+  throw TProtocolException(TProtocolException::INVALID_DATA, "invalid TType");
+}
+
+/**
+ * Passes the result struct of a reply on, verbatim if the protocols match.
+ */
+void relay(TProtocol* from, TProtocol* to) {
+  uint32_t size = 0;
+  const uint8_t* data = nullptr;
+  if (typeid(*from) == typeid(*to)) {
+    data = lend(from, T_STRUCT, size);
+  }
+  if (data != nullptr) {
+    to->getTransport()->write(data, size);
+    from->getTransport()->consume(size);
+  } else {
+    copy(from, to, T_STRUCT);
+  }
+}
+
+void discard(TProtocol* in) {
+  in->skip(T_STRUCT);
+  in->readMessageEnd();
+  in->getTransport()->readEnd();
+}
+
+void fail(TProtocol* out,
+          const std::string& name,
+          int32_t seqid,
+          TApplicationException::TApplicationExceptionType type,
+          const std::string& message) {
+  TApplicationException x(type, "TProxyProcessor: " + message);
+  out->writeMessageBegin(name, T_EXCEPTION, seqid);
+  x.write(out);
+  out->writeMessageEnd();
+  out->getTransport()->writeEnd();
+  out->getTransport()->flush();
+}
+}
+
+void TProxyProcessor::addRoute(const std::string& name,
+                               BackendFactory factory,
+                               bool stripServiceName) {
+  std::shared_ptr<Route> route(new Route());
+  route->factory = factory;
+  route->stripServiceName = stripServiceName;
+  routes_[name] = route;
+}
+
+void TProxyProcessor::setDefaultRoute(BackendFactory factory) {
+  defaultRoute_.reset(new Route());
+  defaultRoute_->factory = factory;
+  defaultRoute_->stripServiceName = false;
+}
+
+TProxyProcessor::Route* TProxyProcessor::findRoute(const std::string& name,
+                                                   std::string& forwardName) const {
+  forwardName = name;
+  auto it = routes_.find(name);
+  if (it != routes_.end()) {
+    return it->second.get();
+  }
+  std::string::size_type separator = name.find(':');
+  if (separator != std::string::npos) {
+    it = routes_.find(name.substr(0, separator));
+    if (it != routes_.end()) {
+      if (it->second->stripServiceName) {
+        forwardName = name.substr(separator + 1);
+      }
+      return it->second.get();
+    }
+  }
+  return defaultRoute_.get();
+}
+
+std::shared_ptr<TProtocol> TProxyProcessor::acquire(Route& route) {
+  {
+    Guard g(route.mutex);
+    if (!route.idle.empty()) {
+      std::shared_ptr<TProtocol> backend = route.idle.back();
+      route.idle.pop_back();
+      return backend;
+    }
+  }
+  std::shared_ptr<TProtocol> backend = route.factory();
+  if (!backend) {
+    throw TTransportException(TTransportException::NOT_OPEN, "no backend connection");
+  }
+  return backend;
+}
+
+void TProxyProcessor::release(Route& route, std::shared_ptr<TProtocol> backend) {
+  Guard g(route.mutex);
+  if (route.idle.size() < maxIdle_) {
+    route.idle.push_back(backend);
+  }
+}
+
+bool TProxyProcessor::process(std::shared_ptr<TProtocol> in,
+                              std::shared_ptr<TProtocol> out,
+                              void* connectionContext) {
+  (void)connectionContext;
+  std::string name;
+  TMessageType type;
+  int32_t seqid;
+  in->readMessageBegin(name, type, seqid);
+
+  if (type != T_CALL && type != T_ONEWAY) {
+    discard(in.get());
+    fail(out.get(), name, seqid, TApplicationException::INVALID_MESSAGE_TYPE,
+         "Unexpected message type");
+    throw TException("Unexpected message type");
+  }
+
+  std::string forwardName;
+  Route* route = findRoute(name, forwardName);
+  if (route == nullptr) {
+    discard(in.get());
+    if (type == T_CALL) {
+      fail(out.get(), name, seqid, TApplicationException::UNKNOWN_METHOD, "No route for " + name);
+    }
+    return true;
+  }
+
+  std::shared_ptr<TProtocol> backend;
+  try {
+    backend = acquire(*route);
+  } catch (TException& e) {
+    discard(in.get());
+    if (type == T_CALL) {
+      fail(out.get(), name, seqid, TApplicationException::INTERNAL_ERROR, e.what());
+    }
+    return true;
+  }
+
+  // Forward the call.  Once the arguments have been lent by the input
+  // transport, a failing backend cannot leave the client connection in the
+  // middle of a message, so it is answered with an exception.
+  uint32_t size = 0;
+  const uint8_t* args = nullptr;
+  if (typeid(*in) == typeid(*backend)) {
+    args = lend(in.get(), T_STRUCT, size);
+  }
+  if (args != nullptr) {
+    try {
+      backend->writeMessageBegin(forwardName, type, seqid);
+      backend->getTransport()->write(args, size);
+      backend->writeMessageEnd();
+      backend->getTransport()->writeEnd();
+      backend->getTransport()->flush();
+    } catch (TException& e) {
+      in->getTransport()->consume(size);
+      in->readMessageEnd();
+      in->getTransport()->readEnd();
+      if (type == T_CALL) {
+        fail(out.get(), name, seqid, TApplicationException::INTERNAL_ERROR, e.what());
+      }
+      return true;
+    }
+    in->getTransport()->consume(size);
+    in->readMessageEnd();
+    in->getTransport()->readEnd();
+  } else {
+    backend->writeMessageBegin(forwardName, type, seqid);
+    copy(in.get(), backend.get(), T_STRUCT);
+    in->readMessageEnd();
+    in->getTransport()->readEnd();
+    backend->writeMessageEnd();
+    backend->getTransport()->writeEnd();
+    backend->getTransport()->flush();
+  }
+
+  if (type == T_ONEWAY) {
+    release(*route, backend);
+    return true;
+  }
+
+  // Pass the reply back under the seqid of the client
+  std::string rname;
+  TMessageType rtype;
+  int32_t rseqid;
+  try {
+    backend->readMessageBegin(rname, rtype, rseqid);
+  } catch (TException& e) {
+    fail(out.get(), name, seqid, TApplicationException::INTERNAL_ERROR, e.what());
+    return true;
+  }
+  if (rseqid != seqid) {
+    fail(out.get(), name, seqid, TApplicationException::BAD_SEQUENCE_ID,
+         "Backend answered out of sequence");
+    return true;
+  }
+  out->writeMessageBegin(rname, rtype, seqid);
+  relay(backend.get(), out.get());
+  backend->readMessageEnd();
+  backend->getTransport()->readEnd();
+  out->writeMessageEnd();
+  out->getTransport()->writeEnd();
+  out->getTransport()->flush();
+
+  release(*route, backend);
+  return true;
+}
+}
+}
+} // apache::thrift::processor
@@ -0,0 +1,112 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_PROCESSOR_TPROXYPROCESSOR_H_
+#define _THRIFT_PROCESSOR_TPROXYPROCESSOR_H_ 1
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <thrift/TProcessor.h>
+#include <thrift/concurrency/Mutex.h>
+#include <thrift/protocol/TProtocol.h>
+
+namespace apache {
+namespace thrift {
+namespace processor {
+
+/**
+ * A processor that forwards calls to other servers without deserializing
+ * them.
+ *
+ * Only the message header is decoded.  Its name selects a route, the call
+ * is passed on over a connection taken from the route's pool, and the reply
+ * is passed back the same way.  When the input transport can lend the rest
+ * of the message through borrow() (TFramedTransport always can, buffered
+ * transports can if the message fits their buffer) and both sides use the
+ * same protocol, the arguments and the result are copied byte for byte:
+ * proxying costs a memcpy rather than a decode and an encode.  Otherwise the
+ * message is re-encoded value by value, which also lets the proxy translate
+ * between protocols.
+ *
+ * Names are looked up as they are, then by the service name before the
+ * TMultiplexedProtocol separator (':'), and finally the default route is
+ * used.  Calls to unknown names are answered with a TApplicationException.
+ *
+ * A backend that cannot be reached, or that fails before its reply has
+ * started, is answered with a TApplicationException as well and its
+ * connection is discarded.  The client connection stays usable unless the
+ * call was being re-encoded, in which case the error is thrown.
+ */
+class TProxyProcessor : public TProcessor {
+public:
+  /**
+   * Opens a new connection to a backend, returning the protocol to talk to
+   * it through.  It is called from process(), whenever a route has no idle
+   * connection, and may throw.
+   */
+  typedef std::function<std::shared_ptr<protocol::TProtocol>()> BackendFactory;
+
+  /// Default number of idle connections kept per route
+  static const size_t DEFAULT_MAX_IDLE = 16;
+
+  TProxyProcessor() : maxIdle_(DEFAULT_MAX_IDLE) {}
+
+  /**
+   * Sends calls to name (a service name, or a full message name such as
+   * "Service:method") to the backends opened by factory.  With
+   * stripServiceName, "Service:" is removed from the message name, for
+   * backends that are not multiplexed.
+   */
+  void addRoute(const std::string& name, BackendFactory factory, bool stripServiceName = false);
+
+  /// Sends calls that match no route to the backends opened by factory
+  void setDefaultRoute(BackendFactory factory);
+
+  /// Sets how many idle connections each route keeps for later calls
+  void setMaxIdleConnections(size_t maxIdle) { maxIdle_ = maxIdle; }
+
+  bool process(std::shared_ptr<protocol::TProtocol> in,
+               std::shared_ptr<protocol::TProtocol> out,
+               void* connectionContext) override;
+
+private:
+  struct Route {
+    BackendFactory factory;
+    bool stripServiceName;
+    concurrency::Mutex mutex;
+    std::vector<std::shared_ptr<protocol::TProtocol> > idle;
+  };
+
+  Route* findRoute(const std::string& name, std::string& forwardName) const;
+  std::shared_ptr<protocol::TProtocol> acquire(Route& route);
+  void release(Route& route, std::shared_ptr<protocol::TProtocol> backend);
+
+  std::map<std::string, std::shared_ptr<Route> > routes_;
+  std::shared_ptr<Route> defaultRoute_;
+  size_t maxIdle_;
+};
+}
+}
+} // apache::thrift::processor
+
+#endif // #ifndef _THRIFT_PROCESSOR_TPROXYPROCESSOR_H_
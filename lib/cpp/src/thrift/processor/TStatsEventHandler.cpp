@@ -0,0 +1,434 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/processor/TStatsEventHandler.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+using apache::thrift::concurrency::Guard;
+
+namespace apache {
+namespace thrift {
+namespace processor {
+
+void TLatencyHistogram::merge(const TLatencyHistogram& other) {
+  for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+    counts_[i] += other.counts_[i];
+  }
+  count_ += other.count_;
+  total_ += other.total_;
+  if (other.max_ > max_) {
+    max_ = other.max_;
+  }
+}
+
+uint64_t TLatencyHistogram::getPercentile(double fraction) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  auto rank = static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(count_)));
+  if (rank < 1) {
+    rank = 1;
+  } else if (rank > count_) {
+    rank = count_;
+  }
+  uint64_t seen = 0;
+  for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+    seen += counts_[i];
+    if (seen >= rank) {
+      return (std::min)(bucketLimit(i), max_);
+    }
+  }
+  return max_;
+}
+
+uint64_t TLatencyHistogram::bucketLimit(size_t bucket) {
+  if (bucket < (1u << SUB_BUCKET_BITS)) {
+    return bucket;
+  }
+  unsigned shift = static_cast<unsigned>(bucket >> SUB_BUCKET_BITS) - 1;
+  uint64_t sub = bucket & ((1u << SUB_BUCKET_BITS) - 1);
+  return (((1ull << SUB_BUCKET_BITS) + sub + 1) << shift) - 1;
+}
+
+namespace {
+
+std::atomic<uint64_t> nextHandlerId(1);
+
+uint64_t now() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now().time_since_epoch())
+                                   .count());
+}
+
+/*
+ * Counters are only ever written by the thread owning them, so they are
+ * updated with a relaxed load and store rather than a locked increment;
+ * the atomics only make reading them from getStats() well defined.
+ */
+inline void bump(std::atomic<uint64_t>& counter, uint64_t delta) {
+  counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+inline uint64_t load(const std::atomic<uint64_t>& counter) {
+  return counter.load(std::memory_order_relaxed);
+}
+
+struct AtomicHistogram {
+  AtomicHistogram() {
+    for (auto& count : counts) {
+      count.store(0, std::memory_order_relaxed);
+    }
+    total.store(0, std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+  }
+
+  void record(uint64_t nanos) {
+    bump(counts[TLatencyHistogram::bucketOf(nanos)], 1);
+    bump(total, nanos);
+    if (nanos > load(max)) {
+      max.store(nanos, std::memory_order_relaxed);
+    }
+  }
+
+  std::atomic<uint64_t> counts[TLatencyHistogram::NUM_BUCKETS];
+  std::atomic<uint64_t> total;
+  std::atomic<uint64_t> max;
+};
+
+struct Counters {
+  explicit Counters(const std::string& name) : name(name) {
+    calls.store(0, std::memory_order_relaxed);
+    errors.store(0, std::memory_order_relaxed);
+    bytesIn.store(0, std::memory_order_relaxed);
+    bytesOut.store(0, std::memory_order_relaxed);
+  }
+
+  const std::string name;
+  std::atomic<uint64_t> calls;
+  std::atomic<uint64_t> errors;
+  std::atomic<uint64_t> bytesIn;
+  std::atomic<uint64_t> bytesOut;
+  AtomicHistogram read;
+  AtomicHistogram handler;
+  AtomicHistogram write;
+};
+
+/*
+ * The context of one call.  Phases are timed as the events come in and
+ * recorded all at once when the context is freed.
+ */
+struct Call {
+  void start(const char* fn_name) {
+    method = fn_name;
+    mark = now();
+    readNanos = handlerNanos = writeNanos = 0;
+    bytesIn = bytesOut = 0;
+    read = handled = wrote = error = false;
+  }
+
+  uint64_t lap() {
+    uint64_t t = now();
+    uint64_t elapsed = t - mark;
+    mark = t;
+    return elapsed;
+  }
+
+  const char* method;
+  uint64_t mark;
+  uint64_t readNanos;
+  uint64_t handlerNanos;
+  uint64_t writeNanos;
+  uint32_t bytesIn;
+  uint32_t bytesOut;
+  bool read;
+  bool handled;
+  bool wrote;
+  bool error;
+};
+
+/*
+ * Contexts freed on a thread, for reuse by the next calls on it.
+ */
+struct CallCache {
+  static const size_t MAX_CACHED = 64;
+
+  ~CallCache() {
+    for (Call* call : calls) {
+      delete call;
+    }
+  }
+
+  std::vector<Call*> calls;
+};
+
+thread_local CallCache callCache;
+}
+
+/*
+ * The counters of one thread.  Only the owning thread adds methods, and it
+ * looks them up without locking; the mutex keeps getStats() from walking
+ * the map while a method is added.
+ */
+struct TStatsEventHandler::Shard {
+  Counters* find(const char* fn_name) {
+    auto it = byPointer.find(fn_name);
+    if (it != byPointer.end() && std::strcmp(it->second->name.c_str(), fn_name) == 0) {
+      return it->second;
+    }
+    Counters* counters;
+    {
+      Guard g(mutex);
+      std::unique_ptr<Counters>& slot = byName[fn_name];
+      if (!slot) {
+        slot.reset(new Counters(fn_name));
+      }
+      counters = slot.get();
+    }
+    byPointer[fn_name] = counters;
+    return counters;
+  }
+
+  concurrency::Mutex mutex;
+  std::map<std::string, std::unique_ptr<Counters> > byName;
+  std::unordered_map<const char*, Counters*> byPointer;
+};
+
+struct TStatsEventHandler::State {
+  concurrency::Mutex mutex;
+  std::vector<std::shared_ptr<Shard> > shards;
+  std::map<std::string, TMethodStats> retired;
+};
+
+/*
+ * A thread's reference to its shard of one handler.  When the thread
+ * exits, the shard's counters are folded into the handler's retired totals
+ * and the shard is dropped, so threads that come and go do not pile up
+ * shards.
+ */
+struct TStatsEventHandler::ShardOwner {
+  ShardOwner(uint64_t id, const std::shared_ptr<State>& state, const std::shared_ptr<Shard>& shard)
+    : id(id), state(state), shard(shard) {}
+
+  ShardOwner(ShardOwner&& other) noexcept
+    : id(other.id), state(std::move(other.state)), shard(std::move(other.shard)) {}
+
+  ShardOwner& operator=(ShardOwner&& other) noexcept {
+    if (this != &other) {
+      retire();
+      id = other.id;
+      state = std::move(other.state);
+      shard = std::move(other.shard);
+    }
+    return *this;
+  }
+
+  ~ShardOwner() { retire(); }
+
+  void retire() {
+    std::shared_ptr<State> live = state.lock();
+    if (live && shard) {
+      Guard g(live->mutex);
+      {
+        Guard sg(shard->mutex);
+        collect(*shard, live->retired);
+      }
+      auto it = std::find(live->shards.begin(), live->shards.end(), shard);
+      if (it != live->shards.end()) {
+        *it = live->shards.back();
+        live->shards.pop_back();
+      }
+    }
+    shard.reset();
+  }
+
+  uint64_t id;
+  std::weak_ptr<State> state;
+  std::shared_ptr<Shard> shard;
+};
+
+TStatsEventHandler::TStatsEventHandler() : id_(nextHandlerId++), state_(new State()) {
+}
+
+TStatsEventHandler::~TStatsEventHandler() = default;
+
+TStatsEventHandler::Shard* TStatsEventHandler::shard() {
+  static thread_local std::vector<ShardOwner> cache;
+  for (auto& entry : cache) {
+    if (entry.id == id_) {
+      return entry.shard.get();
+    }
+  }
+
+  // forget the shards of handlers that are gone
+  for (size_t i = 0; i < cache.size();) {
+    if (cache[i].state.expired()) {
+      cache[i] = std::move(cache.back());
+      cache.pop_back();
+    } else {
+      ++i;
+    }
+  }
+
+  std::shared_ptr<Shard> shard(new Shard());
+  {
+    Guard g(state_->mutex);
+    state_->shards.push_back(shard);
+  }
+  cache.emplace_back(id_, state_, shard);
+  return shard.get();
+}
+
+void* TStatsEventHandler::getContext(const char* fn_name, void* serverContext) {
+  (void)serverContext;
+  Call* call;
+  if (callCache.calls.empty()) {
+    call = new Call();
+  } else {
+    call = callCache.calls.back();
+    callCache.calls.pop_back();
+  }
+  call->start(fn_name);
+  return call;
+}
+
+void TStatsEventHandler::freeContext(void* ctx, const char* fn_name) {
+  (void)fn_name;
+  auto* call = static_cast<Call*>(ctx);
+  if (call == nullptr) {
+    return;
+  }
+
+  Counters* counters = shard()->find(call->method);
+  bump(counters->calls, 1);
+  if (call->error) {
+    bump(counters->errors, 1);
+  }
+  bump(counters->bytesIn, call->bytesIn);
+  bump(counters->bytesOut, call->bytesOut);
+  if (call->read) {
+    counters->read.record(call->readNanos);
+  }
+  if (call->handled) {
+    counters->handler.record(call->handlerNanos);
+  }
+  if (call->wrote) {
+    counters->write.record(call->writeNanos);
+  }
+
+  if (callCache.calls.size() < CallCache::MAX_CACHED) {
+    callCache.calls.push_back(call);
+  } else {
+    delete call;
+  }
+}
+
+void TStatsEventHandler::preRead(void* ctx, const char* fn_name) {
+  (void)fn_name;
+  static_cast<Call*>(ctx)->lap();
+}
+
+void TStatsEventHandler::postRead(void* ctx, const char* fn_name, uint32_t bytes) {
+  (void)fn_name;
+  auto* call = static_cast<Call*>(ctx);
+  call->readNanos = call->lap();
+  call->bytesIn = bytes;
+  call->read = true;
+}
+
+void TStatsEventHandler::preWrite(void* ctx, const char* fn_name) {
+  (void)fn_name;
+  auto* call = static_cast<Call*>(ctx);
+  if (!call->handled) {
+    call->handlerNanos = call->lap();
+    call->handled = true;
+  } else {
+    call->lap();
+  }
+}
+
+void TStatsEventHandler::postWrite(void* ctx, const char* fn_name, uint32_t bytes) {
+  (void)fn_name;
+  auto* call = static_cast<Call*>(ctx);
+  call->writeNanos = call->lap();
+  call->bytesOut = bytes;
+  call->wrote = true;
+}
+
+void TStatsEventHandler::asyncComplete(void* ctx, const char* fn_name) {
+  (void)fn_name;
+  auto* call = static_cast<Call*>(ctx);
+  call->handlerNanos = call->lap();
+  call->handled = true;
+}
+
+void TStatsEventHandler::handlerError(void* ctx, const char* fn_name) {
+  (void)fn_name;
+  auto* call = static_cast<Call*>(ctx);
+  call->handlerNanos = call->lap();
+  call->handled = true;
+  call->error = true;
+}
+
+void TStatsEventHandler::collect(const Shard& shard, std::map<std::string, TMethodStats>& stats) {
+  auto collectHistogram = [](const AtomicHistogram& from, TLatencyHistogram& to) {
+    for (size_t i = 0; i < TLatencyHistogram::NUM_BUCKETS; ++i) {
+      uint64_t count = load(from.counts[i]);
+      to.counts_[i] += count;
+      to.count_ += count;
+    }
+    to.total_ += load(from.total);
+    to.max_ = (std::max)(to.max_, load(from.max));
+  };
+
+  for (const auto& method : shard.byName) {
+    const Counters& counters = *method.second;
+    TMethodStats& total = stats[method.first];
+    total.calls += load(counters.calls);
+    total.errors += load(counters.errors);
+    total.bytesIn += load(counters.bytesIn);
+    total.bytesOut += load(counters.bytesOut);
+    collectHistogram(counters.read, total.read);
+    collectHistogram(counters.handler, total.handler);
+    collectHistogram(counters.write, total.write);
+  }
+}
+
+std::map<std::string, TMethodStats> TStatsEventHandler::getStats() const {
+  Guard g(state_->mutex);
+  std::map<std::string, TMethodStats> stats(state_->retired);
+  for (const auto& shard : state_->shards) {
+    Guard sg(shard->mutex);
+    collect(*shard, stats);
+  }
+  return stats;
+}
+
+size_t TStatsEventHandler::getShardCount() const {
+  Guard g(state_->mutex);
+  return state_->shards.size();
+}
+}
+}
+} // apache::thrift::processor
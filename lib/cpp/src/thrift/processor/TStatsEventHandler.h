@@ -0,0 +1,195 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_PROCESSOR_TSTATSEVENTHANDLER_H_
+#define _THRIFT_PROCESSOR_TSTATSEVENTHANDLER_H_ 1
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <thrift/TProcessor.h>
+#include <thrift/concurrency/Mutex.h>
+
+namespace apache {
+namespace thrift {
+namespace processor {
+
+/**
+ * A latency histogram with logarithmic buckets, in the manner of HDR
+ * histograms: every power of two is split into 16 linear sub-buckets, so a
+ * percentile is accurate to within 1/16 of its value.  Latencies are in
+ * nanoseconds; those over 2^36 ns (about 68 seconds) are counted in the last
+ * bucket.
+ */
+class TLatencyHistogram {
+public:
+  static const unsigned SUB_BUCKET_BITS = 4;
+  static const unsigned MAX_BITS = 36;
+  static const size_t NUM_BUCKETS = (MAX_BITS - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS;
+
+  TLatencyHistogram() : counts_(NUM_BUCKETS), count_(0), total_(0), max_(0) {}
+
+  void record(uint64_t nanos) {
+    ++counts_[bucketOf(nanos)];
+    ++count_;
+    total_ += nanos;
+    if (nanos > max_) {
+      max_ = nanos;
+    }
+  }
+
+  /// Adds the samples of another histogram to this one
+  void merge(const TLatencyHistogram& other);
+
+  uint64_t getCount() const { return count_; }
+
+  /// Sum of all samples, in nanoseconds
+  uint64_t getTotal() const { return total_; }
+
+  uint64_t getMax() const { return max_; }
+
+  uint64_t getMean() const { return count_ == 0 ? 0 : total_ / count_; }
+
+  /**
+   * Returns the latency below which the given fraction (e.g. 0.99) of the
+   * samples fall, as the upper bound of the bucket holding it.  Returns 0
+   * for an empty histogram.
+   */
+  uint64_t getPercentile(double fraction) const;
+
+  /// Returns the bucket that counts the given latency
+  static size_t bucketOf(uint64_t nanos) {
+    if (nanos < (1u << SUB_BUCKET_BITS)) {
+      return static_cast<size_t>(nanos);
+    }
+    unsigned msb = 63;
+    while ((nanos >> msb) == 0) {
+      --msb;
+    }
+    if (msb >= MAX_BITS) {
+      return NUM_BUCKETS - 1;
+    }
+    unsigned shift = msb - SUB_BUCKET_BITS;
+    return ((shift + 1) << SUB_BUCKET_BITS) + ((nanos >> shift) & ((1u << SUB_BUCKET_BITS) - 1));
+  }
+
+  /// Returns the largest latency counted in the given bucket
+  static uint64_t bucketLimit(size_t bucket);
+
+private:
+  friend class TStatsEventHandler;
+
+  std::vector<uint64_t> counts_;
+  uint64_t count_;
+  uint64_t total_;
+  uint64_t max_;
+};
+
+/**
+ * Statistics of one method, as returned by TStatsEventHandler::getStats().
+ */
+struct TMethodStats {
+  TMethodStats() : calls(0), errors(0), bytesIn(0), bytesOut(0) {}
+
+  /// Calls completed (or failed)
+  uint64_t calls;
+
+  /// Calls whose handler threw something other than a declared exception
+  uint64_t errors;
+
+  /// Bytes of arguments read, and of results written
+  uint64_t bytesIn;
+  uint64_t bytesOut;
+
+  /// Time spent reading the arguments, in the handler and writing the result
+  TLatencyHistogram read;
+  TLatencyHistogram handler;
+  TLatencyHistogram write;
+};
+
+/**
+ * A processor event handler that keeps per-method call counts, error
+ * counts, byte counts and latency histograms, for instance:
+ *
+ *   std::shared_ptr<TStatsEventHandler> stats(new TStatsEventHandler());
+ *   processor->setEventHandler(stats);
+ *   ...
+ *   uint64_t p99 = stats->getStats()["Calculator.add"].handler.getPercentile(0.99);
+ *
+ * Every thread records into counters of its own, without locks or atomic
+ * read-modify-write operations; getStats() adds them up.  A method is keyed
+ * by the name the generated processor passes to the handler, which is
+ * "Service.method".
+ *
+ * Declared exceptions are part of the result, so only undeclared ones (see
+ * handlerError()) count as errors.
+ */
+class TStatsEventHandler : public TProcessorEventHandler {
+public:
+  TStatsEventHandler();
+  ~TStatsEventHandler() override;
+
+  void* getContext(const char* fn_name, void* serverContext) override;
+  void freeContext(void* ctx, const char* fn_name) override;
+  void preRead(void* ctx, const char* fn_name) override;
+  void postRead(void* ctx, const char* fn_name, uint32_t bytes) override;
+  void preWrite(void* ctx, const char* fn_name) override;
+  void postWrite(void* ctx, const char* fn_name, uint32_t bytes) override;
+  void asyncComplete(void* ctx, const char* fn_name) override;
+  void handlerError(void* ctx, const char* fn_name) override;
+
+  /**
+   * Returns the statistics of every method called so far.  Calls still in
+   * progress on other threads may or may not be included.
+   */
+  std::map<std::string, TMethodStats> getStats() const;
+
+  /**
+   * Returns the number of live threads holding counters of their own.  The
+   * counters of a thread are folded into shared totals when it exits.
+   */
+  size_t getShardCount() const;
+
+private:
+  struct Shard;
+  struct State;
+  struct ShardOwner;
+
+  Shard* shard();
+
+  /// Adds the counters of a shard to stats; the caller holds the shard's mutex
+  static void collect(const Shard& shard, std::map<std::string, TMethodStats>& stats);
+
+  const uint64_t id_;
+
+  /*
+   * The shards of live threads and the totals of exited ones.  Threads
+   * hold on to it weakly, to retire their shard when they exit even if
+   * the handler has gone first.
+   */
+  std::shared_ptr<State> state_;
+};
+}
+}
+} // apache::thrift::processor
+
+#endif // #ifndef _THRIFT_PROCESSOR_TSTATSEVENTHANDLER_H_
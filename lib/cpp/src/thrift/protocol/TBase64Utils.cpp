@@ -19,6 +19,14 @@
 
 #include <thrift/protocol/TBase64Utils.h>
 
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(_M_X64)) && defined(__GNUC__)
+#define THRIFT_BASE64_SSSE3 1
+#define THRIFT_BASE64_AVX2 1
+#include <immintrin.h>
+#endif
+
 using std::string;
 
 namespace apache {
@@ -310,6 +318,263 @@ void base64_decode(uint8_t* buf, uint32_t len) {
     }
   }
 }
+
+namespace {
+
+// Encodes or decodes the leading whole blocks of in to out and returns how
+// many input bytes were consumed; the scalar loops below finish the rest.
+// The decoders stop early at a block holding a character outside the
+// base64 alphabet, leaving it to the scalar code.
+typedef uint32_t (*CodecFn)(const uint8_t* in, uint32_t len, uint8_t* out);
+
+struct Base64Kernels {
+  CodecFn encode;
+  CodecFn decode;
+};
+
+uint32_t encodeScalar(const uint8_t* in, uint32_t len, uint8_t* out) {
+  uint8_t* start = out;
+  for (; len >= 3; in += 3, len -= 3, out += 4) {
+    uint32_t group = (in[0] << 16) | (in[1] << 8) | in[2];
+    out[0] = kBase64EncodeTable[group >> 18];
+    out[1] = kBase64EncodeTable[(group >> 12) & 0x3f];
+    out[2] = kBase64EncodeTable[(group >> 6) & 0x3f];
+    out[3] = kBase64EncodeTable[group & 0x3f];
+  }
+  if (len > 0) {
+    base64_encode(in, len, out);
+    out += len + 1;
+  }
+  return static_cast<uint32_t>(out - start);
+}
+
+uint32_t decodeScalar(const uint8_t* in, uint32_t len, uint8_t* out) {
+  uint8_t* start = out;
+  for (; len >= 4; in += 4, len -= 4, out += 3) {
+    // read the whole group before writing, out may trail in
+    uint32_t group = (kBase64DecodeTable[in[0]] << 18) | (kBase64DecodeTable[in[1]] << 12)
+                     | (kBase64DecodeTable[in[2]] << 6) | kBase64DecodeTable[in[3]];
+    out[0] = static_cast<uint8_t>(group >> 16);
+    out[1] = static_cast<uint8_t>(group >> 8);
+    out[2] = static_cast<uint8_t>(group);
+  }
+  if (len > 1) {
+    uint8_t tail[4] = {in[0], in[1], len > 2 ? in[2] : uint8_t(0), 0};
+    base64_decode(tail, len);
+    memcpy(out, tail, len - 1);
+    out += len - 1;
+  }
+  return static_cast<uint32_t>(out - start);
+}
+
+#ifdef THRIFT_BASE64_SSSE3
+
+// The vector kernels follow Wojciech Mula and Daniel Lemire, "Faster Base64
+// Encoding and Decoding Using AVX2 Instructions".  Encoding spreads each
+// three bytes over four, splits them into 6-bit indices with two multiplies
+// and maps the indices to characters by adding an offset looked up by
+// range.  Decoding validates characters with two nibble lookups, turns them
+// back into 6-bit values the same way and packs those with multiply-adds.
+
+__attribute__((target("ssse3"))) inline __m128i encodeIndices(__m128i in) {
+  // every three bytes a b c become the four bytes b a c b
+  in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+  __m128i hi = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)),
+                               _mm_set1_epi32(0x04000040));
+  __m128i lo = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)),
+                               _mm_set1_epi32(0x01000010));
+  return _mm_or_si128(hi, lo);
+}
+
+__attribute__((target("ssse3"))) inline __m128i encodeCharacters(__m128i indices) {
+  // 0: a-z, 1-10: 0-9, 11: +, 12: /, 13: A-Z
+  const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                        '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+  __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+  range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+  return _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, range));
+}
+
+__attribute__((target("ssse3"))) uint32_t encodeSsse3(const uint8_t* in,
+                                                      uint32_t len,
+                                                      uint8_t* out) {
+  uint32_t done = 0;
+  // loads 16 bytes for every 12 encoded
+  for (; len - done >= 16; done += 12, out += 16) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), encodeCharacters(encodeIndices(bytes)));
+  }
+  return done;
+}
+
+// Returns the 6-bit values of the characters in in, or sets *valid to false
+__attribute__((target("ssse3"))) inline __m128i decodeValues(__m128i in, bool* valid) {
+  // each character's low nibble and high nibble select a set of bits; they
+  // share one only when the character is outside the alphabet
+  const __m128i lowBits = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                        0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+  const __m128i highBits = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10,
+                                         0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  // offset back to 6-bit values, by high nibble, with '/' moved to 1
+  const __m128i offsets
+      = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  __m128i high = _mm_and_si128(_mm_srli_epi32(in, 4), nibble);
+  __m128i low = _mm_and_si128(in, nibble);
+  __m128i invalid = _mm_and_si128(_mm_shuffle_epi8(lowBits, low), _mm_shuffle_epi8(highBits, high));
+  *valid = _mm_movemask_epi8(_mm_cmpeq_epi8(invalid, _mm_setzero_si128())) == 0xffff;
+  __m128i slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+  return _mm_add_epi8(in, _mm_shuffle_epi8(offsets, _mm_add_epi8(slash, high)));
+}
+
+// Packs 6-bit values into 12 bytes at the start of the result
+__attribute__((target("ssse3"))) inline __m128i decodePack(__m128i values) {
+  __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+  __m128i words = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+  return _mm_shuffle_epi8(words,
+                          _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+__attribute__((target("ssse3"))) uint32_t decodeSsse3(const uint8_t* in,
+                                                      uint32_t len,
+                                                      uint8_t* out) {
+  uint32_t done = 0;
+  // stores 16 bytes for every 12 decoded, so stop while there is room for
+  // the extra four in what the rest of in decodes to
+  for (; len - done >= 24; done += 16, out += 12) {
+    bool valid;
+    __m128i values
+        = decodeValues(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done)), &valid);
+    if (!valid) {
+      break;
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), decodePack(values));
+  }
+  return done;
+}
+
+#endif // THRIFT_BASE64_SSSE3
+
+#ifdef THRIFT_BASE64_AVX2
+
+__attribute__((target("avx2"))) uint32_t encodeAvx2(const uint8_t* in,
+                                                    uint32_t len,
+                                                    uint8_t* out) {
+  const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                          1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+  const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                                           'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  uint32_t done = 0;
+  // each lane loads 16 bytes and encodes 12 of them
+  for (; len - done >= 28; done += 24, out += 32) {
+    __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done));
+    __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done + 12));
+    __m256i bytes = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+    bytes = _mm256_shuffle_epi8(bytes, spread);
+    __m256i indices
+        = _mm256_or_si256(_mm256_mulhi_epu16(_mm256_and_si256(bytes,
+                                                              _mm256_set1_epi32(0x0fc0fc00)),
+                                             _mm256_set1_epi32(0x04000040)),
+                          _mm256_mullo_epi16(_mm256_and_si256(bytes,
+                                                              _mm256_set1_epi32(0x003f03f0)),
+                                             _mm256_set1_epi32(0x01000010)));
+    __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+    range = _mm256_or_si256(range, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out),
+                        _mm256_add_epi8(indices, _mm256_shuffle_epi8(offsets, range)));
+  }
+  // finish off with the narrower kernel, clearing the upper halves of the
+  // registers first so its SSE instructions do not stall on them
+  _mm256_zeroupper();
+  return done + encodeSsse3(in + done, len - done, out);
+}
+
+__attribute__((target("avx2"))) uint32_t decodeAvx2(const uint8_t* in,
+                                                    uint32_t len,
+                                                    uint8_t* out) {
+  const __m256i lowBits = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                           0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+                                           0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                           0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+  const __m256i highBits = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m256i offsets = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0,
+                                           0, 0, 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0,
+                                           0, 0, 0, 0);
+  const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  uint32_t done = 0;
+  // stores 32 bytes for every 24 decoded
+  for (; len - done >= 48; done += 32, out += 24) {
+    __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + done));
+    __m256i high = _mm256_and_si256(_mm256_srli_epi32(chars, 4), nibble);
+    __m256i low = _mm256_and_si256(chars, nibble);
+    if (!_mm256_testz_si256(_mm256_shuffle_epi8(lowBits, low),
+                            _mm256_shuffle_epi8(highBits, high))) {
+      break;
+    }
+    __m256i slash = _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('/'));
+    __m256i values
+        = _mm256_add_epi8(chars, _mm256_shuffle_epi8(offsets, _mm256_add_epi8(slash, high)));
+    __m256i pairs = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+    __m256i words = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+    __m256i bytes = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(words, pack),
+                                                _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), bytes);
+  }
+  _mm256_zeroupper();
+  return done + decodeSsse3(in + done, len - done, out);
+}
+
+#endif // THRIFT_BASE64_AVX2
+
+uint32_t noKernel(const uint8_t*, uint32_t, uint8_t*) {
+  return 0;
+}
+
+Base64Kernels selectKernels() {
+  Base64Kernels kernels = {noKernel, noKernel};
+#ifdef THRIFT_BASE64_SSSE3
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("ssse3")) {
+    kernels.encode = encodeSsse3;
+    kernels.decode = decodeSsse3;
+  }
+#endif
+#ifdef THRIFT_BASE64_AVX2
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.encode = encodeAvx2;
+    kernels.decode = decodeAvx2;
+  }
+#endif
+  return kernels;
+}
+
+const Base64Kernels& kernels() {
+  static const Base64Kernels selected = selectKernels();
+  return selected;
+}
+}
+
+uint32_t base64_encode_bulk(const uint8_t* in, uint32_t len, uint8_t* out) {
+  uint32_t done = kernels().encode(in, len, out);
+  return done / 3 * 4 + encodeScalar(in + done, len - done, out + done / 3 * 4);
+}
+
+uint32_t base64_decode_bulk(const uint8_t* in, uint32_t len, uint8_t* out) {
+  uint32_t done = kernels().decode(in, len, out);
+  return done / 4 * 3 + decodeScalar(in + done, len - done, out + done / 4 * 3);
+}
 }
 }
 } // apache::thrift::protocol
@@ -38,6 +38,29 @@ void base64_encode(const uint8_t* in, uint32_t len, uint8_t* buf);
 // len is number of bytes to consume from input (must be 2, 3, or 4)
 // no '=' padding should be included in the input
 void base64_decode(uint8_t* buf, uint32_t len);
+
+// Returns the number of characters base64_encode_bulk() produces for len
+// bytes: four per three bytes, plus two or three for a remainder of one or
+// two bytes
+inline uint32_t base64_encoded_size(uint32_t len) {
+  return len / 3 * 4 + (len % 3 == 0 ? 0 : len % 3 + 1);
+}
+
+// The bulk functions below work through whole fields; they pick an SSSE3 or
+// AVX2 kernel at runtime where the CPU has one, and fall back to portable
+// code elsewhere.
+
+// Encodes len bytes from in to out, which must have room for
+// base64_encoded_size(len) characters.  Without '=' padding, like
+// base64_encode().  Returns the number of characters written.
+uint32_t base64_encode_bulk(const uint8_t* in, uint32_t len, uint8_t* out);
+
+// Decodes len base64 characters (without '=' padding) from in to out, which
+// must have room for len * 3 / 4 bytes and may be the same as in.  A single
+// leftover character is ignored, and characters outside the base64 alphabet
+// decode the same as with base64_decode().  Returns the number of bytes
+// written.
+uint32_t base64_decode_bulk(const uint8_t* in, uint32_t len, uint8_t* out);
 }
 }
 } // apache::thrift::protocol
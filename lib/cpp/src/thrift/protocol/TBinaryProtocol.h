@@ -61,13 +61,20 @@ public:
       strict_read_(strict_read),
       strict_write_(strict_write) {}
 
-  void setStringSizeLimit(int32_t string_limit) { string_limit_ = string_limit; }
+  void setStringSizeLimit(int32_t string_limit) {
+    string_limit_ = string_limit;
+    this->renewGeneration();
+  }
 
-  void setContainerSizeLimit(int32_t container_limit) { container_limit_ = container_limit; }
+  void setContainerSizeLimit(int32_t container_limit) {
+    container_limit_ = container_limit;
+    this->renewGeneration();
+  }
 
   void setStrict(bool strict_read, bool strict_write) {
     strict_read_ = strict_read;
     strict_write_ = strict_write;
+    this->renewGeneration();
   }
 
   /**
@@ -119,8 +126,18 @@ public:
 
   inline uint32_t writeBinary(const std::string& str);
 
+  inline uint32_t writeBinary(const TArenaString& str);
+
   inline uint32_t writeUUID(const TUuid& uuid);
 
+  inline uint32_t writeI16Array(const int16_t* values, uint32_t count);
+
+  inline uint32_t writeI32Array(const int32_t* values, uint32_t count);
+
+  inline uint32_t writeI64Array(const int64_t* values, uint32_t count);
+
+  inline uint32_t writeDoubleArray(const double* values, uint32_t count);
+
   /**
    * Reading functions
    */
@@ -168,10 +185,28 @@ public:
 
   inline uint32_t readBinary(std::string& str);
 
+  inline uint32_t readBinary(TArenaString& str);
+
   inline uint32_t readUUID(TUuid& uuid);
 
+  inline uint32_t readI16Array(int16_t* values, uint32_t count);
+
+  inline uint32_t readI32Array(int32_t* values, uint32_t count);
+
+  inline uint32_t readI64Array(int64_t* values, uint32_t count);
+
+  inline uint32_t readDoubleArray(double* values, uint32_t count);
+
   int getMinSerializedSize(TType type) override;
 
+  std::shared_ptr<TProtocol> cloneForTransport(std::shared_ptr<TTransport> trans) const override {
+    return std::make_shared<TBinaryProtocolT<TTransport, ByteOrder_> >(trans,
+                                                                       string_limit_,
+                                                                       container_limit_,
+                                                                       strict_read_,
+                                                                       strict_write_);
+  }
+
   void checkReadBytesAvailable(TSet& set) override
   {
       trans_->checkReadBytesAvailable(set.size_ * getMinSerializedSize(set.elemType_));
@@ -188,10 +223,24 @@ public:
       trans_->checkReadBytesAvailable(map.size_ * elmSize);
   }
 
+  uint32_t writeArenaString_virt(const TArenaString& str) override { return writeString(str); }
+
+  uint32_t writeArenaBinary_virt(const TArenaString& str) override { return writeBinary(str); }
+
+  uint32_t readArenaString_virt(TArenaString& str) override { return readString(str); }
+
+  uint32_t readArenaBinary_virt(TArenaString& str) override { return readBinary(str); }
+
 protected:
   template <typename StrType>
   uint32_t readStringBody(StrType& str, int32_t sz);
 
+  template <typename T>
+  uint32_t writeFixedArray(const T* values, uint32_t count);
+
+  template <typename T>
+  uint32_t readFixedArray(T* values, uint32_t count);
+
   Transport_* trans_;
 
   int32_t string_limit_;
@@ -21,6 +21,7 @@
 #define _THRIFT_PROTOCOL_TBINARYPROTOCOL_TCC_ 1
 
 #include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TByteSwapUtils.h>
 #include <thrift/transport/TTransportException.h>
 
 #include <limits>
@@ -183,7 +184,7 @@ uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeString(const StrType& st
   auto size = static_cast<uint32_t>(str.size());
   uint32_t result = writeI32((int32_t)size);
   if (size > 0) {
-    this->trans_->write((uint8_t*)str.data(), size);
+    this->trans_->writeReference((uint8_t*)str.data(), size);
   }
   return result + size;
 }
@@ -193,6 +194,11 @@ uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeBinary(const std::string
   return TBinaryProtocolT<Transport_, ByteOrder_>::writeString(str);
 }
 
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeBinary(const TArenaString& str) {
+  return TBinaryProtocolT<Transport_, ByteOrder_>::writeString(str);
+}
+
 template <class Transport_, class ByteOrder_>
 uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeUUID(const TUuid& uuid) {
   // TODO: Consider endian swapping, see lib/delphi/src/Thrift.Utils.pas:377
@@ -200,6 +206,30 @@ uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeUUID(const TUuid& uuid)
   return 16;
 }
 
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeI16Array(const int16_t* values,
+                                                                 uint32_t count) {
+  return writeFixedArray(values, count);
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeI32Array(const int32_t* values,
+                                                                 uint32_t count) {
+  return writeFixedArray(values, count);
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeI64Array(const int64_t* values,
+                                                                 uint32_t count) {
+  return writeFixedArray(values, count);
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeDoubleArray(const double* values,
+                                                                    uint32_t count) {
+  return writeFixedArray(values, count);
+}
+
 /**
  * Reading functions
  */
@@ -435,12 +465,86 @@ uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readBinary(std::string& str)
   return TBinaryProtocolT<Transport_, ByteOrder_>::readString(str);
 }
 
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readBinary(TArenaString& str) {
+  return TBinaryProtocolT<Transport_, ByteOrder_>::readString(str);
+}
+
 template <class Transport_, class ByteOrder_>
 uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readUUID(TUuid& uuid) {
   this->trans_->readAll(uuid.begin(), uuid.size());
   return 16;
 }
 
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readI16Array(int16_t* values, uint32_t count) {
+  return readFixedArray(values, count);
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readI32Array(int32_t* values, uint32_t count) {
+  return readFixedArray(values, count);
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readI64Array(int64_t* values, uint32_t count) {
+  return readFixedArray(values, count);
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readDoubleArray(double* values, uint32_t count) {
+  return readFixedArray(values, count);
+}
+
+/**
+ * List elements of a fixed width type are laid out on the wire just as they
+ * are in memory, apart from the byte order.  So they go to and from the
+ * transport in one piece and, when the wire order differs from the host's,
+ * get byte swapped as a whole.
+ */
+template <class Transport_, class ByteOrder_>
+template <typename T>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeFixedArray(const T* values,
+                                                                   uint32_t count) {
+  static_assert(std::numeric_limits<T>::is_iec559 || std::numeric_limits<T>::is_integer,
+                "only integers and IEEE 754 floating point go over the wire as is");
+  if (count > (std::numeric_limits<uint32_t>::max)() / sizeof(T)) {
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  }
+  auto size = static_cast<uint32_t>(count * sizeof(T));
+  if (ByteOrder_::toWire16(1) == 1) {
+    this->trans_->write(reinterpret_cast<const uint8_t*>(values), size);
+    return size;
+  }
+
+  uint8_t buf[4096];
+  const uint32_t chunk = sizeof(buf) / sizeof(T);
+  while (count > 0) {
+    uint32_t n = count < chunk ? count : chunk;
+    byte_swap(values, buf, n, sizeof(T));
+    this->trans_->write(buf, n * static_cast<uint32_t>(sizeof(T)));
+    values += n;
+    count -= n;
+  }
+  return size;
+}
+
+template <class Transport_, class ByteOrder_>
+template <typename T>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readFixedArray(T* values, uint32_t count) {
+  static_assert(std::numeric_limits<T>::is_iec559 || std::numeric_limits<T>::is_integer,
+                "only integers and IEEE 754 floating point go over the wire as is");
+  if (count > (std::numeric_limits<uint32_t>::max)() / sizeof(T)) {
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  }
+  auto size = static_cast<uint32_t>(count * sizeof(T));
+  this->trans_->readAll(reinterpret_cast<uint8_t*>(values), size);
+  if (ByteOrder_::toWire16(1) != 1) {
+    byte_swap(values, values, count, sizeof(T));
+  }
+  return size;
+}
+
 template <class Transport_, class ByteOrder_>
 template <typename StrType>
 uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readStringBody(StrType& str, int32_t size) {
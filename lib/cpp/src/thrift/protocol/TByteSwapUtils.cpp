@@ -0,0 +1,218 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/protocol/TByteSwapUtils.h>
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define THRIFT_BYTESWAP_SSE2 1
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define THRIFT_BYTESWAP_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+#if defined(_MSC_VER)
+#include <stdlib.h>
+#endif
+
+namespace apache {
+namespace thrift {
+namespace protocol {
+
+namespace {
+
+typedef void (*SwapFn)(const uint8_t* in, uint8_t* out, uint32_t count);
+
+struct SwapKernels {
+  SwapFn swap16;
+  SwapFn swap32;
+  SwapFn swap64;
+};
+
+inline uint16_t swap(uint16_t n) {
+  return static_cast<uint16_t>((n >> 8) | (n << 8));
+}
+
+inline uint32_t swap(uint32_t n) {
+#if defined(__GNUC__)
+  return __builtin_bswap32(n);
+#elif defined(_MSC_VER)
+  return _byteswap_ulong(n);
+#else
+  return (n >> 24) | ((n >> 8) & 0xff00) | ((n << 8) & 0xff0000) | (n << 24);
+#endif
+}
+
+inline uint64_t swap(uint64_t n) {
+#if defined(__GNUC__)
+  return __builtin_bswap64(n);
+#elif defined(_MSC_VER)
+  return _byteswap_uint64(n);
+#else
+  return (static_cast<uint64_t>(swap(static_cast<uint32_t>(n))) << 32)
+         | swap(static_cast<uint32_t>(n >> 32));
+#endif
+}
+
+// memcpy keeps unaligned buffers (e.g. transport memory) well defined
+template <typename T>
+void swapScalar(const uint8_t* in, uint8_t* out, uint32_t count) {
+  for (uint32_t i = 0; i < count; ++i) {
+    T value;
+    memcpy(&value, in + i * sizeof(T), sizeof(T));
+    value = swap(value);
+    memcpy(out + i * sizeof(T), &value, sizeof(T));
+  }
+}
+
+#ifdef THRIFT_BYTESWAP_SSE2
+
+inline __m128i swapBytesInWords(__m128i v) {
+  return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+template <typename T, __m128i (*Swap)(__m128i)>
+void swapSse2(const uint8_t* in, uint8_t* out, uint32_t count) {
+  const uint32_t perVector = 16 / sizeof(T);
+  uint32_t i = 0;
+  for (; i + perVector <= count; i += perVector) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * sizeof(T)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * sizeof(T)), Swap(v));
+  }
+  swapScalar<T>(in + i * sizeof(T), out + i * sizeof(T), count - i);
+}
+
+__m128i swapVector16(__m128i v) {
+  return swapBytesInWords(v);
+}
+
+__m128i swapVector32(__m128i v) {
+  v = swapBytesInWords(v);
+  v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+  return _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+}
+
+__m128i swapVector64(__m128i v) {
+  v = swapBytesInWords(v);
+  v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+  return _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+#endif // THRIFT_BYTESWAP_SSE2
+
+#ifdef THRIFT_BYTESWAP_AVX2
+
+// byte shuffles reversing each value within both 128 bit lanes; the tag
+// argument selects the value width
+__attribute__((target("avx2"))) inline __m256i swapOrder(uint16_t) {
+  return _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                          1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+}
+
+__attribute__((target("avx2"))) inline __m256i swapOrder(uint32_t) {
+  return _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                          3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+}
+
+__attribute__((target("avx2"))) inline __m256i swapOrder(uint64_t) {
+  return _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                          7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+}
+
+template <typename T>
+__attribute__((target("avx2"))) void swapAvx2(const uint8_t* in, uint8_t* out, uint32_t count) {
+  const __m256i shuffle = swapOrder(T());
+  const uint32_t perVector = 32 / sizeof(T);
+  uint32_t i = 0;
+  for (; i + 2 * perVector <= count; i += 2 * perVector) {
+    const __m256i* src = reinterpret_cast<const __m256i*>(in + i * sizeof(T));
+    __m256i* dst = reinterpret_cast<__m256i*>(out + i * sizeof(T));
+    __m256i a = _mm256_loadu_si256(src);
+    __m256i b = _mm256_loadu_si256(src + 1);
+    _mm256_storeu_si256(dst, _mm256_shuffle_epi8(a, shuffle));
+    _mm256_storeu_si256(dst + 1, _mm256_shuffle_epi8(b, shuffle));
+  }
+  for (; i + perVector <= count; i += perVector) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i * sizeof(T)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i * sizeof(T)),
+                        _mm256_shuffle_epi8(v, shuffle));
+  }
+  swapScalar<T>(in + i * sizeof(T), out + i * sizeof(T), count - i);
+}
+
+#endif // THRIFT_BYTESWAP_AVX2
+
+SwapKernels selectKernels() {
+  SwapKernels kernels = {swapScalar<uint16_t>, swapScalar<uint32_t>, swapScalar<uint64_t>};
+#ifdef THRIFT_BYTESWAP_SSE2
+  kernels.swap16 = swapSse2<uint16_t, swapVector16>;
+  kernels.swap32 = swapSse2<uint32_t, swapVector32>;
+  kernels.swap64 = swapSse2<uint64_t, swapVector64>;
+#endif
+#ifdef THRIFT_BYTESWAP_AVX2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.swap16 = swapAvx2<uint16_t>;
+    kernels.swap32 = swapAvx2<uint32_t>;
+    kernels.swap64 = swapAvx2<uint64_t>;
+  }
+#endif
+  return kernels;
+}
+
+const SwapKernels& kernels() {
+  static const SwapKernels selected = selectKernels();
+  return selected;
+}
+}
+
+void byte_swap_16(const void* in, void* out, uint32_t count) {
+  kernels().swap16(static_cast<const uint8_t*>(in), static_cast<uint8_t*>(out), count);
+}
+
+void byte_swap_32(const void* in, void* out, uint32_t count) {
+  kernels().swap32(static_cast<const uint8_t*>(in), static_cast<uint8_t*>(out), count);
+}
+
+void byte_swap_64(const void* in, void* out, uint32_t count) {
+  kernels().swap64(static_cast<const uint8_t*>(in), static_cast<uint8_t*>(out), count);
+}
+
+void byte_swap(const void* in, void* out, uint32_t count, uint32_t width) {
+  switch (width) {
+  case 2:
+    byte_swap_16(in, out, count);
+    break;
+  case 4:
+    byte_swap_32(in, out, count);
+    break;
+  case 8:
+    byte_swap_64(in, out, count);
+    break;
+  default:
+    memmove(out, in, static_cast<size_t>(count) * width);
+    break;
+  }
+}
+}
+}
+} // apache::thrift::protocol
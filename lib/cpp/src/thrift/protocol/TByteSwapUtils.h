@@ -0,0 +1,48 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_PROTOCOL_TBYTESWAPUTILS_H_
+#define _THRIFT_PROTOCOL_TBYTESWAPUTILS_H_
+
+#include <stdint.h>
+
+namespace apache {
+namespace thrift {
+namespace protocol {
+
+/*
+ * Byte swapping of whole arrays, used by the protocols to convert lists of
+ * fixed width numbers between host and wire order.  Like TVarintUtils, the
+ * x86-64 build picks an SSE2 or AVX2 kernel at runtime.
+ */
+
+// reverses the bytes of each of the count 2, 4 or 8 byte values at in and
+// stores the results at out
+// in and out may be the same buffer, but must not otherwise overlap
+void byte_swap_16(const void* in, void* out, uint32_t count);
+void byte_swap_32(const void* in, void* out, uint32_t count);
+void byte_swap_64(const void* in, void* out, uint32_t count);
+
+// one of the above, chosen by width (2, 4 or 8)
+void byte_swap(const void* in, void* out, uint32_t count, uint32_t width);
+}
+}
+} // apache::thrift::protocol
+
+#endif // #define _THRIFT_PROTOCOL_TBYTESWAPUTILS_H_
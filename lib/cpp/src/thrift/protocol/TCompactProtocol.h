@@ -138,12 +138,26 @@ public:
 
   uint32_t writeString(const std::string& str);
 
+  uint32_t writeString(const TArenaString& str);
+
   uint32_t writeBinary(const std::string& str);
 
+  uint32_t writeBinary(const TArenaString& str);
+
   uint32_t writeUUID(const TUuid& str);
 
+  uint32_t writeI32Array(const int32_t* values, uint32_t count);
+
+  uint32_t writeI64Array(const int64_t* values, uint32_t count);
+
+  uint32_t writeDoubleArray(const double* values, uint32_t count);
+
   int getMinSerializedSize(TType type) override;
 
+  std::shared_ptr<TProtocol> cloneForTransport(std::shared_ptr<TTransport> trans) const override {
+    return std::make_shared<TCompactProtocolT<TTransport> >(trans, string_limit_, container_limit_);
+  }
+
   void checkReadBytesAvailable(TSet& set) override
   {
       trans_->checkReadBytesAvailable(set.size_ * getMinSerializedSize(set.elemType_));
@@ -213,8 +227,26 @@ public:
 
   uint32_t readString(std::string& str);
 
+  uint32_t readString(TArenaString& str);
+
   uint32_t readBinary(std::string& str);
 
+  uint32_t readBinary(TArenaString& str);
+
+  uint32_t writeArenaString_virt(const TArenaString& str) override { return writeString(str); }
+
+  uint32_t writeArenaBinary_virt(const TArenaString& str) override { return writeBinary(str); }
+
+  uint32_t readArenaString_virt(TArenaString& str) override { return readString(str); }
+
+  uint32_t readArenaBinary_virt(TArenaString& str) override { return readBinary(str); }
+
+  uint32_t readI32Array(int32_t* values, uint32_t count);
+
+  uint32_t readI64Array(int64_t* values, uint32_t count);
+
+  uint32_t readDoubleArray(double* values, uint32_t count);
+
   uint32_t readUUID(TUuid& str);
 
   /*
@@ -228,6 +260,11 @@ public:
   uint32_t readSetEnd() { return 0; }
 
 protected:
+  template <typename StrType>
+  uint32_t writeBinaryBody(const StrType& str);
+  template <typename StrType>
+  uint32_t readBinaryBody(StrType& str);
+
   uint32_t readVarint32(int32_t& i32);
   uint32_t readVarint64(int64_t& i64);
   int32_t zigzagToI32(uint32_t n);
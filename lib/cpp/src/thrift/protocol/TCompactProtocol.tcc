@@ -23,6 +23,8 @@
 #include <cstdlib>
 
 #include "thrift/config.h"
+#include <thrift/protocol/TByteSwapUtils.h>
+#include <thrift/protocol/TVarintUtils.h>
 
 /*
  * TCompactProtocol::i*ToZigzag depend on the fact that the right shift
@@ -273,8 +275,24 @@ uint32_t TCompactProtocolT<Transport_>::writeString(const std::string& str) {
   return writeBinary(str);
 }
 
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeString(const TArenaString& str) {
+  return writeBinary(str);
+}
+
 template <class Transport_>
 uint32_t TCompactProtocolT<Transport_>::writeBinary(const std::string& str) {
+  return writeBinaryBody(str);
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeBinary(const TArenaString& str) {
+  return writeBinaryBody(str);
+}
+
+template <class Transport_>
+template <typename StrType>
+uint32_t TCompactProtocolT<Transport_>::writeBinaryBody(const StrType& str) {
   if(str.size() > (std::numeric_limits<uint32_t>::max)())
     throw TProtocolException(TProtocolException::SIZE_LIMIT);
   auto ssize = static_cast<uint32_t>(str.size());
@@ -284,7 +302,7 @@ uint32_t TCompactProtocolT<Transport_>::writeBinary(const std::string& str) {
   if(ssize > (std::numeric_limits<uint32_t>::max)() - wsize)
     throw TProtocolException(TProtocolException::SIZE_LIMIT);
   wsize += ssize;
-  trans_->write(reinterpret_cast<const uint8_t*>(str.data()), ssize);
+  trans_->writeReference(reinterpret_cast<const uint8_t*>(str.data()), ssize);
   return wsize;
 }
 
@@ -297,6 +315,75 @@ uint32_t TCompactProtocolT<Transport_>::writeUUID(const TUuid& uuid) {
   return uuid.size();
 }
 
+/**
+ * Write the elements of a list of i32s.  They are encoded a chunk at a time
+ * into a local buffer, so the transport sees one write per chunk instead of
+ * one per element.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeI32Array(const int32_t* values, uint32_t count) {
+  const uint32_t chunk = 256;
+  uint8_t buf[chunk * VARINT32_MAX_BYTES + VARINT_ENCODE_SLACK];
+  uint32_t wsize = 0;
+  while (count > 0) {
+    uint32_t n = count < chunk ? count : chunk;
+    uint32_t size = varint_encode_zigzag32(values, n, buf);
+    trans_->write(buf, size);
+    wsize += size;
+    values += n;
+    count -= n;
+  }
+  return wsize;
+}
+
+/**
+ * Write the elements of a list of i64s, see writeI32Array().
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeI64Array(const int64_t* values, uint32_t count) {
+  const uint32_t chunk = 256;
+  uint8_t buf[chunk * VARINT64_MAX_BYTES + VARINT_ENCODE_SLACK];
+  uint32_t wsize = 0;
+  while (count > 0) {
+    uint32_t n = count < chunk ? count : chunk;
+    uint32_t size = varint_encode_zigzag64(values, n, buf);
+    trans_->write(buf, size);
+    wsize += size;
+    values += n;
+    count -= n;
+  }
+  return wsize;
+}
+
+/**
+ * Write the elements of a list of doubles.  These are fixed width little
+ * endian, so on little endian hosts the array is written as is.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeDoubleArray(const double* values, uint32_t count) {
+  static_assert(std::numeric_limits<double>::is_iec559, "std::numeric_limits<double>::is_iec559");
+
+  if (count > (std::numeric_limits<uint32_t>::max)() / 8) {
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  }
+  uint32_t wsize = count * 8;
+  if (THRIFT_htolell(static_cast<uint64_t>(1)) == 1) {
+    trans_->write(reinterpret_cast<const uint8_t*>(values), wsize);
+    return wsize;
+  }
+
+  const uint32_t chunk = 512;
+  uint8_t buf[chunk * 8];
+  while (count > 0) {
+    uint32_t n = count < chunk ? count : chunk;
+    byte_swap_64(values, buf, n);
+    trans_->write(buf, n * 8);
+    values += n;
+    count -= n;
+  }
+  return wsize;
+}
+
 //
 // Internal Writing methods
 //
@@ -689,11 +776,27 @@ uint32_t TCompactProtocolT<Transport_>::readString(std::string& str) {
   return readBinary(str);
 }
 
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readString(TArenaString& str) {
+  return readBinary(str);
+}
+
 /**
  * Read a byte[] from the wire.
  */
 template <class Transport_>
 uint32_t TCompactProtocolT<Transport_>::readBinary(std::string& str) {
+  return readBinaryBody(str);
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readBinary(TArenaString& str) {
+  return readBinaryBody(str);
+}
+
+template <class Transport_>
+template <typename StrType>
+uint32_t TCompactProtocolT<Transport_>::readBinaryBody(StrType& str) {
   int32_t rsize = 0;
   int32_t size;
 
@@ -739,6 +842,76 @@ uint32_t TCompactProtocolT<Transport_>::readUUID(TUuid& uuid) {
   return trans_->readAll(uuid.begin(), uuid.size());
 }
 
+/**
+ * Read the elements of a list of i32s.  Whatever the transport lets us
+ * borrow is decoded in bulk; an element cut off by the end of the borrowed
+ * data (or a transport that cannot lend its buffer) goes through readI32().
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readI32Array(int32_t* values, uint32_t count) {
+  uint32_t rsize = 0;
+  uint32_t i = 0;
+  while (i < count) {
+    uint32_t avail = 1;
+    const uint8_t* borrowed = trans_->borrow(nullptr, &avail);
+    if (borrowed != nullptr) {
+      uint32_t decoded = 0;
+      uint32_t size = varint_decode_zigzag32(borrowed, avail, values + i, count - i, &decoded);
+      if (decoded > 0) {
+        trans_->consume(size);
+        rsize += size;
+        i += decoded;
+        continue;
+      }
+    }
+    rsize += readI32(values[i++]);
+  }
+  return rsize;
+}
+
+/**
+ * Read the elements of a list of i64s, see readI32Array().
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readI64Array(int64_t* values, uint32_t count) {
+  uint32_t rsize = 0;
+  uint32_t i = 0;
+  while (i < count) {
+    uint32_t avail = 1;
+    const uint8_t* borrowed = trans_->borrow(nullptr, &avail);
+    if (borrowed != nullptr) {
+      uint32_t decoded = 0;
+      uint32_t size = varint_decode_zigzag64(borrowed, avail, values + i, count - i, &decoded);
+      if (decoded > 0) {
+        trans_->consume(size);
+        rsize += size;
+        i += decoded;
+        continue;
+      }
+    }
+    rsize += readI64(values[i++]);
+  }
+  return rsize;
+}
+
+/**
+ * Read the elements of a list of doubles, see writeDoubleArray().
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readDoubleArray(double* values, uint32_t count) {
+  static_assert(std::numeric_limits<double>::is_iec559, "std::numeric_limits<double>::is_iec559");
+
+  if (count > (std::numeric_limits<uint32_t>::max)() / 8) {
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  }
+  uint32_t rsize = count * 8;
+  trans_->readAll(reinterpret_cast<uint8_t*>(values), rsize);
+  if (THRIFT_letohll(static_cast<uint64_t>(1)) != 1) {
+    byte_swap_64(values, values, count);
+  }
+  return rsize;
+}
+
 /**
  * Read an i32 from the wire as a varint. The MSB of each byte is set
  * if there is another byte to follow. This can read up to 5 bytes.
@@ -137,6 +137,22 @@ public:
 
   uint32_t writeUUID(const TUuid& uuid);
 
+  uint32_t writeI16Array(const int16_t* values, uint32_t count) {
+    return proto_->writeI16Array(values, count);
+  }
+
+  uint32_t writeI32Array(const int32_t* values, uint32_t count) {
+    return proto_->writeI32Array(values, count);
+  }
+
+  uint32_t writeI64Array(const int64_t* values, uint32_t count) {
+    return proto_->writeI64Array(values, count);
+  }
+
+  uint32_t writeDoubleArray(const double* values, uint32_t count) {
+    return proto_->writeDoubleArray(values, count);
+  }
+
   /**
    * Reading functions
    */
@@ -185,6 +201,22 @@ public:
 
   uint32_t readUUID(TUuid& uuid);
 
+  uint32_t readI16Array(int16_t* values, uint32_t count) {
+    return proto_->readI16Array(values, count);
+  }
+
+  uint32_t readI32Array(int32_t* values, uint32_t count) {
+    return proto_->readI32Array(values, count);
+  }
+
+  uint32_t readI64Array(int64_t* values, uint32_t count) {
+    return proto_->readI64Array(values, count);
+  }
+
+  uint32_t readDoubleArray(double* values, uint32_t count) {
+    return proto_->readDoubleArray(values, count);
+  }
+
 protected:
   std::shared_ptr<THeaderTransport> trans_;
 
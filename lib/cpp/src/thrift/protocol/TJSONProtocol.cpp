@@ -22,10 +22,24 @@
 #include <boost/locale.hpp>
 
 #include <cmath>
+#include <cstring>
 #include <limits>
 #include <locale>
 #include <sstream>
 #include <stdexcept>
+#include <type_traits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// std::to_chars and std::from_chars for double, where the standard library
+// has them
+#if defined(__has_include) && (__cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L))
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
 
 #include <thrift/protocol/TBase64Utils.h>
 #include <thrift/transport/TTransportException.h>
@@ -300,6 +314,114 @@ static bool isLowSurrogate(uint16_t val) {
   return val >= 0xDC00 && val <= 0xDFFF;
 }
 
+// Return the first character in [p, end) that a JSON string can't hold as
+// it is: '"', '\\' and, if Control, the control characters.  Strings are
+// mostly made of long runs of other characters, so this looks at 16 of
+// them at a time where SSE2 is available.
+template <bool Control>
+static const uint8_t* findJSONSpecialChar(const uint8_t* p, const uint8_t* end) {
+#ifdef __SSE2__
+  const __m128i quote = _mm_set1_epi8(static_cast<char>(kJSONStringDelimiter));
+  const __m128i backslash = _mm_set1_epi8(static_cast<char>(kJSONBackslash));
+  const __m128i lastControl = _mm_set1_epi8(0x1f);
+  while (end - p >= 16) {
+    __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i special = _mm_or_si128(_mm_cmpeq_epi8(chars, quote), _mm_cmpeq_epi8(chars, backslash));
+    if (Control) {
+      // unsigned chars <= 0x1f
+      special = _mm_or_si128(special, _mm_cmpeq_epi8(_mm_min_epu8(chars, lastControl), chars));
+    }
+    int mask = _mm_movemask_epi8(special);
+    if (mask != 0) {
+      return p + __builtin_ctz(static_cast<unsigned>(mask));
+    }
+    p += 16;
+  }
+#endif
+  for (; p != end; ++p) {
+    if (*p == kJSONStringDelimiter || *p == kJSONBackslash || (Control && *p < 0x20)) {
+      return p;
+    }
+  }
+  return end;
+}
+
+// Write the decimal digits of value so that they end just before end, and
+// return where they start.
+static char* formatDecimal(uint64_t value, char* end) {
+  static const char kDigitPairs[] =
+      "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+      "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+      "8081828384858687888990919293949596979899";
+  while (value >= 100) {
+    const char* pair = kDigitPairs + (value % 100) * 2;
+    value /= 100;
+    *--end = pair[1];
+    *--end = pair[0];
+  }
+  if (value >= 10) {
+    const char* pair = kDigitPairs + value * 2;
+    *--end = pair[1];
+    *--end = pair[0];
+  } else {
+    *--end = static_cast<char>('0' + value);
+  }
+  return end;
+}
+
+static char* formatInteger(uint64_t value, char* end) {
+  return formatDecimal(value, end);
+}
+
+static char* formatInteger(int64_t value, char* end) {
+  if (value >= 0) {
+    return formatDecimal(static_cast<uint64_t>(value), end);
+  }
+  char* begin = formatDecimal(0 - static_cast<uint64_t>(value), end);
+  *--begin = '-';
+  return begin;
+}
+
+// Parse str as a decimal integer the way std::istream does in the classic
+// locale, but without the stream: an optional sign followed by digits.  As
+// with std::istream, a '-' in front of an unsigned type wraps around.
+// Return false if str isn't such an integer or doesn't fit num.
+template <typename NumberType>
+static bool parseInteger(const std::string& str, NumberType& num) {
+  const char* p = str.data();
+  const char* end = p + str.size();
+  bool negative = false;
+  if (p != end && (*p == '-' || *p == '+')) {
+    negative = (*p++ == '-');
+  }
+  if (p == end) {
+    return false;
+  }
+  uint64_t value = 0;
+  for (; p != end; ++p) {
+    auto digit = static_cast<unsigned>(*p - '0');
+    if (digit > 9 || value > ((std::numeric_limits<uint64_t>::max)() - digit) / 10) {
+      return false;
+    }
+    value = value * 10 + digit;
+  }
+
+  const auto max = static_cast<uint64_t>((std::numeric_limits<NumberType>::max)());
+  if (std::numeric_limits<NumberType>::is_signed && negative) {
+    if (value > max + 1) {
+      return false;
+    }
+    // -(max + 1) can't be negated within NumberType
+    num = value == 0 ? 0 : static_cast<NumberType>(-static_cast<NumberType>(value - 1) - 1);
+  } else {
+    if (value > max) {
+      return false;
+    }
+    num = static_cast<NumberType>(negative ? 0 - value : value);
+  }
+  return true;
+}
+
 /**
  * Class to serve as base JSON context and as base class for other context
  * implementations
@@ -464,10 +586,20 @@ uint32_t TJSONProtocol::writeJSONString(const std::string& str) {
   uint32_t result = context_->write(*trans_);
   result += 2; // For quotes
   trans_->write(&kJSONStringDelimiter, 1);
-  std::string::const_iterator iter(str.begin());
-  std::string::const_iterator end(str.end());
-  while (iter != end) {
-    result += writeJSONChar(*iter++);
+  const auto* p = reinterpret_cast<const uint8_t*>(str.data());
+  const uint8_t* end = p + str.size();
+  while (p != end) {
+    // Write what needs no escaping in one go
+    const uint8_t* special = findJSONSpecialChar<true>(p, end);
+    if (special != p) {
+      auto len = static_cast<uint32_t>(special - p);
+      trans_->write(p, len);
+      result += len;
+      p = special;
+    }
+    if (p != end) {
+      result += writeJSONChar(*p++);
+    }
   }
   trans_->write(&kJSONStringDelimiter, 1);
   return result;
@@ -479,23 +611,20 @@ uint32_t TJSONProtocol::writeJSONBase64(const std::string& str) {
   uint32_t result = context_->write(*trans_);
   result += 2; // For quotes
   trans_->write(&kJSONStringDelimiter, 1);
-  uint8_t b[4];
   const auto* bytes = (const uint8_t*)str.c_str();
   if (str.length() > (std::numeric_limits<uint32_t>::max)())
     throw TProtocolException(TProtocolException::SIZE_LIMIT);
   auto len = static_cast<uint32_t>(str.length());
-  while (len >= 3) {
-    // Encode 3 bytes at a time
-    base64_encode(bytes, 3, b);
-    trans_->write(b, 4);
-    result += 4;
-    bytes += 3;
-    len -= 3;
-  }
-  if (len) { // Handle remainder
-    base64_encode(bytes, len, b);
-    trans_->write(b, len + 1);
-    result += len + 1;
+  // Encode a chunk at a time, so that large values take neither a write
+  // per 3 bytes nor a copy of their whole encoding
+  uint8_t b[4096];
+  while (len > 0) {
+    uint32_t chunk = (std::min)(len, static_cast<uint32_t>(sizeof(b) / 4 * 3));
+    uint32_t encoded = base64_encode_bulk(bytes, chunk, b);
+    trans_->write(b, encoded);
+    result += encoded;
+    bytes += chunk;
+    len -= chunk;
   }
   trans_->write(&kJSONStringDelimiter, 1);
   return result;
@@ -506,16 +635,21 @@ uint32_t TJSONProtocol::writeJSONBase64(const std::string& str) {
 template <typename NumberType>
 uint32_t TJSONProtocol::writeJSONInteger(NumberType num) {
   uint32_t result = context_->write(*trans_);
-  std::string val(to_string(num));
+  // bools and unsigned types print as unsigned, everything else (enums
+  // included) as signed
+  typedef typename std::conditional<std::is_unsigned<NumberType>::value, uint64_t, int64_t>::type
+      Widest;
+  char buf[24];
+  char* end = buf + sizeof(buf);
+  char* begin = formatInteger(static_cast<Widest>(num), end);
+  auto len = static_cast<uint32_t>(end - begin);
   bool escapeNum = context_->escapeNum();
   if (escapeNum) {
     trans_->write(&kJSONStringDelimiter, 1);
     result += 1;
   }
-  if (val.length() > (std::numeric_limits<uint32_t>::max)())
-    throw TProtocolException(TProtocolException::SIZE_LIMIT);
-  trans_->write((const uint8_t*)val.c_str(), static_cast<uint32_t>(val.length()));
-  result += static_cast<uint32_t>(val.length());
+  trans_->write(reinterpret_cast<const uint8_t*>(begin), len);
+  result += len;
   if (escapeNum) {
     trans_->write(&kJSONStringDelimiter, 1);
     result += 1;
@@ -525,12 +659,20 @@ uint32_t TJSONProtocol::writeJSONInteger(NumberType num) {
 
 namespace {
 std::string doubleToString(double d) {
+  const std::streamsize max_digits10 = 2 + std::numeric_limits<double>::digits10;
+#ifdef __cpp_lib_to_chars
+  // what the stream below produces, without the stream
+  char buf[32];
+  std::to_chars_result formatted
+      = std::to_chars(buf, buf + sizeof(buf), d, std::chars_format::general, max_digits10);
+  return std::string(buf, formatted.ptr);
+#else
   std::ostringstream str;
   str.imbue(std::locale::classic());
-  const std::streamsize max_digits10 = 2 + std::numeric_limits<double>::digits10;
   str.precision(max_digits10);
   str << d;
   return str.str();
+#endif
 }
 }
 
@@ -752,6 +894,18 @@ uint32_t TJSONProtocol::readJSONString(std::string& str, bool skipContext) {
   uint8_t ch;
   str.clear();
   while (true) {
+    // Take what needs no unescaping straight from the transport's buffer
+    uint32_t len = 0;
+    const uint8_t* buf = codeunits.empty() ? reader_.borrow(&len) : nullptr;
+    if (buf != nullptr) {
+      auto run = static_cast<uint32_t>(findJSONSpecialChar<false>(buf, buf + len) - buf);
+      str.append(reinterpret_cast<const char*>(buf), run);
+      reader_.consume(run);
+      result += run;
+      if (run == len) {
+        continue;
+      }
+    }
     ch = reader_.read();
     ++result;
     if (ch == kJSONStringDelimiter) {
@@ -809,25 +963,16 @@ uint32_t TJSONProtocol::readJSONBase64(std::string& str) {
   if (tmp.length() > (std::numeric_limits<uint32_t>::max)())
     throw TProtocolException(TProtocolException::SIZE_LIMIT);
   auto len = static_cast<uint32_t>(tmp.length());
-  str.clear();
   // Ignore padding
   uint32_t padding_count = 0;
   while (len > 0 && b[len - 1] == '=' && padding_count < 2) {
     --len;
     ++padding_count;
   }
-  while (len >= 4) {
-    base64_decode(b, 4);
-    str.append((const char*)b, 3);
-    b += 4;
-    len -= 4;
-  }
-  // Don't decode if we hit the end or got a single leftover byte (invalid
-  // base64 but legal for skip of regular string type)
-  if (len > 1) {
-    base64_decode(b, len);
-    str.append((const char*)b, len - 1);
-  }
+  // A single leftover byte is ignored (invalid base64 but legal for skip of
+  // regular string type)
+  len = base64_decode_bulk(b, len, b);
+  str.assign((const char*)b, len);
   return result;
 }
 
@@ -837,6 +982,21 @@ uint32_t TJSONProtocol::readJSONNumericChars(std::string& str) {
   uint32_t result = 0;
   str.clear();
   while (true) {
+    uint32_t len = 0;
+    const uint8_t* buf = reader_.borrow(&len);
+    if (buf != nullptr) {
+      uint32_t run = 0;
+      while (run < len && isJSONNumeric(buf[run])) {
+        ++run;
+      }
+      str.append(reinterpret_cast<const char*>(buf), run);
+      reader_.consume(run);
+      result += run;
+      if (run < len) {
+        break;
+      }
+      continue;
+    }
     uint8_t ch = reader_.peek();
     if (!isJSONNumeric(ch)) {
       break;
@@ -849,15 +1009,29 @@ uint32_t TJSONProtocol::readJSONNumericChars(std::string& str) {
 }
 
 namespace {
-template <typename T>
-T fromString(const std::string& s) {
-  T t;
+double doubleFromString(const std::string& s) {
+#ifdef __cpp_lib_to_chars
+  // std::from_chars doesn't take a leading '+' and, unlike the stream,
+  // takes "inf" and "nan", so leave those to the stream.  So too values
+  // out of range, which the stream saturates.
+  const char* p = s.data();
+  const char* end = p + s.size();
+  const char* digits = p + (p != end && (*p == '-' || *p == '+') ? 1 : 0);
+  if (digits != end && (*digits == '.' || (*digits >= '0' && *digits <= '9'))) {
+    double d;
+    std::from_chars_result parsed = std::from_chars(*p == '+' ? digits : p, end, d);
+    if (parsed.ec == std::errc() && parsed.ptr == end) {
+      return d;
+    }
+  }
+#endif
+  double d;
   std::istringstream str(s);
   str.imbue(std::locale::classic());
-  str >> t;
+  str >> d;
   if (str.bad() || !str.eof())
     throw std::runtime_error(s);
-  return t;
+  return d;
 }
 }
 
@@ -871,9 +1045,7 @@ uint32_t TJSONProtocol::readJSONInteger(NumberType& num) {
   }
   std::string str;
   result += readJSONNumericChars(str);
-  try {
-    num = fromString<NumberType>(str);
-  } catch (const std::runtime_error&) {
+  if (!parseInteger(str, num)) {
     throw TProtocolException(TProtocolException::INVALID_DATA,
                              "Expected numeric value; got \"" + str + "\"");
   }
@@ -903,7 +1075,7 @@ uint32_t TJSONProtocol::readJSONDouble(double& num) {
                                      "Numeric data unexpectedly quoted");
       }
       try {
-        num = fromString<double>(str);
+        num = doubleFromString(str);
       } catch (const std::runtime_error&) {
         throw TProtocolException(TProtocolException::INVALID_DATA,
                                      "Expected numeric value; got \"" + str + "\"");
@@ -916,7 +1088,7 @@ uint32_t TJSONProtocol::readJSONDouble(double& num) {
     }
     result += readJSONNumericChars(str);
     try {
-      num = fromString<double>(str);
+      num = doubleFromString(str);
     } catch (const std::runtime_error&) {
       throw TProtocolException(TProtocolException::INVALID_DATA,
                                    "Expected numeric value; got \"" + str + "\"");
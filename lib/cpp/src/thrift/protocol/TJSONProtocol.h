@@ -289,6 +289,24 @@ public:
       return data_;
     }
 
+    /**
+     * Lends the bytes the transport has buffered, so that runs of them can
+     * be scanned in bulk instead of a byte at a time.  Returns nullptr when
+     * a byte was peeked or the transport doesn't lend its buffer; read()
+     * and peek() work either way.  Like peek(), may block until a byte is
+     * available.
+     */
+    const uint8_t* borrow(uint32_t* len) {
+      if (hasData_) {
+        return nullptr;
+      }
+      *len = 1;
+      return trans_->borrow(nullptr, len);
+    }
+
+    /// Consumes len of the bytes returned by borrow()
+    void consume(uint32_t len) { trans_->consume(len); }
+
   private:
     TTransport* trans_;
     bool hasData_;
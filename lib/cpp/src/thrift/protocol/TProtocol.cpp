@@ -19,11 +19,19 @@
 
 #include <thrift/protocol/TProtocol.h>
 
+#include <atomic>
+
 namespace apache {
 namespace thrift {
 namespace protocol {
 
 TProtocol::~TProtocol() = default;
+
+uint64_t TProtocol::newGeneration() {
+  static std::atomic<uint64_t> last(0);
+  return last.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
 uint32_t TProtocol::skip_virt(TType type) {
   return ::apache::thrift::protocol::skip(*this, type);
 }
@@ -50,6 +50,7 @@
 #include <thrift/protocol/TSet.h>
 #include <thrift/protocol/TMap.h>
 #include <thrift/TUuid.h>
+#include <thrift/TArena.h>
 
 #include <memory>
 
@@ -278,6 +279,57 @@ public:
 
   virtual uint32_t writeUUID_virt(const TUuid& uuid) = 0;
 
+  /*
+   * Arena string overloads used by code generated with the cpp:arena option.
+   * The defaults go through a temporary std::string; protocols that can
+   * handle any string type override them to avoid the extra copy.
+   */
+  virtual uint32_t writeArenaString_virt(const TArenaString& str) {
+    return writeString_virt(std::string(str.data(), str.size()));
+  }
+
+  virtual uint32_t writeArenaBinary_virt(const TArenaString& str) {
+    return writeBinary_virt(std::string(str.data(), str.size()));
+  }
+
+  /*
+   * Bulk writes of the elements of a list of i16, i32, i64 or double.  The
+   * list header is written separately with writeListBegin().  The defaults
+   * write one element at a time; protocols with a cheaper bulk encoding
+   * override them.
+   */
+  virtual uint32_t writeI16Array_virt(const int16_t* values, uint32_t count) {
+    uint32_t wsize = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      wsize += writeI16_virt(values[i]);
+    }
+    return wsize;
+  }
+
+  virtual uint32_t writeI32Array_virt(const int32_t* values, uint32_t count) {
+    uint32_t wsize = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      wsize += writeI32_virt(values[i]);
+    }
+    return wsize;
+  }
+
+  virtual uint32_t writeI64Array_virt(const int64_t* values, uint32_t count) {
+    uint32_t wsize = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      wsize += writeI64_virt(values[i]);
+    }
+    return wsize;
+  }
+
+  virtual uint32_t writeDoubleArray_virt(const double* values, uint32_t count) {
+    uint32_t wsize = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      wsize += writeDouble_virt(values[i]);
+    }
+    return wsize;
+  }
+
   uint32_t writeMessageBegin(const std::string& name,
                              const TMessageType messageType,
                              const int32_t seqid) {
@@ -390,6 +442,36 @@ public:
     return writeUUID_virt(uuid);
   }
 
+  uint32_t writeString(const TArenaString& str) {
+    T_VIRTUAL_CALL();
+    return writeArenaString_virt(str);
+  }
+
+  uint32_t writeBinary(const TArenaString& str) {
+    T_VIRTUAL_CALL();
+    return writeArenaBinary_virt(str);
+  }
+
+  uint32_t writeI16Array(const int16_t* values, uint32_t count) {
+    T_VIRTUAL_CALL();
+    return writeI16Array_virt(values, count);
+  }
+
+  uint32_t writeI32Array(const int32_t* values, uint32_t count) {
+    T_VIRTUAL_CALL();
+    return writeI32Array_virt(values, count);
+  }
+
+  uint32_t writeI64Array(const int64_t* values, uint32_t count) {
+    T_VIRTUAL_CALL();
+    return writeI64Array_virt(values, count);
+  }
+
+  uint32_t writeDoubleArray(const double* values, uint32_t count) {
+    T_VIRTUAL_CALL();
+    return writeDoubleArray_virt(values, count);
+  }
+
   /**
    * Reading functions
    */
@@ -440,6 +522,56 @@ public:
 
   virtual uint32_t readUUID_virt(TUuid& uuid) = 0;
 
+  virtual uint32_t readArenaString_virt(TArenaString& str) {
+    std::string tmp;
+    uint32_t result = readString_virt(tmp);
+    str.assign(tmp.data(), tmp.size());
+    return result;
+  }
+
+  virtual uint32_t readArenaBinary_virt(TArenaString& str) {
+    std::string tmp;
+    uint32_t result = readBinary_virt(tmp);
+    str.assign(tmp.data(), tmp.size());
+    return result;
+  }
+
+  /*
+   * Bulk reads of count list elements of type i16, i32, i64 or double,
+   * following a readListBegin().  The defaults read one element at a time.
+   */
+  virtual uint32_t readI16Array_virt(int16_t* values, uint32_t count) {
+    uint32_t rsize = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      rsize += readI16_virt(values[i]);
+    }
+    return rsize;
+  }
+
+  virtual uint32_t readI32Array_virt(int32_t* values, uint32_t count) {
+    uint32_t rsize = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      rsize += readI32_virt(values[i]);
+    }
+    return rsize;
+  }
+
+  virtual uint32_t readI64Array_virt(int64_t* values, uint32_t count) {
+    uint32_t rsize = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      rsize += readI64_virt(values[i]);
+    }
+    return rsize;
+  }
+
+  virtual uint32_t readDoubleArray_virt(double* values, uint32_t count) {
+    uint32_t rsize = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      rsize += readDouble_virt(values[i]);
+    }
+    return rsize;
+  }
+
   uint32_t readMessageBegin(std::string& name, TMessageType& messageType, int32_t& seqid) {
     T_VIRTUAL_CALL();
     return readMessageBegin_virt(name, messageType, seqid);
@@ -545,6 +677,36 @@ public:
     return readUUID_virt(uuid);
   }
 
+  uint32_t readString(TArenaString& str) {
+    T_VIRTUAL_CALL();
+    return readArenaString_virt(str);
+  }
+
+  uint32_t readBinary(TArenaString& str) {
+    T_VIRTUAL_CALL();
+    return readArenaBinary_virt(str);
+  }
+
+  uint32_t readI16Array(int16_t* values, uint32_t count) {
+    T_VIRTUAL_CALL();
+    return readI16Array_virt(values, count);
+  }
+
+  uint32_t readI32Array(int32_t* values, uint32_t count) {
+    T_VIRTUAL_CALL();
+    return readI32Array_virt(values, count);
+  }
+
+  uint32_t readI64Array(int64_t* values, uint32_t count) {
+    T_VIRTUAL_CALL();
+    return readI64Array_virt(values, count);
+  }
+
+  uint32_t readDoubleArray(double* values, uint32_t count) {
+    T_VIRTUAL_CALL();
+    return readDoubleArray_virt(values, count);
+  }
+
   /*
    * std::vector is specialized for bool, and its elements are individual bits
    * rather than bools.   We need to define a different version of readBool()
@@ -596,12 +758,35 @@ public:
     return 0;
   }
 
+  /**
+   * Returns a new protocol that encodes values the same way as this one,
+   * over another transport, or nullptr if this protocol cannot make one.
+   * Lazy fields (see TLazyField.h) use it to scan and later parse values
+   * in bytes copied out of this protocol's transport.
+   */
+  virtual std::shared_ptr<TProtocol> cloneForTransport(std::shared_ptr<TTransport> trans) const {
+    THRIFT_UNUSED_VARIABLE(trans);
+    return nullptr;
+  }
+
+  /**
+   * Identifies this protocol together with the settings cloneForTransport()
+   * copies.  No two protocols ever share a value, and it changes whenever
+   * one of those settings does, so a clone can be reused for as long as the
+   * generation it was made from stays the same.
+   */
+  virtual uint64_t getGeneration() const { return generation_; }
+
 protected:
   TProtocol(std::shared_ptr<TTransport> ptrans)
     : ptrans_(ptrans), input_recursion_depth_(0), output_recursion_depth_(0),
-      recursion_limit_(ptrans->getConfiguration()->getRecursionLimit())
+      recursion_limit_(ptrans->getConfiguration()->getRecursionLimit()),
+      generation_(newGeneration())
   {}
 
+  // to be called when a setting cloneForTransport() copies changes
+  void renewGeneration() { generation_ = newGeneration(); }
+
   virtual void checkReadBytesAvailable(TSet& set)
   {
       ptrans_->checkReadBytesAvailable(set.size_ * getMinSerializedSize(set.elemType_));
@@ -622,9 +807,12 @@ protected:
 
 private:
   TProtocol() = default;
+  static uint64_t newGeneration();
+
   uint32_t input_recursion_depth_;
   uint32_t output_recursion_depth_;
   uint32_t recursion_limit_;
+  uint64_t generation_;
 };
 
 /**
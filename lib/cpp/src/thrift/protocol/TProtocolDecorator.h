@@ -93,6 +93,24 @@ public:
   uint32_t writeString_virt(const std::string& str) override { return protocol->writeString(str); }
   uint32_t writeBinary_virt(const std::string& str) override { return protocol->writeBinary(str); }
   uint32_t writeUUID_virt(const TUuid& uuid) override { return protocol->writeUUID(uuid); }
+  uint32_t writeArenaString_virt(const TArenaString& str) override {
+    return protocol->writeString(str);
+  }
+  uint32_t writeArenaBinary_virt(const TArenaString& str) override {
+    return protocol->writeBinary(str);
+  }
+  uint32_t writeI16Array_virt(const int16_t* values, uint32_t count) override {
+    return protocol->writeI16Array(values, count);
+  }
+  uint32_t writeI32Array_virt(const int32_t* values, uint32_t count) override {
+    return protocol->writeI32Array(values, count);
+  }
+  uint32_t writeI64Array_virt(const int64_t* values, uint32_t count) override {
+    return protocol->writeI64Array(values, count);
+  }
+  uint32_t writeDoubleArray_virt(const double* values, uint32_t count) override {
+    return protocol->writeDoubleArray(values, count);
+  }
 
   uint32_t readMessageBegin_virt(std::string& name,
                                          TMessageType& messageType,
@@ -142,6 +160,26 @@ public:
   uint32_t readString_virt(std::string& str) override { return protocol->readString(str); }
   uint32_t readBinary_virt(std::string& str) override { return protocol->readBinary(str); }
   uint32_t readUUID_virt(TUuid& uuid) override { return protocol->readUUID(uuid); }
+  uint32_t readArenaString_virt(TArenaString& str) override { return protocol->readString(str); }
+  uint32_t readArenaBinary_virt(TArenaString& str) override { return protocol->readBinary(str); }
+  uint32_t readI16Array_virt(int16_t* values, uint32_t count) override {
+    return protocol->readI16Array(values, count);
+  }
+  uint32_t readI32Array_virt(int32_t* values, uint32_t count) override {
+    return protocol->readI32Array(values, count);
+  }
+  uint32_t readI64Array_virt(int64_t* values, uint32_t count) override {
+    return protocol->readI64Array(values, count);
+  }
+  uint32_t readDoubleArray_virt(double* values, uint32_t count) override {
+    return protocol->readDoubleArray(values, count);
+  }
+
+  shared_ptr<TProtocol> cloneForTransport(shared_ptr<TTransport> trans) const override {
+    return protocol->cloneForTransport(trans);
+  }
+
+  uint64_t getGeneration() const override { return protocol->getGeneration(); }
 
 private:
   shared_ptr<TProtocol> protocol;
@@ -0,0 +1,469 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/protocol/TVarintUtils.h>
+#include <thrift/protocol/TProtocol.h>
+#include <thrift/protocol/TProtocolException.h>
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define THRIFT_VARINT_SSE2 1
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define THRIFT_VARINT_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace apache {
+namespace thrift {
+namespace protocol {
+
+namespace {
+
+// Decodes the leading run of single byte varints in [p, end) into out,
+// stopping at the first longer one; returns how many values were decoded.
+// May scribble over out beyond the returned count, but never past count.
+template <typename T>
+using DecodeRunFn = uint32_t (*)(const uint8_t* p, const uint8_t* end, T* out, uint32_t count);
+
+// Encodes the leading run of values whose encoding is a single byte, in
+// whole blocks; returns how many values (and bytes) were written.
+template <typename T>
+using EncodeRunFn = uint32_t (*)(const T* in, uint32_t count, uint8_t* out);
+
+struct VarintKernels {
+  DecodeRunFn<int32_t> decodeRun32;
+  DecodeRunFn<int64_t> decodeRun64;
+  EncodeRunFn<int32_t> encodeRun32;
+  EncodeRunFn<int64_t> encodeRun64;
+};
+
+inline uint32_t countTrailingZeros(uint64_t n) {
+#if defined(__GNUC__)
+  return static_cast<uint32_t>(__builtin_ctzll(n));
+#elif defined(_MSC_VER) && defined(_M_X64)
+  unsigned long index;
+  _BitScanForward64(&index, n);
+  return static_cast<uint32_t>(index);
+#else
+  uint32_t count = 0;
+  while (!(n & 1)) {
+    n >>= 1;
+    ++count;
+  }
+  return count;
+#endif
+}
+
+inline uint32_t significantBits(uint64_t n) {
+#if defined(__GNUC__)
+  return 64 - static_cast<uint32_t>(__builtin_clzll(n | 1));
+#else
+  uint32_t bits = 1;
+  while (n >>= 1) {
+    ++bits;
+  }
+  return bits;
+#endif
+}
+
+inline int32_t zigzagToI32(uint32_t n) {
+  return static_cast<int32_t>((n >> 1) ^ (~(n & 1) + 1));
+}
+
+inline int64_t zigzagToI64(uint64_t n) {
+  return static_cast<int64_t>((n >> 1) ^ (~(n & 1) + 1));
+}
+
+// 32 bit values are read as 64 bit varints and truncated, like readI32()
+inline void fromZigzag(uint64_t n, int32_t& out) {
+  out = zigzagToI32(static_cast<uint32_t>(n));
+}
+
+inline void fromZigzag(uint64_t n, int64_t& out) {
+  out = zigzagToI64(n);
+}
+
+inline uint64_t toZigzag(int32_t n) {
+  return (static_cast<uint32_t>(n) << 1) ^ static_cast<uint32_t>(n >> 31);
+}
+
+inline uint64_t toZigzag(int64_t n) {
+  return (static_cast<uint64_t>(n) << 1) ^ static_cast<uint64_t>(n >> 63);
+}
+
+uint32_t readVarintSlow(const uint8_t* p, const uint8_t* end, uint64_t& val) {
+  uint64_t result = 0;
+  uint32_t size = 0;
+  int shift = 0;
+  while (p + size < end) {
+    uint8_t byte = p[size++];
+    result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      val = result;
+      return size;
+    }
+    if (size == VARINT64_MAX_BYTES) {
+      throw TProtocolException(TProtocolException::INVALID_DATA,
+                               "Variable-length int over 10 bytes.");
+    }
+    shift += 7;
+  }
+  return 0;
+}
+
+// Reads one varint; returns its size, or 0 if it runs past end
+inline uint32_t readVarint(const uint8_t* p, const uint8_t* end, uint64_t& val) {
+#if __THRIFT_BYTE_ORDER == __THRIFT_LITTLE_ENDIAN
+  if (end - p >= 8) {
+    // Varints of up to eight bytes are gathered from a single load: find
+    // the first byte without a continuation bit, then squeeze the 7 bit
+    // groups together pairwise.
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    uint64_t stops = ~word & 0x8080808080808080ULL;
+    if (stops != 0) {
+      uint32_t bits = countTrailingZeros(stops) + 1;
+      if (bits < 64) {
+        word &= (1ULL << bits) - 1;
+      }
+      word &= 0x7f7f7f7f7f7f7f7fULL;
+      word = ((word & 0x7f007f007f007f00ULL) >> 1) | (word & 0x007f007f007f007fULL);
+      word = ((word & 0x3fff00003fff0000ULL) >> 2) | (word & 0x00003fff00003fffULL);
+      word = ((word & 0x0fffffff00000000ULL) >> 4) | (word & 0x000000000fffffffULL);
+      val = word;
+      return bits / 8;
+    }
+  }
+#endif
+  return readVarintSlow(p, end, val);
+}
+
+// Writes one varint, possibly touching up to VARINT_ENCODE_SLACK bytes
+// beyond it; returns its size
+inline uint32_t writeVarint(uint64_t n, uint8_t* out) {
+#if __THRIFT_BYTE_ORDER == __THRIFT_LITTLE_ENDIAN
+  if (n < (1ULL << 56)) {
+    // The reverse of readVarint(): spread the value into 7 bit groups and
+    // set the continuation bit on all but the last byte.
+    uint32_t size = (significantBits(n) * 9 + 64) >> 6; // ceil(bits / 7) for 1..64
+    uint64_t word = n;
+    word = ((word & 0x00fffffff0000000ULL) << 4) | (word & 0x000000000fffffffULL);
+    word = ((word & 0x0fffc0000fffc000ULL) << 2) | (word & 0x00003fff00003fffULL);
+    word = ((word & 0x3f803f803f803f80ULL) << 1) | (word & 0x007f007f007f007fULL);
+    word |= 0x8080808080808080ULL & ((1ULL << (8 * (size - 1))) - 1);
+    memcpy(out, &word, sizeof(word));
+    return size;
+  }
+#endif
+  uint32_t size = 0;
+  while (n & ~0x7fULL) {
+    out[size++] = static_cast<uint8_t>((n & 0x7f) | 0x80);
+    n >>= 7;
+  }
+  out[size++] = static_cast<uint8_t>(n);
+  return size;
+}
+
+template <typename T>
+uint32_t decodeZigzag(const uint8_t* buf,
+                      uint32_t len,
+                      T* out,
+                      uint32_t count,
+                      uint32_t* decoded,
+                      DecodeRunFn<T> decodeRun) {
+  const uint8_t* p = buf;
+  const uint8_t* end = buf + len;
+  uint32_t i = 0;
+  while (i < count) {
+    if (decodeRun != nullptr && p < end && !(*p & 0x80)) {
+      uint32_t run = decodeRun(p, end, out + i, count - i);
+      p += run;
+      i += run;
+      if (i == count) {
+        break;
+      }
+    }
+    uint64_t val;
+    uint32_t size = readVarint(p, end, val);
+    if (size == 0) {
+      break;
+    }
+    fromZigzag(val, out[i++]);
+    p += size;
+  }
+  *decoded = i;
+  return static_cast<uint32_t>(p - buf);
+}
+
+template <typename T>
+uint32_t encodeZigzag(const T* in, uint32_t count, uint8_t* buf, EncodeRunFn<T> encodeRun) {
+  uint8_t* p = buf;
+  uint32_t i = 0;
+  while (i < count) {
+    uint32_t scalar = count - i;
+    if (encodeRun != nullptr) {
+      uint32_t run = encodeRun(in + i, count - i, p);
+      p += run;
+      i += run;
+      // the block that stopped the run has a large value in it, so do not
+      // retry on it
+      scalar = (count - i < 16) ? count - i : 16;
+    }
+    for (uint32_t stop = i + scalar; i < stop; ++i) {
+      p += writeVarint(toZigzag(in[i]), p);
+    }
+  }
+  return static_cast<uint32_t>(p - buf);
+}
+
+#ifdef THRIFT_VARINT_SSE2
+
+inline __m128i zigzagDecode32(__m128i v) {
+  const __m128i one = _mm_set1_epi32(1);
+  return _mm_xor_si128(_mm_srli_epi32(v, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(v, one)));
+}
+
+inline __m128i zigzagDecode64(__m128i v) {
+  const __m128i one = _mm_set1_epi64x(1);
+  return _mm_xor_si128(_mm_srli_epi64(v, 1), _mm_sub_epi64(_mm_setzero_si128(), _mm_and_si128(v, one)));
+}
+
+uint32_t decodeRun32Sse2(const uint8_t* p, const uint8_t* end, int32_t* out, uint32_t count) {
+  const __m128i zero = _mm_setzero_si128();
+  uint32_t done = 0;
+  while (count - done >= 16 && end - p >= 16) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(bytes));
+    __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+    __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+    __m128i* dst = reinterpret_cast<__m128i*>(out + done);
+    _mm_storeu_si128(dst, zigzagDecode32(_mm_unpacklo_epi16(lo, zero)));
+    _mm_storeu_si128(dst + 1, zigzagDecode32(_mm_unpackhi_epi16(lo, zero)));
+    _mm_storeu_si128(dst + 2, zigzagDecode32(_mm_unpacklo_epi16(hi, zero)));
+    _mm_storeu_si128(dst + 3, zigzagDecode32(_mm_unpackhi_epi16(hi, zero)));
+    uint32_t run = mask ? countTrailingZeros(mask) : 16;
+    p += run;
+    done += run;
+    if (run < 16) {
+      break;
+    }
+  }
+  return done;
+}
+
+uint32_t decodeRun64Sse2(const uint8_t* p, const uint8_t* end, int64_t* out, uint32_t count) {
+  const __m128i zero = _mm_setzero_si128();
+  uint32_t done = 0;
+  while (count - done >= 16 && end - p >= 16) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(bytes));
+    __m128i words[2] = {_mm_unpacklo_epi8(bytes, zero), _mm_unpackhi_epi8(bytes, zero)};
+    __m128i* dst = reinterpret_cast<__m128i*>(out + done);
+    for (int w = 0; w < 2; ++w) {
+      __m128i lo = _mm_unpacklo_epi16(words[w], zero);
+      __m128i hi = _mm_unpackhi_epi16(words[w], zero);
+      _mm_storeu_si128(dst++, zigzagDecode64(_mm_unpacklo_epi32(lo, zero)));
+      _mm_storeu_si128(dst++, zigzagDecode64(_mm_unpackhi_epi32(lo, zero)));
+      _mm_storeu_si128(dst++, zigzagDecode64(_mm_unpacklo_epi32(hi, zero)));
+      _mm_storeu_si128(dst++, zigzagDecode64(_mm_unpackhi_epi32(hi, zero)));
+    }
+    uint32_t run = mask ? countTrailingZeros(mask) : 16;
+    p += run;
+    done += run;
+    if (run < 16) {
+      break;
+    }
+  }
+  return done;
+}
+
+uint32_t encodeRun32Sse2(const int32_t* in, uint32_t count, uint8_t* out) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i large = _mm_set1_epi32(~0x7f);
+  uint32_t done = 0;
+  while (count - done >= 16) {
+    const __m128i* src = reinterpret_cast<const __m128i*>(in + done);
+    __m128i z[4];
+    __m128i any = zero;
+    for (int k = 0; k < 4; ++k) {
+      __m128i v = _mm_loadu_si128(src + k);
+      z[k] = _mm_xor_si128(_mm_slli_epi32(v, 1), _mm_srai_epi32(v, 31));
+      any = _mm_or_si128(any, z[k]);
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(any, large), zero)) != 0xffff) {
+      break;
+    }
+    __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(z[0], z[1]), _mm_packs_epi32(z[2], z[3]));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + done), bytes);
+    done += 16;
+  }
+  return done;
+}
+
+uint32_t encodeRun64Sse2(const int64_t* in, uint32_t count, uint8_t* out) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i large = _mm_set1_epi64x(~0x7fLL);
+  uint32_t done = 0;
+  while (count - done >= 16) {
+    const __m128i* src = reinterpret_cast<const __m128i*>(in + done);
+    __m128i low[4];
+    __m128i any = zero;
+    for (int k = 0; k < 4; ++k) {
+      __m128i a = _mm_loadu_si128(src + 2 * k);
+      __m128i b = _mm_loadu_si128(src + 2 * k + 1);
+      // there is no 64 bit arithmetic shift in SSE2, so spread the sign
+      // of the high halves instead
+      a = _mm_xor_si128(_mm_slli_epi64(a, 1),
+                        _mm_shuffle_epi32(_mm_srai_epi32(a, 31), _MM_SHUFFLE(3, 3, 1, 1)));
+      b = _mm_xor_si128(_mm_slli_epi64(b, 1),
+                        _mm_shuffle_epi32(_mm_srai_epi32(b, 31), _MM_SHUFFLE(3, 3, 1, 1)));
+      any = _mm_or_si128(any, _mm_or_si128(a, b));
+      low[k] = _mm_unpacklo_epi64(_mm_shuffle_epi32(a, _MM_SHUFFLE(2, 0, 2, 0)),
+                                  _mm_shuffle_epi32(b, _MM_SHUFFLE(2, 0, 2, 0)));
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(any, large), zero)) != 0xffff) {
+      break;
+    }
+    __m128i bytes
+        = _mm_packus_epi16(_mm_packs_epi32(low[0], low[1]), _mm_packs_epi32(low[2], low[3]));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + done), bytes);
+    done += 16;
+  }
+  return done;
+}
+
+#endif // THRIFT_VARINT_SSE2
+
+#ifdef THRIFT_VARINT_AVX2
+
+__attribute__((target("avx2"))) inline __m256i zigzagDecode32Avx2(__m256i v) {
+  const __m256i one = _mm256_set1_epi32(1);
+  return _mm256_xor_si256(_mm256_srli_epi32(v, 1),
+                          _mm256_sub_epi32(_mm256_setzero_si256(), _mm256_and_si256(v, one)));
+}
+
+__attribute__((target("avx2"))) inline __m256i zigzagDecode64Avx2(__m256i v) {
+  const __m256i one = _mm256_set1_epi64x(1);
+  return _mm256_xor_si256(_mm256_srli_epi64(v, 1),
+                          _mm256_sub_epi64(_mm256_setzero_si256(), _mm256_and_si256(v, one)));
+}
+
+__attribute__((target("avx2")))
+uint32_t decodeRun32Avx2(const uint8_t* p, const uint8_t* end, int32_t* out, uint32_t count) {
+  uint32_t done = 0;
+  while (count - done >= 32 && end - p >= 32) {
+    __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(bytes));
+    __m256i* dst = reinterpret_cast<__m256i*>(out + done);
+    for (int k = 0; k < 4; ++k) {
+      __m128i eight = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + 8 * k));
+      _mm256_storeu_si256(dst + k, zigzagDecode32Avx2(_mm256_cvtepu8_epi32(eight)));
+    }
+    uint32_t run = mask ? countTrailingZeros(mask) : 32;
+    p += run;
+    done += run;
+    if (run < 32) {
+      return done;
+    }
+  }
+  // finish off with the narrower kernel
+  return done + decodeRun32Sse2(p, end, out + done, count - done);
+}
+
+__attribute__((target("avx2")))
+uint32_t decodeRun64Avx2(const uint8_t* p, const uint8_t* end, int64_t* out, uint32_t count) {
+  uint32_t done = 0;
+  while (count - done >= 32 && end - p >= 32) {
+    __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(bytes));
+    __m256i* dst = reinterpret_cast<__m256i*>(out + done);
+    for (int k = 0; k < 8; ++k) {
+      int32_t four;
+      memcpy(&four, p + 4 * k, sizeof(four));
+      _mm256_storeu_si256(dst + k, zigzagDecode64Avx2(_mm256_cvtepu8_epi64(_mm_cvtsi32_si128(four))));
+    }
+    uint32_t run = mask ? countTrailingZeros(mask) : 32;
+    p += run;
+    done += run;
+    if (run < 32) {
+      return done;
+    }
+  }
+  return done + decodeRun64Sse2(p, end, out + done, count - done);
+}
+
+#endif // THRIFT_VARINT_AVX2
+
+VarintKernels selectKernels() {
+  VarintKernels kernels = {nullptr, nullptr, nullptr, nullptr};
+#ifdef THRIFT_VARINT_SSE2
+  kernels.decodeRun32 = decodeRun32Sse2;
+  kernels.decodeRun64 = decodeRun64Sse2;
+  kernels.encodeRun32 = encodeRun32Sse2;
+  kernels.encodeRun64 = encodeRun64Sse2;
+#endif
+#ifdef THRIFT_VARINT_AVX2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.decodeRun32 = decodeRun32Avx2;
+    kernels.decodeRun64 = decodeRun64Avx2;
+  }
+#endif
+  return kernels;
+}
+
+const VarintKernels& kernels() {
+  static const VarintKernels selected = selectKernels();
+  return selected;
+}
+}
+
+uint32_t varint_decode_zigzag32(const uint8_t* buf,
+                                uint32_t len,
+                                int32_t* out,
+                                uint32_t count,
+                                uint32_t* decoded) {
+  return decodeZigzag(buf, len, out, count, decoded, kernels().decodeRun32);
+}
+
+uint32_t varint_decode_zigzag64(const uint8_t* buf,
+                                uint32_t len,
+                                int64_t* out,
+                                uint32_t count,
+                                uint32_t* decoded) {
+  return decodeZigzag(buf, len, out, count, decoded, kernels().decodeRun64);
+}
+
+uint32_t varint_encode_zigzag32(const int32_t* in, uint32_t count, uint8_t* buf) {
+  return encodeZigzag(in, count, buf, kernels().encodeRun32);
+}
+
+uint32_t varint_encode_zigzag64(const int64_t* in, uint32_t count, uint8_t* buf) {
+  return encodeZigzag(in, count, buf, kernels().encodeRun64);
+}
+}
+}
+} // apache::thrift::protocol
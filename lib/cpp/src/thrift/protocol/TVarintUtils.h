@@ -0,0 +1,69 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_PROTOCOL_TVARINTUTILS_H_
+#define _THRIFT_PROTOCOL_TVARINTUTILS_H_
+
+#include <stdint.h>
+
+namespace apache {
+namespace thrift {
+namespace protocol {
+
+/*
+ * Bulk encoding and decoding of the zigzag varints used by TCompactProtocol
+ * for lists of i32 and i64.  The decoders pick an SSE2 or AVX2 kernel at
+ * runtime where the CPU has one, and fall back to portable code elsewhere.
+ */
+
+// Extra room the encoders may scribble past the bytes they report written
+const uint32_t VARINT_ENCODE_SLACK = 8;
+
+// Largest encodings, in bytes, of a single i32 and i64
+const uint32_t VARINT32_MAX_BYTES = 5;
+const uint32_t VARINT64_MAX_BYTES = 10;
+
+// decodes up to count varints from the len bytes at buf into out
+// stops early at a varint that is cut off by the end of buf
+// *decoded receives the number of values decoded
+// returns the number of bytes consumed
+// throws TProtocolException if a varint is longer than ten bytes
+uint32_t varint_decode_zigzag32(const uint8_t* buf,
+                                uint32_t len,
+                                int32_t* out,
+                                uint32_t count,
+                                uint32_t* decoded);
+
+uint32_t varint_decode_zigzag64(const uint8_t* buf,
+                                uint32_t len,
+                                int64_t* out,
+                                uint32_t count,
+                                uint32_t* decoded);
+
+// encodes count values into buf and returns the number of bytes written
+// buf must have room for count * VARINT32_MAX_BYTES (or VARINT64_MAX_BYTES)
+// plus VARINT_ENCODE_SLACK bytes
+uint32_t varint_encode_zigzag32(const int32_t* in, uint32_t count, uint8_t* buf);
+
+uint32_t varint_encode_zigzag64(const int64_t* in, uint32_t count, uint8_t* buf);
+}
+}
+} // apache::thrift::protocol
+
+#endif // #define _THRIFT_PROTOCOL_TVARINTUTILS_H_
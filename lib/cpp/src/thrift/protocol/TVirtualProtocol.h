@@ -397,6 +397,22 @@ public:
     return static_cast<Protocol_*>(this)->writeUUID(uuid);
   }
 
+  uint32_t writeI16Array_virt(const int16_t* values, uint32_t count) override {
+    return static_cast<Protocol_*>(this)->writeI16Array(values, count);
+  }
+
+  uint32_t writeI32Array_virt(const int32_t* values, uint32_t count) override {
+    return static_cast<Protocol_*>(this)->writeI32Array(values, count);
+  }
+
+  uint32_t writeI64Array_virt(const int64_t* values, uint32_t count) override {
+    return static_cast<Protocol_*>(this)->writeI64Array(values, count);
+  }
+
+  uint32_t writeDoubleArray_virt(const double* values, uint32_t count) override {
+    return static_cast<Protocol_*>(this)->writeDoubleArray(values, count);
+  }
+
   /**
    * Reading functions
    */
@@ -479,6 +495,22 @@ public:
     return static_cast<Protocol_*>(this)->readUUID(uuid);
   }
 
+  uint32_t readI16Array_virt(int16_t* values, uint32_t count) override {
+    return static_cast<Protocol_*>(this)->readI16Array(values, count);
+  }
+
+  uint32_t readI32Array_virt(int32_t* values, uint32_t count) override {
+    return static_cast<Protocol_*>(this)->readI32Array(values, count);
+  }
+
+  uint32_t readI64Array_virt(int64_t* values, uint32_t count) override {
+    return static_cast<Protocol_*>(this)->readI64Array(values, count);
+  }
+
+  uint32_t readDoubleArray_virt(double* values, uint32_t count) override {
+    return static_cast<Protocol_*>(this)->readDoubleArray(values, count);
+  }
+
   uint32_t skip_virt(TType type) override { return static_cast<Protocol_*>(this)->skip(type); }
 
   /*
@@ -511,6 +543,83 @@ public:
   }
   using Super_::readBool; // so we don't hide readBool(bool&)
 
+  /*
+   * Provide default bulk list element methods that loop over the
+   * non-virtual single element ones.  Protocols with a cheaper bulk
+   * encoding define their own.
+   */
+  uint32_t writeI16Array(const int16_t* values, uint32_t count) {
+    auto* const prot = static_cast<Protocol_*>(this);
+    uint32_t wsize = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      wsize += prot->writeI16(values[i]);
+    }
+    return wsize;
+  }
+
+  uint32_t writeI32Array(const int32_t* values, uint32_t count) {
+    auto* const prot = static_cast<Protocol_*>(this);
+    uint32_t wsize = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      wsize += prot->writeI32(values[i]);
+    }
+    return wsize;
+  }
+
+  uint32_t writeI64Array(const int64_t* values, uint32_t count) {
+    auto* const prot = static_cast<Protocol_*>(this);
+    uint32_t wsize = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      wsize += prot->writeI64(values[i]);
+    }
+    return wsize;
+  }
+
+  uint32_t writeDoubleArray(const double* values, uint32_t count) {
+    auto* const prot = static_cast<Protocol_*>(this);
+    uint32_t wsize = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      wsize += prot->writeDouble(values[i]);
+    }
+    return wsize;
+  }
+
+  uint32_t readI16Array(int16_t* values, uint32_t count) {
+    auto* const prot = static_cast<Protocol_*>(this);
+    uint32_t rsize = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      rsize += prot->readI16(values[i]);
+    }
+    return rsize;
+  }
+
+  uint32_t readI32Array(int32_t* values, uint32_t count) {
+    auto* const prot = static_cast<Protocol_*>(this);
+    uint32_t rsize = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      rsize += prot->readI32(values[i]);
+    }
+    return rsize;
+  }
+
+  uint32_t readI64Array(int64_t* values, uint32_t count) {
+    auto* const prot = static_cast<Protocol_*>(this);
+    uint32_t rsize = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      rsize += prot->readI64(values[i]);
+    }
+    return rsize;
+  }
+
+  uint32_t readDoubleArray(double* values, uint32_t count) {
+    auto* const prot = static_cast<Protocol_*>(this);
+    uint32_t rsize = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      rsize += prot->readDouble(values[i]);
+    }
+    return rsize;
+  }
+
 protected:
   TVirtualProtocol(std::shared_ptr<TTransport> ptrans) : Super_(ptrans) {}
 };
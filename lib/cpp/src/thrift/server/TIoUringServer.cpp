@@ -0,0 +1,1329 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+#include <thrift/server/TIoUringServer.h>
+#include <thrift/concurrency/Exception.h>
+#include <thrift/concurrency/Mutex.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TSocket.h>
+
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_set>
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+using namespace apache::thrift::protocol;
+using namespace apache::thrift::transport;
+using namespace apache::thrift::concurrency;
+using std::shared_ptr;
+
+namespace {
+
+/// Operation kinds, stored in the low bits of each SQE's user_data.
+enum TIoUringOp {
+  OP_IGNORE = 0,
+  OP_ACCEPT = 1,
+  OP_RECV = 2,
+  OP_SEND = 3,
+  OP_WAKEUP = 4
+};
+
+const uint64_t OP_MASK = 7;
+
+/// Buffer group id used for the provided receive buffers.
+const uint16_t RECV_BUFFER_GROUP = 0;
+
+uint64_t makeUserData(void* ptr, TIoUringOp op) {
+  return reinterpret_cast<uint64_t>(ptr) | static_cast<uint64_t>(op);
+}
+
+int sys_io_uring_setup(unsigned entries, struct io_uring_params* p) {
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+}
+
+int sys_io_uring_enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+  return static_cast<int>(
+      ::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+#ifdef IORING_RECV_MULTISHOT
+int sys_io_uring_register(int fd, unsigned opcode, void* arg, unsigned nrArgs) {
+  return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs));
+}
+#endif
+
+/**
+ * Minimal wrapper around the raw io_uring system call interface.  It maps the
+ * submission and completion rings, hands out SQEs and reaps CQEs.  A Ring is
+ * only ever touched by the IO thread that owns it.
+ */
+class Ring {
+public:
+  Ring()
+    : fd_(-1),
+      sqRing_(nullptr),
+      sqRingSize_(0),
+      cqRing_(nullptr),
+      cqRingSize_(0),
+      sqes_(nullptr),
+      sqesSize_(0),
+      sqHead_(nullptr),
+      sqTail_(nullptr),
+      sqMask_(0),
+      sqEntries_(0),
+      cqHead_(nullptr),
+      cqTail_(nullptr),
+      cqMask_(0),
+      cqes_(nullptr),
+      sqeTail_(0),
+      sqeSubmitted_(0) {}
+
+  ~Ring() { destroy(); }
+
+  void init(unsigned entries) {
+    struct io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+    // Multishot operations can post many completions per submission, so ask
+    // for a roomier completion queue when the kernel supports it.
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = entries * 4;
+    fd_ = sys_io_uring_setup(entries, &p);
+    if (fd_ < 0 && errno == EINVAL) {
+      std::memset(&p, 0, sizeof(p));
+      fd_ = sys_io_uring_setup(entries, &p);
+    }
+    if (fd_ < 0) {
+      int errno_copy = errno;
+      TOutput::instance().perror("TIoUringServer: io_uring_setup() ", errno_copy);
+      throw TException("TIoUringServer: io_uring_setup() failed");
+    }
+
+    sqRingSize_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqRingSize_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap) {
+      sqRingSize_ = cqRingSize_ = (std::max)(sqRingSize_, cqRingSize_);
+    }
+
+    sqRing_ = mapRing(sqRingSize_, IORING_OFF_SQ_RING);
+    if (singleMmap) {
+      cqRing_ = sqRing_;
+    } else {
+      cqRing_ = mapRing(cqRingSize_, IORING_OFF_CQ_RING);
+    }
+    sqesSize_ = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = static_cast<struct io_uring_sqe*>(mapRing(sqesSize_, IORING_OFF_SQES));
+
+    auto* sq = static_cast<uint8_t*>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sqEntries_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_entries);
+    // The SQ array is an indirection we don't need: map slot i to SQE i.
+    auto* array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    for (unsigned i = 0; i < sqEntries_; ++i) {
+      array[i] = i;
+    }
+
+    auto* cq = static_cast<uint8_t*>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + p.cq_off.cqes);
+
+    sqeTail_ = sqeSubmitted_ = *sqTail_;
+  }
+
+  void destroy() {
+    if (sqes_) {
+      ::munmap(sqes_, sqesSize_);
+      sqes_ = nullptr;
+    }
+    if (cqRing_ && cqRing_ != sqRing_) {
+      ::munmap(cqRing_, cqRingSize_);
+    }
+    cqRing_ = nullptr;
+    if (sqRing_) {
+      ::munmap(sqRing_, sqRingSize_);
+      sqRing_ = nullptr;
+    }
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  int fd() const { return fd_; }
+
+  /**
+   * Returns a zeroed SQE.  If the submission queue is full the pending
+   * entries are handed to the kernel first.
+   */
+  struct io_uring_sqe* getSqe() {
+    if (sqeTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_) {
+      submitAndWait(0);
+      if (sqeTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_) {
+        throw TException("TIoUringServer: submission queue overflow");
+      }
+    }
+    struct io_uring_sqe* sqe = &sqes_[sqeTail_ & sqMask_];
+    ++sqeTail_;
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+  }
+
+  /**
+   * Submits everything prepared since the last call and, if waitNr > 0,
+   * blocks until that many completions are available -- one system call.
+   */
+  void submitAndWait(unsigned waitNr) {
+    unsigned toSubmit = sqeTail_ - sqeSubmitted_;
+    __atomic_store_n(sqTail_, sqeTail_, __ATOMIC_RELEASE);
+    sqeSubmitted_ = sqeTail_;
+    if (toSubmit == 0 && waitNr == 0) {
+      return;
+    }
+    if (waitNr > 0 && cqReady() >= waitNr) {
+      waitNr = 0;
+      if (toSubmit == 0) {
+        return;
+      }
+    }
+    unsigned flags = waitNr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    for (;;) {
+      int ret = sys_io_uring_enter(fd_, toSubmit, waitNr, flags);
+      if (ret >= 0) {
+        return;
+      }
+      int errno_copy = errno;
+      if (errno_copy == EINTR) {
+        continue;
+      }
+      if (errno_copy == EBUSY || errno_copy == EAGAIN) {
+        // completion queue overflowed; let the caller reap before retrying
+        return;
+      }
+      TOutput::instance().perror("TIoUringServer: io_uring_enter() ", errno_copy);
+      throw TException("TIoUringServer: io_uring_enter() failed");
+    }
+  }
+
+  /// Invokes f on every available CQE and then releases them to the kernel.
+  template <typename F>
+  void reap(F f) {
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+      // copy the CQE so the slot can be released before f submits new work
+      struct io_uring_cqe cqe = cqes_[head & cqMask_];
+      ++head;
+      __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+      f(cqe);
+      tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    }
+  }
+
+private:
+  unsigned cqReady() const {
+    return __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE) - *cqHead_;
+  }
+
+  void* mapRing(size_t size, off_t offset) {
+    void* ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                       offset);
+    if (ptr == MAP_FAILED) {
+      int errno_copy = errno;
+      TOutput::instance().perror("TIoUringServer: mmap() ", errno_copy);
+      destroy();
+      throw TException("TIoUringServer: could not map io_uring");
+    }
+    return ptr;
+  }
+
+  int fd_;
+  void* sqRing_;
+  size_t sqRingSize_;
+  void* cqRing_;
+  size_t cqRingSize_;
+  struct io_uring_sqe* sqes_;
+  size_t sqesSize_;
+  unsigned* sqHead_;
+  unsigned* sqTail_;
+  unsigned sqMask_;
+  unsigned sqEntries_;
+  unsigned* cqHead_;
+  unsigned* cqTail_;
+  unsigned cqMask_;
+  struct io_uring_cqe* cqes_;
+  unsigned sqeTail_;
+  unsigned sqeSubmitted_;
+};
+
+/**
+ * A ring of fixed-size receive buffers registered with the kernel.  Multishot
+ * receives pick a buffer from here for every completion; the buffer is handed
+ * back as soon as its contents have been copied into the connection.
+ */
+class RecvBufferRing {
+public:
+  RecvBufferRing() : ring_(nullptr), ringSize_(0), buffers_(nullptr), count_(0), size_(0) {}
+
+  ~RecvBufferRing() {
+    if (ring_) {
+      ::munmap(ring_, ringSize_);
+    }
+    std::free(buffers_);
+  }
+
+  /// Registers the buffers; returns false if the kernel does not support it.
+  bool init(Ring& ring, uint32_t count, uint32_t size) {
+#ifdef IORING_RECV_MULTISHOT
+    if (count == 0 || count > 32768 || (count & (count - 1)) != 0) {
+      throw TException("TIoUringServer: receive buffer count must be a power of 2 <= 32768");
+    }
+    ringSize_ = count * sizeof(struct io_uring_buf);
+    void* mem = ::mmap(nullptr, ringSize_, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE,
+                       -1, 0);
+    if (mem == MAP_FAILED) {
+      return false;
+    }
+    ring_ = static_cast<struct io_uring_buf*>(mem);
+
+    struct io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring_);
+    reg.ring_entries = count;
+    reg.bgid = RECV_BUFFER_GROUP;
+    if (sys_io_uring_register(ring.fd(), IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+      ::munmap(ring_, ringSize_);
+      ring_ = nullptr;
+      return false;
+    }
+
+    buffers_ = static_cast<uint8_t*>(std::malloc(static_cast<size_t>(count) * size));
+    if (buffers_ == nullptr) {
+      throw std::bad_alloc();
+    }
+    count_ = count;
+    size_ = size;
+    for (uint32_t i = 0; i < count; ++i) {
+      put(static_cast<uint16_t>(i), static_cast<uint16_t>(i));
+    }
+    __atomic_store_n(tail(), static_cast<uint16_t>(count), __ATOMIC_RELEASE);
+    return true;
+#else
+    (void)ring;
+    (void)count;
+    (void)size;
+    return false;
+#endif
+  }
+
+  uint8_t* buffer(uint16_t bid) const { return buffers_ + static_cast<size_t>(bid) * size_; }
+
+  /// Gives a buffer back to the kernel.
+  void recycle(uint16_t bid) {
+#ifdef IORING_RECV_MULTISHOT
+    uint16_t next = *tail();
+    put(next, bid);
+    __atomic_store_n(tail(), static_cast<uint16_t>(next + 1), __ATOMIC_RELEASE);
+#else
+    (void)bid;
+#endif
+  }
+
+private:
+#ifdef IORING_RECV_MULTISHOT
+  // struct io_uring_buf_ring is not usable from C++: its flexible array
+  // member is preceded by an empty struct, which has a size of one byte in
+  // C++ and shifts every entry.  Index the entries directly instead; the
+  // tail overlays the resv field of the first entry.
+  uint16_t* tail() { return &ring_[0].resv; }
+
+  void put(uint16_t slot, uint16_t bid) {
+    struct io_uring_buf* buf = &ring_[slot & (count_ - 1)];
+    buf->addr = reinterpret_cast<uint64_t>(buffer(bid));
+    buf->len = size_;
+    buf->bid = bid;
+  }
+
+  struct io_uring_buf* ring_;
+#else
+  void* ring_;
+#endif
+  size_t ringSize_;
+  uint8_t* buffers_;
+  uint32_t count_;
+  uint32_t size_;
+};
+
+} // namespace
+
+/// Application states of a connection.
+enum TIoUringAppState { IOU_APP_READ, IOU_APP_WAIT_TASK, IOU_APP_SEND };
+
+/**
+ * Per-IO-thread event loop.  Owns one ring, the provided receive buffers, a
+ * wakeup eventfd and all connections accepted on this thread.
+ */
+class TIoUringServer::IOThread : public Runnable {
+public:
+  IOThread(TIoUringServer* server, int number, THRIFT_SOCKET listenSocket);
+  ~IOThread() override;
+
+  /// Creates the ring and registers buffers.  Called before serving starts.
+  void setup();
+
+  void run() override;
+
+  /// Asks the loop to shut down (can be called from any thread).
+  void stop();
+
+  /// Hands a connection whose task finished back to this thread.
+  void post(TConnection* connection);
+
+  void join();
+
+  TIoUringServer* getServer() const { return server_; }
+
+  void setThread(const std::shared_ptr<Thread>& t) { thread_ = t; }
+
+  bool usesMultishotRecv() const { return multishotRecv_; }
+
+  uint32_t getRecvBufferSize() const { return server_->getRecvBufferSize(); }
+
+  void armRecv(TConnection* connection);
+  void armSend(TConnection* connection);
+
+private:
+  void wakeup();
+  void armAccept();
+  void armWakeup();
+  void beginShutdown();
+  void handleCompletion(const struct io_uring_cqe& cqe);
+  void handleAccept(const struct io_uring_cqe& cqe);
+  void handleRecv(TConnection* connection, const struct io_uring_cqe& cqe);
+  void handleSend(TConnection* connection, const struct io_uring_cqe& cqe);
+  void handleWakeup();
+  void destroyConnection(TConnection* connection);
+
+  TIoUringServer* server_;
+  const int number_;
+  THRIFT_SOCKET listenSocket_;
+  int wakeupFd_;
+  uint64_t wakeupValue_;
+  std::atomic<bool> stop_;
+  bool stopping_;
+  bool acceptArmed_;
+  bool multishotAccept_;
+  bool multishotRecv_;
+  std::unordered_set<TConnection*> connections_;
+  Mutex completedMutex_;
+  std::vector<TConnection*> completed_;
+  std::shared_ptr<Thread> thread_;
+  RecvBufferRing recvBuffers_;
+  Ring ring_;
+};
+
+/**
+ * A client connection served by an IOThread.  Implements the same framing
+ * state machine as TNonblockingServer's TConnection: accumulate a 4 byte
+ * frame size and the frame, process it (inline or as a task), send back the
+ * framed response, then move on to the next frame.
+ */
+class TIoUringServer::TConnection {
+public:
+  class Task;
+
+  TConnection(IOThread* ioThread, THRIFT_SOCKET fd);
+  ~TConnection();
+
+  THRIFT_SOCKET getFD() const { return fd_; }
+
+  /// Appends received bytes and processes any complete frames.
+  void onData(const uint8_t* data, uint32_t len);
+
+  /// Accounts for len bytes received directly into the read buffer.
+  void onDataInPlace(uint32_t len);
+
+  /// Accounts for len bytes sent from the write buffer.
+  void onSent(uint32_t len);
+
+  /// Called on the IO thread once a task has finished.
+  void taskDone();
+
+  /// Marks the connection as closing and shuts the socket down.
+  void close();
+
+  /// True once close() was called and nothing is in flight any more.
+  bool canDestroy() const {
+    return closing_ && !recvArmed_ && !sendArmed_ && appState_ != IOU_APP_WAIT_TASK;
+  }
+
+  /// True if a receive should be outstanding.
+  bool wantsRecv() const {
+    return !closing_ && (ioThread_->usesMultishotRecv() || appState_ == IOU_APP_READ);
+  }
+
+  /// Returns where (and how many bytes) a single-shot receive can write.
+  uint8_t* getRecvPtr(uint32_t* len);
+
+  const uint8_t* getSendPtr(uint32_t* len) const {
+    *len = writeBufferSize_ - writeBufferPos_;
+    return writeBuffer_ + writeBufferPos_;
+  }
+
+  void forceCloseAfterTask() { closeAfterTask_ = true; }
+
+  IOThread* getIOThread() const { return ioThread_; }
+
+  bool recvArmed_;
+  bool sendArmed_;
+  bool closing_;
+
+private:
+  void processFrames();
+  void dispatch(uint32_t frameSize);
+  void finishRequest();
+  void completeFrame();
+  void ensureReadCapacity(uint32_t want);
+
+  IOThread* ioThread_;
+  TIoUringServer* server_;
+  THRIFT_SOCKET fd_;
+  std::shared_ptr<TSocket> tSocket_;
+  TIoUringAppState appState_;
+  bool closeAfterTask_;
+
+  uint8_t* readBuffer_;
+  uint32_t readBufferSize_;
+  uint32_t readBufferLen_;
+  uint32_t frameLen_;
+  std::string pendingInput_;
+
+  uint8_t* writeBuffer_;
+  uint32_t writeBufferSize_;
+  uint32_t writeBufferPos_;
+
+  std::shared_ptr<TMemoryBuffer> inputTransport_;
+  std::shared_ptr<TMemoryBuffer> outputTransport_;
+  std::shared_ptr<TTransport> factoryInputTransport_;
+  std::shared_ptr<TTransport> factoryOutputTransport_;
+  std::shared_ptr<TProtocol> inputProtocol_;
+  std::shared_ptr<TProtocol> outputProtocol_;
+  std::shared_ptr<TProcessor> processor_;
+  std::shared_ptr<TServerEventHandler> serverEventHandler_;
+  void* connectionContext_;
+};
+
+class TIoUringServer::TConnection::Task : public Runnable {
+public:
+  Task(std::shared_ptr<TProcessor> processor,
+       std::shared_ptr<TProtocol> input,
+       std::shared_ptr<TProtocol> output,
+       std::shared_ptr<TSocket> socket,
+       std::shared_ptr<TServerEventHandler> serverEventHandler,
+       void* connectionContext,
+       TConnection* connection)
+    : processor_(processor),
+      input_(input),
+      output_(output),
+      socket_(socket),
+      serverEventHandler_(serverEventHandler),
+      connectionContext_(connectionContext),
+      connection_(connection) {}
+
+  void run() override {
+    try {
+      for (;;) {
+        if (serverEventHandler_) {
+          serverEventHandler_->processContext(connectionContext_, socket_);
+        }
+        if (!processor_->process(input_, output_, connectionContext_)
+            || !input_->getTransport()->peek()) {
+          break;
+        }
+      }
+    } catch (const TTransportException& ttx) {
+      TOutput::instance().printf("TIoUringServer: client died: %s", ttx.what());
+    } catch (const std::bad_alloc&) {
+      TOutput::instance()("TIoUringServer: caught bad_alloc exception.");
+      exit(1);
+    } catch (const std::exception& x) {
+      TOutput::instance().printf("TIoUringServer: process() exception: %s: %s",
+                                 typeid(x).name(),
+                                 x.what());
+    } catch (...) {
+      TOutput::instance().printf("TIoUringServer: unknown exception while processing.");
+    }
+
+    connection_->getIOThread()->post(connection_);
+  }
+
+  TConnection* getTConnection() { return connection_; }
+
+private:
+  std::shared_ptr<TProcessor> processor_;
+  std::shared_ptr<TProtocol> input_;
+  std::shared_ptr<TProtocol> output_;
+  std::shared_ptr<TSocket> socket_;
+  std::shared_ptr<TServerEventHandler> serverEventHandler_;
+  void* connectionContext_;
+  TConnection* connection_;
+};
+
+TIoUringServer::TConnection::TConnection(IOThread* ioThread, THRIFT_SOCKET fd)
+  : recvArmed_(false),
+    sendArmed_(false),
+    closing_(false),
+    ioThread_(ioThread),
+    server_(ioThread->getServer()),
+    fd_(fd),
+    appState_(IOU_APP_READ),
+    closeAfterTask_(false),
+    readBuffer_(nullptr),
+    readBufferSize_(0),
+    readBufferLen_(0),
+    frameLen_(0),
+    writeBuffer_(nullptr),
+    writeBufferSize_(0),
+    writeBufferPos_(0),
+    connectionContext_(nullptr) {
+  tSocket_ = std::make_shared<TSocket>(fd);
+
+  inputTransport_.reset(new TMemoryBuffer(readBuffer_, readBufferSize_));
+  outputTransport_.reset(
+      new TMemoryBuffer(static_cast<uint32_t>(server_->getWriteBufferDefaultSize())));
+
+  factoryInputTransport_ = server_->getInputTransportFactory()->getTransport(inputTransport_);
+  factoryOutputTransport_ = server_->getOutputTransportFactory()->getTransport(outputTransport_);
+
+  if (server_->getHeaderTransport()) {
+    inputProtocol_ = server_->getInputProtocolFactory()->getProtocol(factoryInputTransport_,
+                                                                     factoryOutputTransport_);
+    outputProtocol_ = inputProtocol_;
+  } else {
+    inputProtocol_ = server_->getInputProtocolFactory()->getProtocol(factoryInputTransport_);
+    outputProtocol_ = server_->getOutputProtocolFactory()->getProtocol(factoryOutputTransport_);
+  }
+
+  serverEventHandler_ = server_->getEventHandler();
+  if (serverEventHandler_) {
+    connectionContext_ = serverEventHandler_->createContext(inputProtocol_, outputProtocol_);
+  }
+
+  processor_ = server_->getProcessor(inputProtocol_, outputProtocol_, tSocket_);
+}
+
+TIoUringServer::TConnection::~TConnection() {
+  if (serverEventHandler_) {
+    serverEventHandler_->deleteContext(connectionContext_, inputProtocol_, outputProtocol_);
+  }
+  factoryInputTransport_->close();
+  factoryOutputTransport_->close();
+  tSocket_->close();
+  std::free(readBuffer_);
+}
+
+void TIoUringServer::TConnection::close() {
+  if (closing_) {
+    return;
+  }
+  closing_ = true;
+  // Completes any outstanding receive or send on this socket; the
+  // descriptor itself is closed once nothing refers to it any more.
+  ::shutdown(fd_, SHUT_RDWR);
+}
+
+void TIoUringServer::TConnection::ensureReadCapacity(uint32_t want) {
+  if (want <= readBufferSize_) {
+    return;
+  }
+  uint32_t newSize = readBufferSize_ ? readBufferSize_ : 1024;
+  while (newSize < want) {
+    newSize *= 2;
+  }
+  auto* newBuffer = static_cast<uint8_t*>(std::realloc(readBuffer_, newSize));
+  if (newBuffer == nullptr) {
+    throw std::bad_alloc();
+  }
+  readBuffer_ = newBuffer;
+  readBufferSize_ = newSize;
+}
+
+uint8_t* TIoUringServer::TConnection::getRecvPtr(uint32_t* len) {
+  uint32_t want = readBufferLen_ + ioThread_->getRecvBufferSize();
+  if (frameLen_ > want) {
+    want = frameLen_;
+  }
+  ensureReadCapacity(want);
+  *len = readBufferSize_ - readBufferLen_;
+  return readBuffer_ + readBufferLen_;
+}
+
+void TIoUringServer::TConnection::onData(const uint8_t* data, uint32_t len) {
+  if (closing_) {
+    return;
+  }
+  if (appState_ != IOU_APP_READ) {
+    // the read buffer is in use by the current request; hold on to the
+    // bytes of any pipelined requests until it has been answered
+    if (pendingInput_.size() + len > server_->getMaxFrameSize() + 4) {
+      TOutput::instance().printf("TIoUringServer: too much pipelined data from client %s",
+                                 tSocket_->getSocketInfo().c_str());
+      close();
+      return;
+    }
+    pendingInput_.append(reinterpret_cast<const char*>(data), len);
+    return;
+  }
+  ensureReadCapacity(readBufferLen_ + len);
+  std::memcpy(readBuffer_ + readBufferLen_, data, len);
+  readBufferLen_ += len;
+  processFrames();
+}
+
+void TIoUringServer::TConnection::onDataInPlace(uint32_t len) {
+  if (closing_) {
+    return;
+  }
+  assert(readBufferLen_ + len <= readBufferSize_);
+  readBufferLen_ += len;
+  processFrames();
+}
+
+void TIoUringServer::TConnection::processFrames() {
+  while (appState_ == IOU_APP_READ && !closing_) {
+    if (readBufferLen_ < sizeof(uint32_t)) {
+      return;
+    }
+    uint32_t frameSize;
+    std::memcpy(&frameSize, readBuffer_, sizeof(frameSize));
+    frameSize = ntohl(frameSize);
+    if (frameSize > server_->getMaxFrameSize()) {
+      // Don't allow giant frame sizes.  This prevents bad clients from
+      // causing us to try and allocate a giant buffer.
+      TOutput::instance().printf(
+          "TIoUringServer: frame size too large "
+          "(%" PRIu32 " > %" PRIu64 ") from client %s. "
+          "Remote side not using TFramedTransport?",
+          frameSize,
+          static_cast<uint64_t>(server_->getMaxFrameSize()),
+          tSocket_->getSocketInfo().c_str());
+      close();
+      return;
+    }
+    frameLen_ = frameSize + 4;
+    if (readBufferLen_ < frameLen_) {
+      ensureReadCapacity(frameLen_);
+      return;
+    }
+    dispatch(frameSize);
+  }
+}
+
+void TIoUringServer::TConnection::dispatch(uint32_t frameSize) {
+  if (server_->getHeaderTransport()) {
+    inputTransport_->resetBuffer(readBuffer_, frameSize + 4);
+    outputTransport_->resetBuffer();
+  } else {
+    inputTransport_->resetBuffer(readBuffer_ + 4, frameSize);
+    outputTransport_->resetBuffer();
+
+    // Prepend four bytes of blank space to the buffer so we can
+    // write the frame size there later.
+    outputTransport_->getWritePtr(4);
+    outputTransport_->wroteBytes(4);
+  }
+
+  if (server_->isThreadPoolProcessing()) {
+    std::shared_ptr<Runnable> task = std::make_shared<Task>(processor_,
+                                                            inputProtocol_,
+                                                            outputProtocol_,
+                                                            tSocket_,
+                                                            serverEventHandler_,
+                                                            connectionContext_,
+                                                            this);
+    appState_ = IOU_APP_WAIT_TASK;
+    try {
+      server_->getThreadManager()->add(task, 0LL, server_->getTaskExpireTime());
+    } catch (const IllegalStateException& ise) {
+      TOutput::instance().printf("IllegalStateException: Server::process() %s", ise.what());
+      appState_ = IOU_APP_READ;
+      close();
+    } catch (const TimedOutException& to) {
+      TOutput::instance().printf("[ERROR] TimedOutException: Server::process() %s", to.what());
+      appState_ = IOU_APP_READ;
+      close();
+    }
+    return;
+  }
+
+  try {
+    if (serverEventHandler_) {
+      serverEventHandler_->processContext(connectionContext_, tSocket_);
+    }
+    processor_->process(inputProtocol_, outputProtocol_, connectionContext_);
+  } catch (const TTransportException& ttx) {
+    TOutput::instance().printf("TIoUringServer transport error in process(): %s", ttx.what());
+    close();
+    return;
+  } catch (const std::exception& x) {
+    TOutput::instance().printf("Server::process() uncaught exception: %s: %s",
+                               typeid(x).name(),
+                               x.what());
+    close();
+    return;
+  } catch (...) {
+    TOutput::instance().printf("Server::process() unknown exception");
+    close();
+    return;
+  }
+  finishRequest();
+}
+
+void TIoUringServer::TConnection::taskDone() {
+  assert(appState_ == IOU_APP_WAIT_TASK);
+  appState_ = IOU_APP_READ;
+  if (closeAfterTask_) {
+    close();
+  }
+  if (closing_) {
+    return;
+  }
+  finishRequest();
+}
+
+void TIoUringServer::TConnection::finishRequest() {
+  outputTransport_->getBuffer(&writeBuffer_, &writeBufferSize_);
+
+  // 4 bytes were reserved for frame size
+  if (writeBufferSize_ > 4) {
+    writeBufferPos_ = 0;
+    auto frameSize = static_cast<uint32_t>(htonl(writeBufferSize_ - 4));
+    std::memcpy(writeBuffer_, &frameSize, 4);
+    appState_ = IOU_APP_SEND;
+    ioThread_->armSend(this);
+    return;
+  }
+
+  // oneway request, nothing to send back
+  completeFrame();
+}
+
+void TIoUringServer::TConnection::onSent(uint32_t len) {
+  if (closing_) {
+    return;
+  }
+  writeBufferPos_ += len;
+  assert(writeBufferPos_ <= writeBufferSize_);
+  if (writeBufferPos_ < writeBufferSize_) {
+    ioThread_->armSend(this);
+    return;
+  }
+  completeFrame();
+}
+
+void TIoUringServer::TConnection::completeFrame() {
+  writeBuffer_ = nullptr;
+  writeBufferSize_ = 0;
+  writeBufferPos_ = 0;
+
+  // drop the frame we just answered, keeping any bytes that follow it
+  assert(frameLen_ <= readBufferLen_);
+  readBufferLen_ -= frameLen_;
+  if (readBufferLen_ > 0) {
+    std::memmove(readBuffer_, readBuffer_ + frameLen_, readBufferLen_);
+  }
+  frameLen_ = 0;
+  appState_ = IOU_APP_READ;
+
+  if (!pendingInput_.empty()) {
+    ensureReadCapacity(readBufferLen_ + static_cast<uint32_t>(pendingInput_.size()));
+    std::memcpy(readBuffer_ + readBufferLen_, pendingInput_.data(), pendingInput_.size());
+    readBufferLen_ += static_cast<uint32_t>(pendingInput_.size());
+    pendingInput_.clear();
+  }
+
+  // don't let one large request pin memory on an idle connection
+  if (readBufferLen_ == 0 && readBufferSize_ > 4 * ioThread_->getRecvBufferSize()) {
+    std::free(readBuffer_);
+    readBuffer_ = nullptr;
+    readBufferSize_ = 0;
+  }
+  if (outputTransport_->getBufferSize() > 4 * server_->getWriteBufferDefaultSize()) {
+    outputTransport_->resetBuffer(static_cast<uint32_t>(server_->getWriteBufferDefaultSize()));
+  }
+
+  processFrames();
+  if (!recvArmed_ && wantsRecv() && appState_ == IOU_APP_READ) {
+    ioThread_->armRecv(this);
+  }
+}
+
+TIoUringServer::IOThread::IOThread(TIoUringServer* server, int number, THRIFT_SOCKET listenSocket)
+  : server_(server),
+    number_(number),
+    listenSocket_(listenSocket),
+    wakeupFd_(-1),
+    wakeupValue_(0),
+    stop_(false),
+    stopping_(false),
+    acceptArmed_(false),
+    multishotAccept_(true),
+    multishotRecv_(false) {
+}
+
+TIoUringServer::IOThread::~IOThread() {
+  join();
+  for (auto connection : connections_) {
+    delete connection;
+  }
+  connections_.clear();
+  ring_.destroy();
+  if (wakeupFd_ >= 0) {
+    ::close(wakeupFd_);
+  }
+}
+
+void TIoUringServer::IOThread::setup() {
+  ring_.init(server_->getRingEntries());
+  multishotRecv_
+      = recvBuffers_.init(ring_, server_->getRecvBufferCount(), server_->getRecvBufferSize());
+#ifndef IORING_ACCEPT_MULTISHOT
+  multishotAccept_ = false;
+#endif
+  wakeupFd_ = ::eventfd(0, EFD_CLOEXEC);
+  if (wakeupFd_ < 0) {
+    int errno_copy = errno;
+    TOutput::instance().perror("TIoUringServer: eventfd() ", errno_copy);
+    throw TException("TIoUringServer: can't create wakeup eventfd");
+  }
+}
+
+void TIoUringServer::IOThread::armAccept() {
+  struct io_uring_sqe* sqe = ring_.getSqe();
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = listenSocket_;
+  sqe->accept_flags = SOCK_CLOEXEC;
+#ifdef IORING_ACCEPT_MULTISHOT
+  if (multishotAccept_) {
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  }
+#endif
+  sqe->user_data = makeUserData(nullptr, OP_ACCEPT);
+  acceptArmed_ = true;
+}
+
+void TIoUringServer::IOThread::armWakeup() {
+  struct io_uring_sqe* sqe = ring_.getSqe();
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = wakeupFd_;
+  sqe->addr = reinterpret_cast<uint64_t>(&wakeupValue_);
+  sqe->len = sizeof(wakeupValue_);
+  sqe->user_data = makeUserData(nullptr, OP_WAKEUP);
+}
+
+void TIoUringServer::IOThread::armRecv(TConnection* connection) {
+  struct io_uring_sqe* sqe = ring_.getSqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = connection->getFD();
+#ifdef IORING_RECV_MULTISHOT
+  if (multishotRecv_) {
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RECV_BUFFER_GROUP;
+  } else
+#endif
+  {
+    uint32_t len = 0;
+    sqe->addr = reinterpret_cast<uint64_t>(connection->getRecvPtr(&len));
+    sqe->len = len;
+  }
+  sqe->user_data = makeUserData(connection, OP_RECV);
+  connection->recvArmed_ = true;
+}
+
+void TIoUringServer::IOThread::armSend(TConnection* connection) {
+  uint32_t len = 0;
+  const uint8_t* buf = connection->getSendPtr(&len);
+  struct io_uring_sqe* sqe = ring_.getSqe();
+  sqe->opcode = IORING_OP_SEND;
+  sqe->fd = connection->getFD();
+  sqe->addr = reinterpret_cast<uint64_t>(buf);
+  sqe->len = len;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = makeUserData(connection, OP_SEND);
+  connection->sendArmed_ = true;
+}
+
+void TIoUringServer::IOThread::run() {
+  TOutput::instance().printf("TIoUringServer: IO thread #%d entering loop...", number_);
+
+  armWakeup();
+  if (listenSocket_ != THRIFT_INVALID_SOCKET) {
+    armAccept();
+  }
+  if (stop_) {
+    beginShutdown();
+  }
+
+  while (!stopping_ || acceptArmed_ || !connections_.empty()) {
+    ring_.submitAndWait(1);
+    ring_.reap([this](const struct io_uring_cqe& cqe) { handleCompletion(cqe); });
+  }
+
+  // Closing the ring cancels the wakeup read that is still armed.
+  ring_.destroy();
+  TOutput::instance().printf("TIoUringServer: IO thread #%d run() done!", number_);
+}
+
+void TIoUringServer::IOThread::handleCompletion(const struct io_uring_cqe& cqe) {
+  auto op = static_cast<TIoUringOp>(cqe.user_data & OP_MASK);
+  void* ptr = reinterpret_cast<void*>(cqe.user_data & ~OP_MASK);
+
+  switch (op) {
+  case OP_ACCEPT:
+    handleAccept(cqe);
+    break;
+  case OP_RECV:
+    handleRecv(static_cast<TConnection*>(ptr), cqe);
+    break;
+  case OP_SEND:
+    handleSend(static_cast<TConnection*>(ptr), cqe);
+    break;
+  case OP_WAKEUP:
+    handleWakeup();
+    break;
+  case OP_IGNORE:
+  default:
+    break;
+  }
+}
+
+void TIoUringServer::IOThread::handleAccept(const struct io_uring_cqe& cqe) {
+  bool more = false;
+#ifdef IORING_ACCEPT_MULTISHOT
+  more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+#endif
+  if (!more) {
+    acceptArmed_ = false;
+  }
+
+  if (cqe.res >= 0) {
+    THRIFT_SOCKET fd = cqe.res;
+    if (stopping_ || server_->numConnections_.load() >= server_->getMaxConnections()) {
+      ::THRIFT_CLOSESOCKET(fd);
+    } else {
+      TConnection* connection = nullptr;
+      try {
+        connection = new TConnection(this, fd);
+      } catch (const std::exception& x) {
+        TOutput::instance().printf("TIoUringServer: failed to create connection: %s", x.what());
+        ::THRIFT_CLOSESOCKET(fd);
+      }
+      if (connection) {
+        ++server_->numConnections_;
+        connections_.insert(connection);
+        armRecv(connection);
+      }
+    }
+  } else if (cqe.res == -EINVAL && multishotAccept_) {
+    TOutput::instance().printf("TIoUringServer: multishot accept not supported, falling back");
+    multishotAccept_ = false;
+  } else if (cqe.res != -ECANCELED) {
+    TOutput::instance().perror("TIoUringServer: accept() ", -cqe.res);
+  }
+
+  if (!acceptArmed_ && !stopping_) {
+    armAccept();
+  }
+}
+
+void TIoUringServer::IOThread::handleRecv(TConnection* connection,
+                                          const struct io_uring_cqe& cqe) {
+  bool more = false;
+#ifdef IORING_RECV_MULTISHOT
+  more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+#endif
+  if (!more) {
+    connection->recvArmed_ = false;
+  }
+
+  try {
+    if (cqe.res > 0) {
+#ifdef IORING_RECV_MULTISHOT
+      if (cqe.flags & IORING_CQE_F_BUFFER) {
+        auto bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        connection->onData(recvBuffers_.buffer(bid), static_cast<uint32_t>(cqe.res));
+        recvBuffers_.recycle(bid);
+      } else
+#endif
+      {
+        connection->onDataInPlace(static_cast<uint32_t>(cqe.res));
+      }
+    } else if (cqe.res == 0) {
+      // remote disconnect
+      connection->close();
+    } else if (cqe.res == -ENOBUFS) {
+      // provided buffers ran dry; they have been recycled by now, re-arm
+    } else if (cqe.res == -EINVAL && multishotRecv_) {
+      TOutput::instance().printf("TIoUringServer: multishot recv not supported, falling back");
+      multishotRecv_ = false;
+    } else {
+      if (!connection->closing_) {
+        TOutput::instance().perror("TIoUringServer: recv() ", -cqe.res);
+      }
+      connection->close();
+    }
+  } catch (const std::bad_alloc&) {
+    TOutput::instance()("TIoUringServer: caught bad_alloc exception.");
+    connection->close();
+  }
+
+  if (!connection->recvArmed_ && connection->wantsRecv()) {
+    armRecv(connection);
+  }
+  if (connection->canDestroy()) {
+    destroyConnection(connection);
+  }
+}
+
+void TIoUringServer::IOThread::handleSend(TConnection* connection,
+                                          const struct io_uring_cqe& cqe) {
+  connection->sendArmed_ = false;
+  try {
+    if (cqe.res < 0) {
+      if (!connection->closing_) {
+        TOutput::instance().perror("TIoUringServer: send() ", -cqe.res);
+      }
+      connection->close();
+    } else {
+      connection->onSent(static_cast<uint32_t>(cqe.res));
+    }
+  } catch (const std::bad_alloc&) {
+    TOutput::instance()("TIoUringServer: caught bad_alloc exception.");
+    connection->close();
+  }
+  if (connection->canDestroy()) {
+    destroyConnection(connection);
+  }
+}
+
+void TIoUringServer::IOThread::handleWakeup() {
+  std::vector<TConnection*> completed;
+  {
+    Guard g(completedMutex_);
+    completed.swap(completed_);
+  }
+  for (auto connection : completed) {
+    try {
+      connection->taskDone();
+    } catch (const std::bad_alloc&) {
+      TOutput::instance()("TIoUringServer: caught bad_alloc exception.");
+      connection->close();
+    }
+    if (!connection->recvArmed_ && connection->wantsRecv()) {
+      armRecv(connection);
+    }
+    if (connection->canDestroy()) {
+      destroyConnection(connection);
+    }
+  }
+
+  if (stop_ && !stopping_) {
+    beginShutdown();
+  }
+  armWakeup();
+}
+
+void TIoUringServer::IOThread::beginShutdown() {
+  stopping_ = true;
+  if (acceptArmed_) {
+    struct io_uring_sqe* sqe = ring_.getSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = makeUserData(nullptr, OP_ACCEPT);
+    sqe->user_data = makeUserData(nullptr, OP_IGNORE);
+  }
+  std::vector<TConnection*> connections(connections_.begin(), connections_.end());
+  for (auto connection : connections) {
+    connection->close();
+    if (connection->canDestroy()) {
+      destroyConnection(connection);
+    }
+  }
+}
+
+void TIoUringServer::IOThread::destroyConnection(TConnection* connection) {
+  connections_.erase(connection);
+  --server_->numConnections_;
+  delete connection;
+}
+
+void TIoUringServer::IOThread::wakeup() {
+  uint64_t one = 1;
+  ssize_t ret;
+  do {
+    ret = ::write(wakeupFd_, &one, sizeof(one));
+  } while (ret < 0 && errno == EINTR);
+}
+
+void TIoUringServer::IOThread::post(TConnection* connection) {
+  {
+    Guard g(completedMutex_);
+    completed_.push_back(connection);
+  }
+  wakeup();
+}
+
+void TIoUringServer::IOThread::stop() {
+  stop_ = true;
+  if (wakeupFd_ >= 0) {
+    wakeup();
+  }
+}
+
+void TIoUringServer::IOThread::join() {
+  if (thread_) {
+    try {
+      thread_->join();
+    } catch (...) {
+      // swallow everything
+    }
+  }
+}
+
+TIoUringServer::~TIoUringServer() {
+  // The IOThread objects have shared_ptrs to the Thread objects and the
+  // Thread objects have shared_ptrs to the IOThread objects (as runnable) so
+  // these objects will never deallocate without help.
+  while (!ioThreads_.empty()) {
+    std::shared_ptr<IOThread> iot = ioThreads_.back();
+    ioThreads_.pop_back();
+    iot->join();
+    iot->setThread(std::shared_ptr<Thread>());
+  }
+}
+
+bool TIoUringServer::isSupported() {
+  struct io_uring_params p;
+  std::memset(&p, 0, sizeof(p));
+  int fd = sys_io_uring_setup(2, &p);
+  if (fd < 0) {
+    return false;
+  }
+  ::close(fd);
+  return true;
+}
+
+void TIoUringServer::setThreadManager(std::shared_ptr<ThreadManager> threadManager) {
+  threadManager_ = threadManager;
+  if (threadManager) {
+    threadManager->setExpireCallback(
+        std::bind(&TIoUringServer::expireClose, this, std::placeholders::_1));
+  }
+}
+
+void TIoUringServer::expireClose(std::shared_ptr<Runnable> task) {
+  auto* t = dynamic_cast<TConnection::Task*>(task.get());
+  if (t) {
+    TConnection* connection = t->getTConnection();
+    connection->forceCloseAfterTask();
+    connection->getIOThread()->post(connection);
+  }
+}
+
+void TIoUringServer::serve() {
+  serverTransport_->listen();
+  THRIFT_SOCKET listenSocket = serverTransport_->getSocketFD();
+
+  if (!numIOThreads_) {
+    numIOThreads_ = DEFAULT_IO_THREADS;
+  }
+
+  {
+    Guard g(ioThreadsMutex_);
+    for (uint32_t id = 0; id < numIOThreads_; ++id) {
+      shared_ptr<IOThread> thread = std::make_shared<IOThread>(this, id, listenSocket);
+      thread->setup();
+      ioThreads_.push_back(thread);
+      if (stopped_) {
+        thread->stop();
+      }
+    }
+  }
+
+  // Notify handler of the preServe event
+  if (eventHandler_) {
+    eventHandler_->preServe();
+  }
+
+  TOutput::instance().printf("TIoUringServer: Serving with %d io threads.", ioThreads_.size());
+
+  // Launch all the secondary IO threads in separate threads
+  if (ioThreads_.size() > 1) {
+    ioThreadFactory_.reset(new ThreadFactory(false));
+    for (uint32_t i = 1; i < ioThreads_.size(); ++i) {
+      shared_ptr<Thread> thread = ioThreadFactory_->newThread(ioThreads_[i]);
+      ioThreads_[i]->setThread(thread);
+      thread->start();
+    }
+  }
+
+  // Run the first IO thread loop in our main thread; this will only return
+  // when the server is shutting down.
+  ioThreads_[0]->run();
+
+  for (uint32_t i = 0; i < ioThreads_.size(); ++i) {
+    ioThreads_[i]->join();
+  }
+  serverTransport_->close();
+}
+
+void TIoUringServer::stop() {
+  Guard g(ioThreadsMutex_);
+  stopped_ = true;
+  for (auto& ioThread : ioThreads_) {
+    ioThread->stop();
+  }
+}
+}
+}
+} // apache::thrift::server
+
+#endif // HAVE_LINUX_IO_URING_H
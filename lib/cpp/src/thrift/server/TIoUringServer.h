@@ -0,0 +1,265 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_SERVER_TIOURINGSERVER_H_
+#define _THRIFT_SERVER_TIOURINGSERVER_H_ 1
+
+#include <thrift/Thrift.h>
+#include <thrift/server/TServer.h>
+#include <thrift/transport/TNonblockingServerTransport.h>
+#include <thrift/concurrency/ThreadManager.h>
+#include <thrift/concurrency/ThreadFactory.h>
+#include <thrift/concurrency/Mutex.h>
+
+#include <atomic>
+#include <climits>
+#include <memory>
+#include <vector>
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+using apache::thrift::transport::TNonblockingServerTransport;
+using apache::thrift::concurrency::ThreadManager;
+using apache::thrift::concurrency::ThreadFactory;
+
+/**
+ * A framed, non-blocking server driven by Linux io_uring instead of libevent.
+ *
+ * Like TNonblockingServer it runs a set of IO threads and expects every
+ * request to be framed with a 4 byte length indicator.  Each IO thread owns
+ * its own submission/completion ring and arms a multishot accept on the
+ * shared listen socket, so new connections are spread across the IO threads
+ * by the kernel without any cross-thread handoff.  Socket reads use
+ * multishot receive with a ring of provided buffers, and all operations
+ * prepared while handling a batch of completions are submitted with a single
+ * io_uring_enter() call.  On kernels without multishot support the server
+ * falls back to re-arming single-shot operations.
+ *
+ * Requests are processed inline on the IO thread, or on a ThreadManager if
+ * one is supplied, exactly as TNonblockingServer does.
+ *
+ * This server is only available on Linux (HAVE_LINUX_IO_URING_H); use
+ * isSupported() to check whether the running kernel allows io_uring.
+ */
+class TIoUringServer : public TServer {
+public:
+  class TConnection;
+  class IOThread;
+
+  /// Default # of IO threads
+  static const int DEFAULT_IO_THREADS = 1;
+
+  /// Default limit on total number of connected sockets
+  static const int MAX_CONNECTIONS = INT_MAX;
+
+  /// Default limit on frame size
+  static const int MAX_FRAME_SIZE = 256 * 1024 * 1024;
+
+  /// Default # of submission queue entries per IO thread
+  static const int RING_ENTRIES = 256;
+
+  /// Default size of each provided receive buffer
+  static const int RECV_BUFFER_SIZE = 16 * 1024;
+
+  /// Default # of provided receive buffers per IO thread (power of 2)
+  static const int RECV_BUFFER_COUNT = 256;
+
+  /// Default size of write buffer
+  static const int WRITE_BUFFER_DEFAULT_SIZE = 1024;
+
+  TIoUringServer(const std::shared_ptr<TProcessorFactory>& processorFactory,
+                 const std::shared_ptr<TNonblockingServerTransport>& serverTransport,
+                 const std::shared_ptr<ThreadManager>& threadManager
+                 = std::shared_ptr<ThreadManager>())
+    : TServer(processorFactory), serverTransport_(serverTransport) {
+    init();
+    setThreadManager(threadManager);
+  }
+
+  TIoUringServer(const std::shared_ptr<TProcessor>& processor,
+                 const std::shared_ptr<TNonblockingServerTransport>& serverTransport,
+                 const std::shared_ptr<ThreadManager>& threadManager
+                 = std::shared_ptr<ThreadManager>())
+    : TServer(processor), serverTransport_(serverTransport) {
+    init();
+    setThreadManager(threadManager);
+  }
+
+  TIoUringServer(const std::shared_ptr<TProcessor>& processor,
+                 const std::shared_ptr<TProtocolFactory>& protocolFactory,
+                 const std::shared_ptr<TNonblockingServerTransport>& serverTransport,
+                 const std::shared_ptr<ThreadManager>& threadManager
+                 = std::shared_ptr<ThreadManager>())
+    : TServer(processor), serverTransport_(serverTransport) {
+    init();
+    setInputProtocolFactory(protocolFactory);
+    setOutputProtocolFactory(protocolFactory);
+    setThreadManager(threadManager);
+  }
+
+  TIoUringServer(const std::shared_ptr<TProcessorFactory>& processorFactory,
+                 const std::shared_ptr<TProtocolFactory>& protocolFactory,
+                 const std::shared_ptr<TNonblockingServerTransport>& serverTransport,
+                 const std::shared_ptr<ThreadManager>& threadManager
+                 = std::shared_ptr<ThreadManager>())
+    : TServer(processorFactory), serverTransport_(serverTransport) {
+    init();
+    setInputProtocolFactory(protocolFactory);
+    setOutputProtocolFactory(protocolFactory);
+    setThreadManager(threadManager);
+  }
+
+  ~TIoUringServer() override;
+
+  /**
+   * Returns true if the running kernel lets this process create an io_uring
+   * instance.  serve() throws a TException when it does not.
+   */
+  static bool isSupported();
+
+  void setThreadManager(std::shared_ptr<ThreadManager> threadManager);
+
+  std::shared_ptr<ThreadManager> getThreadManager() { return threadManager_; }
+
+  bool isThreadPoolProcessing() const { return threadManager_ != nullptr; }
+
+  int getListenPort() { return serverTransport_->getListenPort(); }
+
+  /**
+   * Sets the number of IO threads used by this server. Can only be used before
+   * the call to serve() and has no effect afterwards.
+   */
+  void setNumIOThreads(size_t numThreads) { numIOThreads_ = numThreads; }
+
+  /** Return the number of IO threads used by this server. */
+  size_t getNumIOThreads() const { return numIOThreads_; }
+
+  /**
+   * Get the maximum # of connections allowed.  Connections accepted beyond
+   * this limit are closed immediately.
+   */
+  size_t getMaxConnections() const { return maxConnections_; }
+
+  /// Set the maximum # of connections allowed.
+  void setMaxConnections(size_t maxConnections) { maxConnections_ = maxConnections; }
+
+  /// Return the count of sockets currently connected to.
+  size_t getNumConnections() const { return numConnections_.load(); }
+
+  /**
+   * Get the maximum allowed frame size.  Clients sending larger frames are
+   * disconnected.
+   */
+  size_t getMaxFrameSize() const { return maxFrameSize_; }
+
+  /// Set the maximum allowed frame size.
+  void setMaxFrameSize(size_t maxFrameSize) { maxFrameSize_ = maxFrameSize; }
+
+  /// Get the # of submission queue entries per IO thread ring.
+  unsigned getRingEntries() const { return ringEntries_; }
+
+  /// Set the # of submission queue entries per IO thread ring.
+  void setRingEntries(unsigned entries) { ringEntries_ = entries; }
+
+  /// Get the size of each provided receive buffer.
+  uint32_t getRecvBufferSize() const { return recvBufferSize_; }
+
+  /// Set the size of each provided receive buffer.
+  void setRecvBufferSize(uint32_t size) { recvBufferSize_ = size; }
+
+  /// Get the # of provided receive buffers per IO thread.
+  uint32_t getRecvBufferCount() const { return recvBufferCount_; }
+
+  /**
+   * Set the # of provided receive buffers per IO thread.  Must be a power of
+   * two no larger than 32768.
+   */
+  void setRecvBufferCount(uint32_t count) { recvBufferCount_ = count; }
+
+  /// Get the starting size of a connection's write buffer.
+  size_t getWriteBufferDefaultSize() const { return writeBufferDefaultSize_; }
+
+  /// Set the starting size of a connection's write buffer.
+  void setWriteBufferDefaultSize(size_t size) { writeBufferDefaultSize_ = size; }
+
+  /// Get the time in milliseconds after which a task expires (0 == infinite).
+  int64_t getTaskExpireTime() const { return taskExpireTime_; }
+
+  /// Set the time in milliseconds after which a task expires (0 == infinite).
+  void setTaskExpireTime(int64_t taskExpireTime) { taskExpireTime_ = taskExpireTime; }
+
+  /**
+   * Some transports, like THeaderTransport, require passing through
+   * the framing size instead of stripping it.
+   */
+  bool getHeaderTransport() { return getOutputProtocolFactory() == nullptr; }
+
+  /**
+   * Starts listening, runs IO thread #0 in the calling thread and returns
+   * once stop() has been called and all IO threads have finished.
+   */
+  void serve() override;
+
+  /// Causes the server to terminate gracefully (can be called from any thread).
+  void stop() override;
+
+private:
+  friend class TConnection;
+  friend class IOThread;
+
+  void init() {
+    numIOThreads_ = DEFAULT_IO_THREADS;
+    maxConnections_ = MAX_CONNECTIONS;
+    maxFrameSize_ = MAX_FRAME_SIZE;
+    ringEntries_ = RING_ENTRIES;
+    recvBufferSize_ = RECV_BUFFER_SIZE;
+    recvBufferCount_ = RECV_BUFFER_COUNT;
+    writeBufferDefaultSize_ = WRITE_BUFFER_DEFAULT_SIZE;
+    taskExpireTime_ = 0;
+    numConnections_ = 0;
+    stopped_ = false;
+  }
+
+  /// Closes the connection of a task that expired in the ThreadManager.
+  void expireClose(std::shared_ptr<apache::thrift::concurrency::Runnable> task);
+
+  std::shared_ptr<TNonblockingServerTransport> serverTransport_;
+  std::shared_ptr<ThreadManager> threadManager_;
+  std::shared_ptr<ThreadFactory> ioThreadFactory_;
+  std::vector<std::shared_ptr<IOThread> > ioThreads_;
+  apache::thrift::concurrency::Mutex ioThreadsMutex_;
+  bool stopped_;
+
+  size_t numIOThreads_;
+  size_t maxConnections_;
+  size_t maxFrameSize_;
+  unsigned ringEntries_;
+  uint32_t recvBufferSize_;
+  uint32_t recvBufferCount_;
+  size_t writeBufferDefaultSize_;
+  int64_t taskExpireTime_;
+  std::atomic<size_t> numConnections_;
+};
+}
+}
+} // apache::thrift::server
+
+#endif // #ifndef _THRIFT_SERVER_TIOURINGSERVER_H_
@@ -26,6 +26,7 @@
 #include <thrift/transport/PlatformSocket.h>
 
 #include <algorithm>
+#include <deque>
 #include <iostream>
 
 #ifdef HAVE_POLL_H
@@ -40,6 +41,10 @@
 #include <sys/socket.h>
 #endif
 
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
 #ifdef HAVE_NETINET_IN_H
 #include <netinet/in.h>
 #include <netinet/tcp.h>
@@ -185,6 +190,32 @@ private:
   /// Thrift call context, if any
   void* connectionContext_;
 
+  /// Next connection in the IO thread's notification queue
+  TConnection* nextNotification_;
+
+  struct PipelinedRequest;
+
+  /// Whether frames are read ahead and processed concurrently
+  bool pipelined_;
+
+  /// Whether pipelined responses may be written out of order
+  bool outOfOrder_;
+
+  /// Pipelined requests without a response on the wire yet, in arrival order
+  std::deque<std::shared_ptr<PipelinedRequest> > pipeline_;
+
+  /// The pipelined request whose response is in writeBuffer_
+  std::shared_ptr<PipelinedRequest> sending_;
+
+  /// Pipelined tasks dispatched whose completion the IO thread has not seen
+  uint32_t inFlight_;
+
+  /// Pipelined tasks completed since the IO thread last looked
+  std::atomic<uint32_t> completions_;
+
+  /// Set when a pipelined connection is closed while tasks are in flight
+  bool closePending_;
+
   /// Go into read mode
   void setRead() { setFlags(EV_READ | EV_PERSIST); }
 
@@ -209,6 +240,29 @@ private:
    */
   void workSocket();
 
+  /// Hands the frame in readBuffer_ to the thread manager (pipelined mode)
+  void dispatchPipelined();
+
+  /// Accounts for finished tasks and starts writing responses (pipelined mode)
+  void pipelineCompleted();
+
+  /**
+   * Moves the next ready response into writeBuffer_ (pipelined mode).
+   *
+   * @return false if the connection was closed.
+   */
+  bool nextPipelinedResponse();
+
+  /**
+   * Writes what the socket takes of the current response (pipelined mode).
+   *
+   * @return false if the connection was closed.
+   */
+  bool writePipelined();
+
+  /// Reads while there is room for more requests and writes while there is a response
+  void setPipelinedFlags();
+
 public:
   class Task;
 
@@ -217,6 +271,8 @@ public:
               TNonblockingIOThread* ioThread) {
     readBuffer_ = nullptr;
     readBufferSize_ = 0;
+    nextNotification_ = nullptr;
+    completions_ = 0;
 
     ioThread_ = ioThread;
     server_ = ioThread->getServer();
@@ -266,9 +322,21 @@ public:
    * @param which the flags associated with the event.
    * @param v void* callback arg where we placed TConnection's "this".
    */
-  static void eventHandler(evutil_socket_t fd, short /* which */, void* v) {
-    assert(fd == static_cast<evutil_socket_t>(((TConnection*)v)->getTSocket()->getSocketFD()));
-    ((TConnection*)v)->workSocket();
+  static void eventHandler(evutil_socket_t fd, short which, void* v) {
+    auto* connection = (TConnection*)v;
+    assert(fd == static_cast<evutil_socket_t>(connection->getTSocket()->getSocketFD()));
+    (void)fd;
+    if (connection->pipelined_) {
+      // reading and writing go on side by side
+      if ((which & EV_WRITE) && (connection->eventFlags_ & EV_WRITE)
+          && !connection->writePipelined()) {
+        return;
+      }
+      if (!(which & EV_READ) || !(connection->eventFlags_ & EV_READ)) {
+        return;
+      }
+    }
+    connection->workSocket();
   }
 
   /**
@@ -282,6 +350,26 @@ public:
    */
   bool notifyIOThread() { return ioThread_->notify(this); }
 
+  /// Called by the IO thread for every notification of this connection.
+  void notified() {
+    if (pipelined_ && appState_ != APP_INIT) {
+      pipelineCompleted();
+    } else {
+      transition();
+    }
+  }
+
+  /**
+   * Called by a task thread when a pipelined request is finished, or when
+   * its task was dropped.  Only the completion that finds no others
+   * pending notifies the IO thread.
+   */
+  void completePipelined(PipelinedRequest& request);
+
+  /// Link used by TNonblockingIOThread to queue notified connections.
+  TConnection* getNextNotification() const { return nextNotification_; }
+  void setNextNotification(TConnection* next) { nextNotification_ = next; }
+
   /*
    * Returns the number of this connection's currently assigned IO
    * thread.
@@ -314,16 +402,37 @@ public:
   void* getConnectionContext() { return connectionContext_; }
 };
 
+/**
+ * A request read ahead on a pipelined connection.  It brings its own
+ * buffers and protocols so it can be processed alongside its neighbours.
+ */
+struct TNonblockingServer::TConnection::PipelinedRequest {
+  std::shared_ptr<TMemoryBuffer> inputTransport;
+  std::shared_ptr<TMemoryBuffer> outputTransport;
+  std::shared_ptr<TTransport> factoryInputTransport;
+  std::shared_ptr<TTransport> factoryOutputTransport;
+  std::shared_ptr<TProtocol> inputProtocol;
+  std::shared_ptr<TProtocol> outputProtocol;
+
+  /// Set (after failed) once the response is in outputTransport
+  std::atomic<bool> done{false};
+
+  /// Set if the task was dropped, which closes the connection
+  std::atomic<bool> failed{false};
+};
+
 class TNonblockingServer::TConnection::Task : public Runnable {
 public:
   Task(std::shared_ptr<TProcessor> processor,
        std::shared_ptr<TProtocol> input,
        std::shared_ptr<TProtocol> output,
-       TConnection* connection)
+       TConnection* connection,
+       std::shared_ptr<PipelinedRequest> request = std::shared_ptr<PipelinedRequest>())
     : processor_(processor),
       input_(input),
       output_(output),
       connection_(connection),
+      request_(request),
       serverEventHandler_(connection_->getServerEventHandler()),
       connectionContext_(connection_->getConnectionContext()) {}
 
@@ -351,6 +460,11 @@ public:
       TOutput::instance().printf("TNonblockingServer: unknown exception while processing.");
     }
 
+    if (request_) {
+      connection_->completePipelined(*request_);
+      return;
+    }
+
     // Signal completion back to the libevent thread via a pipe
     if (!connection_->notifyIOThread()) {
       TOutput::instance().printf("TNonblockingServer: failed to notifyIOThread, closing.");
@@ -362,11 +476,23 @@ public:
 
   TConnection* getTConnection() { return connection_; }
 
+  /// Closes the connection of a task that is dropped rather than run.
+  void cancel() {
+    if (request_) {
+      request_->failed = true;
+      connection_->completePipelined(*request_);
+    } else {
+      assert(connection_->getServer() && connection_->getState() == APP_WAIT_TASK);
+      connection_->forceClose();
+    }
+  }
+
 private:
   std::shared_ptr<TProcessor> processor_;
   std::shared_ptr<TProtocol> input_;
   std::shared_ptr<TProtocol> output_;
   TConnection* connection_;
+  std::shared_ptr<PipelinedRequest> request_;
   std::shared_ptr<TServerEventHandler> serverEventHandler_;
   void* connectionContext_;
 };
@@ -388,6 +514,11 @@ void TNonblockingServer::TConnection::init(TNonblockingIOThread* ioThread) {
   socketState_ = SOCKET_RECV_FRAMING;
   callsForResize_ = 0;
 
+  pipelined_ = server_->isThreadPoolProcessing() && server_->getMaxPipelinedRequests() > 1;
+  outOfOrder_ = server_->getAllowOutOfOrderResponses() && server_->getHeaderTransport();
+  inFlight_ = 0;
+  closePending_ = false;
+
   // get input/transports
   factoryInputTransport_ = server_->getInputTransportFactory()->getTransport(inputTransport_);
   factoryOutputTransport_ = server_->getOutputTransportFactory()->getTransport(outputTransport_);
@@ -524,7 +655,8 @@ void TNonblockingServer::TConnection::workSocket() {
         // We are done reading, move onto the next state
         if (readBufferPos_ == readWant_) {
           transition();
-          if (socketState_ == SOCKET_RECV_FRAMING && tSocket_->hasPendingDataToRead())
+          if (socketState_ == SOCKET_RECV_FRAMING && (eventFlags_ & EV_READ)
+              && tSocket_->hasPendingDataToRead())
           {
               continue;
           }
@@ -598,6 +730,11 @@ void TNonblockingServer::TConnection::transition() {
   switch (appState_) {
 
   case APP_READ_REQUEST:
+    if (pipelined_) {
+      dispatchPipelined();
+      return;
+    }
+
     // We are done reading the request, package the read buffer into transport
     // and get back some data from the dispatch function
     if (server_->getHeaderTransport()) {
@@ -789,6 +926,171 @@ void TNonblockingServer::TConnection::transition() {
   }
 }
 
+void TNonblockingServer::TConnection::dispatchPipelined() {
+  std::shared_ptr<PipelinedRequest> request(new PipelinedRequest);
+  if (server_->getHeaderTransport()) {
+    request->inputTransport.reset(
+        new TMemoryBuffer(readBuffer_, readBufferPos_, TMemoryBuffer::COPY));
+    request->outputTransport.reset(new TMemoryBuffer());
+  } else {
+    request->inputTransport.reset(
+        new TMemoryBuffer(readBuffer_ + 4, readBufferPos_ - 4, TMemoryBuffer::COPY));
+    request->outputTransport.reset(new TMemoryBuffer());
+    // room for the frame size, as in transition()
+    request->outputTransport->getWritePtr(4);
+    request->outputTransport->wroteBytes(4);
+  }
+  request->factoryInputTransport
+      = server_->getInputTransportFactory()->getTransport(request->inputTransport);
+  request->factoryOutputTransport
+      = server_->getOutputTransportFactory()->getTransport(request->outputTransport);
+  if (server_->getHeaderTransport()) {
+    request->inputProtocol
+        = server_->getInputProtocolFactory()->getProtocol(request->factoryInputTransport,
+                                                          request->factoryOutputTransport);
+    request->outputProtocol = request->inputProtocol;
+  } else {
+    request->inputProtocol
+        = server_->getInputProtocolFactory()->getProtocol(request->factoryInputTransport);
+    request->outputProtocol
+        = server_->getOutputProtocolFactory()->getProtocol(request->factoryOutputTransport);
+  }
+
+  server_->incrementActiveProcessors();
+  std::shared_ptr<Runnable> task = std::shared_ptr<Runnable>(
+      new Task(processor_, request->inputProtocol, request->outputProtocol, this, request));
+  pipeline_.push_back(request);
+  ++inFlight_;
+
+  try {
+    server_->addTask(task);
+  } catch (IllegalStateException& ise) {
+    TOutput::instance().printf("IllegalStateException: Server::process() %s", ise.what());
+    pipeline_.pop_back();
+    --inFlight_;
+    server_->decrementActiveProcessors();
+    close();
+    return;
+  } catch (TimedOutException& to) {
+    TOutput::instance().printf("[ERROR] TimedOutException: Server::process() %s", to.what());
+    pipeline_.pop_back();
+    --inFlight_;
+    server_->decrementActiveProcessors();
+    close();
+    return;
+  }
+
+  // go on with the next frame while this one is processed
+  socketState_ = SOCKET_RECV_FRAMING;
+  appState_ = APP_READ_FRAME_SIZE;
+  readBufferPos_ = 0;
+  setPipelinedFlags();
+}
+
+void TNonblockingServer::TConnection::completePipelined(PipelinedRequest& request) {
+  request.done = true;
+  // the IO thread keeps this connection open until it has counted every
+  // completion, so it must not be touched once the count is in
+  if (completions_.fetch_add(1) == 0 && !notifyIOThread()) {
+    TOutput::instance().printf("TNonblockingServer: failed to notifyIOThread.");
+    throw TException("TConnection::completePipelined: failed write on notify pipe");
+  }
+}
+
+void TNonblockingServer::TConnection::pipelineCompleted() {
+  uint32_t completed = completions_.exchange(0);
+  assert(completed <= inFlight_);
+  inFlight_ -= completed;
+  for (; completed > 0; --completed) {
+    server_->decrementActiveProcessors();
+  }
+
+  if (closePending_) {
+    if (inFlight_ == 0) {
+      close();
+    }
+    return;
+  }
+
+  if (!sending_ && !nextPipelinedResponse()) {
+    return;
+  }
+  setPipelinedFlags();
+}
+
+bool TNonblockingServer::TConnection::nextPipelinedResponse() {
+  while (!sending_ && !pipeline_.empty()) {
+    auto it = pipeline_.begin();
+    if (outOfOrder_) {
+      it = std::find_if(pipeline_.begin(),
+                        pipeline_.end(),
+                        [](const std::shared_ptr<PipelinedRequest>& r) { return r->done.load(); });
+    }
+    if (it == pipeline_.end() || !(*it)->done) {
+      break;
+    }
+    std::shared_ptr<PipelinedRequest> request = *it;
+    pipeline_.erase(it);
+
+    if (request->failed) {
+      // the task expired or was dropped on overload
+      close();
+      return false;
+    }
+
+    // 4 bytes were reserved for frame size, oneway requests leave no more
+    request->outputTransport->getBuffer(&writeBuffer_, &writeBufferSize_);
+    if (writeBufferSize_ > 4) {
+      auto frameSize = (int32_t)htonl(writeBufferSize_ - 4);
+      memcpy(writeBuffer_, &frameSize, 4);
+      writeBufferPos_ = 0;
+      sending_ = request;
+    } else {
+      writeBuffer_ = nullptr;
+      writeBufferSize_ = 0;
+    }
+  }
+  return true;
+}
+
+bool TNonblockingServer::TConnection::writePipelined() {
+  assert(sending_ && writeBufferPos_ < writeBufferSize_);
+  try {
+    uint32_t left = writeBufferSize_ - writeBufferPos_;
+    writeBufferPos_ += tSocket_->write_partial(writeBuffer_ + writeBufferPos_, left);
+  } catch (TTransportException& te) {
+    TOutput::instance().printf("TConnection::workSocket(): %s ", te.what());
+    close();
+    return false;
+  }
+
+  if (writeBufferPos_ == writeBufferSize_) {
+    if (writeBufferSize_ > largestWriteBufferSize_) {
+      largestWriteBufferSize_ = writeBufferSize_;
+    }
+    sending_.reset();
+    writeBuffer_ = nullptr;
+    writeBufferPos_ = 0;
+    writeBufferSize_ = 0;
+    if (!nextPipelinedResponse()) {
+      return false;
+    }
+    setPipelinedFlags();
+  }
+  return true;
+}
+
+void TNonblockingServer::TConnection::setPipelinedFlags() {
+  short flags = 0;
+  if (pipeline_.size() + (sending_ ? 1 : 0) < server_->getMaxPipelinedRequests()) {
+    flags |= EV_READ;
+  }
+  if (sending_) {
+    flags |= EV_WRITE;
+  }
+  setFlags(flags ? flags | EV_PERSIST : 0);
+}
+
 void TNonblockingServer::TConnection::setFlags(short eventFlags) {
   // Catch the do nothing case
   if (eventFlags_ == eventFlags) {
@@ -851,9 +1153,19 @@ void TNonblockingServer::TConnection::setFlags(short eventFlags) {
 void TNonblockingServer::TConnection::close() {
   setIdle();
 
+  if (inFlight_ > 0 && !closePending_) {
+    // pipelined tasks still refer to this connection, the last one to
+    // complete finishes the close
+    closePending_ = true;
+    return;
+  }
+  pipeline_.clear();
+  sending_.reset();
+
   if (serverEventHandler_) {
     serverEventHandler_->deleteContext(connectionContext_, inputProtocol_, outputProtocol_);
   }
+  int ioThreadNumber = getIOThreadNumber();
   ioThread_ = nullptr;
 
   // Close the socket
@@ -867,7 +1179,7 @@ void TNonblockingServer::TConnection::close() {
   processor_.reset();
 
   // Give this object back to the server that owns it
-  server_->returnConnection(this);
+  server_->returnConnection(this, ioThreadNumber);
 }
 
 void TNonblockingServer::TConnection::checkIdleBufferMemLimit(size_t readLimit, size_t writeLimit) {
@@ -885,9 +1197,15 @@ void TNonblockingServer::TConnection::checkIdleBufferMemLimit(size_t readLimit,
 }
 
 TNonblockingServer::~TNonblockingServer() {
-  // Close any active connections (moves them to the idle connection stack)
-  while (!activeConnections_.empty()) {
-    (*activeConnections_.begin())->close();
+  for (auto& cache : connectionCaches_) {
+    // Close any active connections (moves them to the idle connection caches)
+    while (!cache->active.empty()) {
+      (*cache->active.begin())->close();
+    }
+    // Clean up unused TConnection objects in the cache
+    for (auto connection : cache->idle) {
+      delete connection;
+    }
   }
   // Clean up unused TConnection objects in connectionStack_
   while (!connectionStack_.empty()) {
@@ -909,68 +1227,114 @@ TNonblockingServer::~TNonblockingServer() {
  * Creates a new connection either by reusing an object off the stack or
  * by allocating a new one entirely
  */
-TNonblockingServer::TConnection* TNonblockingServer::createConnection(std::shared_ptr<TSocket> socket) {
-  // Check the stack
-  Guard g(connMutex_);
-
-  // pick an IO thread to handle this connection -- currently round robin
-  assert(nextIOThread_ < ioThreads_.size());
-  int selectedThreadIdx = nextIOThread_;
-  nextIOThread_ = static_cast<uint32_t>((nextIOThread_ + 1) % ioThreads_.size());
+TNonblockingServer::TConnection* TNonblockingServer::createConnection(std::shared_ptr<TSocket> socket,
+                                                                     int ioThreadNumber) {
+  // pick an IO thread to handle this connection -- the accepting one when
+  // every IO thread listens, otherwise round robin.  In the latter case only
+  // IO thread 0 gets here, so this needs no lock.
+  int selectedThreadIdx = ioThreadNumber;
+  if (listeners_.size() == 1) {
+    assert(nextIOThread_ < ioThreads_.size());
+    selectedThreadIdx = nextIOThread_;
+    nextIOThread_ = static_cast<uint32_t>((nextIOThread_ + 1) % ioThreads_.size());
+  }
 
   TNonblockingIOThread* ioThread = ioThreads_[selectedThreadIdx].get();
+  ConnectionCache& cache = *connectionCaches_[selectedThreadIdx];
 
-  // Check the connection stack to see if we can re-use
+  // Check the IO thread's cache, then the shared stack, to see if we can re-use
   TConnection* result = nullptr;
-  if (connectionStack_.empty()) {
+  {
+    Guard g(cache.mutex);
+    if (!cache.idle.empty()) {
+      result = cache.idle.back();
+      cache.idle.pop_back();
+    }
+  }
+  if (result == nullptr) {
+    Guard g(connMutex_);
+    if (!connectionStack_.empty()) {
+      result = connectionStack_.top();
+      connectionStack_.pop();
+    }
+  }
+
+  if (result == nullptr) {
     result = new TConnection(socket, ioThread);
     ++numTConnections_;
   } else {
-    result = connectionStack_.top();
-    connectionStack_.pop();
+    --numIdleConnections_;
     result->setSocket(socket);
     result->init(ioThread);
   }
 
-  activeConnections_.insert(result);
+  Guard g(cache.mutex);
+  cache.active.insert(result);
   return result;
 }
 
 /**
- * Returns a connection to the stack
+ * Returns a connection to the cache of its IO thread or to the stack
  */
-void TNonblockingServer::returnConnection(TConnection* connection) {
-  Guard g(connMutex_);
+void TNonblockingServer::returnConnection(TConnection* connection, int ioThreadNumber) {
+  connection->checkIdleBufferMemLimit(idleReadBufferLimit_, idleWriteBufferLimit_);
 
-  activeConnections_.erase(connection);
-  if (connectionStackLimit_ && (connectionStack_.size() >= connectionStackLimit_)) {
+  ConnectionCache& cache = *connectionCaches_[ioThreadNumber];
+  {
+    Guard g(cache.mutex);
+    cache.active.erase(connection);
+
+    // each IO thread keeps its share of the limit for itself
+    size_t localLimit = (connectionStackLimit_ + connectionCaches_.size() - 1)
+                        / connectionCaches_.size();
+    if ((!connectionStackLimit_ || cache.idle.size() < localLimit) && reserveIdleConnection()) {
+      cache.idle.push_back(connection);
+      return;
+    }
+  }
+
+  if (reserveIdleConnection()) {
+    Guard g(connMutex_);
+    connectionStack_.push(connection);
+  } else {
     delete connection;
     --numTConnections_;
-  } else {
-    connection->checkIdleBufferMemLimit(idleReadBufferLimit_, idleWriteBufferLimit_);
-    connectionStack_.push(connection);
   }
 }
 
+bool TNonblockingServer::reserveIdleConnection() {
+  size_t idle = numIdleConnections_.load();
+  do {
+    if (connectionStackLimit_ && idle >= connectionStackLimit_) {
+      return false;
+    }
+  } while (!numIdleConnections_.compare_exchange_weak(idle, idle + 1));
+  return true;
+}
+
 /**
  * Server socket had something happen.  We accept all waiting client
  * connections on fd and assign TConnection objects to handle those requests.
  */
-void TNonblockingServer::handleEvent(THRIFT_SOCKET fd, short which) {
+void TNonblockingServer::handleEvent(THRIFT_SOCKET fd, short which, int ioThreadNumber) {
   (void)which;
+  TNonblockingServerTransport* listener = listeners_[ioThreadNumber].get();
   // Make sure that libevent didn't mess up the socket handles
-  assert(fd == serverSocket_);
+  assert(fd == listener->getSocketFD());
+  (void)fd;
 
   // Going to accept a new client socket
   std::shared_ptr<TSocket> clientSocket;
 
-  clientSocket = serverTransport_->accept();
+  clientSocket = listener->accept();
   if (clientSocket) {
     // If we're overloaded, take action here
     if (overloadAction_ != T_OVERLOAD_NO_ACTION && serverOverloaded()) {
-      Guard g(connMutex_);
-      nConnectionsDropped_++;
-      nTotalConnectionsDropped_++;
+      {
+        Guard g(connMutex_);
+        nConnectionsDropped_++;
+        nTotalConnectionsDropped_++;
+      }
       if (overloadAction_ == T_OVERLOAD_CLOSE_ON_ACCEPT) {
         clientSocket->close();
         return;
@@ -984,7 +1348,7 @@ void TNonblockingServer::handleEvent(THRIFT_SOCKET fd, short which) {
     }
 
     // Create a new TConnection for this client socket.
-    TConnection* clientConnection = createConnection(clientSocket);
+    TConnection* clientConnection = createConnection(clientSocket, ioThreadNumber);
 
     // Fail fast if we could not create a TConnection object
     if (clientConnection == nullptr) {
@@ -1001,11 +1365,11 @@ void TNonblockingServer::handleEvent(THRIFT_SOCKET fd, short which) {
      * (We need to avoid writing to our own notification pipe, to
      * avoid possible deadlocks if the pipe is full.)
      *
-     * The IO thread #0 is the only one that handles these listen
-     * events, so unless the connection has been assigned to thread #0
-     * we know it's not on our thread.
+     * The listen event was handled by IO thread #ioThreadNumber, so
+     * unless the connection has been assigned to that thread we know
+     * it's not on our thread.
      */
-    if (clientConnection->getIOThreadNumber() == 0) {
+    if (clientConnection->getIOThreadNumber() == ioThreadNumber) {
       clientConnection->transition();
     } else {
       if (!clientConnection->notifyIOThread()) {
@@ -1022,6 +1386,7 @@ void TNonblockingServer::handleEvent(THRIFT_SOCKET fd, short which) {
 void TNonblockingServer::createAndListenOnSocket() {
   serverTransport_->listen();
   serverSocket_ = serverTransport_->getSocketFD();
+  listeners_.assign(1, serverTransport_);
 }
 
 
@@ -1039,7 +1404,9 @@ void TNonblockingServer::setThreadManager(std::shared_ptr<ThreadManager> threadM
 }
 
 bool TNonblockingServer::serverOverloaded() {
-  size_t activeConnections = numTConnections_ - connectionStack_.size();
+  // with a listener per IO thread several threads may get here at once
+  Guard g(connMutex_);
+  size_t activeConnections = getNumActiveConnections();
   if (numActiveProcessors_ > maxActiveProcessors_ || activeConnections > maxConnections_) {
     if (!overloaded_) {
       TOutput::instance().printf("TNonblockingServer: overload condition begun.");
@@ -1065,9 +1432,7 @@ bool TNonblockingServer::drainPendingTask() {
   if (threadManager_) {
     std::shared_ptr<Runnable> task = threadManager_->removeNextPending();
     if (task) {
-      TConnection* connection = static_cast<TConnection::Task*>(task.get())->getTConnection();
-      assert(connection && connection->getServer() && connection->getState() == APP_WAIT_TASK);
-      connection->forceClose();
+      static_cast<TConnection::Task*>(task.get())->cancel();
       return true;
     }
   }
@@ -1075,9 +1440,7 @@ bool TNonblockingServer::drainPendingTask() {
 }
 
 void TNonblockingServer::expireClose(std::shared_ptr<Runnable> task) {
-  TConnection* connection = static_cast<TConnection::Task*>(task.get())->getTConnection();
-  assert(connection && connection->getServer() && connection->getState() == APP_WAIT_TASK);
-  connection->forceClose();
+  static_cast<TConnection::Task*>(task.get())->cancel();
 }
 
 void TNonblockingServer::stop() {
@@ -1102,13 +1465,24 @@ void TNonblockingServer::registerEvents(event_base* user_event_base) {
   // User-provided event-base doesn't works for multi-threaded servers
   assert(numIOThreads_ == 1 || !userEventBase_);
 
+  // with reuse port listeners every IO thread listens, otherwise only the first
+  if (useReusePortListeners_) {
+    while (listeners_.size() < numIOThreads_) {
+      std::shared_ptr<TNonblockingServerTransport> listener
+          = serverTransport_->createReusePortListener();
+      listener->listen();
+      listeners_.push_back(listener);
+    }
+  }
+
   for (uint32_t id = 0; id < numIOThreads_; ++id) {
-    // the first IO thread also does the listening on server socket
-    THRIFT_SOCKET listenFd = (id == 0 ? serverSocket_ : THRIFT_INVALID_SOCKET);
+    THRIFT_SOCKET listenFd
+        = (id < listeners_.size() ? listeners_[id]->getSocketFD() : THRIFT_INVALID_SOCKET);
 
     shared_ptr<TNonblockingIOThread> thread(
         new TNonblockingIOThread(this, id, listenFd, useHighPriorityIOThreads_));
     ioThreads_.push_back(thread);
+    connectionCaches_.emplace_back(new ConnectionCache());
   }
 
   // Notify handler of the preServe event
@@ -1176,9 +1550,15 @@ TNonblockingIOThread::TNonblockingIOThread(TNonblockingServer* server,
     eventBase_(nullptr),
     ownEventBase_(false),
     serverEvent_{},
-    notificationEvent_{} {
+    notificationEvent_{},
+    notificationHead_(nullptr),
+    wakeupPending_(false),
+    stopRequested_(false) {
   notificationPipeFDs_[0] = -1;
   notificationPipeFDs_[1] = -1;
+  // created up front so connections can be handed to this thread before
+  // it has registered its events
+  createNotificationPipe();
 }
 
 TNonblockingIOThread::~TNonblockingIOThread() {
@@ -1197,6 +1577,14 @@ TNonblockingIOThread::~TNonblockingIOThread() {
     listenSocket_ = THRIFT_INVALID_SOCKET;
   }
 
+#ifdef HAVE_SYS_EVENTFD_H
+  if (notificationPipeFDs_[0] >= 0) {
+    if (0 != ::close(notificationPipeFDs_[0])) {
+      TOutput::instance().perror("TNonblockingIOThread notification eventfd close(): ", errno);
+    }
+    notificationPipeFDs_[0] = notificationPipeFDs_[1] = THRIFT_INVALID_SOCKET;
+  }
+#else
   for (auto notificationPipeFD : notificationPipeFDs_) {
     if (notificationPipeFD >= 0) {
       if (0 != ::THRIFT_CLOSESOCKET(notificationPipeFD)) {
@@ -1206,9 +1594,19 @@ TNonblockingIOThread::~TNonblockingIOThread() {
       notificationPipeFD = THRIFT_INVALID_SOCKET;
     }
   }
+#endif
 }
 
 void TNonblockingIOThread::createNotificationPipe() {
+#ifdef HAVE_SYS_EVENTFD_H
+  // a single eventfd counter is both ends of the "pipe"
+  int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd < 0) {
+    TOutput::instance().perror("TNonblockingServer::createNotificationPipe eventfd() ", errno);
+    throw TException("can't create notification eventfd");
+  }
+  notificationPipeFDs_[0] = notificationPipeFDs_[1] = fd;
+#else
   if (evutil_socketpair(AF_LOCAL, SOCK_STREAM, 0, notificationPipeFDs_) == -1) {
     TOutput::instance().perror("TNonblockingServer::createNotificationPipe ", EVUTIL_SOCKET_ERROR());
     throw TException("can't create notification pipe");
@@ -1234,6 +1632,7 @@ void TNonblockingIOThread::createNotificationPipe() {
           "FD_CLOEXEC");
     }
   }
+#endif
 }
 
 /**
@@ -1262,7 +1661,7 @@ void TNonblockingIOThread::registerEvents() {
               listenSocket_,
               EV_READ | EV_PERSIST,
               TNonblockingIOThread::listenHandler,
-              server_);
+              this);
     event_base_set(eventBase_, &serverEvent_);
 
     // Add the event and start up the server
@@ -1274,8 +1673,6 @@ void TNonblockingIOThread::registerEvents() {
     TOutput::instance().printf("TNonblocking: IO thread #%d registered for listen.", number_);
   }
 
-  createNotificationPipe();
-
   // Create an event to be notified when a task finishes
   event_set(&notificationEvent_,
             getNotificationRecvFD(),
@@ -1296,124 +1693,138 @@ void TNonblockingIOThread::registerEvents() {
 }
 
 bool TNonblockingIOThread::notify(TNonblockingServer::TConnection* conn) {
-  auto fd = getNotificationSendFD();
-  if (fd < 0) {
+  if (getNotificationSendFD() < 0) {
     return false;
   }
 
-  int ret = -1;
-  long kSize = sizeof(conn);
-  const char * pos = (const char *)const_cast_sockopt(&conn);
+  if (conn == nullptr) {
+    stopRequested_ = true;
+  } else {
+    // lock-free push; the IO thread is the only consumer
+    TNonblockingServer::TConnection* head = notificationHead_.load(std::memory_order_relaxed);
+    do {
+      conn->setNextNotification(head);
+    } while (!notificationHead_.compare_exchange_weak(head, conn));
+  }
 
-#if defined(HAVE_POLL_H) || defined(HAVE_SYS_POLL_H)
-  struct pollfd pfd = {fd, POLLOUT, 0};
+  // A burst of notifications costs one wakeup: whoever finds no wakeup
+  // pending writes it, everybody else relies on the IO thread draining
+  // the queue before it clears the flag.
+  if (wakeupPending_.exchange(true)) {
+    return true;
+  }
+  return wakeup();
+}
 
-  while (kSize > 0) {
-    pfd.revents = 0;
-    ret = poll(&pfd, 1, -1);
-    if (ret < 0) {
-      return false;
-    } else if (ret == 0) {
-      continue;
+bool TNonblockingIOThread::wakeup() {
+  auto fd = getNotificationSendFD();
+#ifdef HAVE_SYS_EVENTFD_H
+  const uint64_t one = 1;
+  while (::write(fd, &one, sizeof(one)) < 0) {
+    if (errno == EAGAIN) {
+      // the counter is saturated, so the IO thread is bound to wake up
+      return true;
     }
-
-    if (pfd.revents & POLLHUP || pfd.revents & POLLERR) {
-      ::THRIFT_CLOSESOCKET(fd);
+    if (errno != EINTR) {
       return false;
     }
-
-    if (pfd.revents & POLLOUT) {
-      ret = send(fd, pos, kSize, 0);
-      if (ret < 0) {
-        if (errno == EAGAIN) {
-          continue;
-        }
-
-        ::THRIFT_CLOSESOCKET(fd);
-        return false;
-      }
-
-      kSize -= ret;
-      pos += ret;
-    }
   }
 #else
-  fd_set wfds, efds;
-
-  while (kSize > 0) {
-    FD_ZERO(&wfds);
-    FD_ZERO(&efds);
-    FD_SET(fd, &wfds);
-    FD_SET(fd, &efds);
-    ret = select(static_cast<int>(fd + 1), nullptr, &wfds, &efds, nullptr);
-    if (ret < 0) {
-      return false;
-    } else if (ret == 0) {
-      continue;
+  const char one = 1;
+  while (send(fd, &one, 1, 0) < 0) {
+    int err = THRIFT_GET_SOCKET_ERROR;
+    if (err == THRIFT_EWOULDBLOCK || err == THRIFT_EAGAIN) {
+      // there are unread wakeups in the pipe already
+      return true;
     }
-
-    if (FD_ISSET(fd, &efds)) {
-      ::THRIFT_CLOSESOCKET(fd);
+    if (err != THRIFT_EINTR) {
       return false;
     }
+  }
+#endif
+  return true;
+}
 
-    if (FD_ISSET(fd, &wfds)) {
-      ret = send(fd, pos, kSize, 0);
-      if (ret < 0) {
-        if (errno == EAGAIN) {
-          continue;
-        }
-
-        ::THRIFT_CLOSESOCKET(fd);
+bool TNonblockingIOThread::drainWakeups() {
+  auto fd = getNotificationRecvFD();
+#ifdef HAVE_SYS_EVENTFD_H
+  uint64_t count;
+  if (::read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN && errno != EINTR) {
+    TOutput::instance().perror("TNonblocking: notifyHandler read() failed: ", errno);
+    return false;
+  }
+#else
+  char buf[64];
+  while (true) {
+    long nBytes = recv(fd, buf, sizeof(buf), 0);
+    if (nBytes == 0) {
+      TOutput::instance().printf("notifyHandler: Notify socket closed!");
+      return false;
+    } else if (nBytes < 0) {
+      int err = THRIFT_GET_SOCKET_ERROR;
+      if (err == THRIFT_EWOULDBLOCK || err == THRIFT_EAGAIN) {
+        break;
+      }
+      if (err != THRIFT_EINTR) {
+        TOutput::instance().perror("TNonblocking: notifyHandler read() failed: ", err);
         return false;
       }
-
-      kSize -= ret;
-      pos += ret;
     }
   }
 #endif
-
   return true;
 }
 
+void TNonblockingIOThread::processNotifications() {
+  while (true) {
+    // The queue is a stack, so reverse each batch to transition the
+    // connections in the order they were notified.
+    TNonblockingServer::TConnection* batch = notificationHead_.exchange(nullptr);
+    if (batch == nullptr) {
+      // Let the next notify() write a wakeup, then make sure nothing
+      // slipped in before it could see the flag cleared.
+      wakeupPending_ = false;
+      if (notificationHead_.load() == nullptr || wakeupPending_.exchange(true)) {
+        return;
+      }
+      continue;
+    }
+
+    TNonblockingServer::TConnection* ordered = nullptr;
+    while (batch != nullptr) {
+      TNonblockingServer::TConnection* next = batch->getNextNotification();
+      batch->setNextNotification(ordered);
+      ordered = batch;
+      batch = next;
+    }
+    while (ordered != nullptr) {
+      // read the link first, transition() may return the connection to the pool
+      TNonblockingServer::TConnection* next = ordered->getNextNotification();
+      ordered->setNextNotification(nullptr);
+      ordered->notified();
+      ordered = next;
+    }
+  }
+}
+
 /* static */
 void TNonblockingIOThread::notifyHandler(evutil_socket_t fd, short which, void* v) {
   auto* ioThread = (TNonblockingIOThread*)v;
   assert(ioThread);
+  assert(fd == ioThread->getNotificationRecvFD());
+  (void)fd;
   (void)which;
 
-  while (true) {
-    TNonblockingServer::TConnection* connection = nullptr;
-    const int kSize = sizeof(connection);
-    long nBytes = recv(fd, cast_sockopt(&connection), kSize, 0);
-    if (nBytes == kSize) {
-      if (connection == nullptr) {
-        // this is the command to stop our thread, exit the handler!
-        ioThread->breakLoop(false);
-        return;
-      }
-      connection->transition();
-    } else if (nBytes > 0) {
-      // throw away these bytes and hope that next time we get a solid read
-      TOutput::instance().printf("notifyHandler: Bad read of %d bytes, wanted %d", nBytes, kSize);
-      ioThread->breakLoop(true);
-      return;
-    } else if (nBytes == 0) {
-      TOutput::instance().printf("notifyHandler: Notify socket closed!");
-      ioThread->breakLoop(false);
-      // exit the loop
-      break;
-    } else { // nBytes < 0
-      if (THRIFT_GET_SOCKET_ERROR != THRIFT_EWOULDBLOCK
-          && THRIFT_GET_SOCKET_ERROR != THRIFT_EAGAIN) {
-        TOutput::instance().perror("TNonblocking: notifyHandler read() failed: ", THRIFT_GET_SOCKET_ERROR);
-        ioThread->breakLoop(true);
-        return;
-      }
-      // exit the loop
-      break;
-    }
+  if (!ioThread->drainWakeups()) {
+    ioThread->breakLoop(true);
+    return;
+  }
+
+  ioThread->processNotifications();
+
+  if (ioThread->stopRequested_.exchange(false)) {
+    // this is the command to stop our thread, exit the handler!
+    ioThread->breakLoop(false);
   }
 }
 
@@ -28,6 +28,7 @@
 #include <thrift/transport/TSocket.h>
 #include <thrift/transport/TNonblockingServerTransport.h>
 #include <thrift/concurrency/ThreadManager.h>
+#include <atomic>
 #include <climits>
 #include <thrift/concurrency/Thread.h>
 #include <thrift/concurrency/ThreadFactory.h>
@@ -147,12 +148,18 @@ private:
   /// # of IO threads to use by default
   static const int DEFAULT_IO_THREADS = 1;
 
+  /// Default limit on unanswered requests per connection (1 = no pipelining)
+  static const size_t MAX_PIPELINED_REQUESTS = 1;
+
   /// # of IO threads this server will use
   size_t numIOThreads_;
 
   /// Whether to set high scheduling priority for IO threads
   bool useHighPriorityIOThreads_;
 
+  /// Whether every IO thread accepts on a SO_REUSEPORT listener of its own
+  bool useReusePortListeners_;
+
   /// Server socket file descriptor
   THRIFT_SOCKET serverSocket_;
 
@@ -174,16 +181,19 @@ private:
   // Index of next IO Thread to be used (for round-robin)
   uint32_t nextIOThread_;
 
-  // Synchronizes access to connection stack and similar data
+  // Synchronizes access to the overflow connection stack and similar data
   Mutex connMutex_;
 
   /// Number of TConnection object we've created
-  size_t numTConnections_;
+  std::atomic<size_t> numTConnections_;
+
+  /// Number of TConnection objects cached for reuse, in all caches
+  std::atomic<size_t> numIdleConnections_;
 
   /// Number of Connections processing or waiting to process
   size_t numActiveProcessors_;
 
-  /// Limit for how many TConnection objects to cache
+  /// Limit for how many TConnection objects to cache, in all caches
   size_t connectionStackLimit_;
 
   /// Limit for number of connections processing or waiting to process
@@ -237,6 +247,12 @@ private:
    */
   int32_t resizeBufferEveryN_;
 
+  /// Limit for requests read ahead and processed concurrently per connection
+  size_t maxPipelinedRequests_;
+
+  /// Whether pipelined responses may be written as soon as they are ready
+  bool allowOutOfOrderResponses_;
+
   /// Set if we are currently in an overloaded state.
   bool overloaded_;
 
@@ -247,42 +263,72 @@ private:
   uint64_t nTotalConnectionsDropped_;
 
   /**
-   * This is a stack of all the objects that have been created but that
-   * are NOT currently in use. When we close a connection, we place it on this
-   * stack so that the object can be reused later, rather than freeing the
-   * memory and reallocating a new object later.
+   * The connection objects belonging to one IO thread.  Connections are
+   * taken from and returned to the cache of the IO thread serving them, so
+   * IO threads do not contend with each other while opening and closing
+   * connections; the mutex only guards against a close() issued from a
+   * task thread.
    */
-  std::stack<TConnection*> connectionStack_;
+  struct ConnectionCache {
+    Mutex mutex;
+
+    /**
+     * Objects that have been created but that are NOT currently in use.
+     * When we close a connection, we place it here so that the object can
+     * be reused later, rather than freeing the memory and reallocating a
+     * new object later.
+     */
+    std::vector<TConnection*> idle;
+
+    /**
+     * Pointers to all active connections.  This allows the server to clean
+     * up unclosed connection objects at destruction, which in turn allows
+     * their transports, protocols, processors and handlers to deallocate and
+     * clean up correctly.
+     */
+    std::unordered_set<TConnection*> active;
+  };
+
+  /// One connection cache per IO thread, indexed by IO thread number
+  std::vector<std::unique_ptr<ConnectionCache> > connectionCaches_;
 
   /**
-   * This container holds pointers to all active connections. This container
-   * allows the server to clean up unlcosed connection objects at destruction,
-   * which in turn allows their transports, protocols, processors and handlers
-   * to deallocate and clean up correctly.
+   * Overflow for idle connections that did not fit into the cache of their
+   * IO thread.  It is shared by all IO threads and guarded by connMutex_.
    */
-  std::unordered_set<TConnection*> activeConnections_;
+  std::stack<TConnection*> connectionStack_;
 
   /*
   */
   std::shared_ptr<TNonblockingServerTransport> serverTransport_;
 
+  /**
+   * The listeners the IO threads accept on, indexed by IO thread number.
+   * The first one is serverTransport_; the other IO threads only have one
+   * when useReusePortListeners_ is set.
+   */
+  std::vector<std::shared_ptr<TNonblockingServerTransport> > listeners_;
+
   /**
    * Called when server socket had something happen.  We accept all waiting
    * client connections on listen socket fd and assign TConnection objects
    * to handle those requests.
    *
    * @param which the event flag that triggered the handler.
+   * @param ioThreadNumber the IO thread owning the listen socket.
    */
-  void handleEvent(THRIFT_SOCKET fd, short which);
+  void handleEvent(THRIFT_SOCKET fd, short which, int ioThreadNumber);
 
   void init() {
     serverSocket_ = THRIFT_INVALID_SOCKET;
     numIOThreads_ = DEFAULT_IO_THREADS;
     nextIOThread_ = 0;
     useHighPriorityIOThreads_ = false;
+    useReusePortListeners_ = false;
     userEventBase_ = nullptr;
     threadPoolProcessing_ = false;
     numTConnections_ = 0;
+    numIdleConnections_ = 0;
     numActiveProcessors_ = 0;
     connectionStackLimit_ = CONNECTION_STACK_LIMIT;
     maxActiveProcessors_ = MAX_ACTIVE_PROCESSORS;
@@ -295,6 +341,8 @@ private:
     idleReadBufferLimit_ = IDLE_READ_BUFFER_LIMIT;
     idleWriteBufferLimit_ = IDLE_WRITE_BUFFER_LIMIT;
     resizeBufferEveryN_ = RESIZE_BUFFER_EVERY_N;
+    maxPipelinedRequests_ = MAX_PIPELINED_REQUESTS;
+    allowOutOfOrderResponses_ = false;
     overloaded_ = false;
     nConnectionsDropped_ = 0;
     nTotalConnectionsDropped_ = 0;
@@ -400,13 +448,30 @@ public:
   /** Set whether the IO threads will get high scheduling priority. */
   void setUseHighPriorityIOThreads(bool val) { useHighPriorityIOThreads_ = val; }
 
+  /** Return whether every IO thread accepts connections itself. */
+  bool useReusePortListeners() const { return useReusePortListeners_; }
+
+  /**
+   * Set whether every IO thread accepts connections on a listener of its
+   * own.  By default IO thread 0 accepts all connections and hands them to
+   * the other IO threads in turn.  When set, the server transport opens one
+   * SO_REUSEPORT listener per IO thread (see
+   * TNonblockingServerTransport::createReusePortListener()), the kernel
+   * balances incoming connections between them, and each connection stays
+   * on the IO thread that accepted it.  The server transport must be set up
+   * to share its port, e.g. with TNonblockingServerSocket::setReusePort().
+   */
+  void setUseReusePortListeners(bool val) { useReusePortListeners_ = val; }
+
   /** Return the number of IO threads used by this server. */
   size_t getNumIOThreads() const { return numIOThreads_; }
 
   /**
    * Get the maximum number of unused TConnection we will hold in reserve.
+   * Each IO thread caches up to its share of this limit for itself; the
+   * remainder is shared by all IO threads.
    *
-   * @return the current limit on TConnection pool size.
+   * @return the current limit on TConnection pool size (0 == unlimited).
    */
   size_t getConnectionStackLimit() const { return connectionStackLimit_; }
 
@@ -435,14 +500,19 @@ public:
    *
    * @return count of connected sockets.
    */
-  size_t getNumActiveConnections() const { return getNumConnections() - getNumIdleConnections(); }
+  size_t getNumActiveConnections() const {
+    // the two counters are read separately, so guard against a torn read
+    size_t numConnections = getNumConnections();
+    size_t numIdleConnections = getNumIdleConnections();
+    return numConnections > numIdleConnections ? numConnections - numIdleConnections : 0;
+  }
 
   /**
    * Return the count of connection objects allocated but not in use.
    *
    * @return count of idle connection objects.
    */
-  size_t getNumIdleConnections() const { return connectionStack_.size(); }
+  size_t getNumIdleConnections() const { return numIdleConnections_; }
 
   /**
    * Return count of number of connections which are currently processing.
@@ -665,6 +735,47 @@ public:
    */
   void setResizeBufferEveryN(int32_t count) { resizeBufferEveryN_ = count; }
 
+  /**
+   * Get the maximum number of unanswered requests per connection.
+   *
+   * @return the current limit (1 == no pipelining).
+   */
+  size_t getMaxPipelinedRequests() const { return maxPipelinedRequests_; }
+
+  /**
+   * Set the maximum number of unanswered requests per connection.  When
+   * this is more than 1 and requests are processed in a thread pool, a
+   * connection keeps reading frames while earlier requests are being
+   * processed, and hands each frame to the thread manager as soon as it
+   * has arrived.  Reading pauses once this many requests are waiting for
+   * their response.  Responses are written in request order.
+   *
+   * The processor of a pipelined connection, and the processContext() of
+   * the server event handler, may then run for that connection on several
+   * threads at once and must be thread safe.  The setting applies to
+   * connections accepted after the call.
+   *
+   * @param count the new limit (0 is taken as 1).
+   */
+  void setMaxPipelinedRequests(size_t count) { maxPipelinedRequests_ = count > 0 ? count : 1; }
+
+  /**
+   * Get whether pipelined responses may be written out of order.
+   *
+   * @return true if responses go out as soon as they are ready.
+   */
+  bool getAllowOutOfOrderResponses() const { return allowOutOfOrderResponses_; }
+
+  /**
+   * Let a pipelined connection write each response as soon as it is ready
+   * rather than in request order.  This is only honored with the header
+   * transport (see getHeaderTransport()), whose clients match responses
+   * to calls by sequence id.
+   *
+   * @param allow whether responses may overtake each other.
+   */
+  void setAllowOutOfOrderResponses(bool allow) { allowOutOfOrderResponses_ = allow; }
+
   /**
    * Main workhorse function, starts up the server listening on a port and
    * loops over the libevent handler.
@@ -715,20 +826,28 @@ private:
    * and flags.
    *
    * @param socket FD of socket associated with this connection.
-   * @param addr the sockaddr of the client
-   * @param addrLen the length of addr
+   * @param ioThreadNumber the IO thread that accepted the connection.
    * @return pointer to initialized TConnection object.
    */
-  TConnection* createConnection(std::shared_ptr<TSocket> socket);
+  TConnection* createConnection(std::shared_ptr<TSocket> socket, int ioThreadNumber);
 
   /**
-   * Returns a connection to pool or deletion.  If the connection pool
-   * (a stack) isn't full, place the connection object on it, otherwise
-   * just delete it.
+   * Returns a connection to pool or deletion.  The connection object goes
+   * to the cache of the IO thread that served it, or to the shared overflow
+   * stack once that cache holds its share; when the pool is full it is
+   * deleted.
    *
    * @param connection the TConection being returned.
+   * @param ioThreadNumber the IO thread that served the connection.
+   */
+  void returnConnection(TConnection* connection, int ioThreadNumber);
+
+  /**
+   * Claims room for one more idle connection object.
+   *
+   * @return false if the pool already holds connectionStackLimit_ objects.
    */
-  void returnConnection(TConnection* connection);
+  bool reserveIdleConnection();
 };
 
 class TNonblockingIOThread : public Runnable {
@@ -756,7 +875,8 @@ public:
   // only be called after the thread has been started.
   Thread::id_t getThreadId() const { return threadId_; }
 
-  // Returns the send-fd for task complete notifications.
+  // Returns the send-fd for task complete notifications.  This is the same
+  // descriptor as the read-fd when an eventfd is used.
   evutil_socket_t getNotificationSendFD() const { return notificationPipeFDs_[1]; }
 
   // Returns the read-fd for task complete notifications.
@@ -768,7 +888,11 @@ public:
   // Sets the actual thread object associated with this IO thread.
   void setThread(const std::shared_ptr<Thread>& t) { thread_ = t; }
 
-  // Used by TConnection objects to indicate processing has finished.
+  // Used by TConnection objects to indicate processing has finished.  The
+  // connection is queued for the IO thread, which is woken up only if it
+  // does not have a wakeup pending already.  A connection may be queued
+  // once until the IO thread has transitioned it.  Passing nullptr asks the
+  // thread to exit its loop.
   bool notify(TNonblockingServer::TConnection* conn);
 
   // Enters the event loop and does not return until a call to stop().
@@ -786,9 +910,8 @@ public:
 private:
   /**
    * C-callable event handler for signaling task completion.  Provides a
-   * callback that libevent can understand that will read a connection
-   * object's address from a pipe and call connection->transition() for
-   * that object.
+   * callback that libevent can understand that will consume the wakeup
+   * and call connection->transition() for every queued connection.
    *
    * @param fd the descriptor the event occurred on.
    */
@@ -800,18 +923,28 @@ private:
    *
    * @param fd the descriptor the event occurred on.
    * @param which the flags associated with the event.
-   * @param v void* callback arg where we placed TNonblockingServer's "this".
+   * @param v void* callback arg where we placed TNonblockingIOThread's "this".
    */
   static void listenHandler(evutil_socket_t fd, short which, void* v) {
-    ((TNonblockingServer*)v)->handleEvent(fd, which);
+    TNonblockingIOThread* ioThread = static_cast<TNonblockingIOThread*>(v);
+    ioThread->server_->handleEvent(fd, which, ioThread->number_);
   }
 
   /// Exits the loop ASAP in case of shutdown or error.
   void breakLoop(bool error);
 
-  /// Create the pipe used to notify I/O process of task completion.
+  /// Create the eventfd (or pipe) used to wake the I/O thread on task completion.
   void createNotificationPipe();
 
+  /// Writes to the notification descriptor to wake the I/O thread.
+  bool wakeup();
+
+  /// Consumes pending wakeups from the notification descriptor.
+  bool drainWakeups();
+
+  /// Transitions every connection queued by notify(), oldest first.
+  void processNotifications();
+
   /// Unregisters our events for notification and listen sockets.
   void cleanupEvents();
 
@@ -850,6 +983,15 @@ private:
   /// File descriptors for pipe used for task completion notification.
   evutil_socket_t notificationPipeFDs_[2];
 
+  /// Connections queued by notify(), newest first
+  std::atomic<TNonblockingServer::TConnection*> notificationHead_;
+
+  /// Set while a wakeup is outstanding, so concurrent notify() calls skip the write
+  std::atomic<bool> wakeupPending_;
+
+  /// Set by notify(nullptr)
+  std::atomic<bool> stopRequested_;
+
   /// Actual IO Thread
   std::shared_ptr<Thread> thread_;
 };
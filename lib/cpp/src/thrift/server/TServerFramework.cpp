@@ -17,17 +17,27 @@
  * under the License.
  */
 
+#include <thrift/thrift-config.h>
+
 #include <algorithm>
 #include <functional>
 #include <stdexcept>
 #include <stdint.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <thrift/concurrency/FunctionRunner.h>
+#include <thrift/concurrency/ThreadFactory.h>
 #include <thrift/server/TServerFramework.h>
 
 namespace apache {
 namespace thrift {
 namespace server {
 
+using apache::thrift::concurrency::FunctionRunner;
 using apache::thrift::concurrency::Synchronized;
+using apache::thrift::concurrency::Thread;
+using apache::thrift::concurrency::ThreadFactory;
 using apache::thrift::protocol::TProtocol;
 using apache::thrift::protocol::TProtocolFactory;
 using std::bind;
@@ -45,7 +55,8 @@ TServerFramework::TServerFramework(const shared_ptr<TProcessorFactory>& processo
   : TServer(processorFactory, serverTransport, transportFactory, protocolFactory),
     clients_(0),
     hwm_(0),
-    limit_(INT64_MAX) {
+    limit_(INT64_MAX),
+    numAcceptorThreads_(1) {
 }
 
 TServerFramework::TServerFramework(const shared_ptr<TProcessor>& processor,
@@ -55,7 +66,8 @@ TServerFramework::TServerFramework(const shared_ptr<TProcessor>& processor,
   : TServer(processor, serverTransport, transportFactory, protocolFactory),
     clients_(0),
     hwm_(0),
-    limit_(INT64_MAX) {
+    limit_(INT64_MAX),
+    numAcceptorThreads_(1) {
 }
 
 TServerFramework::TServerFramework(const shared_ptr<TProcessorFactory>& processorFactory,
@@ -72,7 +84,8 @@ TServerFramework::TServerFramework(const shared_ptr<TProcessorFactory>& processo
             outputProtocolFactory),
     clients_(0),
     hwm_(0),
-    limit_(INT64_MAX) {
+    limit_(INT64_MAX),
+    numAcceptorThreads_(1) {
 }
 
 TServerFramework::TServerFramework(const shared_ptr<TProcessor>& processor,
@@ -89,7 +102,8 @@ TServerFramework::TServerFramework(const shared_ptr<TProcessor>& processor,
             outputProtocolFactory),
     clients_(0),
     hwm_(0),
-    limit_(INT64_MAX) {
+    limit_(INT64_MAX),
+    numAcceptorThreads_(1) {
 }
 
 TServerFramework::~TServerFramework() = default;
@@ -107,21 +121,108 @@ static void releaseOneDescriptor(const string& name, T& pTransport) {
 }
 
 void TServerFramework::serve() {
-  shared_ptr<TTransport> client;
-  shared_ptr<TTransport> inputTransport;
-  shared_ptr<TTransport> outputTransport;
-  shared_ptr<TProtocol> inputProtocol;
-  shared_ptr<TProtocol> outputProtocol;
-
   // Start the server listening
   serverTransport_->listen();
 
+  // Every additional acceptor thread gets a listener of its own
+  std::vector<shared_ptr<TServerTransport> > acceptors;
+  try {
+    for (size_t i = 1; i < numAcceptorThreads_; ++i) {
+      acceptors.push_back(serverTransport_->createReusePortListener());
+      acceptors.back()->listen();
+    }
+  } catch (...) {
+    for (auto& acceptor : acceptors) {
+      releaseOneDescriptor("acceptor", acceptor);
+    }
+    releaseOneDescriptor("serverTransport", serverTransport_);
+    throw;
+  }
+
+  {
+    Synchronized sync(mon_);
+    acceptors_ = acceptors;
+  }
+
   // Run the preServe event to indicate server is now listening
   // and that it is safe to connect.
   if (eventHandler_) {
     eventHandler_->preServe();
   }
 
+  // The serve() thread stops accepting when the server is stopped, its
+  // transport died or something threw; take the other acceptors down with
+  // it in every case.
+  struct AcceptorsGuard {
+    TServerFramework* server;
+    std::vector<shared_ptr<Thread> > threads;
+    ~AcceptorsGuard() { server->stopAcceptors(threads); }
+  } acceptorsGuard = {this, std::vector<shared_ptr<Thread> >()};
+
+  ThreadFactory threadFactory(false);
+  for (auto& acceptor : acceptors) {
+    acceptorsGuard.threads.push_back(threadFactory.newThread(
+        FunctionRunner::create(bind(&TServerFramework::runAcceptor, this, acceptor))));
+    acceptorsGuard.threads.back()->start();
+  }
+
+  acceptClients(serverTransport_);
+}
+
+void TServerFramework::runAcceptor(const shared_ptr<TServerTransport>& listener) {
+  // Nothing may escape an acceptor thread; losing one only costs a listener.
+  try {
+    acceptClients(listener);
+  } catch (TException& tx) {
+    string errStr = string("TServerFramework acceptor died: ") + tx.what();
+    TOutput::instance()(errStr.c_str());
+  } catch (std::exception& ex) {
+    string errStr = string("TServerFramework acceptor died: ") + ex.what();
+    TOutput::instance()(errStr.c_str());
+  } catch (...) {
+    TOutput::instance()("TServerFramework acceptor died: unknown exception");
+  }
+
+  // Stop listening right away so the kernel no longer routes connections to
+  // this listener.
+  {
+    Synchronized sync(mon_);
+    acceptors_.erase(std::remove(acceptors_.begin(), acceptors_.end(), listener),
+                     acceptors_.end());
+  }
+  releaseOneDescriptor("acceptor", listener);
+}
+
+void TServerFramework::stopAcceptors(const std::vector<shared_ptr<Thread> >& acceptorThreads) {
+  {
+    Synchronized sync(mon_);
+    for (auto& acceptor : acceptors_) {
+      acceptor->interrupt();
+    }
+  }
+  for (auto& acceptorThread : acceptorThreads) {
+    acceptorThread->join();
+  }
+
+  // Every acceptor thread closes its own listener; these never got a thread.
+  std::vector<shared_ptr<TServerTransport> > remaining;
+  {
+    Synchronized sync(mon_);
+    remaining.swap(acceptors_);
+  }
+  for (auto& acceptor : remaining) {
+    releaseOneDescriptor("acceptor", acceptor);
+  }
+  releaseOneDescriptor("serverTransport", serverTransport_);
+}
+
+void TServerFramework::acceptClients(const shared_ptr<TServerTransport>& listener) {
+  shared_ptr<TTransport> client;
+  shared_ptr<TTransport> inputTransport;
+  shared_ptr<TTransport> outputTransport;
+  shared_ptr<TProtocol> inputProtocol;
+  shared_ptr<TProtocol> outputProtocol;
+
   // Fetch client from server
   for (;;) {
     try {
@@ -143,7 +244,7 @@ void TServerFramework::serve() {
         }
       }
 
-      client = serverTransport_->accept();
+      client = listener->accept();
 
       inputTransport = inputTransportFactory_->getTransport(client);
       outputTransport = outputTransportFactory_->getTransport(client);
@@ -184,8 +285,6 @@ void TServerFramework::serve() {
       }
     }
   }
-
-  releaseOneDescriptor("serverTransport", serverTransport_);
 }
 
 int64_t TServerFramework::getConcurrentClientLimit() const {
@@ -210,8 +309,21 @@ void TServerFramework::setConcurrentClientLimit(int64_t newLimit) {
   Synchronized sync(mon_);
   limit_ = newLimit;
   if (limit_ - clients_ > 0) {
-    mon_.notify();
+    mon_.notifyAll();
+  }
+}
+
+size_t TServerFramework::getNumAcceptorThreads() const {
+  Synchronized sync(mon_);
+  return numAcceptorThreads_;
+}
+
+void TServerFramework::setNumAcceptorThreads(size_t numAcceptorThreads) {
+  if (numAcceptorThreads < 1) {
+    throw std::invalid_argument("numAcceptorThreads must be greater than zero");
   }
+  Synchronized sync(mon_);
+  numAcceptorThreads_ = numAcceptorThreads;
 }
 
 void TServerFramework::stop() {
@@ -219,6 +331,12 @@ void TServerFramework::stop() {
   // interrupted, which closes the socket that interruptChildren uses.
   serverTransport_->interruptChildren();
   serverTransport_->interrupt();
+
+  Synchronized sync(mon_);
+  for (auto& acceptor : acceptors_) {
+    acceptor->interruptChildren();
+    acceptor->interrupt();
+  }
 }
 
 void TServerFramework::newlyConnectedClient(const shared_ptr<TConnectedClient>& pClient) {
@@ -237,7 +355,7 @@ void TServerFramework::disposeConnectedClient(TConnectedClient* pClient) {
 
   Synchronized sync(mon_);
   if (limit_ - --clients_ > 0) {
-    mon_.notify();
+    mon_.notifyAll();
   }
 }
 
@@ -22,8 +22,10 @@
 
 #include <memory>
 #include <stdint.h>
+#include <vector>
 #include <thrift/TProcessor.h>
 #include <thrift/concurrency/Monitor.h>
+#include <thrift/concurrency/Thread.h>
 #include <thrift/server/TConnectedClient.h>
 #include <thrift/server/TServer.h>
 #include <thrift/transport/TServerTransport.h>
@@ -121,6 +123,30 @@ public:
    */
   virtual void setConcurrentClientLimit(int64_t newLimit);
 
+  /**
+   * Get the number of threads accepting clients.
+   * \returns the number of acceptor threads
+   */
+  virtual size_t getNumAcceptorThreads() const;
+
+  /**
+   * Set the number of threads accepting clients.  With more than one,
+   * serve() opens an additional listener per extra thread through
+   * TServerTransport::createReusePortListener(), so the kernel spreads new
+   * connections over the acceptors instead of funnelling every accept()
+   * through the serve() thread.  The server transport must be set up to
+   * share its port (e.g. TServerSocket::setReusePort(true)).
+   *
+   * With several acceptors the concurrent client limit may be exceeded
+   * by up to one client per additional acceptor.
+   *
+   * Must be called before serve().  The default value is 1.
+   *
+   * \param[in]  numAcceptorThreads  the number of acceptor threads
+   * \throws std::invalid_argument if numAcceptorThreads is less than 1
+   */
+  virtual void setNumAcceptorThreads(size_t numAcceptorThreads);
+
 protected:
   /**
    * A client has connected.  The implementation is responsible for managing the
@@ -144,6 +170,24 @@ protected:
   virtual void onClientDisconnected(TConnectedClient* pClient) = 0;
 
 private:
+  /**
+   * Accepts clients from one listener until it is interrupted or fails.
+   */
+  void acceptClients(const std::shared_ptr<apache::thrift::transport::TServerTransport>& listener);
+
+  /**
+   * Body of an additional acceptor thread: accepts clients from its
+   * listener, logs whatever stopped it and closes the listener.
+   */
+  void runAcceptor(const std::shared_ptr<apache::thrift::transport::TServerTransport>& listener);
+
+  /**
+   * Interrupts the additional acceptor threads, waits for them and releases
+   * the listeners of the server.
+   */
+  void stopAcceptors(
+      const std::vector<std::shared_ptr<apache::thrift::concurrency::Thread> >& acceptorThreads);
+
   /**
    * Common handling for new connected clients.  Implements concurrent
    * client rate limiting after onClientConnected returns by blocking the
@@ -176,6 +220,16 @@ private:
    * The limit on the number of concurrent clients.
    */
   int64_t limit_;
+
+  /**
+   * The number of threads accepting clients, including the serve() thread.
+   */
+  size_t numAcceptorThreads_;
+
+  /**
+   * The listeners of the additional acceptor threads, guarded by mon_.
+   */
+  std::vector<std::shared_ptr<apache::thrift::transport::TServerTransport> > acceptors_;
 };
 }
 }
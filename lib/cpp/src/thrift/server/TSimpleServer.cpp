@@ -101,6 +101,13 @@ void TSimpleServer::onClientDisconnected(TConnectedClient*) {
  */
 void TSimpleServer::setConcurrentClientLimit(int64_t) {
 }
+
+/**
+ * The simple server drives each client on the thread that accepted it, so
+ * more acceptors would mean more than one client at a time; hidden as well.
+ */
+void TSimpleServer::setNumAcceptorThreads(size_t) {
+}
 }
 }
 } // apache::thrift::server
@@ -69,6 +69,7 @@ protected:
 
 private:
   void setConcurrentClientLimit(int64_t newLimit) override; // hide
+  void setNumAcceptorThreads(size_t numAcceptorThreads) override; // hide
 };
 }
 }
@@ -249,13 +249,29 @@ void TFramedTransport::writeSlow(const uint8_t* buf, uint32_t len) {
   wBase_ += len;
 }
 
+void TFramedTransport::addReference(const uint8_t* buf, uint32_t len) {
+  auto have = static_cast<uint32_t>(wBase_ - wBuf_.get());
+  uint64_t total = static_cast<uint64_t>(have) + wRefBytes_ + len;
+  if (total > 0x7fffffff) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "Attempted to write over 2 GB to TFramedTransport.");
+  }
+  WriteReference ref;
+  ref.bufEnd = have;
+  ref.data = buf;
+  ref.len = len;
+  wRefs_.push_back(ref);
+  wRefBytes_ += len;
+}
+
 void TFramedTransport::flush() {
   resetConsumedMessageSize();
   int32_t sz_hbo, sz_nbo;
   assert(wBufSize_ > sizeof(sz_nbo));
 
   // Slip the frame size into the start of the buffer.
-  sz_hbo = static_cast<uint32_t>(wBase_ - (wBuf_.get() + sizeof(sz_nbo)));
+  auto buffered = static_cast<uint32_t>(wBase_ - wBuf_.get());
+  sz_hbo = static_cast<int32_t>(buffered - sizeof(sz_nbo) + wRefBytes_);
   sz_nbo = static_cast<int32_t>(htonl(static_cast<uint32_t>(sz_hbo)));
   memcpy(wBuf_.get(), reinterpret_cast<uint8_t*>(&sz_nbo), sizeof(sz_nbo));
 
@@ -266,8 +282,28 @@ void TFramedTransport::flush() {
     // up an exception
     wBase_ = wBuf_.get() + sizeof(sz_nbo);
 
-    // Write size and frame body.
-    transport_->write(wBuf_.get(), static_cast<uint32_t>(sizeof(sz_nbo)) + sz_hbo);
+    if (wRefs_.empty()) {
+      // Write size and frame body.
+      transport_->write(wBuf_.get(), buffered);
+    } else {
+      // Interleave the buffered bytes with the referenced writes.
+      wIov_.clear();
+      uint32_t pos = 0;
+      for (const auto& ref : wRefs_) {
+        if (ref.bufEnd > pos) {
+          wIov_.push_back(TIOVec{wBuf_.get() + pos, ref.bufEnd - pos});
+          pos = ref.bufEnd;
+        }
+        wIov_.push_back(TIOVec{ref.data, ref.len});
+      }
+      if (buffered > pos) {
+        wIov_.push_back(TIOVec{wBuf_.get() + pos, buffered - pos});
+      }
+      wRefs_.clear();
+      wRefBytes_ = 0;
+
+      transport_->writev(wIov_.data(), static_cast<uint32_t>(wIov_.size()));
+    }
   }
 
   // Flush the underlying transport.
@@ -286,7 +322,7 @@ void TFramedTransport::flush() {
 }
 
 uint32_t TFramedTransport::writeEnd() {
-  return static_cast<uint32_t>(wBase_ - wBuf_.get());
+  return static_cast<uint32_t>(wBase_ - wBuf_.get()) + wRefBytes_;
 }
 
 const uint8_t* TFramedTransport::borrowSlow(uint8_t* buf, uint32_t* len) {
@@ -23,6 +23,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <limits>
+#include <vector>
 
 #include <thrift/transport/TTransport.h>
 #include <thrift/transport/TVirtualTransport.h>
@@ -327,7 +328,9 @@ public:
       wBufSize_(DEFAULT_BUFFER_SIZE),
       rBuf_(),
       wBuf_(new uint8_t[wBufSize_]),
-      bufReclaimThresh_((std::numeric_limits<uint32_t>::max)()) {
+      bufReclaimThresh_((std::numeric_limits<uint32_t>::max)()),
+      referenceThreshold_(0),
+      wRefBytes_(0) {
     initPointers();
   }
 
@@ -339,7 +342,9 @@ public:
       rBuf_(),
       wBuf_(new uint8_t[wBufSize_]),
       bufReclaimThresh_((std::numeric_limits<uint32_t>::max)()),
-      maxFrameSize_(configuration_->getMaxFrameSize()) {
+      maxFrameSize_(configuration_->getMaxFrameSize()),
+      referenceThreshold_(0),
+      wRefBytes_(0) {
     initPointers();
   }
 
@@ -354,7 +359,9 @@ public:
       rBuf_(),
       wBuf_(new uint8_t[wBufSize_]),
       bufReclaimThresh_(bufReclaimThresh),
-      maxFrameSize_(configuration_->getMaxFrameSize()) {
+      maxFrameSize_(configuration_->getMaxFrameSize()),
+      referenceThreshold_(0),
+      wRefBytes_(0) {
     initPointers();
   }
 
@@ -371,6 +378,20 @@ public:
 
   uint32_t readSlow(uint8_t* buf, uint32_t len) override;
 
+  /**
+   * Appends buf to the current frame like write().  Buffers of at least
+   * getReferenceThreshold() bytes are not copied into the frame buffer; the
+   * frame refers to buf instead and flush() passes it on through the
+   * underlying transport's writev().
+   */
+  void writeReference(const uint8_t* buf, uint32_t len) {
+    if (TDB_LIKELY(referenceThreshold_ == 0 || len < referenceThreshold_)) {
+      TBufferBase::write(buf, len);
+    } else {
+      addReference(buf, len);
+    }
+  }
+
   void writeSlow(const uint8_t* buf, uint32_t len) override;
 
   void flush() override;
@@ -383,6 +404,23 @@ public:
 
   std::shared_ptr<TTransport> getUnderlyingTransport() { return transport_; }
 
+  /**
+   * Set the size from which writeReference() refers to the caller's buffer
+   * rather than copying it into the frame buffer (0, the default, always
+   * copies).  Plain write() always copies.  The protocols only pass string
+   * and binary values through writeReference(), so those values must stay
+   * valid and unmodified until the frame has been flushed; generated code
+   * satisfies this since it flushes before the written struct goes out of
+   * scope.  Worthwhile for large binary or string fields, especially over a
+   * TSocket, which sends the pieces with a single sendmsg().
+   */
+  void setReferenceThreshold(uint32_t threshold) { referenceThreshold_ = threshold; }
+
+  /**
+   * Get the size from which writes are referenced rather than copied
+   */
+  uint32_t getReferenceThreshold() const { return referenceThreshold_; }
+
   /*
    * TVirtualTransport provides a default implementation of readAll().
    * We want to use the TBufferBase version instead.
@@ -413,6 +451,9 @@ protected:
    */
   virtual bool readFrame();
 
+  /// Adds a write that is sent from the caller's buffer at flush time.
+  void addReference(const uint8_t* buf, uint32_t len);
+
   void initPointers() {
     setReadBuffer(nullptr, 0);
     setWriteBuffer(wBuf_.get(), wBufSize_);
@@ -430,6 +471,18 @@ protected:
   std::unique_ptr<uint8_t[]> wBuf_;
   uint32_t bufReclaimThresh_;
   uint32_t maxFrameSize_;
+
+  /// A write kept by reference; it follows wBuf_ up to offset bufEnd.
+  struct WriteReference {
+    uint32_t bufEnd;
+    const uint8_t* data;
+    uint32_t len;
+  };
+
+  uint32_t referenceThreshold_;
+  uint32_t wRefBytes_;
+  std::vector<WriteReference> wRefs_;
+  std::vector<TIOVec> wIov_;
 };
 
 /**
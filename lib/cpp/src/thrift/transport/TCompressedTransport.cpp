@@ -0,0 +1,269 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/transport/TCompressedTransport.h>
+
+#include <cstring>
+#include <utility>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+using concurrency::Guard;
+
+const size_t TCompressionPool::DEFAULT_MAX_IDLE;
+const uint32_t TCompressionPool::DEFAULT_MAX_BUFFER_SIZE;
+
+TCompressionPool::TCompressionPool(CodecFactory factory, size_t maxIdle, uint32_t maxBufferSize)
+  : factory_(std::move(factory)), maxIdle_(maxIdle), maxBufferSize_(maxBufferSize) {
+}
+
+std::shared_ptr<TCompressionPool> TCompressionPool::getDefault() {
+  static std::shared_ptr<TCompressionPool> pool = std::make_shared<TCompressionPool>(
+      [] { return std::make_shared<TZlibHeaderTransform>(); });
+  return pool;
+}
+
+std::shared_ptr<THeaderTransform> TCompressionPool::takeCodec() {
+  {
+    Guard g(mutex_);
+    if (!codecs_.empty()) {
+      std::shared_ptr<THeaderTransform> codec = std::move(codecs_.back());
+      codecs_.pop_back();
+      return codec;
+    }
+  }
+  return factory_();
+}
+
+void TCompressionPool::returnCodec(std::shared_ptr<THeaderTransform> codec) {
+  Guard g(mutex_);
+  if (codecs_.size() < maxIdle_) {
+    codecs_.push_back(std::move(codec));
+  }
+}
+
+std::unique_ptr<THeaderTransformBuffer> TCompressionPool::takeBuffer() {
+  {
+    Guard g(mutex_);
+    if (!buffers_.empty()) {
+      std::unique_ptr<THeaderTransformBuffer> buffer = std::move(buffers_.back());
+      buffers_.pop_back();
+      return buffer;
+    }
+  }
+  return std::unique_ptr<THeaderTransformBuffer>(new THeaderTransformBuffer());
+}
+
+void TCompressionPool::returnBuffer(std::unique_ptr<THeaderTransformBuffer> buffer) {
+  if (!buffer || buffer->size() > maxBufferSize_) {
+    return;
+  }
+  Guard g(mutex_);
+  if (buffers_.size() < maxIdle_) {
+    buffers_.push_back(std::move(buffer));
+  }
+}
+
+size_t TCompressionPool::getIdleCodecs() const {
+  Guard g(mutex_);
+  return codecs_.size();
+}
+
+size_t TCompressionPool::getIdleBuffers() const {
+  Guard g(mutex_);
+  return buffers_.size();
+}
+
+TCompressedTransport::TCompressedTransport(std::shared_ptr<TTransport> transport,
+                                           std::shared_ptr<TCompressionPool> pool,
+                                           std::shared_ptr<TConfiguration> config)
+  : TVirtualTransport(config),
+    transport_(transport),
+    pool_(pool ? pool : TCompressionPool::getDefault()),
+    rFrameSize_(0) {
+}
+
+TCompressedTransport::~TCompressedTransport() {
+  // unflushed data is discarded, as with the other transports
+  pool_->returnBuffer(std::move(rBuf_));
+  pool_->returnBuffer(std::move(wBuf_));
+}
+
+void TCompressedTransport::releaseReadBuffer() {
+  setReadBuffer(nullptr, 0);
+  pool_->returnBuffer(std::move(rBuf_));
+}
+
+uint32_t TCompressedTransport::readSlow(uint8_t* buf, uint32_t len) {
+  auto have = static_cast<uint32_t>(rBound_ - rBase_);
+
+  // As in TFramedTransport, hand out what is left of the frame first
+  // rather than risk blocking for the next one
+  if (have > 0) {
+    memcpy(buf, rBase_, have);
+    releaseReadBuffer();
+    return have;
+  }
+
+  releaseReadBuffer();
+  if (!readFrame()) {
+    return 0;
+  }
+
+  uint32_t give = (std::min)(len, static_cast<uint32_t>(rBound_ - rBase_));
+  memcpy(buf, rBase_, give);
+  rBase_ += give;
+  return give;
+}
+
+bool TCompressedTransport::readFrame() {
+  // Like TFramedTransport, only EOF before the header is a clean EOF
+  uint32_t header[2];
+  uint32_t headerRead = 0;
+  while (headerRead < sizeof(header)) {
+    uint32_t got = transport_->read(reinterpret_cast<uint8_t*>(header) + headerRead,
+                                    static_cast<uint32_t>(sizeof(header)) - headerRead);
+    if (got == 0) {
+      if (headerRead == 0) {
+        return false;
+      }
+      throw TTransportException(TTransportException::END_OF_FILE,
+                                "No more data to read after partial frame header.");
+    }
+    headerRead += got;
+  }
+
+  uint32_t compressedSize = ntohl(header[0]);
+  uint32_t size = ntohl(header[1]);
+  if (size == 0 || compressedSize == 0 || compressedSize > size) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA, "Invalid compressed frame");
+  }
+  // Checked before decompressing, so a small frame can't inflate to gigabytes
+  if (size > static_cast<uint32_t>(getMaxMessageSize())) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA, "Received an oversized frame");
+  }
+
+  std::unique_ptr<THeaderTransformBuffer> compressed = pool_->takeBuffer();
+  transport_->readAll(compressed->reserve(compressedSize), compressedSize);
+
+  if (compressedSize == size) {
+    // sent uncompressed
+    rBuf_ = std::move(compressed);
+  } else {
+    std::unique_ptr<THeaderTransformBuffer> frame = pool_->takeBuffer();
+    std::shared_ptr<THeaderTransform> codec = pool_->takeCodec();
+    uint32_t got = codec->untransform(compressed->get(), compressedSize, size, *frame);
+    // a codec that threw is dropped rather than returned, its state is unknown
+    pool_->returnCodec(std::move(codec));
+    pool_->returnBuffer(std::move(compressed));
+    if (got != size) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                "Compressed frame has the wrong size");
+    }
+    rBuf_ = std::move(frame);
+  }
+
+  setReadBuffer(rBuf_->get(), size);
+  rFrameSize_ = compressedSize + static_cast<uint32_t>(sizeof(header));
+  return true;
+}
+
+void TCompressedTransport::writeSlow(const uint8_t* buf, uint32_t len) {
+  uint32_t have = 0;
+  if (wBuf_) {
+    have = static_cast<uint32_t>(wBase_ - wBuf_->get());
+  } else {
+    wBuf_ = pool_->takeBuffer();
+  }
+  if (len + have < have /* overflow */ || len + have > 0x7fffffff) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "Attempted to write over 2 GB to TCompressedTransport.");
+  }
+
+  // reserve() grows the buffer geometrically
+  uint8_t* base = wBuf_->reserve(have + len, have);
+  setWriteBuffer(base, wBuf_->size());
+  wBase_ = base + have;
+  memcpy(wBase_, buf, len);
+  wBase_ += len;
+}
+
+void TCompressedTransport::flush() {
+  resetConsumedMessageSize();
+
+  // Take the frame out of the transport first, so that it is in a sane
+  // state (i.e. empty) even if compressing or writing throws
+  std::unique_ptr<THeaderTransformBuffer> frame = std::move(wBuf_);
+  uint32_t size = frame ? static_cast<uint32_t>(wBase_ - frame->get()) : 0;
+  setWriteBuffer(nullptr, 0);
+
+  if (size > 0) {
+    std::unique_ptr<THeaderTransformBuffer> compressed = pool_->takeBuffer();
+    std::shared_ptr<THeaderTransform> codec = pool_->takeCodec();
+    uint32_t compressedSize = codec->transform(frame->get(), size, *compressed);
+    pool_->returnCodec(std::move(codec));
+
+    uint32_t header[2];
+    TIOVec iov[2];
+    if (compressedSize < size) {
+      header[0] = htonl(compressedSize);
+      iov[1].base = compressed->get();
+      iov[1].len = compressedSize;
+    } else {
+      header[0] = htonl(size);
+      iov[1].base = frame->get();
+      iov[1].len = size;
+    }
+    header[1] = htonl(size);
+    iov[0].base = reinterpret_cast<const uint8_t*>(header);
+    iov[0].len = static_cast<uint32_t>(sizeof(header));
+    transport_->writev(iov, 2);
+
+    pool_->returnBuffer(std::move(compressed));
+  }
+  pool_->returnBuffer(std::move(frame));
+
+  transport_->flush();
+}
+
+uint32_t TCompressedTransport::readEnd() {
+  uint32_t bytes = rFrameSize_;
+  rFrameSize_ = 0;
+  if (rBase_ == rBound_) {
+    releaseReadBuffer();
+  }
+  resetConsumedMessageSize();
+  return bytes;
+}
+
+uint32_t TCompressedTransport::writeEnd() {
+  return wBuf_ ? static_cast<uint32_t>(wBase_ - wBuf_->get()) : 0;
+}
+
+const uint8_t* TCompressedTransport::borrowSlow(uint8_t* buf, uint32_t* len) {
+  (void)buf;
+  (void)len;
+  // Frames are decompressed whole, there is nothing to borrow across them
+  return nullptr;
+}
+}
+}
+} // apache::thrift::transport
@@ -0,0 +1,198 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TRANSPORT_TCOMPRESSEDTRANSPORT_H_
+#define _THRIFT_TRANSPORT_TCOMPRESSEDTRANSPORT_H_ 1
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <thrift/concurrency/Mutex.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/THeaderTransform.h>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+/**
+ * Compression codecs and buffers shared by TCompressedTransport instances.
+ *
+ * A transport only holds a codec and buffers while it is compressing or
+ * decompressing a frame and hands them back afterwards, so the memory used
+ * for compression grows with the number of frames in flight rather than with
+ * the number of connections.  A zlib deflate stream alone is over 256KB.
+ *
+ * The pool is thread safe.
+ */
+class TCompressionPool {
+public:
+  typedef std::function<std::shared_ptr<THeaderTransform>()> CodecFactory;
+
+  /// Idle codecs and buffers kept, each
+  static const size_t DEFAULT_MAX_IDLE = 64;
+
+  /// Idle buffers bigger than this are freed rather than kept
+  static const uint32_t DEFAULT_MAX_BUFFER_SIZE = 1024 * 1024;
+
+  /**
+   * @param factory       Creates the codecs, e.g. a TZstdHeaderTransform with
+   *                      a dictionary.  Both peers must use the same codec.
+   * @param maxIdle       Idle codecs and buffers kept, each
+   * @param maxBufferSize Idle buffers bigger than this are freed
+   */
+  explicit TCompressionPool(CodecFactory factory,
+                            size_t maxIdle = DEFAULT_MAX_IDLE,
+                            uint32_t maxBufferSize = DEFAULT_MAX_BUFFER_SIZE);
+
+  TCompressionPool(const TCompressionPool&) = delete;
+  TCompressionPool& operator=(const TCompressionPool&) = delete;
+
+  /// The pool transports use by default: zlib at its default level
+  static std::shared_ptr<TCompressionPool> getDefault();
+
+  std::shared_ptr<THeaderTransform> takeCodec();
+  void returnCodec(std::shared_ptr<THeaderTransform> codec);
+
+  std::unique_ptr<THeaderTransformBuffer> takeBuffer();
+  void returnBuffer(std::unique_ptr<THeaderTransformBuffer> buffer);
+
+  size_t getIdleCodecs() const;
+  size_t getIdleBuffers() const;
+
+private:
+  CodecFactory factory_;
+  size_t maxIdle_;
+  uint32_t maxBufferSize_;
+  mutable concurrency::Mutex mutex_;
+  std::vector<std::shared_ptr<THeaderTransform> > codecs_;
+  std::vector<std::unique_ptr<THeaderTransformBuffer> > buffers_;
+};
+
+/**
+ * Compresses every frame written to it, TFramedTransport style.
+ *
+ * Each flush() compresses everything written since the previous one as an
+ * independent unit, so the compressor state is only flushed once per
+ * message and a frame can be decompressed on its own.  Small messages
+ * compress poorly on their own; give both peers a codec with a preset
+ * dictionary (see TZlibHeaderTransform and TZstdDictionary) to make up for
+ * that.
+ *
+ * A frame is the compressed size and the uncompressed size, both as big
+ * endian 32 bit integers, followed by the compressed payload.  Frames that
+ * don't get smaller are sent as they are, with both sizes equal.
+ *
+ * Between messages the transport holds no buffers or codecs of its own,
+ * see TCompressionPool.
+ */
+class TCompressedTransport : public TVirtualTransport<TCompressedTransport, TBufferBase> {
+public:
+  /**
+   * @param transport The transport to read frames from and write them to
+   * @param pool      Where to get codecs and buffers from; by default
+   *                  TCompressionPool::getDefault()
+   */
+  TCompressedTransport(std::shared_ptr<TTransport> transport,
+                       std::shared_ptr<TCompressionPool> pool = nullptr,
+                       std::shared_ptr<TConfiguration> config = nullptr);
+
+  ~TCompressedTransport() override;
+
+  void open() override { transport_->open(); }
+
+  bool isOpen() const override { return transport_->isOpen(); }
+
+  bool peek() override { return (rBase_ < rBound_) || transport_->peek(); }
+
+  void close() override { transport_->close(); }
+
+  uint32_t readSlow(uint8_t* buf, uint32_t len) override;
+
+  void writeSlow(const uint8_t* buf, uint32_t len) override;
+
+  void flush() override;
+
+  uint32_t readEnd() override;
+
+  uint32_t writeEnd() override;
+
+  const uint8_t* borrowSlow(uint8_t* buf, uint32_t* len) override;
+
+  std::shared_ptr<TTransport> getUnderlyingTransport() { return transport_; }
+
+  std::shared_ptr<TCompressionPool> getPool() { return pool_; }
+
+  /*
+   * TVirtualTransport provides a default implementation of readAll().
+   * We want to use the TBufferBase version instead.
+   */
+  uint32_t readAll(uint8_t* buf, uint32_t len) { return TBufferBase::readAll(buf, len); }
+
+  const std::string getOrigin() const override { return transport_->getOrigin(); }
+
+protected:
+  /**
+   * Reads and decompresses a frame.
+   *
+   * @return false on EOF before the frame
+   */
+  bool readFrame();
+
+  /// Hands the read buffer back to the pool once it has been consumed
+  void releaseReadBuffer();
+
+  std::shared_ptr<TTransport> transport_;
+  std::shared_ptr<TCompressionPool> pool_;
+
+  std::unique_ptr<THeaderTransformBuffer> rBuf_;
+  std::unique_ptr<THeaderTransformBuffer> wBuf_;
+
+  /// Bytes of the last frame read, framing included
+  uint32_t rFrameSize_;
+};
+
+/**
+ * Wraps a transport into a TCompressedTransport.
+ */
+class TCompressedTransportFactory : public TTransportFactory {
+public:
+  /**
+   * @param pool Pool shared by all the transports made; by default
+   *             TCompressionPool::getDefault()
+   */
+  explicit TCompressedTransportFactory(std::shared_ptr<TCompressionPool> pool = nullptr)
+    : pool_(pool) {}
+
+  ~TCompressedTransportFactory() override = default;
+
+  std::shared_ptr<TTransport> getTransport(std::shared_ptr<TTransport> trans) override {
+    return std::shared_ptr<TTransport>(new TCompressedTransport(trans, pool_));
+  }
+
+private:
+  std::shared_ptr<TCompressionPool> pool_;
+};
+}
+}
+} // apache::thrift::transport
+
+#endif // #ifndef _THRIFT_TRANSPORT_TCOMPRESSEDTRANSPORT_H_
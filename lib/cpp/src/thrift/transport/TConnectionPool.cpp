@@ -0,0 +1,343 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <algorithm>
+#include <ctime>
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+#ifdef HAVE_SYS_POLL_H
+#include <sys/poll.h>
+#endif
+
+#include <thrift/transport/PlatformSocket.h>
+#include <thrift/transport/TConnectionPool.h>
+
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+using concurrency::Guard;
+
+TConnectionPool::TConnectionPool()
+  : next_(0),
+    maxIdle_(DEFAULT_MAX_IDLE),
+    idleTimeout_(0),
+    maxConsecutiveFailures_(1),
+    retryInterval_(60),
+    connTimeout_(0),
+    sendTimeout_(0),
+    recvTimeout_(0) {
+}
+
+TConnectionPool::TConnectionPool(const vector<std::pair<string, int> >& servers)
+  : TConnectionPool() {
+  for (const auto& server : servers) {
+    addServer(server.first, server.second);
+  }
+}
+
+TConnectionPool::~TConnectionPool() {
+  for (auto& backend : backends_) {
+    for (auto& idle : backend->idle) {
+      idle.socket->close();
+    }
+  }
+}
+
+void TConnectionPool::addServer(const string& host, int port) {
+  addServer(std::make_shared<TSocketPoolServer>(host, port));
+}
+
+void TConnectionPool::addServer(const shared_ptr<TSocketPoolServer>& server) {
+  if (!server) {
+    return;
+  }
+  std::unique_ptr<Backend> backend(new Backend());
+  backend->server = server;
+  backend->outstanding = 0;
+  Guard g(mutex_);
+  backends_.push_back(std::move(backend));
+}
+
+void TConnectionPool::setMaxIdle(size_t maxIdle) {
+  Guard g(mutex_);
+  maxIdle_ = maxIdle;
+}
+
+void TConnectionPool::setIdleTimeout(int seconds) {
+  Guard g(mutex_);
+  idleTimeout_ = seconds;
+}
+
+void TConnectionPool::setMaxConsecutiveFailures(int maxConsecutiveFailures) {
+  Guard g(mutex_);
+  maxConsecutiveFailures_ = maxConsecutiveFailures;
+}
+
+void TConnectionPool::setRetryInterval(int retryInterval) {
+  Guard g(mutex_);
+  retryInterval_ = retryInterval;
+}
+
+void TConnectionPool::setConnTimeout(int ms) {
+  Guard g(mutex_);
+  connTimeout_ = ms;
+}
+
+void TConnectionPool::setSendTimeout(int ms) {
+  Guard g(mutex_);
+  sendTimeout_ = ms;
+}
+
+void TConnectionPool::setRecvTimeout(int ms) {
+  Guard g(mutex_);
+  recvTimeout_ = ms;
+}
+
+/**
+ * Picks the server with the fewest leased connections among those not yet
+ * tried, preferring servers that are not marked down.  Called locked.
+ */
+TConnectionPool::Backend* TConnectionPool::pick(time_t now, const vector<Backend*>& tried) {
+  size_t count = backends_.size();
+  for (int pass = 0; pass < 2; ++pass) {
+    Backend* best = nullptr;
+    for (size_t i = 0; i < count; ++i) {
+      Backend* backend = backends_[(next_ + i) % count].get();
+      if (std::find(tried.begin(), tried.end(), backend) != tried.end()) {
+        continue;
+      }
+      time_t lastFail = backend->server->lastFailTime_;
+      if (pass == 0 && lastFail > 0 && now - lastFail <= retryInterval_) {
+        continue;
+      }
+      if (best == nullptr || backend->outstanding < best->outstanding) {
+        best = backend;
+      }
+    }
+    if (best != nullptr) {
+      ++next_;
+      return best;
+    }
+    // everything is down: try those servers anyway, like TSocketPool
+    // always trying the last one
+  }
+  return nullptr;
+}
+
+bool TConnectionPool::usable(const Idle& idle, time_t now) const {
+  if (!idle.socket->isOpen()) {
+    return false;
+  }
+  if (idleTimeout_ > 0 && now - idle.since > idleTimeout_) {
+    return false;
+  }
+  // An idle connection has nothing to read: if it is readable, the server
+  // has closed it or sent something nobody asked for
+  struct THRIFT_POLLFD fds[1];
+  fds[0].fd = idle.socket->getSocketFD();
+  fds[0].events = THRIFT_POLLIN;
+  fds[0].revents = 0;
+  return THRIFT_POLL(fds, 1, 0) == 0;
+}
+
+shared_ptr<TSocket> TConnectionPool::connect(Backend& backend) {
+  shared_ptr<TSocket> socket;
+  {
+    Guard g(mutex_);
+    socket = std::make_shared<TSocket>(backend.server->host_, backend.server->port_);
+    socket->setConnTimeout(connTimeout_);
+    socket->setSendTimeout(sendTimeout_);
+    socket->setRecvTimeout(recvTimeout_);
+  }
+
+  try {
+    socket->open();
+  } catch (const TException& e) {
+    string errStr = "TConnectionPool::connect failed " + socket->getSocketInfo() + ": " + e.what();
+    TOutput::instance()(errStr.c_str());
+    Guard g(mutex_);
+    if (++backend.server->consecutiveFailures_ > maxConsecutiveFailures_) {
+      // Mark server as down
+      backend.server->consecutiveFailures_ = 0;
+      backend.server->lastFailTime_ = time(nullptr);
+    }
+    return shared_ptr<TSocket>();
+  }
+
+  Guard g(mutex_);
+  backend.server->consecutiveFailures_ = 0;
+  backend.server->lastFailTime_ = 0;
+  return socket;
+}
+
+shared_ptr<TSocket> TConnectionPool::acquire() {
+  vector<Backend*> tried;
+  while (true) {
+    Backend* backend;
+    Idle idle;
+    {
+      Guard g(mutex_);
+      time_t now = time(nullptr);
+      backend = pick(now, tried);
+      if (backend == nullptr) {
+        break;
+      }
+      ++backend->outstanding;
+      if (!backend->idle.empty()) {
+        // the most recently used connection is the likeliest to be alive
+        idle = backend->idle.back();
+        backend->idle.pop_back();
+        if (usable(idle, now)) {
+          leased_[idle.socket.get()] = backend;
+          return idle.socket;
+        }
+      }
+    }
+
+    if (idle.socket) {
+      // dead or expired: drop it and look again, possibly at another server
+      idle.socket->close();
+      Guard g(mutex_);
+      --backend->outstanding;
+      continue;
+    }
+
+    shared_ptr<TSocket> socket = connect(*backend);
+    Guard g(mutex_);
+    if (socket) {
+      leased_[socket.get()] = backend;
+      return socket;
+    }
+    --backend->outstanding;
+    tried.push_back(backend);
+  }
+
+  TOutput::instance()("TConnectionPool::acquire: all connections failed");
+  throw TTransportException(TTransportException::NOT_OPEN, "all connections failed");
+}
+
+void TConnectionPool::release(shared_ptr<TSocket> socket, bool reusable) {
+  {
+    Guard g(mutex_);
+    auto it = leased_.find(socket.get());
+    if (it == leased_.end()) {
+      throw TTransportException(TTransportException::BAD_ARGS,
+                                "socket was not leased from this pool");
+    }
+    Backend* backend = it->second;
+    leased_.erase(it);
+    --backend->outstanding;
+    if (reusable && socket->isOpen() && backend->idle.size() < maxIdle_) {
+      Idle idle;
+      idle.socket = socket;
+      idle.since = time(nullptr);
+      backend->idle.push_back(idle);
+      return;
+    }
+  }
+  socket->close();
+}
+
+void TConnectionPool::warm(size_t count) {
+  vector<Backend*> backends;
+  {
+    Guard g(mutex_);
+    time_t now = time(nullptr);
+    for (auto& backend : backends_) {
+      time_t lastFail = backend->server->lastFailTime_;
+      if (lastFail == 0 || now - lastFail > retryInterval_) {
+        backends.push_back(backend.get());
+      }
+    }
+  }
+
+  for (Backend* backend : backends) {
+    while (true) {
+      {
+        Guard g(mutex_);
+        if (backend->idle.size() >= (std::min)(count, maxIdle_)) {
+          break;
+        }
+      }
+      shared_ptr<TSocket> socket = connect(*backend);
+      if (!socket) {
+        break;
+      }
+      Idle idle;
+      idle.socket = socket;
+      idle.since = time(nullptr);
+      Guard g(mutex_);
+      backend->idle.push_back(idle);
+    }
+  }
+}
+
+void TConnectionPool::checkIdle() {
+  vector<shared_ptr<TSocket> > dead;
+  {
+    Guard g(mutex_);
+    time_t now = time(nullptr);
+    for (auto& backend : backends_) {
+      vector<Idle> keep;
+      for (auto& idle : backend->idle) {
+        if (usable(idle, now)) {
+          keep.push_back(idle);
+        } else {
+          dead.push_back(idle.socket);
+        }
+      }
+      backend->idle.swap(keep);
+    }
+  }
+  for (auto& socket : dead) {
+    socket->close();
+  }
+}
+
+size_t TConnectionPool::getOutstanding(const string& host, int port) const {
+  Guard g(mutex_);
+  size_t outstanding = 0;
+  for (const auto& backend : backends_) {
+    if (backend->server->host_ == host && backend->server->port_ == port) {
+      outstanding += backend->outstanding;
+    }
+  }
+  return outstanding;
+}
+
+size_t TConnectionPool::getIdleCount() const {
+  Guard g(mutex_);
+  size_t count = 0;
+  for (const auto& backend : backends_) {
+    count += backend->idle.size();
+  }
+  return count;
+}
+}
+}
+} // apache::thrift::transport
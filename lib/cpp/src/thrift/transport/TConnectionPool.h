@@ -0,0 +1,200 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TRANSPORT_TCONNECTIONPOOL_H_
+#define _THRIFT_TRANSPORT_TCONNECTIONPOOL_H_ 1
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <thrift/concurrency/Mutex.h>
+#include <thrift/transport/TSocket.h>
+#include <thrift/transport/TSocketPool.h>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+/**
+ * A thread safe pool of client connections to a set of servers.
+ *
+ * Where a TSocketPool is one socket that fails over between servers when it
+ * is opened, a TConnectionPool is shared by all the threads of a client.
+ * Threads lease an open socket, make their calls on it and return it, so
+ * connections are set up once and reused rather than opened and closed as
+ * worker threads come and go.
+ *
+ * A lease goes to the server with the fewest leased connections (ties go
+ * round robin), using an idle connection to it when there is one.  Idle
+ * connections are checked before they are handed out: one the server has
+ * closed, that has unexpected data waiting, or that has been idle for longer
+ * than the idle timeout is closed and passed over.  Servers failing to
+ * connect are marked down the way TSocketPool does it, see
+ * setMaxConsecutiveFailures() and setRetryInterval().
+ *
+ * A connection that was left in the middle of a call (for instance after a
+ * timeout) must not be reused: return it with release(socket, false), or
+ * let a Lease that was not released discard it.
+ */
+class TConnectionPool {
+public:
+  /**
+   * Holds a leased connection and returns it to the pool when destroyed.
+   * Unless release() was called the connection is taken to be broken and is
+   * closed instead, so a call that throws does not poison the pool.
+   */
+  class Lease {
+  public:
+    explicit Lease(TConnectionPool& pool) : pool_(&pool), socket_(pool.acquire()) {}
+    Lease(Lease&& other) : pool_(other.pool_), socket_(std::move(other.socket_)) {
+      other.pool_ = nullptr;
+    }
+    ~Lease() { reset(false); }
+
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+
+    const std::shared_ptr<TSocket>& socket() const { return socket_; }
+
+    /// Returns the connection to the pool for reuse
+    void release() { reset(true); }
+
+  private:
+    void reset(bool reusable) {
+      if (pool_ != nullptr && socket_) {
+        pool_->release(socket_, reusable);
+      }
+      pool_ = nullptr;
+      socket_.reset();
+    }
+
+    TConnectionPool* pool_;
+    std::shared_ptr<TSocket> socket_;
+  };
+
+  /// Default number of idle connections kept per server
+  static const size_t DEFAULT_MAX_IDLE = 8;
+
+  TConnectionPool();
+
+  /**
+   * @param servers list of pairs of host name and port
+   */
+  TConnectionPool(const std::vector<std::pair<std::string, int> >& servers);
+
+  /**
+   * Closes the idle connections.  Leased connections must be returned
+   * before the pool is destroyed.
+   */
+  ~TConnectionPool();
+
+  TConnectionPool(const TConnectionPool&) = delete;
+  TConnectionPool& operator=(const TConnectionPool&) = delete;
+
+  void addServer(const std::string& host, int port);
+
+  void addServer(const std::shared_ptr<TSocketPoolServer>& server);
+
+  /**
+   * Opens connections until each server that is not marked down has count
+   * idle ones (at most the idle limit), so the first calls do not pay for
+   * connecting.  Servers that cannot be reached are skipped.
+   */
+  void warm(size_t count);
+
+  /**
+   * Leases an open connection.
+   *
+   * @throws TTransportException if no server can be connected to
+   */
+  std::shared_ptr<TSocket> acquire();
+
+  /**
+   * Returns a leased connection.  With reusable false, or when its server
+   * already has enough idle connections, it is closed.
+   *
+   * @throws TTransportException if the socket was not leased from this pool
+   */
+  void release(std::shared_ptr<TSocket> socket, bool reusable = true);
+
+  /**
+   * Closes idle connections that are dead or have timed out.  acquire()
+   * checks connections as it takes them; this is for tidying up a pool that
+   * sits idle for long periods.
+   */
+  void checkIdle();
+
+  /// Sets how many idle connections are kept per server
+  void setMaxIdle(size_t maxIdle);
+
+  /// Sets how long, in seconds, a connection may be idle; 0 for no limit
+  void setIdleTimeout(int seconds);
+
+  /// Sets how many times in a row connecting may fail before a server is marked down
+  void setMaxConsecutiveFailures(int maxConsecutiveFailures);
+
+  /// Sets how long, in seconds, a server that is marked down is left alone
+  void setRetryInterval(int retryInterval);
+
+  /// Timeouts, in milliseconds, of the sockets opened from now on
+  void setConnTimeout(int ms);
+  void setSendTimeout(int ms);
+  void setRecvTimeout(int ms);
+
+  /// Number of connections currently leased from the given server
+  size_t getOutstanding(const std::string& host, int port) const;
+
+  /// Number of idle connections to all servers
+  size_t getIdleCount() const;
+
+private:
+  struct Idle {
+    std::shared_ptr<TSocket> socket;
+    time_t since;
+  };
+
+  struct Backend {
+    std::shared_ptr<TSocketPoolServer> server;
+    std::vector<Idle> idle;
+    size_t outstanding;
+  };
+
+  Backend* pick(time_t now, const std::vector<Backend*>& tried);
+  std::shared_ptr<TSocket> connect(Backend& backend);
+  bool usable(const Idle& idle, time_t now) const;
+
+  mutable concurrency::Mutex mutex_;
+  std::vector<std::unique_ptr<Backend> > backends_;
+  std::unordered_map<const TSocket*, Backend*> leased_;
+  size_t next_;
+  size_t maxIdle_;
+  time_t idleTimeout_;
+  int maxConsecutiveFailures_;
+  time_t retryInterval_;
+  int connTimeout_;
+  int sendTimeout_;
+  int recvTimeout_;
+};
+}
+}
+} // apache::thrift::transport
+
+#endif // #ifndef _THRIFT_TRANSPORT_TCONNECTIONPOOL_H_
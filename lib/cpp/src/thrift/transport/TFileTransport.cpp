@@ -31,11 +31,13 @@
 #ifdef HAVE_STRINGS_H
 #include <strings.h>
 #endif
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <thread>
 #ifdef HAVE_SYS_STAT_H
 #include <sys/stat.h>
 #endif
@@ -45,9 +47,11 @@
 #endif
 
 #include <thrift/transport/TFileTransport.h>
+#include <thrift/transport/TMappedFileTransport.h>
 #include <thrift/transport/TTransportUtils.h>
 #include <thrift/transport/PlatformSocket.h>
 #include <thrift/concurrency/FunctionRunner.h>
+#include <thrift/concurrency/ThreadManager.h>
 
 namespace apache {
 namespace thrift {
@@ -68,6 +72,8 @@ TFileTransport::TFileTransport(string path, bool readOnly, std::shared_ptr<TConf
     readTimeout_(NO_TAIL_READ_TIMEOUT),
     chunkSize_(DEFAULT_CHUNK_SIZE),
     eventBufferSize_(DEFAULT_EVENT_BUFFER_SIZE),
+    writeBufferSize_(DEFAULT_WRITE_BUFFER_SIZE),
+    writeBatchSize_(DEFAULT_WRITE_BATCH_SIZE),
     flushMaxUs_(DEFAULT_FLUSH_MAX_US),
     flushMaxBytes_(DEFAULT_FLUSH_MAX_BYTES),
     maxEventSize_(DEFAULT_MAX_EVENT_SIZE),
@@ -75,13 +81,37 @@ TFileTransport::TFileTransport(string path, bool readOnly, std::shared_ptr<TConf
     eofSleepTime_(DEFAULT_EOF_SLEEP_TIME_US),
     corruptedEventSleepTime_(DEFAULT_CORRUPTED_SLEEP_TIME_US),
     writerThreadIOErrorSleepTime_(DEFAULT_WRITER_THREAD_SLEEP_TIME_US),
-    dequeueBuffer_(nullptr),
-    enqueueBuffer_(nullptr),
+    ring_(nullptr),
+    ringSize_(0),
+    ringHead_(0),
+    ringTail_(0),
+    writerSleeping_(false),
+    blockedWriters_(0),
+    stageAlloc_(nullptr),
+    stage_(nullptr),
+    stageLen_(0),
+    stageEvents_(0),
+    stageOffset_(0),
+    directIO_(false),
+    directFd_(-1),
+    hasIOError_(false),
+    unflushed_(0),
     notFull_(&mutex_),
     notEmpty_(&mutex_),
     closing_(false),
     flushed_(&mutex_),
     forceFlush_(false),
+    flushTarget_(0),
+    statEvents_(0),
+    statBytes_(0),
+    statWrites_(0),
+    statSyncs_(0),
+    statDroppedEvents_(0),
+    statProducerWaits_(0),
+    statWriteUsTotal_(0),
+    statWriteUsMax_(0),
+    statSyncUsTotal_(0),
+    statSyncUsMax_(0),
     filename_(path),
     fd_(0),
     bufferAndThreadInitialized_(false),
@@ -94,6 +124,10 @@ TFileTransport::TFileTransport(string path, bool readOnly, std::shared_ptr<TConf
 }
 
 void TFileTransport::resetOutputFile(int fd, string filename, off_t offset) {
+  if (directIO_ && bufferAndThreadInitialized_) {
+    throw TTransportException("TFileTransport: cannot change the output file with direct IO");
+  }
+
   filename_ = filename;
   offset_ = offset;
 
@@ -125,26 +159,24 @@ void TFileTransport::resetOutputFile(int fd, string filename, off_t offset) {
 TFileTransport::~TFileTransport() {
   // flush the buffer if a writer thread is active
   if (writerThread_.get()) {
-    // set state to closing
-    closing_ = true;
-
-    // wake up the writer thread
-    // Since closing_ is true, it will attempt to flush all data, then exit.
-    notEmpty_.notify();
+    // set state to closing, and wake up the writer thread and any blocked
+    // writers. Since closing_ is true, the writer thread will attempt to
+    // flush all data, then exit.
+    {
+      Guard g(mutex_);
+      closing_ = true;
+      notEmpty_.notify();
+      notFull_.notifyAll();
+    }
 
     writerThread_->join();
     writerThread_.reset();
   }
 
-  if (dequeueBuffer_) {
-    delete dequeueBuffer_;
-    dequeueBuffer_ = nullptr;
-  }
-
-  if (enqueueBuffer_) {
-    delete enqueueBuffer_;
-    enqueueBuffer_ = nullptr;
-  }
+  delete[] ring_;
+  ring_ = nullptr;
+  delete[] stageAlloc_;
+  stageAlloc_ = nullptr;
 
   if (readBuff_) {
     delete[] readBuff_;
@@ -167,22 +199,46 @@ TFileTransport::~TFileTransport() {
   }
 }
 
+TFileWriterStats TFileTransport::getWriterStats() const {
+  TFileWriterStats stats;
+  stats.events = statEvents_.load(std::memory_order_relaxed);
+  stats.bytes = statBytes_.load(std::memory_order_relaxed);
+  stats.writes = statWrites_.load(std::memory_order_relaxed);
+  stats.syncs = statSyncs_.load(std::memory_order_relaxed);
+  stats.droppedEvents = statDroppedEvents_.load(std::memory_order_relaxed);
+  stats.producerWaits = statProducerWaits_.load(std::memory_order_relaxed);
+  stats.writeUsTotal = statWriteUsTotal_.load(std::memory_order_relaxed);
+  stats.writeUsMax = statWriteUsMax_.load(std::memory_order_relaxed);
+  stats.syncUsTotal = statSyncUsTotal_.load(std::memory_order_relaxed);
+  stats.syncUsMax = statSyncUsMax_.load(std::memory_order_relaxed);
+  return stats;
+}
+
 bool TFileTransport::initBufferAndWriteThread() {
   if (bufferAndThreadInitialized_) {
     T_ERROR("%s", "Trying to double-init TFileTransport");
     return false;
   }
 
+  uint32_t ringSize = 64;
+  while (ringSize < writeBufferSize_ && ringSize < 0x80000000u) {
+    ringSize <<= 1;
+  }
+  ring_ = new std::atomic<uint32_t>[ringSize / 4]();
+  ringSize_ = ringSize;
+
+  // aligned for O_DIRECT
+  stageAlloc_ = new uint8_t[writeBatchSize_ + DIRECT_IO_ALIGNMENT];
+  stage_ = stageAlloc_ + (DIRECT_IO_ALIGNMENT
+                          - reinterpret_cast<uintptr_t>(stageAlloc_) % DIRECT_IO_ALIGNMENT);
+  bufferAndThreadInitialized_ = true;
+
   if (!writerThread_.get()) {
     writerThread_ = threadFactory_.newThread(
         apache::thrift::concurrency::FunctionRunner::create(startWriterThread, this));
     writerThread_->start();
   }
 
-  dequeueBuffer_ = new TFileTransportBuffer(eventBufferSize_);
-  enqueueBuffer_ = new TFileTransportBuffer(eventBufferSize_);
-  bufferAndThreadInitialized_ = true;
-
   return true;
 }
 
@@ -194,12 +250,6 @@ void TFileTransport::write(const uint8_t* buf, uint32_t len) {
   enqueueEvent(buf, len);
 }
 
-template <class _T>
-struct uniqueDeleter
-{
-  void operator()(_T *ptr) const { delete ptr; }
-};
-
 void TFileTransport::enqueueEvent(const uint8_t* buf, uint32_t eventLen) {
   // can't enqueue more events if file is going to close
   if (closing_) {
@@ -209,6 +259,7 @@ void TFileTransport::enqueueEvent(const uint8_t* buf, uint32_t eventLen) {
   // make sure that event size is valid
   if ((maxEventSize_ > 0) && (eventLen > maxEventSize_)) {
     T_ERROR("msg size is greater than max event size: %u > %u\n", eventLen, maxEventSize_);
+    dropEvents(1);
     return;
   }
 
@@ -217,88 +268,317 @@ void TFileTransport::enqueueEvent(const uint8_t* buf, uint32_t eventLen) {
     return;
   }
 
-  std::unique_ptr<eventInfo, uniqueDeleter<eventInfo> > toEnqueue(new eventInfo());
-  toEnqueue->eventBuff_ = new uint8_t[(sizeof(uint8_t) * eventLen) + 4];
+  // make sure that the buffer is initialized and writer thread is running
+  if (!bufferAndThreadInitialized_) {
+    Guard g(mutex_);
+    if (!bufferAndThreadInitialized_ && !initBufferAndWriteThread()) {
+      return;
+    }
+  }
+
+  uint64_t recordLen = 4 + ((static_cast<uint64_t>(eventLen) + 3) & ~static_cast<uint64_t>(3));
+  if (recordLen > ringSize_) {
+    T_ERROR("msg size is greater than the write buffer size: %u > %u\n", eventLen, ringSize_);
+    dropEvents(1);
+    return;
+  }
+
+  // reserve a record
+  uint64_t head = ringHead_.load(std::memory_order_relaxed);
+  while (true) {
+    if (head + recordLen > ringTail_.load(std::memory_order_acquire) + ringSize_) {
+      waitForSpace(head + recordLen);
+      if (closing_) {
+        return;
+      }
+      head = ringHead_.load(std::memory_order_relaxed);
+      continue;
+    }
+    if (ringHead_.compare_exchange_weak(head, head + recordLen, std::memory_order_relaxed)) {
+      break;
+    }
+  }
 
-  // first 4 bytes is the event length
-  memcpy(toEnqueue->eventBuff_, (void*)(&eventLen), 4);
-  // actual event contents
-  memcpy(toEnqueue->eventBuff_ + 4, buf, eventLen);
-  toEnqueue->eventSize_ = eventLen + 4;
+  // copy the event in, then publish it by storing its size
+  uint32_t mask = ringSize_ - 1;
+  uint8_t* ring = reinterpret_cast<uint8_t*>(ring_);
+  auto data = static_cast<uint32_t>((head + 4) & mask);
+  uint32_t first = (std::min)(eventLen, ringSize_ - data);
+  memcpy(ring + data, buf, first);
+  memcpy(ring, buf + first, eventLen - first);
+  ring_[(head & mask) / 4].store(eventLen);
+
+  if (writerSleeping_) {
+    Guard g(mutex_);
+    notEmpty_.notify();
+  }
+}
 
-  // lock mutex
+void TFileTransport::waitForSpace(uint64_t end) {
   Guard g(mutex_);
+  statProducerWaits_.fetch_add(1, std::memory_order_relaxed);
+  ++blockedWriters_;
+  while (!closing_ && end > ringTail_.load() + ringSize_) {
+    notFull_.wait();
+  }
+  --blockedWriters_;
+}
 
-  // make sure that enqueue buffer is initialized and writer thread is running
-  if (!bufferAndThreadInitialized_) {
-    if (!initBufferAndWriteThread()) {
-      return;
+void TFileTransport::dropEvents(uint64_t count) {
+  statDroppedEvents_.fetch_add(count, std::memory_order_relaxed);
+}
+
+namespace {
+void recordTime(std::atomic<uint64_t>& total,
+                std::atomic<uint64_t>& max,
+                std::chrono::steady_clock::time_point start) {
+  auto us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                      std::chrono::steady_clock::now() - start).count());
+  total.fetch_add(us, std::memory_order_relaxed);
+  if (us > max.load(std::memory_order_relaxed)) {
+    max.store(us, std::memory_order_relaxed);
+  }
+}
+}
+
+/**
+ * Moves published events from the ring to the stage, laid out as they go in
+ * the file, and frees their records.  Stops at the first event not yet
+ * published or once about a batch has been taken, and returns the position
+ * reached.
+ */
+uint64_t TFileTransport::stageEvents(uint64_t cursor) {
+  uint32_t mask = ringSize_ - 1;
+  uint8_t* ring = reinterpret_cast<uint8_t*>(ring_);
+  uint64_t limit = cursor + writeBatchSize_;
+
+  while (cursor < limit) {
+    std::atomic<uint32_t>& header = ring_[(cursor & mask) / 4];
+    uint32_t eventLen = header.load(std::memory_order_acquire);
+    if (eventLen == 0) {
+      break;
+    }
+    auto data = static_cast<uint32_t>((cursor + 4) & mask);
+    uint32_t first = (std::min)(eventLen, ringSize_ - data);
+    uint32_t eventSize = eventLen + 4;
+
+    // If chunking is required, then make sure that msg does not cross chunk boundary
+    if ((chunkSize_ != 0) && (eventSize > chunkSize_)) {
+      // event size must be less than chunk size
+      T_ERROR("TFileTransport: event size(%u) > chunk size(%u): skipping event",
+              eventSize,
+              chunkSize_);
+      dropEvents(1);
+    } else {
+      if (chunkSize_ != 0) {
+        int64_t chunk1 = offset_ / chunkSize_;
+        int64_t chunk2 = (offset_ + eventSize - 1) / chunkSize_;
+
+        // if adding this event will cross a chunk boundary, pad the chunk with zeros
+        if (chunk1 != chunk2) {
+          stageBytes(nullptr, static_cast<uint32_t>((chunk1 + 1) * chunkSize_ - offset_));
+        }
+      }
+
+      // first 4 bytes is the event length
+      uint8_t size[4];
+      memcpy(size, &eventLen, 4);
+      stageBytes(size, 4);
+      stageBytes(ring + data, first);
+      stageBytes(ring, eventLen - first);
+      ++stageEvents_;
+      statEvents_.fetch_add(1, std::memory_order_relaxed);
     }
+
+    // clear the record for reuse
+    uint32_t recordData = (eventLen + 3) & ~3u;
+    uint32_t firstData = (std::min)(recordData, ringSize_ - data);
+    memset(ring + data, 0, firstData);
+    memset(ring, 0, recordData - firstData);
+    header.store(0, std::memory_order_relaxed);
+    cursor += 4 + recordData;
   }
+  return cursor;
+}
 
-  // Can't enqueue while buffer is full
-  while (enqueueBuffer_->isFull()) {
-    notFull_.wait();
+/**
+ * Appends len bytes from buf (zeros if buf is null) to the stage, writing
+ * it out whenever it fills up.
+ */
+void TFileTransport::stageBytes(const uint8_t* buf, uint32_t len) {
+  unflushed_ += len;
+  offset_ += len;
+  statBytes_.fetch_add(len, std::memory_order_relaxed);
+  while (len > 0) {
+    if (stageLen_ == writeBatchSize_) {
+      writeStage();
+    }
+    uint32_t n = (std::min)(len, writeBatchSize_ - stageLen_);
+    if (buf) {
+      memcpy(stage_ + stageLen_, buf, n);
+      buf += n;
+    } else {
+      memset(stage_ + stageLen_, 0, n);
+    }
+    stageLen_ += n;
+    len -= n;
   }
+}
 
-  // We shouldn't be trying to enqueue new data while a forced flush is
-  // requested.  (Otherwise the writer thread might not ever be able to finish
-  // the flush if more data keeps being enqueued.)
-  assert(!forceFlush_);
+/**
+ * Frees ring space up to cursor, waking writers waiting for it.
+ */
+void TFileTransport::releaseSpace(uint64_t cursor) {
+  ringTail_.store(cursor);
+  if (blockedWriters_ > 0) {
+    Guard g(mutex_);
+    notFull_.notifyAll();
+  }
+}
 
-  // add to the buffer
-  eventInfo* pEvent = toEnqueue.release();
-  if (!enqueueBuffer_->addEvent(pEvent)) {
-    delete pEvent;
+/**
+ * Writes out the stage in one call.  In direct IO mode only whole blocks
+ * are written, and the rest moves to the front of the stage.  If there is
+ * any IO error, for instance, the output file is unmounted or deleted, the
+ * staged events are dropped and the writer thread goes into recovery.
+ */
+void TFileTransport::writeStage() {
+  if (hasIOError_) {
+    dropEvents(stageEvents_);
+    stageEvents_ = 0;
+    stageLen_ = 0;
+    return;
+  }
+  uint32_t len = directIO_ ? stageLen_ & ~(DIRECT_IO_ALIGNMENT - 1) : stageLen_;
+  if (len == 0) {
     return;
   }
 
-  // signal anybody who's waiting for the buffer to be non-empty
-  notEmpty_.notify();
+  auto start = std::chrono::steady_clock::now();
+  uint32_t written = 0;
+  while (written < len) {
+    int64_t rv;
+#ifdef O_DIRECT
+    if (directIO_) {
+      rv = ::pwrite(directFd_, stage_ + written, len - written, stageOffset_ + written);
+    } else
+#endif
+    {
+      rv = ::THRIFT_WRITE(fd_, stage_ + written, len - written);
+    }
+    if (rv == -1) {
+      int errno_copy = THRIFT_ERRNO;
+      TOutput::instance().perror("TFileTransport: error while writing event ", errno_copy);
+      hasIOError_ = true;
+      dropEvents(stageEvents_);
+      stageEvents_ = 0;
+      stageLen_ = 0;
+      return;
+    }
+    written += static_cast<uint32_t>(rv);
+  }
+  statWrites_.fetch_add(1, std::memory_order_relaxed);
+  recordTime(statWriteUsTotal_, statWriteUsMax_, start);
 
-  // this really should be a loop where it makes sure it got flushed
-  // because condition variables can get triggered by the os for no reason
-  // it is probably a non-factor for the time being
+  stageEvents_ = 0;
+  stageLen_ -= len;
+  if (stageLen_ > 0) {
+    memmove(stage_, stage_ + len, stageLen_);
+  }
+  stageOffset_ += len;
 }
 
-bool TFileTransport::swapEventBuffers(const std::chrono::time_point<std::chrono::steady_clock> *deadline) {
-  bool swap;
-  Guard g(mutex_);
-
-  if (!enqueueBuffer_->isEmpty()) {
-    swap = true;
-  } else if (closing_) {
-    // even though there is no data to write,
-    // return immediately if the transport is closing
-    swap = false;
-  } else {
-    if (deadline != nullptr) {
-      // if we were handed a deadline time struct, do a timed wait
-      notEmpty_.waitForTime(*deadline);
-    } else {
-      // just wait until the buffer gets an item
-      notEmpty_.wait();
+/**
+ * Syncs the file to disk.  In direct IO mode the partial block left in the
+ * stage is written through the page cache first.
+ */
+void TFileTransport::syncFile() {
+  auto start = std::chrono::steady_clock::now();
+#ifdef O_DIRECT
+  if (directIO_) {
+    if (stageLen_ > 0 && !hasIOError_
+        && -1 == ::pwrite(fd_, stage_, stageLen_, stageOffset_)) {
+      int errno_copy = THRIFT_ERRNO;
+      TOutput::instance().perror("TFileTransport: error while writing event ", errno_copy);
+      hasIOError_ = true;
+      return;
     }
+    ::fdatasync(fd_);
+  } else
+#endif
+  {
+    THRIFT_FSYNC(fd_);
+  }
+  statSyncs_.fetch_add(1, std::memory_order_relaxed);
+  recordTime(statSyncUsTotal_, statSyncUsMax_, start);
+}
 
-    // could be empty if we timed out
-    swap = enqueueBuffer_->isEmpty();
+/**
+ * Positions the writer at the end of the last complete event in the file,
+ * throwing away anything after it.
+ */
+void TFileTransport::prepareForWriting() {
+  seekToEnd();
+  // throw away any partial events
+  offset_ += readState_.lastDispatchPtr_;
+  if (0 != THRIFT_FTRUNCATE(fd_, offset_)) {
+    int errno_copy = THRIFT_ERRNO;
+    TOutput::instance().perror("TFileTransport: writerThread() truncate ", errno_copy);
+    throw TTransportException(TTransportException::UNKNOWN,
+                              "TFileTransport: error in truncate",
+                              errno_copy);
+  }
+  readState_.resetAllValues();
+  stageLen_ = 0;
+  stageEvents_ = 0;
+  if (directIO_) {
+    openDirectFile();
   }
+}
 
-  if (swap) {
-    TFileTransportBuffer* temp = enqueueBuffer_;
-    enqueueBuffer_ = dequeueBuffer_;
-    dequeueBuffer_ = temp;
+/**
+ * Opens the file again for direct IO, and loads the partial block at its end
+ * into the stage.
+ */
+void TFileTransport::openDirectFile() {
+  closeDirectFile();
+#ifdef O_DIRECT
+  // from now on the writer thread writes at explicit offsets
+  int flags = ::fcntl(fd_, F_GETFL);
+  if (flags == -1 || -1 == ::fcntl(fd_, F_SETFL, flags & ~O_APPEND)) {
+    int errno_copy = THRIFT_ERRNO;
+    throw TTransportException(TTransportException::UNKNOWN, "TFileTransport: fcntl", errno_copy);
+  }
+  directFd_ = ::THRIFT_OPEN(filename_.c_str(), O_WRONLY | O_DIRECT);
+  if (directFd_ == -1) {
+    int errno_copy = THRIFT_ERRNO;
+    TOutput::instance().perror("TFileTransport: openDirectFile() ::open() file: " + filename_,
+                               errno_copy);
+    throw TTransportException(TTransportException::NOT_OPEN, filename_, errno_copy);
   }
 
-  if (swap) {
-    notFull_.notify();
+  stageOffset_ = offset_ & ~static_cast<off_t>(DIRECT_IO_ALIGNMENT - 1);
+  stageLen_ = static_cast<uint32_t>(offset_ - stageOffset_);
+  stageEvents_ = 0;
+  if (stageLen_ > 0 && ::pread(fd_, stage_, stageLen_, stageOffset_) != static_cast<ssize_t>(stageLen_)) {
+    int errno_copy = THRIFT_ERRNO;
+    throw TTransportException(TTransportException::UNKNOWN, "TFileTransport: pread", errno_copy);
   }
+#else
+  T_ERROR("%s", "TFileTransport: direct IO is not supported on this platform");
+  directIO_ = false;
+#endif
+}
 
-  return swap;
+void TFileTransport::closeDirectFile() {
+  if (directFd_ != -1) {
+    ::THRIFT_CLOSE(directFd_);
+    directFd_ = -1;
+  }
 }
 
 void TFileTransport::writerThread() {
-  bool hasIOError = false;
+  hasIOError_ = false;
 
   // open file if it is not open
   if (!fd_) {
@@ -308,44 +588,39 @@ void TFileTransport::writerThread() {
       int errno_copy = THRIFT_ERRNO;
       TOutput::instance().perror("TFileTransport: writerThread() openLogFile() ", errno_copy);
       fd_ = 0;
-      hasIOError = true;
+      hasIOError_ = true;
     }
   }
 
   // set the offset to the correct value (EOF)
-  if (!hasIOError) {
+  if (!hasIOError_) {
     try {
-      seekToEnd();
-      // throw away any partial events
-      offset_ += readState_.lastDispatchPtr_;
-      if (0 == THRIFT_FTRUNCATE(fd_, offset_)) {
-        readState_.resetAllValues();
-      } else {
-        int errno_copy = THRIFT_ERRNO;
-        TOutput::instance().perror("TFileTransport: writerThread() truncate ", errno_copy);
-        hasIOError = true;
-      }
+      prepareForWriting();
     } catch (...) {
       int errno_copy = THRIFT_ERRNO;
       TOutput::instance().perror("TFileTransport: writerThread() initialization ", errno_copy);
-      hasIOError = true;
+      hasIOError_ = true;
     }
   }
 
   // Figure out the next time by which a flush must take place
   auto ts_next_flush = getNextFlushTime();
-  uint32_t unflushed = 0;
+  unflushed_ = 0;
+  uint64_t cursor = 0;
+  uint32_t mask = ringSize_ - 1;
 
   while (1) {
     // this will only be true when the destructor is being invoked
     if (closing_) {
-      if (hasIOError) {
+      if (hasIOError_) {
         return;
       }
 
-      // Try to empty buffers before exit
-      if (enqueueBuffer_->isEmpty() && dequeueBuffer_->isEmpty()) {
-        ::THRIFT_FSYNC(fd_);
+      // Try to empty the buffer before exit
+      if (cursor == ringHead_) {
+        writeStage();
+        syncFile();
+        closeDirectFile();
         if (-1 == ::THRIFT_CLOSE(fd_)) {
           int errno_copy = THRIFT_ERRNO;
           TOutput::instance().perror("TFileTransport: writerThread() ::close() ", errno_copy);
@@ -357,137 +632,62 @@ void TFileTransport::writerThread() {
       }
     }
 
-    if (swapEventBuffers(&ts_next_flush)) {
-      eventInfo* outEvent;
-      while (nullptr != (outEvent = dequeueBuffer_->getNext())) {
-        // Remove an event from the buffer and write it out to disk. If there is any IO error, for
-        // instance,
-        // the output file is unmounted or deleted, then this event is dropped. However, the writer
-        // thread
-        // will: (1) sleep for a short while; (2) try to reopen the file; (3) if successful then
-        // start writing
-        // from the end.
-
-        while (hasIOError) {
-          T_ERROR(
-              "TFileTransport: writer thread going to sleep for %u microseconds due to IO errors",
+    // After an IO error the writer thread will: (1) sleep for a short while;
+    // (2) try to reopen the file; (3) if successful then start writing from
+    // the end.  Events stay queued meanwhile.
+    while (hasIOError_) {
+      T_ERROR("TFileTransport: writer thread going to sleep for %u microseconds due to IO errors",
               writerThreadIOErrorSleepTime_);
-          THRIFT_SLEEP_USEC(writerThreadIOErrorSleepTime_);
-          if (closing_) {
-            return;
-          }
-          if (!fd_) {
-            ::THRIFT_CLOSE(fd_);
-            fd_ = 0;
-          }
-          try {
-            openLogFile();
-            seekToEnd();
-            unflushed = 0;
-            hasIOError = false;
-            T_LOG_OPER(
-                "TFileTransport: log file %s reopened by writer thread during error recovery",
+      THRIFT_SLEEP_USEC(writerThreadIOErrorSleepTime_);
+      if (closing_) {
+        return;
+      }
+      if (fd_ > 0) {
+        ::THRIFT_CLOSE(fd_);
+        fd_ = 0;
+      }
+      try {
+        openLogFile();
+        prepareForWriting();
+        unflushed_ = 0;
+        hasIOError_ = false;
+        T_LOG_OPER("TFileTransport: log file %s reopened by writer thread during error recovery",
+                   filename_.c_str());
+      } catch (...) {
+        T_ERROR("TFileTransport: unable to reopen log file %s during error recovery",
                 filename_.c_str());
-          } catch (...) {
-            T_ERROR("TFileTransport: unable to reopen log file %s during error recovery",
-                    filename_.c_str());
-          }
-        }
-
-        // sanity check on event
-        if ((maxEventSize_ > 0) && (outEvent->eventSize_ > maxEventSize_)) {
-          T_ERROR("msg size is greater than max event size: %u > %u\n",
-                  outEvent->eventSize_,
-                  maxEventSize_);
-          continue;
-        }
-
-        // If chunking is required, then make sure that msg does not cross chunk boundary
-        if ((outEvent->eventSize_ > 0) && (chunkSize_ != 0)) {
-          // event size must be less than chunk size
-          if (outEvent->eventSize_ > chunkSize_) {
-            T_ERROR("TFileTransport: event size(%u) > chunk size(%u): skipping event",
-                    outEvent->eventSize_,
-                    chunkSize_);
-            continue;
-          }
-
-          int64_t chunk1 = offset_ / chunkSize_;
-          int64_t chunk2 = (offset_ + outEvent->eventSize_ - 1) / chunkSize_;
-
-          // if adding this event will cross a chunk boundary, pad the chunk with zeros
-          if (chunk1 != chunk2) {
-            // refetch the offset to keep in sync
-            offset_ = THRIFT_LSEEK(fd_, 0, SEEK_CUR);
-            auto padding = (int32_t)((offset_ / chunkSize_ + 1) * chunkSize_ - offset_);
-
-            auto* zeros = new uint8_t[padding];
-            memset(zeros, '\0', padding);
-            std::unique_ptr<uint8_t[]> array(zeros);
-            if (-1 == ::THRIFT_WRITE(fd_, zeros, padding)) {
-              int errno_copy = THRIFT_ERRNO;
-              TOutput::instance().perror("TFileTransport: writerThread() error while padding zeros ",
-                                  errno_copy);
-              hasIOError = true;
-              continue;
-            }
-            unflushed += padding;
-            offset_ += padding;
-          }
-        }
-
-        // write the dequeued event to the file
-        if (outEvent->eventSize_ > 0) {
-          if (-1 == ::THRIFT_WRITE(fd_, outEvent->eventBuff_, outEvent->eventSize_)) {
-            int errno_copy = THRIFT_ERRNO;
-            TOutput::instance().perror("TFileTransport: error while writing event ", errno_copy);
-            hasIOError = true;
-            continue;
-          }
-          unflushed += outEvent->eventSize_;
-          offset_ += outEvent->eventSize_;
-        }
       }
-      dequeueBuffer_->reset();
     }
 
-    if (hasIOError) {
+    // Take everything published since the last pass and write it out at
+    // once.  Writers keep queueing while the write is in progress, which
+    // makes the next group larger the busier they are.
+    uint64_t staged = stageEvents(cursor);
+    bool progressed = staged != cursor;
+    if (progressed) {
+      cursor = staged;
+      releaseSpace(cursor);
+      writeStage();
+    }
+
+    if (hasIOError_) {
       continue;
     }
 
-    // Local variable to cache the state of forceFlush_.
-    //
-    // We only want to check the value of forceFlush_ once each time around the
-    // loop.  If we check it more than once without holding the lock the entire
-    // time, it could have changed state in between.  This will result in us
-    // making inconsistent decisions.
+    // a forced flush is done once everything queued before it is staged
     bool forced_flush = false;
-    {
+    if (forceFlush_) {
       Guard g(mutex_);
-      if (forceFlush_) {
-        if (!enqueueBuffer_->isEmpty()) {
-          // If forceFlush_ is true, we need to flush all available data.
-          // If enqueueBuffer_ is not empty, go back to the start of the loop to
-          // write it out.
-          //
-          // We know the main thread is waiting on forceFlush_ to be cleared,
-          // so no new events will be added to enqueueBuffer_ until we clear
-          // forceFlush_.  Therefore the next time around the loop enqueueBuffer_
-          // is guaranteed to be empty.  (I.e., we're guaranteed to make progress
-          // and clear forceFlush_ the next time around the loop.)
-          continue;
-        }
-        forced_flush = true;
-      }
+      forced_flush = forceFlush_ && cursor >= flushTarget_;
     }
 
     // determine if we need to perform an fsync
     bool flush = false;
-    if (forced_flush || unflushed > flushMaxBytes_) {
+    if (forced_flush || unflushed_ > flushMaxBytes_) {
       flush = true;
     } else {
       if (std::chrono::steady_clock::now() > ts_next_flush) {
-        if (unflushed > 0) {
+        if (unflushed_ > 0) {
           flush = true;
         } else {
           // If there is no new data since the last fsync,
@@ -499,19 +699,31 @@ void TFileTransport::writerThread() {
 
     if (flush) {
       // sync (force flush) file to disk
-      THRIFT_FSYNC(fd_);
-      unflushed = 0;
+      syncFile();
+      unflushed_ = 0;
       ts_next_flush = getNextFlushTime();
 
       // notify anybody waiting for flush completion
       if (forced_flush) {
         Guard g(mutex_);
         forceFlush_ = false;
-        assert(enqueueBuffer_->isEmpty());
-        assert(dequeueBuffer_->isEmpty());
         flushed_.notifyAll();
       }
     }
+
+    if (!progressed) {
+      if (cursor != ringHead_) {
+        // a writer is still copying its event in
+        std::this_thread::yield();
+      } else {
+        Guard g(mutex_);
+        writerSleeping_ = true;
+        if (!closing_ && !forceFlush_ && ring_[(cursor & mask) / 4].load() == 0) {
+          notEmpty_.waitForTime(ts_next_flush);
+        }
+        writerSleeping_ = false;
+      }
+    }
   }
 }
 
@@ -524,7 +736,8 @@ void TFileTransport::flush() {
   // wait for flush to take place
   Guard g(mutex_);
 
-  // Indicate that we are requesting a flush
+  // Indicate that we are requesting a flush of everything queued so far
+  flushTarget_ = (std::max)(flushTarget_, ringHead_.load());
   forceFlush_ = true;
   // Wake up the writer thread so it will perform the flush immediately
   notEmpty_.notify();
@@ -1063,6 +1276,89 @@ void TFileProcessor::processChunk() {
     }
   }
 }
+
+void TFileProcessor::processParallel(shared_ptr<concurrency::ThreadManager> threadManager,
+                                     bool inOrder) {
+  shared_ptr<TMappedFileTransport> file
+      = std::dynamic_pointer_cast<TMappedFileTransport>(inputTransport_);
+  if (!file) {
+    throw TException("TFileProcessor: parallel processing needs a TMappedFileTransport");
+  }
+
+  // cut the file at event boundaries
+  uint64_t size = file->getSize();
+  uint64_t step = file->getChunkSize();
+  if (!inOrder) {
+    size_t workers = (std::max)(threadManager->workerCount(), static_cast<size_t>(1));
+    step = (std::max)(size / (workers * 4), static_cast<uint64_t>(64 * 1024));
+  }
+  std::vector<uint64_t> bounds(1, 0);
+  while (bounds.back() < size) {
+    uint64_t next = bounds.back() + step;
+    if (!inOrder) {
+      next = file->findEvent(next);
+    }
+    bounds.push_back((std::min)(next, size));
+  }
+
+  Monitor monitor;
+  size_t pending = 0;
+  auto replay = [&](shared_ptr<TMappedFileTransport> slice) {
+    // however the replay ends, the waiting frame must hear of it
+    struct Done {
+      Monitor& monitor;
+      size_t& pending;
+      ~Done() {
+        Synchronized s(monitor);
+        if (--pending == 0) {
+          monitor.notify();
+        }
+      }
+    } done = {monitor, pending};
+
+    shared_ptr<TProtocol> inputProtocol = inputProtocolFactory_->getProtocol(slice);
+    shared_ptr<TProtocol> outputProtocol = outputProtocolFactory_->getProtocol(outputTransport_);
+    while (1) {
+      try {
+        processor_->process(inputProtocol, outputProtocol, nullptr);
+      } catch (TEOFException&) {
+        break;
+      } catch (TException& te) {
+        cerr << te.what() << '\n';
+        break;
+      }
+    }
+  };
+
+  try {
+    for (size_t i = 1; i < bounds.size(); ++i) {
+      shared_ptr<TMappedFileTransport> slice = file->slice(bounds[i - 1], bounds[i]);
+      {
+        Synchronized s(monitor);
+        ++pending;
+      }
+      try {
+        threadManager->add(concurrency::FunctionRunner::create(std::bind(replay, slice)));
+      } catch (...) {
+        Synchronized s(monitor);
+        --pending;
+        throw;
+      }
+    }
+  } catch (...) {
+    // the tasks already added still refer to this frame
+    Synchronized s(monitor);
+    while (pending > 0) {
+      monitor.waitForever();
+    }
+    throw;
+  }
+
+  Synchronized s(monitor);
+  while (pending > 0) {
+    monitor.waitForever();
+  }
+}
 }
 }
 } // apache::thrift::transport
@@ -35,6 +35,9 @@
 
 namespace apache {
 namespace thrift {
+namespace concurrency {
+class ThreadManager;
+}
 namespace transport {
 
 using apache::thrift::TProcessor;
@@ -107,8 +110,25 @@ typedef struct readState {
 } readState;
 
 /**
- * TFileTransportBuffer - buffer class used by TFileTransport for queueing up events
- * to be written to disk.  Should be used in the following way:
+ * Counters kept by the writer thread of a TFileTransport, see
+ * TFileTransport::getWriterStats().
+ */
+struct TFileWriterStats {
+  uint64_t events;        ///< events taken from the buffer to be written
+  uint64_t bytes;         ///< bytes taken likewise, with event sizes and chunk padding
+  uint64_t writes;        ///< write calls made; each commits a group of events
+  uint64_t syncs;         ///< fsync (or fdatasync) calls made
+  uint64_t droppedEvents; ///< events refused for their size, or taken but lost to IO errors
+  uint64_t producerWaits; ///< write() calls that waited for buffer space
+  uint64_t writeUsTotal;  ///< microseconds spent in write calls
+  uint64_t writeUsMax;    ///< longest write call, in microseconds
+  uint64_t syncUsTotal;   ///< microseconds spent syncing
+  uint64_t syncUsMax;     ///< longest sync, in microseconds
+};
+
+/**
+ * TFileTransportBuffer - buffer class formerly used by TFileTransport for queueing up
+ * events to be written to disk.  Should be used in the following way:
  *  1) Buffer created
  *  2) Buffer written to (addEvent)
  *  3) Buffer read from (getNext)
@@ -116,9 +136,10 @@ typedef struct readState {
  *  5) Go back to 2, or destroy buffer
  *
  * The buffer should never be written to after it is read from, unless it is reset first.
- * Note: The above rules are enforced mainly for debugging its sole client TFileTransport
- *       which uses the buffer in this way.
+ * Note: The above rules are enforced mainly for debugging.
  *
+ * @deprecated TFileTransport queues events in a byte ring instead and no
+ *             longer uses this class.
  */
 class TFileTransportBuffer {
 public:
@@ -216,15 +237,70 @@ public:
   }
   uint32_t getChunkSize() override { return chunkSize_; }
 
+  /**
+   * @deprecated Events are queued in a buffer sized in bytes, see
+   * setWriteBufferSize(); the number of queued events is no longer limited.
+   * The value is ignored, apart from being returned by getEventBufferSize().
+   */
   void setEventBufferSize(uint32_t bufferSize) {
+    TOutput::instance()("TFileTransport::setEventBufferSize() is ignored, use setWriteBufferSize()");
+    eventBufferSize_ = bufferSize;
+  }
+  uint32_t getEventBufferSize() { return eventBufferSize_; }
+
+  /**
+   * Sets the size in bytes of the buffer write() queues events in for the
+   * writer thread, rounded up to a power of two.  Each event takes its size
+   * plus 4 to 7 bytes; write() blocks while the buffer is full, and drops
+   * events that could never fit.  Must be called before the first write().
+   */
+  void setWriteBufferSize(uint32_t writeBufferSize) {
     if (bufferAndThreadInitialized_) {
       TOutput::instance()("Cannot change the buffer size after writer thread started");
       return;
     }
-    eventBufferSize_ = bufferSize;
+    if (writeBufferSize) {
+      writeBufferSize_ = writeBufferSize;
+    }
   }
+  uint32_t getWriteBufferSize() { return writeBufferSize_; }
 
-  uint32_t getEventBufferSize() { return eventBufferSize_; }
+  /**
+   * Sets the most bytes the writer thread hands to a single write call.
+   * The writer gathers every event queued since its last write, so under
+   * load one call commits many events.  Must be called before the first
+   * write().
+   */
+  void setWriteBatchSize(uint32_t writeBatchSize) {
+    if (bufferAndThreadInitialized_) {
+      TOutput::instance()("Cannot change the batch size after writer thread started");
+      return;
+    }
+    if (writeBatchSize >= 2 * DIRECT_IO_ALIGNMENT) {
+      writeBatchSize_ = writeBatchSize;
+    }
+  }
+  uint32_t getWriteBatchSize() { return writeBatchSize_; }
+
+  /**
+   * Makes the writer thread bypass the page cache: whole blocks are written
+   * with O_DIRECT, and flushes use fdatasync().  The last partial block is
+   * only written (through the page cache) when the file is synced, so
+   * readers tailing the file see events at sync points rather than as they
+   * are written.  Only available where O_DIRECT is; must be called before
+   * the first write(), and the output file cannot be changed afterwards.
+   */
+  void setDirectIO(bool directIO) {
+    if (bufferAndThreadInitialized_) {
+      TOutput::instance()("Cannot change direct IO after writer thread started");
+      return;
+    }
+    directIO_ = directIO;
+  }
+  bool getDirectIO() { return directIO_; }
+
+  /// Returns a snapshot of the writer thread's counters
+  TFileWriterStats getWriterStats() const;
 
   void setFlushMaxUs(uint32_t flushMaxUs) {
     if (flushMaxUs) {
@@ -267,8 +343,9 @@ public:
 private:
   // helper functions for writing to a file
   void enqueueEvent(const uint8_t* buf, uint32_t eventLen);
-  bool swapEventBuffers(const std::chrono::time_point<std::chrono::steady_clock> *deadline);
   bool initBufferAndWriteThread();
+  void waitForSpace(uint64_t end);
+  void dropEvents(uint64_t count);
 
   // control for writer thread
   static void* startWriterThread(void* ptr) {
@@ -276,6 +353,14 @@ private:
     return nullptr;
   }
   void writerThread();
+  uint64_t stageEvents(uint64_t cursor);
+  void stageBytes(const uint8_t* buf, uint32_t len);
+  void releaseSpace(uint64_t cursor);
+  void writeStage();
+  void syncFile();
+  void prepareForWriting();
+  void openDirectFile();
+  void closeDirectFile();
 
   // helper functions for reading from a file
   eventInfo* readEvent();
@@ -303,10 +388,21 @@ private:
   uint32_t chunkSize_;
   static const uint32_t DEFAULT_CHUNK_SIZE = 16 * 1024 * 1024;
 
-  // size of event buffers
+  // unused, see setEventBufferSize()
   uint32_t eventBufferSize_;
   static const uint32_t DEFAULT_EVENT_BUFFER_SIZE = 10000;
 
+  // size of the buffer events are queued in
+  uint32_t writeBufferSize_;
+  static const uint32_t DEFAULT_WRITE_BUFFER_SIZE = 8 * 1024 * 1024;
+
+  // most bytes written at once
+  uint32_t writeBatchSize_;
+  static const uint32_t DEFAULT_WRITE_BATCH_SIZE = 1024 * 1024;
+
+  // write and offset alignment that works for O_DIRECT on common devices
+  static const uint32_t DIRECT_IO_ALIGNMENT = 4096;
+
   // max number of microseconds that can pass without flushing
   uint32_t flushMaxUs_;
   static const uint32_t DEFAULT_FLUSH_MAX_US = 3000000;
@@ -339,28 +435,69 @@ private:
   apache::thrift::concurrency::ThreadFactory threadFactory_;
   std::shared_ptr<apache::thrift::concurrency::Thread> writerThread_;
 
-  // buffers to hold data before it is flushed. Each element of the buffer stores a msg that
-  // needs to be written to the file.  The buffers are swapped by the writer thread.
-  TFileTransportBuffer* dequeueBuffer_;
-  TFileTransportBuffer* enqueueBuffer_;
+  // Events are queued in a ring of 4 byte aligned records: the event size,
+  // which is only stored once the event has been copied in, and the event.
+  // Writers reserve records by advancing ringHead_; the writer thread zeroes
+  // records it has consumed and then advances ringTail_.  Both only grow, a
+  // position's offset in the ring being position & (ringSize_ - 1).
+  std::atomic<uint32_t>* ring_;
+  uint32_t ringSize_;
+  std::atomic<uint64_t> ringHead_;
+  std::atomic<uint64_t> ringTail_;
+
+  // set while the writer thread waits on notEmpty_, and count of writers
+  // waiting on notFull_, so that either side only takes mutex_ to wake the
+  // other when it has to
+  std::atomic<bool> writerSleeping_;
+  std::atomic<uint32_t> blockedWriters_;
+
+  // bytes gathered for the next write call.  In direct IO mode the stage
+  // starts at the aligned file offset stageOffset_, and keeps the partial
+  // block at the end of the file between calls.
+  uint8_t* stageAlloc_;
+  uint8_t* stage_;
+  uint32_t stageLen_;
+  uint32_t stageEvents_;
+  off_t stageOffset_;
+
+  bool directIO_;
+  int directFd_;
+
+  // writer thread state: whether the file needs recovering, and bytes
+  // staged since the last sync
+  bool hasIOError_;
+  uint32_t unflushed_;
 
   // conditions used to block when the buffer is full or empty
   Monitor notFull_, notEmpty_;
   std::atomic<bool> closing_;
 
-  // To keep track of whether the buffer has been flushed
+  // To keep track of whether the buffer has been flushed, and up to where
   Monitor flushed_;
   std::atomic<bool> forceFlush_;
+  uint64_t flushTarget_;
 
-  // Mutex that is grabbed when enqueueing and swapping the read/write buffers
+  // Mutex used for waiting and for starting the writer thread
   Mutex mutex_;
 
+  // writer counters, see TFileWriterStats
+  std::atomic<uint64_t> statEvents_;
+  std::atomic<uint64_t> statBytes_;
+  std::atomic<uint64_t> statWrites_;
+  std::atomic<uint64_t> statSyncs_;
+  std::atomic<uint64_t> statDroppedEvents_;
+  std::atomic<uint64_t> statProducerWaits_;
+  std::atomic<uint64_t> statWriteUsTotal_;
+  std::atomic<uint64_t> statWriteUsMax_;
+  std::atomic<uint64_t> statSyncUsTotal_;
+  std::atomic<uint64_t> statSyncUsMax_;
+
   // File information
   std::string filename_;
   int fd_;
 
   // Whether the writer thread and buffers have been initialized
-  bool bufferAndThreadInitialized_;
+  std::atomic<bool> bufferAndThreadInitialized_;
 
   // Offset within the file
   off_t offset_;
@@ -424,6 +561,24 @@ public:
    */
   void processChunk();
 
+  /**
+   * processes all events in the file on the threads of a thread manager
+   *
+   * The input transport must be a TMappedFileTransport, which is cut into
+   * slices that are replayed concurrently.  If inOrder is set there is one
+   * slice per chunk, so events are processed in order within a chunk (but
+   * not across chunks); otherwise slices are sized to keep every worker
+   * busy and no order is kept.  The processor and the output transport are
+   * shared by all workers and must be thread safe.  Returns once every
+   * event has been processed.
+   *
+   * @param threadManager started thread manager to run the slices on
+   * @param inOrder keep events of a chunk in order if true
+   * @throws TException if the input transport cannot be sliced
+   */
+  void processParallel(std::shared_ptr<concurrency::ThreadManager> threadManager,
+                       bool inOrder = true);
+
 private:
   std::shared_ptr<TProcessor> processor_;
   std::shared_ptr<TProtocolFactory> inputProtocolFactory_;
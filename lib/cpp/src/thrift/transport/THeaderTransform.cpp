@@ -0,0 +1,502 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <thrift/transport/THeaderTransform.h>
+#include <thrift/transport/THeaderTransport.h>
+#include <thrift/transport/TTransportException.h>
+#include <thrift/concurrency/Mutex.h>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <new>
+#include <zlib.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_SNAPPY
+#include <snappy-c.h>
+#endif
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::Mutex;
+
+const int TZlibHeaderTransform::DEFAULT_LEVEL;
+const int TZstdHeaderTransform::DEFAULT_LEVEL;
+
+uint8_t* THeaderTransformBuffer::reserve(uint32_t size, uint32_t keep) {
+  if (size > size_ || !buf_) {
+    // grow geometrically so that untransform() loops stay linear
+    uint32_t newSize = (std::max)(size, size_ + size_ / 2);
+    std::unique_ptr<uint8_t[]> buf(new uint8_t[(std::max)(newSize, 1u)]);
+    if (keep > 0) {
+      memcpy(buf.get(), buf_.get(), (std::min)(keep, size_));
+    }
+    buf_.swap(buf);
+    size_ = newSize;
+  }
+  return buf_.get();
+}
+
+namespace {
+
+struct Registry {
+  Registry() {
+    factories[THeaderTransport::ZLIB_TRANSFORM] = [] {
+      return std::make_shared<TZlibHeaderTransform>();
+    };
+#ifdef HAVE_ZSTD
+    factories[THeaderTransport::ZSTD_TRANSFORM] = [] {
+      return std::make_shared<TZstdHeaderTransform>();
+    };
+#endif
+#ifdef HAVE_LZ4
+    factories[THeaderTransport::LZ4_TRANSFORM] = [] {
+      return std::make_shared<TLz4HeaderTransform>();
+    };
+#endif
+#ifdef HAVE_SNAPPY
+    factories[THeaderTransport::SNAPPY_TRANSFORM] = [] {
+      return std::make_shared<TSnappyHeaderTransform>();
+    };
+#endif
+  }
+
+  Mutex mutex;
+  std::map<uint16_t, THeaderTransformRegistry::Factory> factories;
+};
+
+Registry& registry() {
+  static Registry instance;
+  return instance;
+}
+
+#if !defined(HAVE_ZSTD) || !defined(HAVE_LZ4) || !defined(HAVE_SNAPPY)
+void notCompiledIn(const char* library) {
+  throw TTransportException(TTransportException::BAD_ARGS,
+                            std::string("Thrift was built without ") + library + " support");
+}
+#endif
+
+void tooLarge() {
+  throw TTransportException(TTransportException::CORRUPTED_DATA,
+                            "Untransformed frame is too large");
+}
+}
+
+void THeaderTransformRegistry::registerTransform(uint16_t id, Factory factory) {
+  Registry& r = registry();
+  Guard g(r.mutex);
+  r.factories[id] = std::move(factory);
+}
+
+void THeaderTransformRegistry::unregisterTransform(uint16_t id) {
+  Registry& r = registry();
+  Guard g(r.mutex);
+  r.factories.erase(id);
+}
+
+bool THeaderTransformRegistry::isRegistered(uint16_t id) {
+  Registry& r = registry();
+  Guard g(r.mutex);
+  return r.factories.find(id) != r.factories.end();
+}
+
+std::shared_ptr<THeaderTransform> THeaderTransformRegistry::create(uint16_t id) {
+  Factory factory;
+  {
+    Registry& r = registry();
+    Guard g(r.mutex);
+    auto it = r.factories.find(id);
+    if (it == r.factories.end()) {
+      return nullptr;
+    }
+    factory = it->second;
+  }
+  return factory();
+}
+
+/*
+ * zlib
+ */
+
+TZlibHeaderTransform::TZlibHeaderTransform(int level, std::string dictionary)
+  : level_(level), dictionary_(std::move(dictionary)), deflate_(nullptr), inflate_(nullptr) {
+}
+
+TZlibHeaderTransform::~TZlibHeaderTransform() {
+  if (deflate_ != nullptr) {
+    deflateEnd(deflate_);
+    delete deflate_;
+  }
+  if (inflate_ != nullptr) {
+    inflateEnd(inflate_);
+    delete inflate_;
+  }
+}
+
+uint32_t TZlibHeaderTransform::transform(const uint8_t* in,
+                                         uint32_t sz,
+                                         THeaderTransformBuffer& out) {
+  // Keep the stream between frames; resetting is far cheaper than init
+  if (deflate_ == nullptr) {
+    std::unique_ptr<z_stream> stream(new z_stream());
+    if (deflateInit(stream.get(), level_) != Z_OK) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                "Error while zlib deflateInit");
+    }
+    deflate_ = stream.release();
+  } else if (deflateReset(deflate_) != Z_OK) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              "Error while zlib deflateReset");
+  }
+  if (!dictionary_.empty()
+      && deflateSetDictionary(deflate_,
+                              reinterpret_cast<const Bytef*>(dictionary_.data()),
+                              static_cast<uInt>(dictionary_.size()))
+             != Z_OK) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              "Error while zlib deflateSetDictionary");
+  }
+
+  auto bound = static_cast<uint32_t>(deflateBound(deflate_, sz));
+  deflate_->next_in = const_cast<Bytef*>(in);
+  deflate_->avail_in = sz;
+  deflate_->next_out = out.reserve(bound);
+  deflate_->avail_out = bound;
+  if (deflate(deflate_, Z_FINISH) != Z_STREAM_END) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA, "Error while zlib deflate");
+  }
+  return static_cast<uint32_t>(deflate_->total_out);
+}
+
+uint32_t TZlibHeaderTransform::untransform(const uint8_t* in,
+                                           uint32_t sz,
+                                           uint32_t maxSize,
+                                           THeaderTransformBuffer& out) {
+  if (inflate_ == nullptr) {
+    std::unique_ptr<z_stream> stream(new z_stream());
+    if (inflateInit(stream.get()) != Z_OK) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                "Error while zlib inflateInit");
+    }
+    inflate_ = stream.release();
+  } else if (inflateReset(inflate_) != Z_OK) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              "Error while zlib inflateReset");
+  }
+
+  // The uncompressed size isn't recorded, so guess and grow
+  uint32_t capacity = (std::min)(maxSize, (std::max)(out.size(), sz * 4));
+  inflate_->next_in = const_cast<Bytef*>(in);
+  inflate_->avail_in = sz;
+  inflate_->next_out = out.reserve(capacity);
+  inflate_->avail_out = capacity;
+  while (true) {
+    int err = inflate(inflate_, Z_FINISH);
+    if (err == Z_STREAM_END) {
+      break;
+    }
+    if (err == Z_NEED_DICT) {
+      if (dictionary_.empty()
+          || inflateSetDictionary(inflate_,
+                                  reinterpret_cast<const Bytef*>(dictionary_.data()),
+                                  static_cast<uInt>(dictionary_.size()))
+                 != Z_OK) {
+        throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                  "zlib data needs a different dictionary");
+      }
+      continue;
+    }
+    if ((err != Z_OK && err != Z_BUF_ERROR) || inflate_->avail_out != 0) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA, "Error while zlib inflate");
+    }
+    if (capacity >= maxSize) {
+      tooLarge();
+    }
+    auto have = static_cast<uint32_t>(inflate_->total_out);
+    capacity = capacity > maxSize / 2 ? maxSize : capacity * 2;
+    inflate_->next_out = out.reserve(capacity, have) + have;
+    inflate_->avail_out = capacity - have;
+  }
+  return static_cast<uint32_t>(inflate_->total_out);
+}
+
+/*
+ * zstd
+ */
+
+#ifdef HAVE_ZSTD
+
+TZstdDictionary::TZstdDictionary(const std::string& dictionary, int level)
+  : cdict_(ZSTD_createCDict(dictionary.data(), dictionary.size(), level)),
+    ddict_(ZSTD_createDDict(dictionary.data(), dictionary.size())) {
+  if (cdict_ == nullptr || ddict_ == nullptr) {
+    ZSTD_freeCDict(cdict_);
+    ZSTD_freeDDict(ddict_);
+    throw TTransportException(TTransportException::BAD_ARGS, "Invalid zstd dictionary");
+  }
+}
+
+TZstdDictionary::~TZstdDictionary() {
+  ZSTD_freeCDict(cdict_);
+  ZSTD_freeDDict(ddict_);
+}
+
+TZstdHeaderTransform::TZstdHeaderTransform(int level,
+                                           std::shared_ptr<const TZstdDictionary> dictionary)
+  : level_(level), dictionary_(dictionary), cctx_(nullptr), dctx_(nullptr) {
+}
+
+TZstdHeaderTransform::~TZstdHeaderTransform() {
+  ZSTD_freeCCtx(cctx_);
+  ZSTD_freeDCtx(dctx_);
+}
+
+uint32_t TZstdHeaderTransform::transform(const uint8_t* in,
+                                         uint32_t sz,
+                                         THeaderTransformBuffer& out) {
+  if (cctx_ == nullptr && (cctx_ = ZSTD_createCCtx()) == nullptr) {
+    throw std::bad_alloc();
+  }
+  size_t bound = ZSTD_compressBound(sz);
+  size_t result;
+  if (dictionary_) {
+    result = ZSTD_compress_usingCDict(cctx_, out.reserve(static_cast<uint32_t>(bound)), bound,
+                                      in, sz, dictionary_->cdict_);
+  } else {
+    result = ZSTD_compressCCtx(cctx_, out.reserve(static_cast<uint32_t>(bound)), bound, in, sz,
+                               level_);
+  }
+  if (ZSTD_isError(result)) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              std::string("Error while zstd compress: ")
+                                  + ZSTD_getErrorName(result));
+  }
+  return static_cast<uint32_t>(result);
+}
+
+uint32_t TZstdHeaderTransform::untransform(const uint8_t* in,
+                                           uint32_t sz,
+                                           uint32_t maxSize,
+                                           THeaderTransformBuffer& out) {
+  if (dctx_ == nullptr && (dctx_ = ZSTD_createDCtx()) == nullptr) {
+    throw std::bad_alloc();
+  }
+  // transform() always records the size in the frame header
+  unsigned long long size = ZSTD_getFrameContentSize(in, sz);
+  if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA, "Invalid zstd frame");
+  }
+  if (size > maxSize) {
+    tooLarge();
+  }
+  auto capacity = static_cast<uint32_t>(size);
+  size_t result;
+  if (dictionary_) {
+    result = ZSTD_decompress_usingDDict(dctx_, out.reserve(capacity), capacity, in, sz,
+                                        dictionary_->ddict_);
+  } else {
+    result = ZSTD_decompressDCtx(dctx_, out.reserve(capacity), capacity, in, sz);
+  }
+  if (ZSTD_isError(result) || result != size) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              std::string("Error while zstd decompress: ")
+                                  + (ZSTD_isError(result) ? ZSTD_getErrorName(result)
+                                                          : "size mismatch"));
+  }
+  return capacity;
+}
+
+#else // HAVE_ZSTD
+
+TZstdDictionary::TZstdDictionary(const std::string&, int) : cdict_(nullptr), ddict_(nullptr) {
+  notCompiledIn("zstd");
+}
+
+TZstdDictionary::~TZstdDictionary() = default;
+
+TZstdHeaderTransform::TZstdHeaderTransform(int level,
+                                           std::shared_ptr<const TZstdDictionary> dictionary)
+  : level_(level), dictionary_(dictionary), cctx_(nullptr), dctx_(nullptr) {
+  notCompiledIn("zstd");
+}
+
+TZstdHeaderTransform::~TZstdHeaderTransform() = default;
+
+uint32_t TZstdHeaderTransform::transform(const uint8_t*, uint32_t, THeaderTransformBuffer&) {
+  return 0;
+}
+
+uint32_t TZstdHeaderTransform::untransform(const uint8_t*,
+                                           uint32_t,
+                                           uint32_t,
+                                           THeaderTransformBuffer&) {
+  return 0;
+}
+
+#endif // HAVE_ZSTD
+
+/*
+ * lz4
+ */
+
+#ifdef HAVE_LZ4
+
+TLz4HeaderTransform::TLz4HeaderTransform() : state_(new char[LZ4_sizeofState()]) {
+}
+
+TLz4HeaderTransform::~TLz4HeaderTransform() = default;
+
+uint32_t TLz4HeaderTransform::transform(const uint8_t* in,
+                                        uint32_t sz,
+                                        THeaderTransformBuffer& out) {
+  if (sz > LZ4_MAX_INPUT_SIZE) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA, "Frame too large for lz4");
+  }
+  int bound = LZ4_compressBound(static_cast<int>(sz));
+  uint8_t* dst = out.reserve(static_cast<uint32_t>(bound) + 4);
+  uint32_t szN = htonl(sz);
+  memcpy(dst, &szN, sizeof(szN));
+  int result = LZ4_compress_fast_extState(state_.get(),
+                                          reinterpret_cast<const char*>(in),
+                                          reinterpret_cast<char*>(dst + 4),
+                                          static_cast<int>(sz),
+                                          bound,
+                                          1);
+  if (result <= 0 && sz > 0) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA, "Error while lz4 compress");
+  }
+  return static_cast<uint32_t>(result) + 4;
+}
+
+uint32_t TLz4HeaderTransform::untransform(const uint8_t* in,
+                                          uint32_t sz,
+                                          uint32_t maxSize,
+                                          THeaderTransformBuffer& out) {
+  uint32_t szN;
+  if (sz < sizeof(szN)) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA, "Invalid lz4 frame");
+  }
+  memcpy(&szN, in, sizeof(szN));
+  uint32_t size = ntohl(szN);
+  if (size > maxSize || size > LZ4_MAX_INPUT_SIZE) {
+    tooLarge();
+  }
+  int result = LZ4_decompress_safe(reinterpret_cast<const char*>(in + 4),
+                                   reinterpret_cast<char*>(out.reserve(size)),
+                                   static_cast<int>(sz - 4),
+                                   static_cast<int>(size));
+  if (result < 0 || static_cast<uint32_t>(result) != size) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA, "Error while lz4 decompress");
+  }
+  return size;
+}
+
+#else // HAVE_LZ4
+
+TLz4HeaderTransform::TLz4HeaderTransform() {
+  notCompiledIn("lz4");
+}
+
+TLz4HeaderTransform::~TLz4HeaderTransform() = default;
+
+uint32_t TLz4HeaderTransform::transform(const uint8_t*, uint32_t, THeaderTransformBuffer&) {
+  return 0;
+}
+
+uint32_t TLz4HeaderTransform::untransform(const uint8_t*,
+                                          uint32_t,
+                                          uint32_t,
+                                          THeaderTransformBuffer&) {
+  return 0;
+}
+
+#endif // HAVE_LZ4
+
+/*
+ * snappy
+ */
+
+#ifdef HAVE_SNAPPY
+
+TSnappyHeaderTransform::TSnappyHeaderTransform() = default;
+
+uint32_t TSnappyHeaderTransform::transform(const uint8_t* in,
+                                           uint32_t sz,
+                                           THeaderTransformBuffer& out) {
+  size_t length = snappy_max_compressed_length(sz);
+  char* dst = reinterpret_cast<char*>(out.reserve(static_cast<uint32_t>(length)));
+  if (snappy_compress(reinterpret_cast<const char*>(in), sz, dst, &length) != SNAPPY_OK) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              "Error while snappy compress");
+  }
+  return static_cast<uint32_t>(length);
+}
+
+uint32_t TSnappyHeaderTransform::untransform(const uint8_t* in,
+                                             uint32_t sz,
+                                             uint32_t maxSize,
+                                             THeaderTransformBuffer& out) {
+  size_t length;
+  if (snappy_uncompressed_length(reinterpret_cast<const char*>(in), sz, &length) != SNAPPY_OK) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA, "Invalid snappy frame");
+  }
+  if (length > maxSize) {
+    tooLarge();
+  }
+  char* dst = reinterpret_cast<char*>(out.reserve(static_cast<uint32_t>(length)));
+  if (snappy_uncompress(reinterpret_cast<const char*>(in), sz, dst, &length) != SNAPPY_OK) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              "Error while snappy decompress");
+  }
+  return static_cast<uint32_t>(length);
+}
+
+#else // HAVE_SNAPPY
+
+TSnappyHeaderTransform::TSnappyHeaderTransform() {
+  notCompiledIn("snappy");
+}
+
+uint32_t TSnappyHeaderTransform::transform(const uint8_t*, uint32_t, THeaderTransformBuffer&) {
+  return 0;
+}
+
+uint32_t TSnappyHeaderTransform::untransform(const uint8_t*,
+                                             uint32_t,
+                                             uint32_t,
+                                             THeaderTransformBuffer&) {
+  return 0;
+}
+
+#endif // HAVE_SNAPPY
+}
+}
+} // apache::thrift::transport
@@ -0,0 +1,253 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFT_TRANSPORT_THEADERTRANSFORM_H_
+#define THRIFT_TRANSPORT_THEADERTRANSFORM_H_ 1
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+
+struct z_stream_s;
+struct ZSTD_CCtx_s;
+struct ZSTD_DCtx_s;
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+/**
+ * Output buffer of a THeaderTransform.  It keeps its memory from one frame
+ * to the next and, unlike std::vector, does not initialize what it grows by.
+ */
+class THeaderTransformBuffer {
+public:
+  THeaderTransformBuffer() : size_(0) {}
+
+  /**
+   * Returns a buffer of at least size bytes, whose first keep bytes are
+   * those of the buffer before the call.
+   */
+  uint8_t* reserve(uint32_t size, uint32_t keep = 0);
+
+  uint8_t* get() const { return buf_.get(); }
+  uint32_t size() const { return size_; }
+
+  /// Exchanges the memory of this buffer with a transport buffer
+  void swap(std::unique_ptr<uint8_t[]>& buf, uint32_t& size) {
+    buf_.swap(buf);
+    std::swap(size_, size);
+  }
+
+private:
+  std::unique_ptr<uint8_t[]> buf_;
+  uint32_t size_;
+};
+
+/**
+ * A transform THeaderTransport applies to the payload of its frames, such
+ * as a compression codec.  Transforms are identified on the wire by the ids
+ * in THeaderTransport::TRANSFORMS and made available with
+ * THeaderTransformRegistry.
+ *
+ * Every THeaderTransport creates its own instance of the transforms it
+ * uses, so an implementation may keep (de)compression contexts from one
+ * frame to the next and need not be thread safe.
+ */
+class THeaderTransform {
+public:
+  virtual ~THeaderTransform() = default;
+
+  /**
+   * Transforms sz bytes at in into out.
+   *
+   * @return the number of bytes written to out
+   * @throws TTransportException if the data could not be transformed
+   */
+  virtual uint32_t transform(const uint8_t* in, uint32_t sz, THeaderTransformBuffer& out) = 0;
+
+  /**
+   * Reverses transform().
+   *
+   * @param maxSize the largest result the caller accepts
+   * @return the number of bytes written to out
+   * @throws TTransportException CORRUPTED_DATA if the data is invalid or
+   *                             would untransform to more than maxSize bytes
+   */
+  virtual uint32_t untransform(const uint8_t* in,
+                               uint32_t sz,
+                               uint32_t maxSize,
+                               THeaderTransformBuffer& out) = 0;
+};
+
+/**
+ * Process wide table of the transforms THeaderTransport can use, by id.
+ *
+ * zlib is always registered.  zstd, lz4 and snappy are registered with
+ * their default settings when Thrift was built with the library; register
+ * them again to change the settings, e.g. to give zstd a dictionary.
+ * Registration is meant to happen at startup: transports that already
+ * created a transform keep using it.
+ */
+class THeaderTransformRegistry {
+public:
+  typedef std::function<std::shared_ptr<THeaderTransform>()> Factory;
+
+  /// Makes id available, replacing any previous registration
+  static void registerTransform(uint16_t id, Factory factory);
+
+  static void unregisterTransform(uint16_t id);
+
+  static bool isRegistered(uint16_t id);
+
+  /// Returns a new instance of transform id, or nullptr if it is unknown
+  static std::shared_ptr<THeaderTransform> create(uint16_t id);
+};
+
+/**
+ * THeaderTransport::ZLIB_TRANSFORM, a zlib stream per frame.
+ */
+class TZlibHeaderTransform : public THeaderTransform {
+public:
+  /// Z_DEFAULT_COMPRESSION
+  static const int DEFAULT_LEVEL = -1;
+
+  /**
+   * @param level      Compression level
+   * @param dictionary zlib preset dictionary, if any: up to 32KB of strings
+   *                   likely to occur in the messages, most common last.
+   *                   Both peers must use the same dictionary.
+   */
+  explicit TZlibHeaderTransform(int level = DEFAULT_LEVEL,
+                                std::string dictionary = std::string());
+  ~TZlibHeaderTransform() override;
+
+  uint32_t transform(const uint8_t* in, uint32_t sz, THeaderTransformBuffer& out) override;
+  uint32_t untransform(const uint8_t* in,
+                       uint32_t sz,
+                       uint32_t maxSize,
+                       THeaderTransformBuffer& out) override;
+
+private:
+  int level_;
+  std::string dictionary_;
+  z_stream_s* deflate_;
+  z_stream_s* inflate_;
+};
+
+/**
+ * A zstd dictionary, typically trained on sample messages with
+ * "zstd --train".  Small Thrift messages share a lot of structure with each
+ * other but little within themselves, so a dictionary considerably improves
+ * how well they compress.  Both peers must use the same dictionary.
+ *
+ * A dictionary is immutable and can be shared between any number of
+ * transforms and threads.
+ */
+class TZstdDictionary {
+public:
+  /**
+   * @param dictionary The dictionary contents
+   * @param level      The compression level to use with it
+   * @throws TTransportException if the dictionary can't be loaded
+   */
+  explicit TZstdDictionary(const std::string& dictionary, int level = 1);
+  ~TZstdDictionary();
+
+  TZstdDictionary(const TZstdDictionary&) = delete;
+  TZstdDictionary& operator=(const TZstdDictionary&) = delete;
+
+private:
+  friend class TZstdHeaderTransform;
+
+  ZSTD_CDict_s* cdict_;
+  ZSTD_DDict_s* ddict_;
+};
+
+/**
+ * THeaderTransport::ZSTD_TRANSFORM, a zstd frame per frame.  At its default
+ * level zstd compresses about as well as zlib does at a fraction of the CPU.
+ */
+class TZstdHeaderTransform : public THeaderTransform {
+public:
+  static const int DEFAULT_LEVEL = 1;
+
+  /**
+   * @param level      Compression level, ignored when a dictionary is given
+   * @param dictionary Dictionary to compress and decompress with, if any
+   */
+  explicit TZstdHeaderTransform(int level = DEFAULT_LEVEL,
+                                std::shared_ptr<const TZstdDictionary> dictionary = nullptr);
+  ~TZstdHeaderTransform() override;
+
+  uint32_t transform(const uint8_t* in, uint32_t sz, THeaderTransformBuffer& out) override;
+  uint32_t untransform(const uint8_t* in,
+                       uint32_t sz,
+                       uint32_t maxSize,
+                       THeaderTransformBuffer& out) override;
+
+private:
+  int level_;
+  std::shared_ptr<const TZstdDictionary> dictionary_;
+  ZSTD_CCtx_s* cctx_;
+  ZSTD_DCtx_s* dctx_;
+};
+
+/**
+ * THeaderTransport::LZ4_TRANSFORM, the uncompressed size as a big endian
+ * 32 bit integer followed by an lz4 block.  Compresses less than zstd but is
+ * cheaper still, especially to decompress.
+ */
+class TLz4HeaderTransform : public THeaderTransform {
+public:
+  TLz4HeaderTransform();
+  ~TLz4HeaderTransform() override;
+
+  uint32_t transform(const uint8_t* in, uint32_t sz, THeaderTransformBuffer& out) override;
+  uint32_t untransform(const uint8_t* in,
+                       uint32_t sz,
+                       uint32_t maxSize,
+                       THeaderTransformBuffer& out) override;
+
+private:
+  std::unique_ptr<char[]> state_;
+};
+
+/**
+ * THeaderTransport::SNAPPY_TRANSFORM, raw snappy.
+ */
+class TSnappyHeaderTransform : public THeaderTransform {
+public:
+  TSnappyHeaderTransform();
+
+  uint32_t transform(const uint8_t* in, uint32_t sz, THeaderTransformBuffer& out) override;
+  uint32_t untransform(const uint8_t* in,
+                       uint32_t sz,
+                       uint32_t maxSize,
+                       THeaderTransformBuffer& out) override;
+};
+}
+}
+} // apache::thrift::transport
+
+#endif // #ifndef THRIFT_TRANSPORT_THEADERTRANSFORM_H_
@@ -23,11 +23,12 @@
 #include <thrift/protocol/TBinaryProtocol.h>
 #include <thrift/protocol/TCompactProtocol.h>
 
+#include <algorithm>
+#include <cstdlib>
 #include <limits>
 #include <utility>
 #include <string>
 #include <string.h>
-#include <zlib.h>
 
 using std::map;
 using std::string;
@@ -43,6 +44,9 @@ namespace transport {
 using namespace apache::thrift::protocol;
 using apache::thrift::protocol::TBinaryProtocol;
 
+const char* const THeaderTransport::TRANSFORMS_HEADER = "thrift_transforms";
+const char* const THeaderTransport::TRANSFORMS_ANSWER_HEADER = "thrift_transforms_answer";
+
 uint32_t THeaderTransport::readSlow(uint8_t* buf, uint32_t len) {
   if (clientType == THRIFT_UNFRAMED_BINARY || clientType == THRIFT_UNFRAMED_COMPACT) {
     return transport_->read(buf, len);
@@ -256,54 +260,41 @@ void THeaderTransport::readHeaderFormat(uint16_t headerSize, uint32_t sz) {
     }
   }
 
+  auto negotiation = readHeaders_.find(TRANSFORMS_HEADER);
+  if (negotiation != readHeaders_.end()) {
+    negotiateTransforms(negotiation->second, false);
+    readHeaders_.erase(negotiation);
+  }
+  negotiation = readHeaders_.find(TRANSFORMS_ANSWER_HEADER);
+  if (negotiation != readHeaders_.end()) {
+    negotiateTransforms(negotiation->second, true);
+    readHeaders_.erase(negotiation);
+  }
+
   // Untransform the data section.  rBuf will contain result.
   untransform(data, safe_numeric_cast<uint32_t>(static_cast<ptrdiff_t>(sz) - (data - rBuf_.get())));
 }
 
 void THeaderTransport::untransform(uint8_t* ptr, uint32_t sz) {
-  // Update the transform buffer size if needed
-  resizeTransformBuffer();
-
-  for (vector<uint16_t>::const_iterator it = readTrans_.begin(); it != readTrans_.end(); ++it) {
-    const uint16_t transId = *it;
-
-    if (transId == ZLIB_TRANSFORM) {
-      z_stream stream;
-      int err;
-
-      stream.next_in = ptr;
-      stream.avail_in = sz;
-
-      // Setting these to 0 means use the default free/alloc functions
-      stream.zalloc = (alloc_func)nullptr;
-      stream.zfree = (free_func)nullptr;
-      stream.opaque = (voidpf)nullptr;
-      err = inflateInit(&stream);
-      if (err != Z_OK) {
-        throw TApplicationException(TApplicationException::MISSING_RESULT,
-                                    "Error while zlib deflateInit");
-      }
-      stream.next_out = tBuf_.get();
-      stream.avail_out = tBufSize_;
-      err = inflate(&stream, Z_FINISH);
-      if (err != Z_STREAM_END || stream.avail_out == 0) {
-        throw TApplicationException(TApplicationException::MISSING_RESULT,
-                                    "Error while zlib deflate");
-      }
-      sz = stream.total_out;
-
-      err = inflateEnd(&stream);
-      if (err != Z_OK) {
-        throw TApplicationException(TApplicationException::MISSING_RESULT,
-                                    "Error while zlib deflateEnd");
-      }
-
-      memcpy(ptr, tBuf_.get(), sz);
-    } else {
+  auto maxSize = static_cast<uint32_t>(getMaxMessageSize());
+  THeaderTransformBuffer* out = nullptr;
+
+  // Undo the transforms in the reverse of the order they were applied
+  for (vector<uint16_t>::const_reverse_iterator it = readTrans_.rbegin(); it != readTrans_.rend();
+       ++it) {
+    THeaderTransform* transform = getTransform(*it);
+    if (transform == nullptr) {
       throw TApplicationException(TApplicationException::MISSING_RESULT, "Unknown transform");
     }
+    out = &transformBufs_[out == &transformBufs_[0] ? 1 : 0];
+    sz = transform->untransform(ptr, sz, maxSize, *out);
+    ptr = out->get();
   }
 
+  if (out != nullptr) {
+    // Make the result the read buffer; the frame buffer is kept for reuse
+    out->swap(rBuf_, rBufSize_);
+  }
   setReadBuffer(ptr, sz);
 }
 
@@ -324,51 +315,104 @@ void THeaderTransport::resizeTransformBuffer(uint32_t additionalSize) {
 }
 
 void THeaderTransport::transform(uint8_t* ptr, uint32_t sz) {
-  // Update the transform buffer size if needed
-  resizeTransformBuffer();
+  THeaderTransformBuffer* out = nullptr;
 
   for (vector<uint16_t>::const_iterator it = writeTrans_.begin(); it != writeTrans_.end(); ++it) {
-    const uint16_t transId = *it;
+    THeaderTransform* transform = getTransform(*it);
+    if (transform == nullptr) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA, "Unknown transform");
+    }
+    out = &transformBufs_[out == &transformBufs_[0] ? 1 : 0];
+    sz = transform->transform(ptr, sz, *out);
+    ptr = out->get();
+  }
 
-    if (transId == ZLIB_TRANSFORM) {
-      z_stream stream;
-      int err;
+  if (out != nullptr) {
+    // Make the result the write buffer; the old one is kept for reuse
+    out->swap(wBuf_, wBufSize_);
+    setWriteBuffer(wBuf_.get(), wBufSize_);
+  }
+  wBase_ = wBuf_.get() + sz;
 
-      stream.next_in = ptr;
-      stream.avail_in = sz;
+  // The frame may have outgrown the old write buffer
+  resizeTransformBuffer();
+}
 
-      stream.zalloc = (alloc_func)nullptr;
-      stream.zfree = (free_func)nullptr;
-      stream.opaque = (voidpf)nullptr;
-      err = deflateInit(&stream, Z_DEFAULT_COMPRESSION);
-      if (err != Z_OK) {
-        throw TTransportException(TTransportException::CORRUPTED_DATA,
-                                  "Error while zlib deflateInit");
-      }
-      uint32_t tbuf_size = 0;
-      while (err == Z_OK) {
-        resizeTransformBuffer(tbuf_size);
-
-        stream.next_out = tBuf_.get();
-        stream.avail_out = tBufSize_;
-        err = deflate(&stream, Z_FINISH);
-        tbuf_size += DEFAULT_BUFFER_SIZE;
-      }
-      sz = stream.total_out;
+THeaderTransform* THeaderTransport::getTransform(uint16_t transId) {
+  auto it = transforms_.find(transId);
+  if (it == transforms_.end()) {
+    shared_ptr<THeaderTransform> transform = THeaderTransformRegistry::create(transId);
+    if (!transform) {
+      return nullptr;
+    }
+    it = transforms_.emplace(transId, transform).first;
+  }
+  return it->second.get();
+}
 
-      err = deflateEnd(&stream);
-      if (err != Z_OK) {
-        throw TTransportException(TTransportException::CORRUPTED_DATA,
-                                  "Error while zlib deflateEnd");
-      }
+void THeaderTransport::setPreferredTransforms(const vector<uint16_t>& transIds) {
+  preferredTrans_.clear();
+  transformsHeader_.clear();
+  for (vector<uint16_t>::const_iterator it = transIds.begin(); it != transIds.end(); ++it) {
+    // offer only what we could use ourselves
+    if (getTransform(*it) == nullptr) {
+      continue;
+    }
+    preferredTrans_.push_back(*it);
+    if (!transformsHeader_.empty()) {
+      transformsHeader_ += ',';
+    }
+    transformsHeader_ += std::to_string(*it);
+  }
+  sendTransformsHeader_ = !preferredTrans_.empty();
+}
 
-      memcpy(ptr, tBuf_.get(), sz);
-    } else {
-      throw TTransportException(TTransportException::CORRUPTED_DATA, "Unknown transform");
+void THeaderTransport::negotiateTransforms(const string& transIds, bool answer) {
+  if (answer && preferredTrans_.empty()) {
+    // We made no offer, or already had its answer
+    return;
+  }
+
+  vector<uint16_t> ids;
+  const char* p = transIds.c_str();
+  while (*p != '\0') {
+    char* end;
+    unsigned long id = strtoul(p, &end, 10);
+    if (end == p) {
+      ++p;
+      continue;
+    }
+    if (id <= (std::numeric_limits<uint16_t>::max)()) {
+      ids.push_back(static_cast<uint16_t>(id));
     }
+    p = end;
   }
 
-  wBase_ = wBuf_.get() + sz;
+  if (answer) {
+    // This is the answer to our offer
+    writeTrans_.clear();
+    for (vector<uint16_t>::const_iterator it = ids.begin(); it != ids.end(); ++it) {
+      if (std::find(preferredTrans_.begin(), preferredTrans_.end(), *it) != preferredTrans_.end()
+          && getTransform(*it) != nullptr) {
+        writeTrans_.push_back(*it);
+        break;
+      }
+    }
+    preferredTrans_.clear();
+    sendTransformsHeader_ = false;
+  } else {
+    // The peer makes an offer; an empty answer means none of them
+    writeTrans_.clear();
+    transformsAnswer_.clear();
+    for (vector<uint16_t>::const_iterator it = ids.begin(); it != ids.end(); ++it) {
+      if (getTransform(*it) != nullptr) {
+        writeTrans_.push_back(*it);
+        transformsAnswer_ = std::to_string(*it);
+        break;
+      }
+    }
+    sendTransformsAnswer_ = true;
+  }
 }
 
 void THeaderTransport::resetProtocol() {
@@ -407,6 +451,12 @@ uint32_t THeaderTransport::getMaxWriteHeadersSize() const {
     // 2 varints32 + the strings themselves
     maxWriteHeadersSize += 5 + 5 + (it->first).length() + (it->second).length();
   }
+  if (sendTransformsHeader_) {
+    maxWriteHeadersSize += 5 + 5 + strlen(TRANSFORMS_HEADER) + transformsHeader_.length();
+  }
+  if (sendTransformsAnswer_) {
+    maxWriteHeadersSize += 5 + 5 + strlen(TRANSFORMS_ANSWER_HEADER) + transformsAnswer_.length();
+  }
   return safe_numeric_cast<uint32_t>(maxWriteHeadersSize);
 }
 
@@ -419,9 +469,15 @@ void THeaderTransport::flush() {
   // Write out any data waiting in the write buffer.
   uint32_t haveBytes = getWriteBytes();
 
+  // Small frames go out as they are, see setMinTransformSize()
+  bool transformed = haveBytes >= minTransformSize_;
   if (clientType == THRIFT_HEADER_CLIENT_TYPE) {
-    transform(wBuf_.get(), haveBytes);
-    haveBytes = getWriteBytes(); // transform may have changed the size
+    if (transformed) {
+      transform(wBuf_.get(), haveBytes);
+      haveBytes = getWriteBytes(); // transform may have changed the size
+    } else {
+      resizeTransformBuffer();
+    }
   }
 
   // Note that we reset wBase_ prior to the underlying write
@@ -437,7 +493,8 @@ void THeaderTransport::flush() {
   if (clientType == THRIFT_HEADER_CLIENT_TYPE) {
     // header size will need to be updated at the end because of varints.
     // Make it big enough here for max varint size, plus 4 for padding.
-    uint32_t headerSize = (2 + getNumTransforms()) * THRIFT_MAX_VARINT32_BYTES + 4;
+    uint16_t numTransforms = transformed ? getNumTransforms() : 0;
+    uint32_t headerSize = (2 + numTransforms) * THRIFT_MAX_VARINT32_BYTES + 4;
     // add approximate size of info headers
     headerSize += getMaxWriteHeadersSize();
 
@@ -475,17 +532,18 @@ void THeaderTransport::flush() {
     headerStart = pkt;
 
     pkt += writeVarint32(protoId, pkt);
-    pkt += writeVarint32(getNumTransforms(), pkt);
+    pkt += writeVarint32(numTransforms, pkt);
 
     // For now, each transform is only the ID, no following data.
-    for (vector<uint16_t>::const_iterator it = writeTrans_.begin(); it != writeTrans_.end(); ++it) {
-      pkt += writeVarint32(*it, pkt);
+    for (uint16_t i = 0; i < numTransforms; ++i) {
+      pkt += writeVarint32(writeTrans_[i], pkt);
     }
 
     // write info headers
 
     // for now only write kv-headers
-    auto headerCount = safe_numeric_cast<int32_t>(writeHeaders_.size());
+    auto headerCount = safe_numeric_cast<int32_t>(writeHeaders_.size())
+                       + (sendTransformsHeader_ ? 1 : 0) + (sendTransformsAnswer_ ? 1 : 0);
     if (headerCount > 0) {
       pkt += writeVarint32(infoIdType::KEYVALUE, pkt);
       // Write key-value headers count
@@ -497,6 +555,18 @@ void THeaderTransport::flush() {
         writeString(pkt, it->second); // value
       }
       writeHeaders_.clear();
+      if (sendTransformsHeader_) {
+        writeString(pkt, TRANSFORMS_HEADER);
+        writeString(pkt, transformsHeader_);
+        // a client keeps offering until it hears back
+        sendTransformsHeader_ = !preferredTrans_.empty();
+      }
+      if (sendTransformsAnswer_) {
+        writeString(pkt, TRANSFORMS_ANSWER_HEADER);
+        writeString(pkt, transformsAnswer_);
+        // a server answers once
+        sendTransformsAnswer_ = false;
+      }
     }
 
     // Fixups after varint size calculations
@@ -35,6 +35,7 @@
 
 #include <thrift/protocol/TProtocolTypes.h>
 #include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/THeaderTransform.h>
 #include <thrift/transport/TTransport.h>
 #include <thrift/transport/TVirtualTransport.h>
 
@@ -81,7 +82,10 @@ public:
       seqId(0),
       flags(0),
       tBufSize_(0),
-      tBuf_(nullptr) {
+      tBuf_(nullptr),
+      minTransformSize_(0),
+      sendTransformsHeader_(false),
+      sendTransformsAnswer_(false) {
     if (!transport_) throw std::invalid_argument("transport is empty");
     initBuffers();
   }
@@ -96,7 +100,10 @@ public:
       seqId(0),
       flags(0),
       tBufSize_(0),
-      tBuf_(nullptr) {
+      tBuf_(nullptr),
+      minTransformSize_(0),
+      sendTransformsHeader_(false),
+      sendTransformsAnswer_(false) {
     if (!transport_) throw std::invalid_argument("inTransport is empty");
     if (!outTransport_) throw std::invalid_argument("outTransport is empty");
     initBuffers();
@@ -105,6 +112,12 @@ public:
   uint32_t readSlow(uint8_t* buf, uint32_t len) override;
   void flush() override;
 
+  /*
+   * flush() transforms the whole frame buffer, so never keep writes by
+   * reference as TFramedTransport::write() may.
+   */
+  void write(const uint8_t* buf, uint32_t len) { TBufferBase::write(buf, len); }
+
   void resizeTransformBuffer(uint32_t additionalSize = 0);
 
   uint16_t getProtocolId() const;
@@ -146,6 +159,30 @@ public:
 
   void setTransform(uint16_t transId) { writeTrans_.push_back(transId); }
 
+  /**
+   * Frames with fewer payload bytes than this are written without the write
+   * transforms, as compressing small frames costs more CPU than it saves.
+   * The default, 0, transforms every frame.
+   */
+  void setMinTransformSize(uint32_t size) { minTransformSize_ = size; }
+  uint32_t getMinTransformSize() const { return minTransformSize_; }
+
+  /**
+   * Negotiates the write transform of this connection with the peer.
+   *
+   * The client offers transIds, most preferred first, in an info header
+   * sent with its frames; ids without a registered transform are dropped.
+   * A THeaderTransport reading the offer picks the first transform it has
+   * registered, applies it to everything it writes from then on and names
+   * it in an answer header of its next frame.  When the client reads that
+   * answer it uses the transform picked for its own frames, or none if the
+   * peer had none in common, and stops offering; later answers are
+   * ignored.  A peer that doesn't know about negotiation ignores the offer.
+   *
+   * Whatever was set with setTransform() is used until the answer arrives.
+   */
+  void setPreferredTransforms(const std::vector<uint16_t>& transIds);
+
   // Info headers
 
   typedef std::map<std::string, std::string> StringToStringMap;
@@ -166,8 +203,17 @@ public:
 
   enum TRANSFORMS {
     ZLIB_TRANSFORM = 0x01,
+    SNAPPY_TRANSFORM = 0x03,
+    ZSTD_TRANSFORM = 0x05,
+    LZ4_TRANSFORM = 0x06,
   };
 
+  /// Info header carrying the offer of setPreferredTransforms()
+  static const char* const TRANSFORMS_HEADER;
+
+  /// Info header carrying the transform picked from an offer
+  static const char* const TRANSFORMS_ANSWER_HEADER;
+
 protected:
   /**
    * Reads a frame of input from the underlying stream.
@@ -223,6 +269,28 @@ protected:
   uint32_t tBufSize_;
   std::unique_ptr<uint8_t[]> tBuf_;
 
+  /**
+   * Returns the transform for transId, creating it on first use, or nullptr
+   * if there is no such transform.
+   */
+  THeaderTransform* getTransform(uint16_t transId);
+
+  /**
+   * Handles a TRANSFORMS_HEADER (offer) or TRANSFORMS_ANSWER_HEADER read
+   * from the peer.
+   */
+  void negotiateTransforms(const std::string& transIds, bool answer);
+
+  std::map<uint16_t, std::shared_ptr<THeaderTransform> > transforms_;
+  THeaderTransformBuffer transformBufs_[2];
+  uint32_t minTransformSize_;
+
+  std::vector<uint16_t> preferredTrans_;
+  std::string transformsHeader_;
+  bool sendTransformsHeader_;
+  std::string transformsAnswer_;
+  bool sendTransformsAnswer_;
+
   void readString(uint8_t*& ptr, /* out */ std::string& str, uint8_t const* headerBoundary);
 
   void writeString(uint8_t*& ptr, const std::string& str);
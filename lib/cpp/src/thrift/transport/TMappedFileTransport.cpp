@@ -0,0 +1,369 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <thrift/transport/TMappedFileTransport.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include <fcntl.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include <thrift/transport/PlatformSocket.h>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+struct TMappedFileTransport::Mapping {
+  Mapping() : data(nullptr), size(0) {}
+  ~Mapping() {
+#ifndef _WIN32
+    if (data != nullptr) {
+      ::munmap(const_cast<uint8_t*>(data), size);
+    }
+#endif
+  }
+
+  const uint8_t* data;
+  uint64_t size;
+};
+
+TMappedFileTransport::TMappedFileTransport(const std::string& path,
+                                           std::shared_ptr<TConfiguration> config)
+  : TTransport(config),
+    fd_(-1),
+    mapping_(new Mapping),
+    pos_(0),
+    eventEnd_(0),
+    end_((std::numeric_limits<uint64_t>::max)()),
+    isSlice_(false),
+    readTimeout_(TFileTransport::NO_TAIL_READ_TIMEOUT),
+    chunkSize_(DEFAULT_CHUNK_SIZE),
+    maxEventSize_(0),
+    eofSleepTime_(DEFAULT_EOF_SLEEP_TIME_US) {
+#ifdef _WIN32
+  throw TTransportException(TTransportException::NOT_OPEN,
+                            "TMappedFileTransport is not supported on Windows");
+#else
+  fd_ = ::THRIFT_OPEN(path.c_str(), O_RDONLY);
+  if (fd_ == -1) {
+    int errno_copy = THRIFT_ERRNO;
+    TOutput::instance().perror("TMappedFileTransport: open() file: " + path, errno_copy);
+    throw TTransportException(TTransportException::NOT_OPEN, path, errno_copy);
+  }
+  try {
+    remap();
+  } catch (...) {
+    ::THRIFT_CLOSE(fd_);
+    throw;
+  }
+#endif
+}
+
+TMappedFileTransport::TMappedFileTransport(const TMappedFileTransport& file,
+                                           uint64_t begin,
+                                           uint64_t end)
+  : TTransport(file.configuration_),
+    fd_(-1),
+    mapping_(file.mapping_),
+    pos_(begin),
+    eventEnd_(begin),
+    end_(end),
+    isSlice_(true),
+    readTimeout_(TFileTransport::NO_TAIL_READ_TIMEOUT),
+    chunkSize_(file.chunkSize_),
+    maxEventSize_(file.maxEventSize_),
+    eofSleepTime_(file.eofSleepTime_) {
+}
+
+TMappedFileTransport::~TMappedFileTransport() {
+  if (fd_ != -1) {
+    ::THRIFT_CLOSE(fd_);
+  }
+}
+
+/**
+ * Maps the file again if it has grown.  Readers sliced off earlier keep the
+ * mapping they were made from.
+ */
+bool TMappedFileTransport::remap() {
+#ifndef _WIN32
+  struct THRIFT_STAT info;
+  if (::THRIFT_FSTAT(fd_, &info) < 0) {
+    int errno_copy = THRIFT_ERRNO;
+    throw TTransportException(TTransportException::UNKNOWN,
+                              "TMappedFileTransport: fstat()",
+                              errno_copy);
+  }
+  auto size = static_cast<uint64_t>(info.st_size);
+  if (size <= mapping_->size) {
+    return false;
+  }
+
+  std::shared_ptr<Mapping> mapping(new Mapping);
+  void* data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd_, 0);
+  if (data == MAP_FAILED) {
+    int errno_copy = THRIFT_ERRNO;
+    TOutput::instance().perror("TMappedFileTransport: mmap() ", errno_copy);
+    throw TTransportException(TTransportException::UNKNOWN,
+                              "TMappedFileTransport: mmap()",
+                              errno_copy);
+  }
+#ifdef MADV_SEQUENTIAL
+  ::madvise(data, size, MADV_SEQUENTIAL);
+#endif
+  mapping->data = static_cast<const uint8_t*>(data);
+  mapping->size = size;
+  mapping_ = mapping;
+  return true;
+#else
+  return false;
+#endif
+}
+
+/**
+ * Moves pos to the size of the first complete event at or after it,
+ * skipping padding, and chunks holding a corrupted event.  Returns false
+ * if the mapping ends first.
+ */
+bool TMappedFileTransport::scanEvent(const Mapping& mapping, uint64_t& pos, uint32_t& size) const {
+  while (true) {
+    uint64_t chunkEnd = (pos / chunkSize_ + 1) * chunkSize_;
+    if (pos + 4 > chunkEnd) {
+      // sizes never cross a chunk boundary
+      pos = chunkEnd;
+      continue;
+    }
+    if (pos + 4 > mapping.size) {
+      return false;
+    }
+
+    uint32_t eventSize;
+    memcpy(&eventSize, mapping.data + pos, 4);
+    if (eventSize == 0) {
+      // 0 length event indicates padding
+      pos += 4;
+      continue;
+    }
+    if ((maxEventSize_ > 0 && eventSize > maxEventSize_) || pos + 4 + eventSize > chunkEnd) {
+      T_ERROR("TMappedFileTransport: corrupted event of size %u at offset %llu, skipping chunk",
+              eventSize,
+              static_cast<unsigned long long>(pos));
+      pos = chunkEnd;
+      continue;
+    }
+    if (pos + 4 + eventSize > mapping.size) {
+      return false;
+    }
+    size = eventSize;
+    return true;
+  }
+}
+
+/**
+ * Moves to the next event.  At the end of the file, waits for more as the
+ * read timeout says if wait is set.
+ */
+bool TMappedFileTransport::nextEvent(bool wait) {
+  bool waited = false;
+  while (true) {
+    uint64_t pos = pos_;
+    uint32_t size;
+    bool found = scanEvent(*mapping_, pos, size);
+    if (pos >= end_) {
+      pos_ = eventEnd_ = end_;
+      return false;
+    }
+    if (found) {
+      pos_ = pos + 4;
+      eventEnd_ = pos_ + size;
+      return true;
+    }
+
+    // what was skipped is padding either way
+    pos_ = eventEnd_ = pos;
+    if (!wait || isSlice_ || readTimeout_ == TFileTransport::NO_TAIL_READ_TIMEOUT) {
+      return false;
+    }
+    if (readTimeout_ == TFileTransport::TAIL_READ_TIMEOUT) {
+      if (!remap()) {
+        THRIFT_SLEEP_USEC(eofSleepTime_);
+      }
+    } else if (readTimeout_ > 0) {
+      if (remap()) {
+        continue;
+      }
+      if (waited) {
+        return false;
+      }
+      THRIFT_SLEEP_USEC(readTimeout_ * 1000);
+      waited = true;
+      remap();
+    } else {
+      return false;
+    }
+  }
+}
+
+bool TMappedFileTransport::peek() {
+  return pos_ < eventEnd_ || nextEvent(true);
+}
+
+uint32_t TMappedFileTransport::read(uint8_t* buf, uint32_t len) {
+  if (pos_ == eventEnd_ && !nextEvent(true)) {
+    return 0;
+  }
+  auto n = static_cast<uint32_t>((std::min)(static_cast<uint64_t>(len), eventEnd_ - pos_));
+  memcpy(buf, mapping_->data + pos_, n);
+  pos_ += n;
+  return n;
+}
+
+uint32_t TMappedFileTransport::readAll(uint8_t* buf, uint32_t len) {
+  uint32_t have = 0;
+  while (have < len) {
+    uint32_t get = read(buf + have, len - have);
+    if (get == 0) {
+      throw TEOFException();
+    }
+    have += get;
+  }
+  return have;
+}
+
+const uint8_t* TMappedFileTransport::borrow(uint8_t* buf, uint32_t* len) {
+  (void)buf;
+  if (pos_ == eventEnd_ && !nextEvent(true)) {
+    return nullptr;
+  }
+  uint64_t available = eventEnd_ - pos_;
+  if (available < *len) {
+    return nullptr;
+  }
+  *len = static_cast<uint32_t>((std::min)(available,
+                                          static_cast<uint64_t>(
+                                              (std::numeric_limits<uint32_t>::max)())));
+  return mapping_->data + pos_;
+}
+
+void TMappedFileTransport::consume(uint32_t len) {
+  if (len > eventEnd_ - pos_) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "TMappedFileTransport: consume did not follow a borrow");
+  }
+  pos_ += len;
+}
+
+uint32_t TMappedFileTransport::getNumChunks() {
+  if (!isSlice_) {
+    remap();
+  }
+  if (mapping_->size == 0) {
+    // empty file has no chunks
+    return 0;
+  }
+  uint64_t numChunks = mapping_->size / chunkSize_ + 1;
+  if (numChunks > (std::numeric_limits<uint32_t>::max)()) {
+    throw TTransportException("Too many chunks");
+  }
+  return static_cast<uint32_t>(numChunks);
+}
+
+uint32_t TMappedFileTransport::getCurChunk() {
+  return static_cast<uint32_t>(pos_ / chunkSize_);
+}
+
+void TMappedFileTransport::seekToChunk(int32_t chunk) {
+  auto numChunks = static_cast<int32_t>(getNumChunks());
+
+  // file is empty, seeking to chunk is pointless
+  if (numChunks == 0) {
+    return;
+  }
+
+  // negative indicates reverse seek (from the end)
+  if (chunk < 0) {
+    chunk += numChunks;
+  }
+
+  // too large a value for reverse seek, just seek to beginning
+  if (chunk < 0) {
+    chunk = 0;
+  }
+
+  // cannot seek past EOF
+  if (chunk >= numChunks) {
+    seekToEnd();
+    return;
+  }
+  pos_ = eventEnd_ = static_cast<uint64_t>(chunk) * chunkSize_;
+}
+
+void TMappedFileTransport::seekToEnd() {
+  uint32_t numChunks = getNumChunks();
+  if (numChunks == 0) {
+    pos_ = eventEnd_ = 0;
+    return;
+  }
+
+  // just past the last complete event
+  uint64_t pos = static_cast<uint64_t>(numChunks - 1) * chunkSize_;
+  uint32_t size;
+  while (scanEvent(*mapping_, pos, size)) {
+    pos += 4 + size;
+  }
+  pos_ = eventEnd_ = pos;
+}
+
+uint64_t TMappedFileTransport::getSize() const {
+  return mapping_->size;
+}
+
+uint64_t TMappedFileTransport::findEvent(uint64_t offset) const {
+  const Mapping& mapping = *mapping_;
+  uint64_t pos = offset / chunkSize_ * chunkSize_;
+  uint32_t size;
+  while (scanEvent(mapping, pos, size)) {
+    if (pos >= offset) {
+      return pos;
+    }
+    pos += 4 + size;
+  }
+  return mapping.size;
+}
+
+std::shared_ptr<TMappedFileTransport> TMappedFileTransport::slice(uint64_t begin,
+                                                                  uint64_t end) const {
+  return std::shared_ptr<TMappedFileTransport>(new TMappedFileTransport(*this, begin, end));
+}
+}
+}
+} // apache::thrift::transport
@@ -0,0 +1,149 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TRANSPORT_TMAPPEDFILETRANSPORT_H_
+#define _THRIFT_TRANSPORT_TMAPPEDFILETRANSPORT_H_ 1
+
+#include <thrift/transport/TFileTransport.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+/**
+ * Reads a log written by TFileTransport through a read only memory mapping
+ * of the file, rather than through a read buffer.  Events are returned in
+ * place by borrow(), and seeking to a chunk costs nothing since chunks
+ * start at fixed offsets.  The chunk size must match the one the log was
+ * written with.
+ *
+ * A reader can be cut into slices that share the mapping and read disjoint
+ * runs of events, which is how TFileProcessor::processParallel() replays a
+ * log on several threads.
+ *
+ * A corrupted event is reported, and reading goes on from the next chunk.
+ * When tailing (see setReadTimeout()), the file is mapped again as it
+ * grows.  Not available on Windows.
+ */
+class TMappedFileTransport : public TFileReaderTransport {
+public:
+  /**
+   * Maps the file at path.
+   *
+   * @throws TTransportException if the file cannot be opened or mapped
+   */
+  TMappedFileTransport(const std::string& path, std::shared_ptr<TConfiguration> config = nullptr);
+  ~TMappedFileTransport() override;
+
+  bool isOpen() const override { return true; }
+  bool peek() override;
+
+  uint32_t read(uint8_t* buf, uint32_t len);
+  uint32_t readAll(uint8_t* buf, uint32_t len);
+
+  /**
+   * Returns a pointer to the rest of the current event in the mapping, if
+   * that has at least *len bytes.
+   */
+  const uint8_t* borrow(uint8_t* buf, uint32_t* len);
+  void consume(uint32_t len);
+
+  int32_t getReadTimeout() override { return readTimeout_; }
+  void setReadTimeout(int32_t readTimeout) override { readTimeout_ = readTimeout; }
+
+  uint32_t getNumChunks() override;
+  uint32_t getCurChunk() override;
+  void seekToChunk(int32_t chunk) override;
+  void seekToEnd() override;
+
+  void setChunkSize(uint32_t chunkSize) {
+    if (chunkSize) {
+      chunkSize_ = chunkSize;
+    }
+  }
+  uint32_t getChunkSize() { return chunkSize_; }
+
+  /// Events bigger than this are taken as corrupted (0 for no limit)
+  void setMaxEventSize(uint32_t maxEventSize) { maxEventSize_ = maxEventSize; }
+  uint32_t getMaxEventSize() { return maxEventSize_; }
+
+  void setEofSleepTimeUs(uint32_t eofSleepTime) {
+    if (eofSleepTime) {
+      eofSleepTime_ = eofSleepTime;
+    }
+  }
+  uint32_t getEofSleepTimeUs() { return eofSleepTime_; }
+
+  /// Size of the mapped file
+  uint64_t getSize() const;
+
+  /**
+   * Returns the offset of the first event starting at or after offset, or
+   * the end of the file if there is none.
+   */
+  uint64_t findEvent(uint64_t offset) const;
+
+  /**
+   * Returns a reader of the events starting in [begin, end), which should
+   * both be event offsets (see findEvent()) or chunk boundaries.  Slices
+   * never tail the file, and seek within it as a whole.
+   */
+  std::shared_ptr<TMappedFileTransport> slice(uint64_t begin, uint64_t end) const;
+
+  uint32_t read_virt(uint8_t* buf, uint32_t len) override { return this->read(buf, len); }
+  uint32_t readAll_virt(uint8_t* buf, uint32_t len) override { return this->readAll(buf, len); }
+  const uint8_t* borrow_virt(uint8_t* buf, uint32_t* len) override { return this->borrow(buf, len); }
+  void consume_virt(uint32_t len) override { this->consume(len); }
+
+private:
+  struct Mapping;
+
+  TMappedFileTransport(const TMappedFileTransport& file, uint64_t begin, uint64_t end);
+
+  bool scanEvent(const Mapping& mapping, uint64_t& pos, uint32_t& size) const;
+  bool nextEvent(bool wait);
+  bool remap();
+
+  int fd_;
+  std::shared_ptr<Mapping> mapping_;
+
+  // the next byte to read, the end of the event it is in (equal to pos_
+  // between events), and where the events of this reader end
+  uint64_t pos_;
+  uint64_t eventEnd_;
+  uint64_t end_;
+  bool isSlice_;
+
+  int32_t readTimeout_;
+  uint32_t chunkSize_;
+  uint32_t maxEventSize_;
+  uint32_t eofSleepTime_;
+
+  static const uint32_t DEFAULT_CHUNK_SIZE = 16 * 1024 * 1024;
+  static const uint32_t DEFAULT_EOF_SLEEP_TIME_US = 500 * 1000;
+};
+}
+}
+} // apache::thrift::transport
+
+#endif // _THRIFT_TRANSPORT_TMAPPEDFILETRANSPORT_H_
@@ -101,6 +101,7 @@ TNonblockingServerSocket::TNonblockingServerSocket(int port)
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
     keepAlive_(false),
+    reusePort_(false),
     listening_(false) {
 }
 
@@ -116,6 +117,7 @@ TNonblockingServerSocket::TNonblockingServerSocket(int port, int sendTimeout, in
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
     keepAlive_(false),
+    reusePort_(false),
     listening_(false) {
 }
 
@@ -132,6 +134,7 @@ TNonblockingServerSocket::TNonblockingServerSocket(const string& address, int po
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
     keepAlive_(false),
+    reusePort_(false),
     listening_(false) {
 }
 
@@ -148,6 +151,7 @@ TNonblockingServerSocket::TNonblockingServerSocket(const string& path)
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
     keepAlive_(false),
+    reusePort_(false),
     listening_(false) {
 }
 
@@ -235,6 +239,23 @@ void TNonblockingServerSocket::_setup_sockopts() {
                                 "Could not set THRIFT_NO_SOCKET_CACHING",
                                 errno_copy);
     }
+
+    if (reusePort_) {
+#ifdef SO_REUSEPORT
+      if (-1 == setsockopt(serverSocket_, SOL_SOCKET, SO_REUSEPORT, cast_sockopt(&one), sizeof(one))) {
+        int errno_copy = THRIFT_GET_SOCKET_ERROR;
+        TOutput::instance().perror("TNonblockingServerSocket::listen() setsockopt() SO_REUSEPORT ", errno_copy);
+        close();
+        throw TTransportException(TTransportException::NOT_OPEN,
+                                  "Could not set SO_REUSEPORT",
+                                  errno_copy);
+      }
+#else
+      close();
+      throw TTransportException(TTransportException::NOT_OPEN,
+                                "SO_REUSEPORT is not supported on this platform");
+#endif
+    }
   }
 
   // Set TCP buffer sizes
@@ -611,6 +632,34 @@ shared_ptr<TSocket> TNonblockingServerSocket::createSocket(THRIFT_SOCKET clientS
   return std::make_shared<TSocket>(clientSocket);
 }
 
+shared_ptr<TNonblockingServerSocket> TNonblockingServerSocket::createListener(const string& address,
+                                                                             int port) {
+  return std::make_shared<TNonblockingServerSocket>(address, port);
+}
+
+shared_ptr<TNonblockingServerTransport> TNonblockingServerSocket::createReusePortListener() {
+  if (!reusePort_ || !listening_ || isUnixDomainSocket()) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "TNonblockingServerSocket::createReusePortListener() needs a TCP "
+                              "socket listening with SO_REUSEPORT");
+  }
+
+  // listenPort_ holds the bound port by now, even if we were asked for port 0
+  shared_ptr<TNonblockingServerSocket> listener = createListener(address_, listenPort_);
+  listener->acceptBacklog_ = acceptBacklog_;
+  listener->sendTimeout_ = sendTimeout_;
+  listener->recvTimeout_ = recvTimeout_;
+  listener->retryLimit_ = retryLimit_;
+  listener->retryDelay_ = retryDelay_;
+  listener->tcpSendBuffer_ = tcpSendBuffer_;
+  listener->tcpRecvBuffer_ = tcpRecvBuffer_;
+  listener->keepAlive_ = keepAlive_;
+  listener->reusePort_ = true;
+  listener->listenCallback_ = listenCallback_;
+  listener->acceptCallback_ = acceptCallback_;
+  return listener;
+}
+
 void TNonblockingServerSocket::close() {
   if (serverSocket_ != THRIFT_INVALID_SOCKET) {
     shutdown(serverSocket_, THRIFT_SHUT_RDWR);
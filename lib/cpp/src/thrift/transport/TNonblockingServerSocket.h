@@ -88,6 +88,11 @@ public:
   void setTcpSendBuffer(int tcpSendBuffer);
   void setTcpRecvBuffer(int tcpRecvBuffer);
 
+  // When enabled, the listening socket is bound with SO_REUSEPORT so that
+  // createReusePortListener() can open more listeners on the same port.
+  // Must be called before listen().
+  void setReusePort(bool reusePort) { reusePort_ = reusePort; }
+
   // listenCallback gets called just before listen, and after all Thrift
   // setsockopt calls have been made.  If you have custom setsockopt
   // things that need to happen on the listening socket, this is the place to do it.
@@ -112,9 +117,13 @@ public:
   void listen() override;
   void close() override;
 
+  std::shared_ptr<TNonblockingServerTransport> createReusePortListener() override;
+
 protected:
   std::shared_ptr<TSocket> acceptImpl() override;
   virtual std::shared_ptr<TSocket> createSocket(THRIFT_SOCKET client);
+  virtual std::shared_ptr<TNonblockingServerSocket> createListener(const std::string& address,
+                                                                   int port);
 
 private:
   void _setup_sockopts();
@@ -134,6 +143,7 @@ private:
   int tcpSendBuffer_;
   int tcpRecvBuffer_;
   bool keepAlive_;
+  bool reusePort_;
   bool listening_;
 
   socket_func_t listenCallback_;
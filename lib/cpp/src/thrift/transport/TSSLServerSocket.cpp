@@ -56,6 +56,11 @@ std::shared_ptr<TSocket> TSSLServerSocket::createSocket(THRIFT_SOCKET client) {
       return factory_->createSocket(client);
   }
 }
+
+std::shared_ptr<TServerSocket> TSSLServerSocket::createListener(const std::string& address,
+                                                                int port) {
+  return std::make_shared<TSSLServerSocket>(address, port, factory_);
+}
 }
 }
 }
@@ -284,6 +284,8 @@ void TSSLSocket::init() {
   handshakeCompleted_ = false;
   readRetryCount_ = 0;
   eventSafe_ = false;
+  ktlsSend_ = false;
+  ktlsReceive_ = false;
 }
 
 bool TSSLSocket::isOpen() const {
@@ -398,6 +400,8 @@ void TSSLSocket::close() {
     SSL_free(ssl_);
     ssl_ = nullptr;
     handshakeCompleted_ = false;
+    ktlsSend_ = false;
+    ktlsReceive_ = false;
 #if OPENSSL_VERSION_NUMBER >= 0x10100000
     // Do nothing unless an openssl derivative is detected
 #  if !defined(OPENSSL_IS_BORINGSSL) && !defined(OPENSSL_IS_AWSLC)
@@ -583,6 +587,23 @@ uint32_t TSSLSocket::write_partial(const uint8_t* buf, uint32_t len) {
   return written;
 }
 
+void TSSLSocket::writev(const TIOVec* iov, uint32_t iovcnt) {
+  if (kernelTLSSend() && !isLibeventSafe()) {
+    // The kernel frames and encrypts whatever is sent on the socket, and
+    // OpenSSL holds nothing back once SSL_write() has returned, so the
+    // buffers can go out together in one sendmsg() and as few records.
+    TSocket::writev(iov, iovcnt);
+    return;
+  }
+  // SSL_write() takes a single buffer and encrypts into OpenSSL's own
+  // record buffers, so there is nothing to gain from gathering here.
+  for (uint32_t i = 0; i < iovcnt; ++i) {
+    if (iov[i].len > 0) {
+      write(iov[i].base, iov[i].len);
+    }
+  }
+}
+
 void TSSLSocket::flush() {
   resetConsumedMessageSize();
   // Don't throw exception if not open. Thrift servers close socket twice.
@@ -707,6 +728,12 @@ void TSSLSocket::initializeHandshake() {
     throw TSSLException(fname + ": " + errors);
   }
   authorize();
+#ifdef SSL_OP_ENABLE_KTLS
+  // with SSL_OP_ENABLE_KTLS, OpenSSL has moved whichever directions the
+  // kernel and cipher allow into the kernel by the end of the handshake
+  ktlsSend_ = BIO_get_ktls_send(SSL_get_wbio(ssl_));
+  ktlsReceive_ = BIO_get_ktls_recv(SSL_get_rbio(ssl_));
+#endif
   handshakeCompleted_ = true;
 }
 
@@ -816,6 +843,36 @@ void TSSLSocket::authorize() {
   }
 }
 
+void TSSLSocket::sendWouldBlock() {
+  // Only room to write matters here; waitForEvent() also wakes up for
+  // incoming data, which would spin the caller.
+  struct THRIFT_POLLFD fds[2];
+  memset(fds, 0, sizeof(fds));
+  fds[0].fd = socket_;
+  fds[0].events = THRIFT_POLLOUT;
+
+  if (interruptListener_) {
+    fds[1].fd = *(interruptListener_.get());
+    fds[1].events = THRIFT_POLLIN;
+  }
+
+  int ret = THRIFT_POLL(fds, interruptListener_ ? 2 : 1, sendTimeout_ ? sendTimeout_ : -1);
+
+  if (ret < 0) {
+    if (THRIFT_GET_SOCKET_ERROR == THRIFT_EINTR) {
+      return; // the caller retries the send
+    }
+    int errno_copy = THRIFT_GET_SOCKET_ERROR;
+    TOutput::instance().perror("TSSLSocket::sendWouldBlock THRIFT_POLL() ", errno_copy);
+    throw TTransportException(TTransportException::UNKNOWN, "Unknown", errno_copy);
+  } else if (ret == 0) {
+    throw TTransportException(TTransportException::TIMED_OUT, "THRIFT_POLL (timed out)");
+  }
+  if (fds[1].revents & THRIFT_POLLIN) {
+    throw TTransportException(TTransportException::INTERRUPTED, "Interrupted");
+  }
+}
+
 /*
  * Note: This method is not libevent safe.
 */
@@ -975,6 +1032,19 @@ void TSSLSocketFactory::authenticate(bool required) {
   SSL_CTX_set_verify(ctx_->get(), mode, nullptr);
 }
 
+void TSSLSocketFactory::kernelTLS(bool enable) {
+#ifdef SSL_OP_ENABLE_KTLS
+  if (enable) {
+    SSL_CTX_set_options(ctx_->get(), SSL_OP_ENABLE_KTLS);
+  } else {
+    SSL_CTX_clear_options(ctx_->get(), SSL_OP_ENABLE_KTLS);
+  }
+#else
+  // OpenSSL before 3.0 has no kTLS support; sockets use its record layer
+  (void)enable;
+#endif
+}
+
 void TSSLSocketFactory::loadCertificate(const char* path, const char* format) {
   if (path == nullptr || format == nullptr) {
     throw TTransportException(TTransportException::BAD_ARGS,
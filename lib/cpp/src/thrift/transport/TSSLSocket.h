@@ -81,6 +81,7 @@ public:
   uint32_t read(uint8_t* buf, uint32_t len) override;
   void write(const uint8_t* buf, uint32_t len) override;
   uint32_t write_partial(const uint8_t* buf, uint32_t len) override;
+  void writev(const TIOVec* iov, uint32_t iovcnt) override;
   void flush() override;
   /**
   * Set whether to use client or server side SSL handshake protocol.
@@ -106,6 +107,15 @@ public:
    * Determines whether SSL Socket is libevent safe or not.
    */
   bool isLibeventSafe() const { return eventSafe_; }
+  /**
+   * Whether the kernel encrypts what this socket sends (kTLS).  Known once
+   * the handshake completes; see TSSLSocketFactory::kernelTLS().
+   */
+  bool kernelTLSSend() const { return ktlsSend_; }
+  /**
+   * Whether the kernel decrypts what this socket receives (kTLS).
+   */
+  bool kernelTLSReceive() const { return ktlsReceive_; }
 
 protected:
   /**
@@ -170,6 +180,13 @@ protected:
    *         TSSL_DATA  if data is available on the socket.
    */
   unsigned int waitForEvent(bool wantRead);
+  /**
+   * Waits for room in the send buffer of the non-blocking socket.
+   *
+   * @throw TTransportException::TIMED_OUT if the send timeout expires.
+   * @throw TTransportException::INTERRUPTED if interrupted is signaled.
+   */
+  void sendWouldBlock() override;
 
   bool server_;
   SSL* ssl_;
@@ -181,6 +198,8 @@ private:
   bool handshakeCompleted_;
   int readRetryCount_;
   bool eventSafe_;
+  bool ktlsSend_;
+  bool ktlsReceive_;
 
   void init();
 };
@@ -257,6 +276,19 @@ public:
    * @param required Require peer to present valid certificate if true
    */
   virtual void authenticate(bool required);
+  /**
+   * Hand the record layer to the kernel (kTLS) once the handshake is done,
+   * so sockets send and receive through plain socket calls while the kernel
+   * does the crypto.  This needs OpenSSL 3.0 or later built with kTLS, a
+   * kernel with the "tls" module and a cipher it supports (AES-GCM, or
+   * ChaCha20-Poly1305 on newer kernels); sockets where any of those is
+   * missing keep using OpenSSL's own record layer.
+   * TSSLSocket::kernelTLSSend() and kernelTLSReceive() tell which they got.
+   * Off by default.
+   *
+   * @param enable  Use kTLS where available if true
+   */
+  virtual void kernelTLS(bool enable);
   /**
    * Load server certificate.
    *
@@ -115,6 +115,7 @@ TServerSocket::TServerSocket(int port)
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
     keepAlive_(false),
+    reusePort_(false),
     listening_(false),
     interruptSockWriter_(THRIFT_INVALID_SOCKET),
     interruptSockReader_(THRIFT_INVALID_SOCKET),
@@ -135,6 +136,7 @@ TServerSocket::TServerSocket(int port, int sendTimeout, int recvTimeout)
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
     keepAlive_(false),
+    reusePort_(false),
     listening_(false),
     interruptSockWriter_(THRIFT_INVALID_SOCKET),
     interruptSockReader_(THRIFT_INVALID_SOCKET),
@@ -156,6 +158,7 @@ TServerSocket::TServerSocket(const string& address, int port)
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
     keepAlive_(false),
+    reusePort_(false),
     listening_(false),
     interruptSockWriter_(THRIFT_INVALID_SOCKET),
     interruptSockReader_(THRIFT_INVALID_SOCKET),
@@ -177,6 +180,7 @@ TServerSocket::TServerSocket(const string& path)
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
     keepAlive_(false),
+    reusePort_(false),
     listening_(false),
     interruptSockWriter_(THRIFT_INVALID_SOCKET),
     interruptSockReader_(THRIFT_INVALID_SOCKET),
@@ -197,6 +201,7 @@ TServerSocket::TServerSocket(THRIFT_SOCKET sock,SocketType socketType)
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
     keepAlive_(false),
+    reusePort_(false),
     listening_(false),
     interruptSockWriter_(THRIFT_INVALID_SOCKET),
     interruptSockReader_(THRIFT_INVALID_SOCKET),
@@ -299,6 +304,23 @@ void TServerSocket::_setup_sockopts() {
                                 "Could not set THRIFT_NO_SOCKET_CACHING",
                                 errno_copy);
     }
+
+    if (reusePort_) {
+#ifdef SO_REUSEPORT
+      if (-1 == setsockopt(serverSocket_, SOL_SOCKET, SO_REUSEPORT, cast_sockopt(&one), sizeof(one))) {
+        int errno_copy = THRIFT_GET_SOCKET_ERROR;
+        TOutput::instance().perror("TServerSocket::listen() setsockopt() SO_REUSEPORT ", errno_copy);
+        close();
+        throw TTransportException(TTransportException::NOT_OPEN,
+                                  "Could not set SO_REUSEPORT",
+                                  errno_copy);
+      }
+#else
+      close();
+      throw TTransportException(TTransportException::NOT_OPEN,
+                                "SO_REUSEPORT is not supported on this platform");
+#endif
+    }
   }
 
   // Set TCP buffer sizes
@@ -741,6 +763,35 @@ shared_ptr<TSocket> TServerSocket::createSocket(THRIFT_SOCKET clientSocket) {
   }
 }
 
+shared_ptr<TServerSocket> TServerSocket::createListener(const string& address, int port) {
+  return std::make_shared<TServerSocket>(address, port);
+}
+
+shared_ptr<TServerTransport> TServerSocket::createReusePortListener() {
+  if (!reusePort_ || !listening_ || isUnixDomainSocket() || boundSocketType_ != SocketType::NONE) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "TServerSocket::createReusePortListener() needs a TCP socket "
+                              "listening with SO_REUSEPORT");
+  }
+
+  // port_ holds the bound port by now, even if we were asked for port 0
+  shared_ptr<TServerSocket> listener = createListener(address_, port_);
+  listener->acceptBacklog_ = acceptBacklog_;
+  listener->sendTimeout_ = sendTimeout_;
+  listener->recvTimeout_ = recvTimeout_;
+  listener->accTimeout_ = accTimeout_;
+  listener->retryLimit_ = retryLimit_;
+  listener->retryDelay_ = retryDelay_;
+  listener->tcpSendBuffer_ = tcpSendBuffer_;
+  listener->tcpRecvBuffer_ = tcpRecvBuffer_;
+  listener->keepAlive_ = keepAlive_;
+  listener->reusePort_ = true;
+  listener->interruptableChildren_ = interruptableChildren_;
+  listener->listenCallback_ = listenCallback_;
+  listener->acceptCallback_ = acceptCallback_;
+  return listener;
+}
+
 void TServerSocket::notify(THRIFT_SOCKET notifySocket) {
   if (notifySocket != THRIFT_INVALID_SOCKET) {
     int8_t byte = 0;
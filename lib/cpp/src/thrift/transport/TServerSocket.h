@@ -116,6 +116,11 @@ public:
   void setTcpSendBuffer(int tcpSendBuffer);
   void setTcpRecvBuffer(int tcpRecvBuffer);
 
+  // When enabled, the listening socket is bound with SO_REUSEPORT so that
+  // createReusePortListener() can open more listeners on the same port.
+  // Must be called before listen().
+  void setReusePort(bool reusePort) { reusePort_ = reusePort; }
+
   // listenCallback gets called just before listen, and after all Thrift
   // setsockopt calls have been made.  If you have custom setsockopt
   // things that need to happen on the listening socket, this is the place to do it.
@@ -153,9 +158,12 @@ public:
   void interruptChildren() override;
   void close() override;
 
+  std::shared_ptr<TServerTransport> createReusePortListener() override;
+
 protected:
   std::shared_ptr<TTransport> acceptImpl() override;
   virtual std::shared_ptr<TSocket> createSocket(THRIFT_SOCKET client);
+  virtual std::shared_ptr<TServerSocket> createListener(const std::string& address, int port);
   bool interruptableChildren_;
   std::shared_ptr<THRIFT_SOCKET> pChildInterruptSockReader_; // if interruptableChildren_ this is shared with child TSockets
 
@@ -178,6 +186,7 @@ private:
   int tcpSendBuffer_;
   int tcpRecvBuffer_;
   bool keepAlive_;
+  bool reusePort_;
   bool listening_;
 
   concurrency::Mutex rwMutex_;                                 // thread-safe interrupt
@@ -95,6 +95,20 @@ public:
 
   virtual THRIFT_SOCKET getSocketFD() { return -1; }
 
+  /**
+   * Creates another listener for the address this transport listens on, so
+   * that several threads can each accept() on a listener of their own and
+   * let the kernel balance incoming connections between them (SO_REUSEPORT).
+   * This transport must already be listening; the new one is not.
+   *
+   * @return A new listener sharing this transport's address
+   * @throws TTransportException if the transport cannot share its address
+   */
+  virtual std::shared_ptr<TServerTransport> createReusePortListener() {
+    throw TTransportException(TTransportException::NOT_OPEN,
+                              "This server transport cannot share its address.");
+  }
+
   /**
    * Closes this transport such that future calls to accept will do nothing.
    */
@@ -49,6 +49,11 @@
 #endif
 #include <fcntl.h>
 
+#if defined(__linux__) && defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+#include <linux/errqueue.h>
+#define THRIFT_HAVE_MSG_ZEROCOPY 1
+#endif
+
 #include <thrift/concurrency/Monitor.h>
 #include <thrift/transport/TSocket.h>
 #include <thrift/transport/TTransportException.h>
@@ -77,6 +82,9 @@ inline SOCKOPT_CAST_T* cast_sockopt(T* v) {
   return reinterpret_cast<SOCKOPT_CAST_T*>(v);
 }
 
+// The largest number of buffers handed to a single sendmsg() call
+static const uint32_t MAX_WRITEV_BUFFERS = 64;
+
 using std::string;
 
 namespace apache {
@@ -101,7 +109,11 @@ TSocket::TSocket(const string& host, int port, std::shared_ptr<TConfiguration> c
     lingerOn_(1),
     lingerVal_(0),
     noDelay_(1),
-    maxRecvRetries_(5) {
+    maxRecvRetries_(5),
+    zeroCopyThreshold_(0),
+    zeroCopyState_(0),
+    zeroCopySent_(0),
+    zeroCopyCompleted_(0) {
 }
 
 TSocket::TSocket(const string& path, std::shared_ptr<TConfiguration> config)
@@ -117,7 +129,11 @@ TSocket::TSocket(const string& path, std::shared_ptr<TConfiguration> config)
     lingerOn_(1),
     lingerVal_(0),
     noDelay_(1),
-    maxRecvRetries_(5) {
+    maxRecvRetries_(5),
+    zeroCopyThreshold_(0),
+    zeroCopyState_(0),
+    zeroCopySent_(0),
+    zeroCopyCompleted_(0) {
   cachedPeerAddr_.ipv4.sin_family = AF_UNSPEC;
 }
 
@@ -133,7 +149,11 @@ TSocket::TSocket(std::shared_ptr<TConfiguration> config)
     lingerOn_(1),
     lingerVal_(0),
     noDelay_(1),
-    maxRecvRetries_(5) {
+    maxRecvRetries_(5),
+    zeroCopyThreshold_(0),
+    zeroCopyState_(0),
+    zeroCopySent_(0),
+    zeroCopyCompleted_(0) {
   cachedPeerAddr_.ipv4.sin_family = AF_UNSPEC;
 }
 
@@ -149,7 +169,11 @@ TSocket::TSocket(THRIFT_SOCKET socket, std::shared_ptr<TConfiguration> config)
     lingerOn_(1),
     lingerVal_(0),
     noDelay_(1),
-    maxRecvRetries_(5) {
+    maxRecvRetries_(5),
+    zeroCopyThreshold_(0),
+    zeroCopyState_(0),
+    zeroCopySent_(0),
+    zeroCopyCompleted_(0) {
   cachedPeerAddr_.ipv4.sin_family = AF_UNSPEC;
 #ifdef SO_NOSIGPIPE
   {
@@ -173,7 +197,11 @@ TSocket::TSocket(THRIFT_SOCKET socket, std::shared_ptr<THRIFT_SOCKET> interruptL
     lingerOn_(1),
     lingerVal_(0),
     noDelay_(1),
-    maxRecvRetries_(5) {
+    maxRecvRetries_(5),
+    zeroCopyThreshold_(0),
+    zeroCopyState_(0),
+    zeroCopySent_(0),
+    zeroCopyCompleted_(0) {
   cachedPeerAddr_.ipv4.sin_family = AF_UNSPEC;
 #ifdef SO_NOSIGPIPE
   {
@@ -510,6 +538,8 @@ void TSocket::close() {
     ::THRIFT_CLOSESOCKET(socket_);
   }
   socket_ = THRIFT_INVALID_SOCKET;
+  zeroCopyState_ = 0;
+  zeroCopySent_ = zeroCopyCompleted_ = 0;
 }
 
 void TSocket::setSocketFD(THRIFT_SOCKET socket) {
@@ -517,6 +547,8 @@ void TSocket::setSocketFD(THRIFT_SOCKET socket) {
     close();
   }
   socket_ = socket;
+  zeroCopyState_ = 0;
+  zeroCopySent_ = zeroCopyCompleted_ = 0;
 }
 
 uint32_t TSocket::read(uint8_t* buf, uint32_t len) {
@@ -649,14 +681,19 @@ void TSocket::write(const uint8_t* buf, uint32_t len) {
   while (sent < len) {
     uint32_t b = write_partial(buf + sent, len - sent);
     if (b == 0) {
-      // This should only happen if the timeout set with SO_SNDTIMEO expired.
-      // Raise an exception.
-      throw TTransportException(TTransportException::TIMED_OUT, "send timeout expired");
+      sendWouldBlock();
+      continue;
     }
     sent += b;
   }
 }
 
+void TSocket::sendWouldBlock() {
+  // This should only happen if the timeout set with SO_SNDTIMEO expired.
+  // Raise an exception.
+  throw TTransportException(TTransportException::TIMED_OUT, "send timeout expired");
+}
+
 uint32_t TSocket::write_partial(const uint8_t* buf, uint32_t len) {
   if (socket_ == THRIFT_INVALID_SOCKET) {
     throw TTransportException(TTransportException::NOT_OPEN, "Called write on non-open socket");
@@ -696,6 +733,207 @@ uint32_t TSocket::write_partial(const uint8_t* buf, uint32_t len) {
   return b;
 }
 
+void TSocket::writev(const TIOVec* iov, uint32_t iovcnt) {
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < iovcnt; ++i) {
+    total += iov[i].len;
+  }
+  bool zeroCopy = zeroCopyThreshold_ > 0 && total >= zeroCopyThreshold_ && enableZeroCopy();
+
+  uint32_t idx = 0;
+  uint32_t offset = 0;
+  while (idx < iovcnt) {
+    if (offset == iov[idx].len) {
+      ++idx;
+      offset = 0;
+      continue;
+    }
+
+    TIOVec window[MAX_WRITEV_BUFFERS];
+    uint32_t count = 0;
+    window[count].base = iov[idx].base + offset;
+    window[count].len = iov[idx].len - offset;
+    ++count;
+    for (uint32_t i = idx + 1; i < iovcnt && count < MAX_WRITEV_BUFFERS; ++i) {
+      if (iov[i].len > 0) {
+        window[count++] = iov[i];
+      }
+    }
+
+    // zero copy may have been turned off by an earlier chunk
+    uint32_t b = sendv(window, count, zeroCopy && zeroCopyState_ > 0);
+    if (b == 0) {
+      sendWouldBlock();
+      continue;
+    }
+
+    // advance past what was sent
+    while (b > 0) {
+      uint32_t left = iov[idx].len - offset;
+      if (b < left) {
+        offset += b;
+        break;
+      }
+      b -= left;
+      ++idx;
+      offset = 0;
+      while (idx < iovcnt && iov[idx].len == 0) {
+        ++idx;
+      }
+    }
+  }
+
+  if (zeroCopy) {
+    waitZeroCopy();
+  }
+}
+
+uint32_t TSocket::sendv(const TIOVec* iov, uint32_t iovcnt, bool zeroCopy) {
+#ifdef _WIN32
+  // no sendmsg(); send the buffers one at a time
+  (void)zeroCopy;
+  (void)iovcnt;
+  return write_partial(iov[0].base, iov[0].len);
+#else
+  if (socket_ == THRIFT_INVALID_SOCKET) {
+    throw TTransportException(TTransportException::NOT_OPEN, "Called write on non-open socket");
+  }
+
+  struct iovec vec[MAX_WRITEV_BUFFERS];
+  for (uint32_t i = 0; i < iovcnt; ++i) {
+    vec[i].iov_base = const_cast<uint8_t*>(iov[i].base);
+    vec[i].iov_len = iov[i].len;
+  }
+  struct msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = vec;
+  msg.msg_iovlen = iovcnt;
+
+  int flags = 0;
+#ifdef MSG_NOSIGNAL
+  // Note the use of MSG_NOSIGNAL to suppress SIGPIPE errors, instead we
+  // check for the THRIFT_EPIPE return condition and close the socket in that case
+  flags |= MSG_NOSIGNAL;
+#endif // ifdef MSG_NOSIGNAL
+
+  ssize_t b;
+#ifdef THRIFT_HAVE_MSG_ZEROCOPY
+  if (zeroCopy) {
+    b = sendmsg(socket_, &msg, flags | MSG_ZEROCOPY);
+    if (b >= 0) {
+      ++zeroCopySent_;
+    } else if (THRIFT_GET_SOCKET_ERROR == ENOBUFS) {
+      // out of optmem for pinned pages; this chunk is copied instead
+      b = sendmsg(socket_, &msg, flags);
+    } else if (THRIFT_GET_SOCKET_ERROR == EOPNOTSUPP) {
+      // the socket took SO_ZEROCOPY but its protocol (e.g. kernel TLS) does
+      // not take MSG_ZEROCOPY; copy from now on
+      zeroCopyState_ = -1;
+      b = sendmsg(socket_, &msg, flags);
+    }
+  } else
+#else
+  (void)zeroCopy;
+#endif
+  {
+    b = sendmsg(socket_, &msg, flags);
+  }
+
+  if (b < 0) {
+    if (THRIFT_GET_SOCKET_ERROR == THRIFT_EWOULDBLOCK || THRIFT_GET_SOCKET_ERROR == THRIFT_EAGAIN) {
+      return 0;
+    }
+    // Fail on a send error
+    int errno_copy = THRIFT_GET_SOCKET_ERROR;
+    TOutput::instance().perror("TSocket::writev() sendmsg() " + getSocketInfo(), errno_copy);
+
+    if (errno_copy == THRIFT_EPIPE || errno_copy == THRIFT_ECONNRESET
+        || errno_copy == THRIFT_ENOTCONN) {
+      throw TTransportException(TTransportException::NOT_OPEN, "writev() sendmsg()", errno_copy);
+    }
+
+    throw TTransportException(TTransportException::UNKNOWN, "writev() sendmsg()", errno_copy);
+  }
+
+  // Fail on blocked send
+  if (b == 0) {
+    throw TTransportException(TTransportException::NOT_OPEN, "Socket sendmsg returned 0.");
+  }
+  return static_cast<uint32_t>(b);
+#endif // _WIN32
+}
+
+bool TSocket::enableZeroCopy() {
+#ifdef THRIFT_HAVE_MSG_ZEROCOPY
+  if (zeroCopyState_ == 0 && socket_ != THRIFT_INVALID_SOCKET) {
+    int one = 1;
+    if (setsockopt(socket_, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0) {
+      zeroCopyState_ = 1;
+    } else {
+      // e.g. UNIX domain sockets or kernels older than 4.14
+      zeroCopyState_ = -1;
+    }
+  }
+  return zeroCopyState_ > 0;
+#else
+  return false;
+#endif
+}
+
+void TSocket::waitZeroCopy() {
+#ifdef THRIFT_HAVE_MSG_ZEROCOPY
+  // The kernel reports the ids of finished MSG_ZEROCOPY sends, as inclusive
+  // ranges, on the socket error queue.  Until every send we issued has been
+  // reported the caller's buffers may still be read by the NIC.
+  while (zeroCopyCompleted_ != zeroCopySent_) {
+    uint8_t control[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (recvmsg(socket_, &msg, MSG_ERRQUEUE) < 0) {
+      int errno_copy = THRIFT_GET_SOCKET_ERROR;
+      if (errno_copy == THRIFT_EINTR) {
+        continue;
+      }
+      if (errno_copy != THRIFT_EAGAIN && errno_copy != THRIFT_EWOULDBLOCK) {
+        TOutput::instance().perror("TSocket::waitZeroCopy() recvmsg() " + getSocketInfo(),
+                                   errno_copy);
+        throw TTransportException(TTransportException::UNKNOWN, "waitZeroCopy()", errno_copy);
+      }
+
+      // nothing queued yet; error queue readiness is signalled as POLLERR
+      struct THRIFT_POLLFD fds[1];
+      std::memset(fds, 0, sizeof(fds));
+      fds[0].fd = socket_;
+      int ret = THRIFT_POLL(fds, 1, sendTimeout_ > 0 ? sendTimeout_ : -1);
+      if (ret == 0) {
+        throw TTransportException(TTransportException::TIMED_OUT,
+                                  "timed out waiting for zero copy send completion");
+      }
+      if (ret < 0 && THRIFT_GET_SOCKET_ERROR != THRIFT_EINTR) {
+        errno_copy = THRIFT_GET_SOCKET_ERROR;
+        throw TTransportException(TTransportException::UNKNOWN, "waitZeroCopy() poll()", errno_copy);
+      }
+      continue;
+    }
+
+    for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+      if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+            || (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+        continue;
+      }
+      auto* serr = reinterpret_cast<struct sock_extended_err*>(CMSG_DATA(cm));
+      if (serr->ee_origin == SO_EE_ORIGIN_ZEROCOPY && serr->ee_errno == 0) {
+        // ee_info..ee_data is the (inclusive) range of completed sends
+        zeroCopyCompleted_ = serr->ee_data + 1;
+      }
+    }
+  }
+#endif
+}
+
 std::string TSocket::getHost() const {
   return host_;
 }
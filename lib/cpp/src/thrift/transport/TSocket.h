@@ -136,6 +136,12 @@ public:
    */
   virtual uint32_t write_partial(const uint8_t* buf, uint32_t len);
 
+  /**
+   * Writes a list of buffers to the underlying socket, handing as many of
+   * them as possible to each sendmsg() call.  Loops until done or fail.
+   */
+  virtual void writev(const TIOVec* iov, uint32_t iovcnt);
+
   /**
    * Get the host that the socket is connected to
    *
@@ -228,6 +234,21 @@ public:
    */
   void setKeepAlive(bool keepAlive);
 
+  /**
+   * Send writev() payloads of at least this many bytes with MSG_ZEROCOPY, so
+   * the kernel pins the pages instead of copying them.  writev() waits for
+   * the kernel to release the pages before it returns, so callers may reuse
+   * their buffers as usual.  This only pays off for very large payloads
+   * (hundreds of KB and up) on Linux; elsewhere, or if the socket does not
+   * support it, the setting is ignored.  0 (the default) disables it.
+   */
+  void setZeroCopyThreshold(uint32_t threshold) { zeroCopyThreshold_ = threshold; }
+
+  /**
+   * Get the MSG_ZEROCOPY threshold (0 when disabled)
+   */
+  uint32_t getZeroCopyThreshold() const { return zeroCopyThreshold_; }
+
   /**
    * Get socket information formatted as a string <Host: x Port: x>
    */
@@ -306,6 +327,13 @@ protected:
   /** connect, called by open */
   void openConnection(struct addrinfo* res);
 
+  /**
+   * Called by write() and writev() when the socket takes no more data.  On
+   * a blocking socket that means the send timeout expired, so this throws
+   * TIMED_OUT; subclasses that make the socket non-blocking wait instead.
+   */
+  virtual void sendWouldBlock();
+
   /** Host to connect to */
   std::string host_;
 
@@ -357,6 +385,16 @@ protected:
   /** Recv EGAIN retries */
   int maxRecvRetries_;
 
+  /** Minimum writev() payload sent with MSG_ZEROCOPY, 0 if disabled */
+  uint32_t zeroCopyThreshold_;
+
+  /** SO_ZEROCOPY state: 0 = not tried yet, 1 = enabled, -1 = unsupported */
+  int zeroCopyState_;
+
+  /** # of MSG_ZEROCOPY sends issued and # whose completion was reaped */
+  uint32_t zeroCopySent_;
+  uint32_t zeroCopyCompleted_;
+
   /** Cached peer address */
   union {
     sockaddr_in ipv4;
@@ -369,6 +407,9 @@ protected:
 private:
   void unix_open();
   void local_open();
+  uint32_t sendv(const TIOVec* iov, uint32_t iovcnt, bool zeroCopy);
+  bool enableZeroCopy();
+  void waitZeroCopy();
 };
 }
 }
@@ -30,6 +30,14 @@ namespace apache {
 namespace thrift {
 namespace transport {
 
+/**
+ * One buffer of a scatter/gather write, see TTransport::writev().
+ */
+struct TIOVec {
+  const uint8_t* base;
+  uint32_t len;
+};
+
 /**
  * Helper template to hoist readAll implementation out of TTransport
  */
@@ -166,6 +174,46 @@ public:
     throw TTransportException(TTransportException::NOT_OPEN, "Base TTransport cannot write.");
   }
 
+  /**
+   * Writes the string in its entirety, like write(), but allows a transport
+   * that gathers writes into frames to keep a pointer to buf instead of
+   * copying it.  The caller must keep buf valid and unmodified until the
+   * next flush().  Protocols use this for the bodies of string and binary
+   * values only; the default implementation simply calls write().
+   *
+   * @param buf  The data to write out
+   * @param len  The number of bytes to write
+   * @throws TTransportException if an error occurs
+   */
+  void writeReference(const uint8_t* buf, uint32_t len) {
+    T_VIRTUAL_CALL();
+    writeReference_virt(buf, len);
+  }
+  virtual void writeReference_virt(const uint8_t* buf, uint32_t len) { write(buf, len); }
+
+  /**
+   * Writes a list of buffers in their entirety, in order.  This has the same
+   * semantics as calling write() once per buffer, which is what the default
+   * implementation does.  Transports that can hand several buffers to the
+   * operating system at once (e.g. TSocket with sendmsg()) override it so
+   * large payloads need not be copied into one contiguous buffer first.
+   *
+   * @param iov     The buffers to write out
+   * @param iovcnt  The number of buffers
+   * @throws TTransportException if an error occurs
+   */
+  void writev(const TIOVec* iov, uint32_t iovcnt) {
+    T_VIRTUAL_CALL();
+    writev_virt(iov, iovcnt);
+  }
+  virtual void writev_virt(const TIOVec* iov, uint32_t iovcnt) {
+    for (uint32_t i = 0; i < iovcnt; ++i) {
+      if (iov[i].len > 0) {
+        write(iov[i].base, iov[i].len);
+      }
+    }
+  }
+
   /**
    * Called when write is completed.
    * This can be over-ridden to perform a transport-specific action
@@ -51,6 +51,10 @@ public:
   uint32_t read(uint8_t* buf, uint32_t len) { return this->TTransport::read_virt(buf, len); }
   uint32_t readAll(uint8_t* buf, uint32_t len) { return this->TTransport::readAll_virt(buf, len); }
   void write(const uint8_t* buf, uint32_t len) { this->TTransport::write_virt(buf, len); }
+  void writeReference(const uint8_t* buf, uint32_t len) {
+    this->TTransport::writeReference_virt(buf, len);
+  }
+  void writev(const TIOVec* iov, uint32_t iovcnt) { this->TTransport::writev_virt(iov, iovcnt); }
   const uint8_t* borrow(uint8_t* buf, uint32_t* len) {
     return this->TTransport::borrow_virt(buf, len);
   }
@@ -96,6 +100,14 @@ public:
     static_cast<Transport_*>(this)->write(buf, len);
   }
 
+  void writeReference_virt(const uint8_t* buf, uint32_t len) override {
+    static_cast<Transport_*>(this)->writeReference(buf, len);
+  }
+
+  void writev_virt(const TIOVec* iov, uint32_t iovcnt) override {
+    static_cast<Transport_*>(this)->writev(iov, iovcnt);
+  }
+
   const uint8_t* borrow_virt(uint8_t* buf, uint32_t* len) override {
     return static_cast<Transport_*>(this)->borrow(buf, len);
   }
@@ -21,6 +21,7 @@
 #define _THRIFT_TEST_GENERICPROTOCOLTEST_TCC_ 1
 
 #include <limits>
+#include <vector>
 
 #include <thrift/protocol/TBinaryProtocol.h>
 #include <thrift/transport/TBufferTransports.h>
@@ -126,6 +127,88 @@ void testMessage() {
   }
 }
 
+inline void writeArray(shared_ptr<TProtocol> protocol, const std::vector<int16_t>& vals) {
+  protocol->writeI16Array(vals.data(), static_cast<uint32_t>(vals.size()));
+}
+
+inline void writeArray(shared_ptr<TProtocol> protocol, const std::vector<int32_t>& vals) {
+  protocol->writeI32Array(vals.data(), static_cast<uint32_t>(vals.size()));
+}
+
+inline void writeArray(shared_ptr<TProtocol> protocol, const std::vector<int64_t>& vals) {
+  protocol->writeI64Array(vals.data(), static_cast<uint32_t>(vals.size()));
+}
+
+inline void writeArray(shared_ptr<TProtocol> protocol, const std::vector<double>& vals) {
+  protocol->writeDoubleArray(vals.data(), static_cast<uint32_t>(vals.size()));
+}
+
+inline void readArray(shared_ptr<TProtocol> protocol, std::vector<int16_t>& vals) {
+  protocol->readI16Array(vals.data(), static_cast<uint32_t>(vals.size()));
+}
+
+inline void readArray(shared_ptr<TProtocol> protocol, std::vector<int32_t>& vals) {
+  protocol->readI32Array(vals.data(), static_cast<uint32_t>(vals.size()));
+}
+
+inline void readArray(shared_ptr<TProtocol> protocol, std::vector<int64_t>& vals) {
+  protocol->readI64Array(vals.data(), static_cast<uint32_t>(vals.size()));
+}
+
+inline void readArray(shared_ptr<TProtocol> protocol, std::vector<double>& vals) {
+  protocol->readDoubleArray(vals.data(), static_cast<uint32_t>(vals.size()));
+}
+
+template <typename TProto, TType type, typename Val>
+void testArray() {
+  // Long runs of small values with the odd large one, so that both the
+  // bulk and the element by element paths of a protocol get exercised.
+  std::vector<Val> vals;
+  vals.push_back((std::numeric_limits<Val>::min)());
+  vals.push_back((std::numeric_limits<Val>::max)());
+  for (int i = 0; i < 1000; i++) {
+    if (i % 37 == 0) {
+      vals.push_back(static_cast<Val>(1LL << (i % (sizeof(Val) * 8 - 1))));
+    } else if (i % 53 == 0) {
+      vals.push_back(static_cast<Val>(-((std::numeric_limits<Val>::max)() / 1000) * i));
+    } else {
+      vals.push_back(static_cast<Val>(i % 101 - 50));
+    }
+  }
+
+  // bulk and single element writes must produce the same wire format
+  for (int bulkWrite = 0; bulkWrite < 2; bulkWrite++) {
+    shared_ptr<TTransport> transport(new TMemoryBuffer());
+    shared_ptr<TProtocol> protocol(new TProto(transport));
+
+    protocol->writeListBegin(type, static_cast<uint32_t>(vals.size()));
+    if (bulkWrite) {
+      writeArray(protocol, vals);
+    } else {
+      for (size_t i = 0; i < vals.size(); i++) {
+        GenericIO::write(protocol, vals[i]);
+      }
+    }
+    protocol->writeListEnd();
+
+    TType elemType;
+    uint32_t size;
+    protocol->readListBegin(elemType, size);
+    if (elemType != type || size != vals.size()) {
+      THRIFT_SNPRINTF(errorMessage, ERR_LEN, "Invalid list header (type: %s)", typeid(Val).name());
+      throw TException(errorMessage);
+    }
+    std::vector<Val> out(size);
+    readArray(protocol, out);
+    protocol->readListEnd();
+
+    if (out != vals) {
+      THRIFT_SNPRINTF(errorMessage, ERR_LEN, "Invalid array read (type: %s)", typeid(Val).name());
+      throw TException(errorMessage);
+    }
+  }
+}
+
 template <typename TProto>
 void testProtocol(const char* protoname) {
   try {
@@ -217,6 +300,11 @@ void testProtocol(const char* protoname) {
     testField<TProto, T_STRING, std::string>("borderlinetiny");
     testField<TProto, T_STRING, std::string>("a bit longer than the smallest possible");
 
+    testArray<TProto, T_I16, int16_t>();
+    testArray<TProto, T_I32, int32_t>();
+    testArray<TProto, T_I64, int64_t>();
+    testArray<TProto, T_DOUBLE, double>();
+
     testMessage<TProto>();
 
     printf("%s => OK\n", protoname);
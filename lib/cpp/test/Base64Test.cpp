@@ -20,8 +20,17 @@
 #include <boost/test/unit_test.hpp>
 #include <thrift/protocol/TBase64Utils.h>
 
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
 using apache::thrift::protocol::base64_encode;
 using apache::thrift::protocol::base64_decode;
+using apache::thrift::protocol::base64_encode_bulk;
+using apache::thrift::protocol::base64_decode_bulk;
+using apache::thrift::protocol::base64_encoded_size;
 
 BOOST_AUTO_TEST_SUITE(Base64Test)
 
@@ -71,4 +80,128 @@ BOOST_AUTO_TEST_CASE(test_Base64_Encode_Decode) {
   }
 }
 
+// The three and four byte API applied group by group, which the bulk
+// functions must agree with
+uint32_t encodeByGroup(const uint8_t* in, uint32_t len, uint8_t* out) {
+  uint32_t written = 0;
+  while (len > 0) {
+    uint32_t group = len < 3 ? len : 3;
+    base64_encode(in, group, out + written);
+    written += group + 1;
+    in += group;
+    len -= group;
+  }
+  return written;
+}
+
+uint32_t decodeByGroup(const uint8_t* in, uint32_t len, uint8_t* out) {
+  uint32_t written = 0;
+  uint8_t group[4];
+  while (len > 1) {
+    uint32_t count = len < 4 ? len : 4;
+    memcpy(group, in, count);
+    base64_decode(group, count);
+    memcpy(out + written, group, count - 1);
+    written += count - 1;
+    in += count;
+    len -= count;
+  }
+  return written;
+}
+
+std::vector<uint8_t> makeData(uint32_t len, uint32_t seed) {
+  std::vector<uint8_t> data(len);
+  for (uint32_t i = 0; i < len; i++) {
+    seed = seed * 1103515245 + 12345;
+    data[i] = (uint8_t)(seed >> 16);
+  }
+  return data;
+}
+
+BOOST_AUTO_TEST_CASE(test_Base64_Bulk_Encode_Decode) {
+  // long enough to run the vector kernels several times, at every alignment
+  // of the tail
+  for (uint32_t len = 0; len < 300; len++) {
+    std::vector<uint8_t> data = makeData(len, len);
+    std::vector<uint8_t> encoded(base64_encoded_size(len) + 1, 0);
+    std::vector<uint8_t> expected(encoded);
+    BOOST_CHECK_EQUAL(base64_encode_bulk(data.data(), len, encoded.data()),
+                      base64_encoded_size(len));
+    encodeByGroup(data.data(), len, expected.data());
+    BOOST_CHECK(encoded == expected);
+    checkEncoding(encoded.data(), base64_encoded_size(len));
+
+    std::vector<uint8_t> decoded(len + 1, 0);
+    BOOST_CHECK_EQUAL(base64_decode_bulk(encoded.data(), base64_encoded_size(len),
+                                         decoded.data()),
+                      len);
+    BOOST_CHECK(0 == memcmp(decoded.data(), data.data(), len));
+
+    // in place, as TJSONProtocol decodes
+    BOOST_CHECK_EQUAL(base64_decode_bulk(encoded.data(), base64_encoded_size(len),
+                                         encoded.data()),
+                      len);
+    BOOST_CHECK(0 == memcmp(encoded.data(), data.data(), len));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_Base64_Bulk_Decode_Invalid) {
+  // characters outside the alphabet decode as they always have, wherever
+  // they fall
+  const uint8_t invalid[] = {0, '\n', ' ', '-', '=', '@', '[', '`', '{', 0x80, 0xff};
+  std::vector<uint8_t> data = makeData(150, 7);
+  std::vector<uint8_t> encoded(base64_encoded_size(150));
+  encodeByGroup(data.data(), 150, encoded.data());
+  for (uint8_t c : invalid) {
+    for (size_t pos = 0; pos < encoded.size(); pos++) {
+      std::vector<uint8_t> corrupt(encoded);
+      corrupt[pos] = c;
+      std::vector<uint8_t> decoded(150), expected(150);
+      BOOST_CHECK_EQUAL(base64_decode_bulk(corrupt.data(), (uint32_t)corrupt.size(),
+                                           decoded.data()),
+                        decodeByGroup(corrupt.data(), (uint32_t)corrupt.size(),
+                                      expected.data()));
+      BOOST_CHECK(decoded == expected);
+    }
+  }
+}
+
+/*
+ * Not a test: how fast binary fields of a few sizes are encoded and decoded
+ * in bulk, against group by group.
+ */
+void measure(const char* name,
+             uint32_t len,
+             uint32_t (*codec)(const uint8_t*, uint32_t, uint8_t*),
+             const std::vector<uint8_t>& in) {
+  std::vector<uint8_t> out(base64_encoded_size((uint32_t)in.size()));
+  uint64_t bytes = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed;
+  do {
+    for (int i = 0; i < 16; i++) {
+      codec(in.data(), len, out.data());
+    }
+    bytes += 16 * (uint64_t)len;
+    elapsed = std::chrono::steady_clock::now() - start;
+  } while (elapsed.count() < 0.05);
+
+  std::cout << std::left << std::setw(16) << name << std::right << std::setw(8) << len
+            << " B" << std::fixed << std::setprecision(1) << std::setw(10)
+            << bytes / elapsed.count() / 1e6 << " MB/s" << '\n';
+}
+
+BOOST_AUTO_TEST_CASE(test_Base64_Bulk_Throughput) {
+  const uint32_t sizes[] = {64, 4096, 512 * 1024};
+  for (uint32_t size : sizes) {
+    std::vector<uint8_t> data = makeData(size, size);
+    std::vector<uint8_t> encoded(base64_encoded_size(size));
+    base64_encode_bulk(data.data(), size, encoded.data());
+    measure("encode bulk", size, base64_encode_bulk, data);
+    measure("encode groups", size, encodeByGroup, data);
+    measure("decode bulk", (uint32_t)encoded.size(), base64_decode_bulk, encoded);
+    measure("decode groups", (uint32_t)encoded.size(), decodeByGroup, encoded);
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
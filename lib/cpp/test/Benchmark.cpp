@@ -25,7 +25,9 @@
 #include <math.h>
 #include <memory>
 #include "thrift/protocol/TBinaryProtocol.h"
+#include "thrift/TArena.h"
 #include "thrift/transport/TBufferTransports.h"
+#include "gen-cpp/ArenaTest_types.h"
 #include "gen-cpp/DebugProtoTest_types.h"
 
 #ifdef HAVE_SYS_TIME_H
@@ -239,6 +241,70 @@ int main() {
     cout << " Double read big endian: " << num / (1000 * elapsed) << " kHz" << '\n';
   }
 
+  // A string heavy object graph generated with cpp:arena, read once with
+  // the heap and once with a per-iteration arena
+  using thrift::test::arena::ArenaItem;
+  using thrift::test::arena::ArenaPerf;
+  using apache::thrift::TArena;
+  using apache::thrift::TArenaScope;
+  using apache::thrift::TArenaString;
+
+  ArenaPerf arenaPerf;
+  for (int i = 0; i < 50; ++i) {
+    ArenaItem item;
+    item.name = "item name";
+    item.id = i;
+    for (int j = 0; j < 8; ++j) {
+      item.tags.push_back(TArenaString(40, static_cast<char>('a' + j)));
+    }
+    item.counts["a somewhat longer key"] = i;
+    item.counts["key"] = 1;
+    item.payload = TArenaString(64, '\1');
+    arenaPerf.items.push_back(item);
+  }
+
+  num = 20000;
+  buf.reset(new TMemoryBuffer());
+  {
+    TBinaryProtocolT<TMemoryBuffer> prot(buf);
+    arenaPerf.write(&prot);
+  }
+  std::string arenaData = buf->getBufferAsString();
+
+  {
+    TBinaryProtocolT<TMemoryBuffer> prot(buf);
+    double elapsed = 0.0;
+    Timer timer;
+
+    for (int i = 0; i < num; i++) {
+      buf->resetBuffer((uint8_t*)arenaData.data(), static_cast<uint32_t>(arenaData.size()));
+      ArenaPerf arenaPerf2;
+      arenaPerf2.read(&prot);
+      buf->readEnd();
+    }
+    elapsed = timer.frame();
+    cout << " Graph read heap: " << num / (1000 * elapsed) << " kHz" << '\n';
+  }
+
+  {
+    TBinaryProtocolT<TMemoryBuffer> prot(buf);
+    TArena arena;
+    double elapsed = 0.0;
+    Timer timer;
+
+    for (int i = 0; i < num; i++) {
+      {
+        TArenaScope scope(&arena);
+        buf->resetBuffer((uint8_t*)arenaData.data(), static_cast<uint32_t>(arenaData.size()));
+        ArenaPerf arenaPerf2;
+        arenaPerf2.read(&prot);
+        buf->readEnd();
+      }
+      arena.reset();
+    }
+    elapsed = timer.frame();
+    cout << " Graph read arena: " << num / (1000 * elapsed) << " kHz" << '\n';
+  }
 
   return 0;
 }
@@ -0,0 +1,368 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Measures how many calls per second threads sharing one concurrent client
+ * get through TConcurrentClientSyncInfo, against the map and monitor based
+ * implementation it replaced.  The connection is simulated in memory: a
+ * server thread answers requests in batches, in reverse order, so most
+ * responses are read by a thread other than the one waiting for them.
+ *
+ * Usage: ConcurrentClientBenchmark [threads [calls per thread]]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "thrift/TApplicationException.h"
+#include "thrift/async/TConcurrentClientSyncInfo.h"
+#include "thrift/concurrency/Monitor.h"
+#include "thrift/transport/TTransportException.h"
+
+using apache::thrift::TApplicationException;
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::Monitor;
+using apache::thrift::concurrency::Mutex;
+using apache::thrift::protocol::TMessageType;
+using apache::thrift::protocol::T_REPLY;
+
+namespace legacy {
+
+/*
+ * The previous TConcurrentClientSyncInfo: a seqid to monitor map guarded by
+ * a mutex, and one read mutex that every waiting thread sleeps on.
+ */
+class SyncInfo {
+public:
+  SyncInfo()
+    : stop_(false),
+      nextseqid_((std::numeric_limits<int32_t>::max)() - 10),
+      recvPending_(false),
+      wakeupSomeone_(false),
+      seqidPending_(0),
+      mtypePending_(apache::thrift::protocol::T_CALL) {}
+
+  int32_t generateSeqId() {
+    Guard seqidGuard(seqidMutex_);
+    if (stop_)
+      throwDeadConnection();
+    if (!seqidToMonitorMap_.empty() && nextseqid_ == seqidToMonitorMap_.begin()->first)
+      throw TApplicationException(TApplicationException::BAD_SEQUENCE_ID,
+                                  "about to repeat a seqid");
+    int32_t newSeqId = nextseqid_;
+    if (nextseqid_ == (std::numeric_limits<int32_t>::max)())
+      nextseqid_ = (std::numeric_limits<int32_t>::min)();
+    else
+      ++nextseqid_;
+    seqidToMonitorMap_[newSeqId] = newMonitor();
+    return newSeqId;
+  }
+
+  bool getPending(std::string& fname, TMessageType& mtype, int32_t& rseqid) {
+    if (stop_)
+      throwDeadConnection();
+    wakeupSomeone_ = false;
+    if (recvPending_) {
+      recvPending_ = false;
+      rseqid = seqidPending_;
+      fname = fnamePending_;
+      mtype = mtypePending_;
+      return true;
+    }
+    return false;
+  }
+
+  void updatePending(const std::string& fname, TMessageType mtype, int32_t rseqid) {
+    recvPending_ = true;
+    seqidPending_ = rseqid;
+    fnamePending_ = fname;
+    mtypePending_ = mtype;
+    MonitorPtr monitor;
+    {
+      Guard seqidGuard(seqidMutex_);
+      auto i = seqidToMonitorMap_.find(rseqid);
+      if (i == seqidToMonitorMap_.end())
+        throw TApplicationException(TApplicationException::BAD_SEQUENCE_ID,
+                                    "server sent a bad seqid");
+      monitor = i->second;
+    }
+    monitor->notify();
+  }
+
+  void waitForWork(int32_t seqid) {
+    MonitorPtr m;
+    {
+      Guard seqidGuard(seqidMutex_);
+      m = seqidToMonitorMap_[seqid];
+    }
+    while (true) {
+      if (stop_)
+        throwDeadConnection();
+      if (wakeupSomeone_)
+        return;
+      if (recvPending_ && seqidPending_ == seqid)
+        return;
+      m->waitForever();
+    }
+  }
+
+  class SendSentry {
+  public:
+    explicit SendSentry(SyncInfo* sync) : sync_(*sync), committed_(false) {
+      sync_.writeMutex_.lock();
+    }
+    ~SendSentry() {
+      if (!committed_) {
+        Guard seqidGuard(sync_.seqidMutex_);
+        sync_.markBad();
+      }
+      sync_.writeMutex_.unlock();
+    }
+    void commit() { committed_ = true; }
+
+  private:
+    SyncInfo& sync_;
+    bool committed_;
+  };
+
+  class RecvSentry {
+  public:
+    RecvSentry(SyncInfo* sync, int32_t seqid) : sync_(*sync), seqid_(seqid), committed_(false) {
+      sync_.readMutex_.lock();
+    }
+    ~RecvSentry() {
+      {
+        Guard seqidGuard(sync_.seqidMutex_);
+        sync_.deleteMonitor(sync_.seqidToMonitorMap_[seqid_]);
+        sync_.seqidToMonitorMap_.erase(seqid_);
+        if (committed_)
+          sync_.wakeupAnyone();
+        else
+          sync_.markBad();
+      }
+      sync_.readMutex_.unlock();
+    }
+    void commit() { committed_ = true; }
+
+  private:
+    SyncInfo& sync_;
+    int32_t seqid_;
+    bool committed_;
+  };
+
+private:
+  typedef std::shared_ptr<Monitor> MonitorPtr;
+  enum { MONITOR_CACHE_SIZE = 10 };
+
+  MonitorPtr newMonitor() {
+    if (freeMonitors_.empty())
+      return std::make_shared<Monitor>(&readMutex_);
+    MonitorPtr retval;
+    retval.swap(freeMonitors_.back());
+    freeMonitors_.pop_back();
+    return retval;
+  }
+
+  void deleteMonitor(MonitorPtr& m) {
+    if (freeMonitors_.size() > MONITOR_CACHE_SIZE) {
+      m.reset();
+      return;
+    }
+    freeMonitors_.push_back(MonitorPtr());
+    m.swap(freeMonitors_.back());
+  }
+
+  void wakeupAnyone() {
+    wakeupSomeone_ = true;
+    if (!seqidToMonitorMap_.empty())
+      seqidToMonitorMap_.rbegin()->second->notify();
+  }
+
+  void markBad() {
+    wakeupSomeone_ = true;
+    stop_ = true;
+    for (auto& i : seqidToMonitorMap_)
+      i.second->notify();
+  }
+
+  static void throwDeadConnection() {
+    throw apache::thrift::transport::TTransportException(
+        apache::thrift::transport::TTransportException::NOT_OPEN, "client died");
+  }
+
+  volatile bool stop_;
+  Mutex seqidMutex_;
+  int32_t nextseqid_;
+  std::map<int32_t, MonitorPtr> seqidToMonitorMap_;
+  std::vector<MonitorPtr> freeMonitors_;
+  Mutex writeMutex_;
+  Mutex readMutex_;
+  bool recvPending_;
+  bool wakeupSomeone_;
+  int32_t seqidPending_;
+  std::string fnamePending_;
+  TMessageType mtypePending_;
+};
+}
+
+namespace current {
+
+struct SyncInfo : apache::thrift::async::TConcurrentClientSyncInfo {
+  typedef apache::thrift::async::TConcurrentSendSentry SendSentry;
+  typedef apache::thrift::async::TConcurrentRecvSentry RecvSentry;
+};
+}
+
+/*
+ * An in-memory connection.  Requests are answered in batches of up to
+ * BATCH, last request first.
+ */
+class Connection {
+public:
+  enum { BATCH = 8 };
+
+  Connection() : closed_(false), server_(&Connection::serve, this) {}
+
+  ~Connection() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+    }
+    requestReady_.notify_one();
+    server_.join();
+  }
+
+  void send(int32_t seqid) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      requests_.push_back(seqid);
+    }
+    requestReady_.notify_one();
+  }
+
+  int32_t receive() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    responseReady_.wait(lock, [this] { return !responses_.empty(); });
+    int32_t seqid = responses_.front();
+    responses_.pop_front();
+    return seqid;
+  }
+
+private:
+  void serve() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      requestReady_.wait(lock, [this] { return closed_ || !requests_.empty(); });
+      if (closed_) {
+        return;
+      }
+      size_t count = (std::min)(requests_.size(), static_cast<size_t>(BATCH));
+      std::reverse(requests_.begin(), requests_.begin() + count);
+      responses_.insert(responses_.end(), requests_.begin(), requests_.begin() + count);
+      requests_.erase(requests_.begin(), requests_.begin() + count);
+      responseReady_.notify_all();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable requestReady_;
+  std::condition_variable responseReady_;
+  std::deque<int32_t> requests_;
+  std::deque<int32_t> responses_;
+  bool closed_;
+  std::thread server_;
+};
+
+/*
+ * One call, following the code generated for concurrent clients.
+ */
+template <typename SyncInfo>
+void call(SyncInfo& sync, Connection& connection) {
+  int32_t seqid = sync.generateSeqId();
+  {
+    typename SyncInfo::SendSentry sentry(&sync);
+    connection.send(seqid);
+    sentry.commit();
+  }
+
+  int32_t rseqid = 0;
+  std::string fname;
+  TMessageType mtype;
+  typename SyncInfo::RecvSentry sentry(&sync, seqid);
+  while (true) {
+    if (!sync.getPending(fname, mtype, rseqid)) {
+      rseqid = connection.receive();
+      fname = "call";
+      mtype = T_REPLY;
+    }
+    if (seqid == rseqid) {
+      sentry.commit();
+      return;
+    }
+    sync.updatePending(fname, mtype, rseqid);
+    sync.waitForWork(seqid);
+  }
+}
+
+template <typename SyncInfo>
+double run(size_t numThreads, size_t callsPerThread) {
+  SyncInfo sync;
+  Connection connection;
+  std::vector<std::thread> threads;
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < numThreads; ++i) {
+    threads.emplace_back([&] {
+      for (size_t j = 0; j < callsPerThread; ++j) {
+        call(sync, connection);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return numThreads * callsPerThread / elapsed.count();
+}
+
+int main(int argc, char** argv) {
+  size_t numThreads = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 16;
+  size_t callsPerThread = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 2000;
+
+  std::cout << numThreads << " threads, " << callsPerThread << " calls each" << '\n';
+  std::cout << "map and monitors:  " << static_cast<uint64_t>(run<legacy::SyncInfo>(numThreads,
+                                                                                  callsPerThread))
+            << " calls/s" << '\n';
+  std::cout << "slot table:        " << static_cast<uint64_t>(run<current::SyncInfo>(numThreads,
+                                                                                   callsPerThread))
+            << " calls/s" << '\n';
+  return 0;
+}
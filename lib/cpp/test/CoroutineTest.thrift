@@ -0,0 +1,41 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// generated with cpp:coroutines, see TCoroutineTest.cpp
+namespace cpp thrift.test.coro
+
+struct CoroItem {
+  1: string name,
+  2: i32 count,
+}
+
+exception CoroMissing {
+  1: string name,
+}
+
+service CoroBase {
+  i32 ping(),
+}
+
+service CoroStore extends CoroBase {
+  CoroItem get(1: string name) throws (1: CoroMissing missing),
+  list<string> names(),
+  void put(1: CoroItem item),
+  oneway void forget(1: string name),
+}
@@ -0,0 +1,181 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Compares the THeaderTransport transforms on a payload corpus: how well
+ * each compresses it, and how much CPU time it spends per byte to compress
+ * and decompress.  Every file named on the command line is one payload
+ * (e.g. a captured request or response); without any, a synthetic corpus
+ * of small and large Thrift messages is used.
+ *
+ * Usage: HeaderTransformBenchmark [payload files...]
+ */
+
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "thrift/protocol/TCompactProtocol.h"
+#include "thrift/transport/TBufferTransports.h"
+#include "thrift/transport/THeaderTransform.h"
+#include "thrift/transport/THeaderTransport.h"
+
+using namespace apache::thrift::protocol;
+using namespace apache::thrift::transport;
+
+/*
+ * A message with the usual mix of ids, names, enums and nested lists.
+ */
+std::string makeMessage(int items, int seed) {
+  auto buffer = std::make_shared<TMemoryBuffer>();
+  TCompactProtocol proto(buffer);
+  proto.writeMessageBegin("getItems", T_REPLY, seed);
+  proto.writeStructBegin("result");
+  proto.writeFieldBegin("success", T_LIST, 0);
+  proto.writeListBegin(T_STRUCT, items);
+  for (int i = 0; i < items; ++i) {
+    proto.writeStructBegin("Item");
+    proto.writeFieldBegin("id", T_I64, 1);
+    proto.writeI64(1000000007LL * (seed + i));
+    proto.writeFieldEnd();
+    proto.writeFieldBegin("name", T_STRING, 2);
+    proto.writeString("item-" + std::to_string((seed * 31 + i) % 1000));
+    proto.writeFieldEnd();
+    proto.writeFieldBegin("status", T_I32, 3);
+    proto.writeI32(i % 4);
+    proto.writeFieldEnd();
+    proto.writeFieldBegin("tags", T_LIST, 4);
+    proto.writeListBegin(T_STRING, 3);
+    proto.writeString("region-" + std::to_string(i % 7));
+    proto.writeString(i % 2 ? "active" : "archived");
+    proto.writeString("owner-" + std::to_string((seed + i) % 50));
+    proto.writeListEnd();
+    proto.writeFieldEnd();
+    proto.writeFieldStop();
+    proto.writeStructEnd();
+  }
+  proto.writeListEnd();
+  proto.writeFieldEnd();
+  proto.writeFieldStop();
+  proto.writeStructEnd();
+  proto.writeMessageEnd();
+  return buffer->getBufferAsString();
+}
+
+struct Result {
+  uint64_t bytesIn = 0;
+  uint64_t bytesOut = 0;
+  double compressCpu = 0;
+  double decompressCpu = 0;
+};
+
+double cpuSeconds() {
+  return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+}
+
+Result measure(THeaderTransform& transform, const std::vector<std::string>& corpus) {
+  THeaderTransformBuffer buffer;
+  std::vector<std::string> compressed;
+  for (const auto& payload : corpus) {
+    uint32_t size = transform.transform(reinterpret_cast<const uint8_t*>(payload.data()),
+                                        static_cast<uint32_t>(payload.size()),
+                                        buffer);
+    compressed.emplace_back(reinterpret_cast<const char*>(buffer.get()), size);
+  }
+
+  // Repeat until there is enough CPU time to measure
+  Result result;
+  uint64_t rounds = 0;
+  do {
+    double start = cpuSeconds();
+    for (const auto& payload : corpus) {
+      result.bytesOut += transform.transform(reinterpret_cast<const uint8_t*>(payload.data()),
+                                             static_cast<uint32_t>(payload.size()),
+                                             buffer);
+      result.bytesIn += payload.size();
+    }
+    double middle = cpuSeconds();
+    for (size_t i = 0; i < corpus.size(); ++i) {
+      uint32_t size = transform.untransform(reinterpret_cast<const uint8_t*>(compressed[i].data()),
+                                            static_cast<uint32_t>(compressed[i].size()),
+                                            0x7FFFFFFF,
+                                            buffer);
+      if (size != corpus[i].size()) {
+        throw std::runtime_error("round trip failed");
+      }
+    }
+    result.compressCpu += middle - start;
+    result.decompressCpu += cpuSeconds() - middle;
+    ++rounds;
+  } while (result.compressCpu < 0.2 && rounds < 100000);
+  return result;
+}
+
+int main(int argc, char** argv) {
+  std::vector<std::string> corpus;
+  for (int i = 1; i < argc; ++i) {
+    std::ifstream in(argv[i], std::ios::binary);
+    if (!in) {
+      std::cerr << "cannot read " << argv[i] << '\n';
+      return 1;
+    }
+    corpus.emplace_back(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+  if (corpus.empty()) {
+    for (int seed = 0; seed < 64; ++seed) {
+      corpus.push_back(makeMessage(seed % 8 == 0 ? 500 : 2 + seed % 5, seed));
+    }
+  }
+
+  uint64_t total = 0;
+  for (const auto& payload : corpus) {
+    total += payload.size();
+  }
+  std::cout << corpus.size() << " payloads, " << total << " bytes" << '\n';
+  std::cout << std::left << std::setw(10) << "transform" << std::right << std::setw(8) << "ratio"
+            << std::setw(16) << "compress ns/B" << std::setw(18) << "decompress ns/B" << '\n';
+
+  struct Candidate {
+    const char* name;
+    uint16_t id;
+  };
+  for (const Candidate& candidate : {Candidate{"zlib", THeaderTransport::ZLIB_TRANSFORM},
+                                     Candidate{"zstd", THeaderTransport::ZSTD_TRANSFORM},
+                                     Candidate{"lz4", THeaderTransport::LZ4_TRANSFORM},
+                                     Candidate{"snappy", THeaderTransport::SNAPPY_TRANSFORM}}) {
+    std::shared_ptr<THeaderTransform> transform = THeaderTransformRegistry::create(candidate.id);
+    if (!transform) {
+      std::cout << std::left << std::setw(10) << candidate.name << "not built in" << '\n';
+      continue;
+    }
+    Result result = measure(*transform, corpus);
+    std::cout << std::left << std::setw(10) << candidate.name << std::right << std::fixed
+              << std::setprecision(2) << std::setw(8)
+              << static_cast<double>(result.bytesIn) / result.bytesOut << std::setw(16)
+              << result.compressCpu * 1e9 / result.bytesIn << std::setw(18)
+              << result.decompressCpu * 1e9 / result.bytesIn << '\n';
+  }
+  return 0;
+}
@@ -0,0 +1,329 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#define BOOST_TEST_MODULE HeaderTransformTest
+#include <boost/test/unit_test.hpp>
+
+#include <thrift/TApplicationException.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/THeaderTransport.h>
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+using apache::thrift::TApplicationException;
+using apache::thrift::TConfiguration;
+using namespace apache::thrift::transport;
+
+namespace {
+
+const uint16_t XOR_TRANSFORM = 0x40;
+
+/*
+ * A transform that isn't built in, to exercise the registry.
+ */
+class XorTransform : public THeaderTransform {
+public:
+  uint32_t transform(const uint8_t* in, uint32_t sz, THeaderTransformBuffer& out) override {
+    uint8_t* dst = out.reserve(sz);
+    for (uint32_t i = 0; i < sz; ++i) {
+      dst[i] = in[i] ^ 0x5a;
+    }
+    return sz;
+  }
+
+  uint32_t untransform(const uint8_t* in,
+                       uint32_t sz,
+                       uint32_t,
+                       THeaderTransformBuffer& out) override {
+    return transform(in, sz, out);
+  }
+};
+
+std::string compressible(size_t size) {
+  std::string data;
+  while (data.size() < size) {
+    data += "struct Item { 1: string name = \"item " + std::to_string(data.size() % 97) + "\" } ";
+  }
+  data.resize(size);
+  return data;
+}
+
+std::string random(size_t size) {
+  std::string data(size, '\0');
+  for (auto& c : data) {
+    c = static_cast<char>(std::rand());
+  }
+  return data;
+}
+
+/*
+ * Writes data as one frame and returns the number of bytes on the wire.
+ */
+uint32_t send(THeaderTransport& writer, TMemoryBuffer& wire, const std::string& data) {
+  uint32_t before = wire.available_read();
+  writer.write(reinterpret_cast<const uint8_t*>(data.data()), static_cast<uint32_t>(data.size()));
+  writer.flush();
+  return wire.available_read() - before;
+}
+
+std::string receive(THeaderTransport& reader, size_t size) {
+  std::string data(size, '\0');
+  reader.readAll(reinterpret_cast<uint8_t*>(&data[0]), static_cast<uint32_t>(size));
+  reader.readEnd();
+  return data;
+}
+
+std::vector<uint16_t> builtinTransforms() {
+  std::vector<uint16_t> ids;
+  for (uint16_t id : {THeaderTransport::ZLIB_TRANSFORM,
+                      THeaderTransport::SNAPPY_TRANSFORM,
+                      THeaderTransport::ZSTD_TRANSFORM,
+                      THeaderTransport::LZ4_TRANSFORM}) {
+    if (THeaderTransformRegistry::isRegistered(id)) {
+      ids.push_back(id);
+    }
+  }
+  return ids;
+}
+}
+
+BOOST_AUTO_TEST_SUITE(HeaderTransformTest)
+
+BOOST_AUTO_TEST_CASE(test_builtin_roundtrip) {
+  BOOST_CHECK(THeaderTransformRegistry::isRegistered(THeaderTransport::ZLIB_TRANSFORM));
+
+  for (uint16_t id : builtinTransforms()) {
+    BOOST_TEST_MESSAGE("transform " << id);
+    auto wire = std::make_shared<TMemoryBuffer>();
+    THeaderTransport writer(wire);
+    THeaderTransport reader(wire);
+    writer.setTransform(id);
+
+    // larger than the write buffer, so the transforms have to grow theirs
+    std::string data = compressible(100000);
+    BOOST_CHECK_LT(send(writer, *wire, data), data.size() / 4);
+    BOOST_CHECK(receive(reader, data.size()) == data);
+
+    // incompressible data grows
+    data = random(100000);
+    send(writer, *wire, data);
+    BOOST_CHECK(receive(reader, data.size()) == data);
+
+    data.clear();
+    send(writer, *wire, data);
+    BOOST_CHECK(receive(reader, data.size()) == data);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_registered_transform) {
+  THeaderTransformRegistry::registerTransform(XOR_TRANSFORM,
+                                              [] { return std::make_shared<XorTransform>(); });
+  auto wire = std::make_shared<TMemoryBuffer>();
+  THeaderTransport writer(wire);
+  THeaderTransport reader(wire);
+  writer.setTransform(XOR_TRANSFORM);
+  writer.setTransform(THeaderTransport::ZLIB_TRANSFORM);
+
+  std::string data = compressible(5000);
+  send(writer, *wire, data);
+  BOOST_CHECK(receive(reader, data.size()) == data);
+
+  THeaderTransformRegistry::unregisterTransform(XOR_TRANSFORM);
+  BOOST_CHECK(!THeaderTransformRegistry::isRegistered(XOR_TRANSFORM));
+
+  // A new transport can't read it any more
+  THeaderTransport stranger(wire);
+  send(writer, *wire, data);
+  BOOST_CHECK_THROW(receive(stranger, data.size()), TApplicationException);
+}
+
+BOOST_AUTO_TEST_CASE(test_zstd_dictionary) {
+  if (!THeaderTransformRegistry::isRegistered(THeaderTransport::ZSTD_TRANSFORM)) {
+    BOOST_CHECK_THROW(TZstdHeaderTransform(), TTransportException);
+    return;
+  }
+
+  // Any content makes a raw dictionary; a trained one does better still
+  auto dictionary = std::make_shared<const TZstdDictionary>(compressible(4096));
+  std::string data = compressible(300);
+
+  uint32_t plainSize;
+  {
+    auto wire = std::make_shared<TMemoryBuffer>();
+    THeaderTransport writer(wire);
+    writer.setTransform(THeaderTransport::ZSTD_TRANSFORM);
+    plainSize = send(writer, *wire, data);
+  }
+
+  THeaderTransformRegistry::registerTransform(THeaderTransport::ZSTD_TRANSFORM, [dictionary] {
+    return std::make_shared<TZstdHeaderTransform>(TZstdHeaderTransform::DEFAULT_LEVEL, dictionary);
+  });
+  auto wire = std::make_shared<TMemoryBuffer>();
+  THeaderTransport writer(wire);
+  THeaderTransport reader(wire);
+  writer.setTransform(THeaderTransport::ZSTD_TRANSFORM);
+  BOOST_CHECK_LT(send(writer, *wire, data), plainSize);
+  BOOST_CHECK(receive(reader, data.size()) == data);
+
+  THeaderTransformRegistry::registerTransform(THeaderTransport::ZSTD_TRANSFORM, [] {
+    return std::make_shared<TZstdHeaderTransform>();
+  });
+}
+
+BOOST_AUTO_TEST_CASE(test_min_transform_size) {
+  auto wire = std::make_shared<TMemoryBuffer>();
+  THeaderTransport writer(wire);
+  THeaderTransport reader(wire);
+  writer.setTransform(THeaderTransport::ZLIB_TRANSFORM);
+  writer.setMinTransformSize(1024);
+
+  std::string small = compressible(1000);
+  BOOST_CHECK_GT(send(writer, *wire, small), small.size());
+  BOOST_CHECK(receive(reader, small.size()) == small);
+
+  std::string large = compressible(1024);
+  BOOST_CHECK_LT(send(writer, *wire, large), large.size());
+  BOOST_CHECK(receive(reader, large.size()) == large);
+}
+
+BOOST_AUTO_TEST_CASE(test_untransform_limit) {
+  for (uint16_t id : builtinTransforms()) {
+    auto wire = std::make_shared<TMemoryBuffer>();
+    THeaderTransport writer(wire);
+    THeaderTransport reader(wire, std::make_shared<TConfiguration>(64 * 1024));
+    writer.setTransform(id);
+    std::string data(1024 * 1024, 'x');
+    send(writer, *wire, data);
+    try {
+      uint8_t first;
+      reader.read(&first, 1);
+      BOOST_ERROR("untransform did not enforce the maximum message size");
+    } catch (const TTransportException& ex) {
+      BOOST_CHECK_EQUAL(ex.getType(), TTransportException::CORRUPTED_DATA);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_negotiation) {
+  auto toServer = std::make_shared<TMemoryBuffer>();
+  auto toClient = std::make_shared<TMemoryBuffer>();
+  THeaderTransport client(toClient, toServer);
+  THeaderTransport server(toServer, toClient);
+
+  // The server knows only the second choice
+  const uint16_t unknown = 0x7f;
+  client.setPreferredTransforms({unknown, THeaderTransport::ZLIB_TRANSFORM});
+  client.setHeader("app", "1");
+
+  std::string request = compressible(4000);
+  BOOST_CHECK_GT(send(client, *toServer, request), request.size());
+  BOOST_CHECK(receive(server, request.size()) == request);
+  BOOST_CHECK_EQUAL(server.getNumTransforms(), 1);
+  BOOST_CHECK_EQUAL(server.getHeaders().size(), 1u);
+  BOOST_CHECK_EQUAL(server.getHeaders().count("app"), 1u);
+
+  std::string response = compressible(8000);
+  BOOST_CHECK_LT(send(server, *toClient, response), response.size() / 4);
+  BOOST_CHECK(receive(client, response.size()) == response);
+  BOOST_CHECK_EQUAL(client.getNumTransforms(), 1);
+  BOOST_CHECK(client.getHeaders().empty());
+
+  // From now on both directions are compressed and nothing is offered
+  BOOST_CHECK_LT(send(client, *toServer, request), request.size() / 4);
+  BOOST_CHECK(receive(server, request.size()) == request);
+  BOOST_CHECK(server.getHeaders().empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_negotiation_without_match) {
+  auto toServer = std::make_shared<TMemoryBuffer>();
+  auto toClient = std::make_shared<TMemoryBuffer>();
+  THeaderTransport client(toClient, toServer);
+  THeaderTransport server(toServer, toClient);
+
+  // The client's transform is gone from the registry by the time the
+  // server looks for it
+  THeaderTransformRegistry::registerTransform(XOR_TRANSFORM,
+                                              [] { return std::make_shared<XorTransform>(); });
+  client.setPreferredTransforms({XOR_TRANSFORM});
+  THeaderTransformRegistry::unregisterTransform(XOR_TRANSFORM);
+  std::string data = compressible(4000);
+  send(client, *toServer, data);
+  BOOST_CHECK(receive(server, data.size()) == data);
+  BOOST_CHECK_EQUAL(server.getNumTransforms(), 0);
+  send(server, *toClient, data);
+  BOOST_CHECK(receive(client, data.size()) == data);
+  BOOST_CHECK_EQUAL(client.getNumTransforms(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_negotiation_offers_known_only) {
+  auto toServer = std::make_shared<TMemoryBuffer>();
+  auto toClient = std::make_shared<TMemoryBuffer>();
+  THeaderTransport client(toClient, toServer);
+  THeaderTransport server(toServer, toClient);
+
+  // Nothing known is left to offer, so no header goes out
+  client.setPreferredTransforms({0x7f});
+  std::string data = compressible(4000);
+  auto plain = std::make_shared<TMemoryBuffer>();
+  THeaderTransport reference(plain);
+  BOOST_CHECK_EQUAL(send(client, *toServer, data), send(reference, *plain, data));
+  BOOST_CHECK(receive(server, data.size()) == data);
+}
+
+BOOST_AUTO_TEST_CASE(test_negotiation_settles) {
+  auto toServer = std::make_shared<TMemoryBuffer>();
+  auto toClient = std::make_shared<TMemoryBuffer>();
+  THeaderTransport client(toClient, toServer);
+  THeaderTransport server(toServer, toClient);
+  client.setPreferredTransforms({THeaderTransport::ZLIB_TRANSFORM});
+
+  // Two requests go out before the first answer comes back, so the
+  // client gets two answers
+  std::string request = compressible(4000);
+  std::string response = compressible(8000);
+  for (int i = 0; i < 2; ++i) {
+    send(client, *toServer, request);
+  }
+  for (int i = 0; i < 2; ++i) {
+    BOOST_CHECK(receive(server, request.size()) == request);
+    send(server, *toClient, response);
+  }
+  for (int i = 0; i < 2; ++i) {
+    BOOST_CHECK(receive(client, response.size()) == response);
+  }
+
+  // Neither side offers or answers anything any more
+  auto plain = std::make_shared<TMemoryBuffer>();
+  THeaderTransport reference(plain);
+  reference.setTransform(THeaderTransport::ZLIB_TRANSFORM);
+  uint32_t requestSize = send(reference, *plain, request);
+  plain->resetBuffer();
+  uint32_t responseSize = send(reference, *plain, response);
+  for (int round = 0; round < 3; ++round) {
+    BOOST_CHECK_EQUAL(send(client, *toServer, request), requestSize);
+    BOOST_CHECK(receive(server, request.size()) == request);
+    BOOST_CHECK_EQUAL(send(server, *toClient, response), responseSize);
+    BOOST_CHECK(receive(client, response.size()) == response);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
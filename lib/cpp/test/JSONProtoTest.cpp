@@ -20,6 +20,7 @@
 #define _USE_MATH_DEFINES
 #include <cmath>
 #include <iomanip>
+#include <limits>
 #include <sstream>
 #include <thrift/protocol/TJSONProtocol.h>
 #include <memory>
@@ -402,3 +403,70 @@ BOOST_AUTO_TEST_CASE(test_json_base64_padding_validation) {
   test_base64_padding("===");
   test_base64_padding("====");
 }
+
+BOOST_AUTO_TEST_CASE(test_json_string_escapes_at_every_offset) {
+  // Strings are scanned in blocks; put the character that needs escaping
+  // at every position of strings a few blocks long
+  const char specials[] = {'"', '\\', '\n', '\x01', '\x1f', '/'};
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  std::shared_ptr<TJSONProtocol> proto(new TJSONProtocol(buffer));
+  for (char special : specials) {
+    for (size_t length = 1; length <= 40; ++length) {
+      for (size_t offset = 0; offset < length; ++offset) {
+        std::string str(length, 'x');
+        str[offset] = special;
+        buffer->resetBuffer();
+        proto->writeString(str);
+        std::string result;
+        proto->readString(result);
+        BOOST_CHECK_EQUAL(result, str);
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_json_binary_lengths) {
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  std::shared_ptr<TJSONProtocol> proto(new TJSONProtocol(buffer));
+  std::string binary;
+  for (size_t length = 0; length <= 5000; length += (length < 64 ? 1 : 997)) {
+    binary.resize(length);
+    for (size_t i = 0; i < length; ++i) {
+      binary[i] = static_cast<char>(i * 31 + length);
+    }
+    buffer->resetBuffer();
+    proto->writeBinary(binary);
+    std::string result;
+    proto->readBinary(result);
+    BOOST_CHECK(result == binary);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_json_integer_limits) {
+  auto read_i32 = [](const std::string& json) {
+    std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer(
+      (uint8_t*)(json.c_str()), static_cast<uint32_t>(json.size())));
+    TJSONProtocol proto(buffer);
+    int32_t value;
+    proto.readI32(value);
+    return value;
+  };
+  auto read_i64 = [](const std::string& json) {
+    std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer(
+      (uint8_t*)(json.c_str()), static_cast<uint32_t>(json.size())));
+    TJSONProtocol proto(buffer);
+    int64_t value;
+    proto.readI64(value);
+    return value;
+  };
+
+  BOOST_CHECK_EQUAL(read_i32("2147483647 "), (std::numeric_limits<int32_t>::max)());
+  BOOST_CHECK_EQUAL(read_i32("-2147483648 "), (std::numeric_limits<int32_t>::min)());
+  BOOST_CHECK_EQUAL(read_i64("9223372036854775807 "), (std::numeric_limits<int64_t>::max)());
+  BOOST_CHECK_EQUAL(read_i64("-9223372036854775808 "), (std::numeric_limits<int64_t>::min)());
+  BOOST_CHECK_THROW(read_i32("2147483648 "), apache::thrift::protocol::TProtocolException);
+  BOOST_CHECK_THROW(read_i32("-2147483649 "), apache::thrift::protocol::TProtocolException);
+  BOOST_CHECK_THROW(read_i64("9223372036854775808 "), apache::thrift::protocol::TProtocolException);
+  BOOST_CHECK_THROW(read_i64("- "), apache::thrift::protocol::TProtocolException);
+  BOOST_CHECK_THROW(read_i64("1.5 "), apache::thrift::protocol::TProtocolException);
+}
@@ -0,0 +1,153 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Measures how fast TJSONProtocol writes and reads a large response, such
+ * as a browser facing endpoint would serve: a list of records with text,
+ * numbers and a binary field.
+ *
+ * Usage: JSONProtocolBenchmark [records [iterations]]
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "thrift/protocol/TJSONProtocol.h"
+#include "thrift/transport/TBufferTransports.h"
+
+using namespace apache::thrift::protocol;
+using namespace apache::thrift::transport;
+
+void writeResponse(TProtocol& proto, size_t records) {
+  std::string binary(256, '\0');
+  for (size_t i = 0; i < binary.size(); ++i) {
+    binary[i] = static_cast<char>(i * 7);
+  }
+
+  proto.writeStructBegin("Response");
+  proto.writeFieldBegin("records", T_LIST, 1);
+  proto.writeListBegin(T_STRUCT, static_cast<uint32_t>(records));
+  for (size_t i = 0; i < records; ++i) {
+    proto.writeStructBegin("Record");
+    proto.writeFieldBegin("id", T_I64, 1);
+    proto.writeI64(static_cast<int64_t>(i) * 1000003);
+    proto.writeFieldEnd();
+    proto.writeFieldBegin("title", T_STRING, 2);
+    proto.writeString("Record number " + std::to_string(i) + " of the \"benchmark\" set");
+    proto.writeFieldEnd();
+    proto.writeFieldBegin("description", T_STRING, 3);
+    proto.writeString(std::string("A longer piece of text as it would appear in a description field,\n"
+                                  "with the odd line break and tab\tbut mostly plain characters that "
+                                  "need no escaping at all."));
+    proto.writeFieldEnd();
+    proto.writeFieldBegin("score", T_DOUBLE, 4);
+    proto.writeDouble(static_cast<double>(i) / 7.0);
+    proto.writeFieldEnd();
+    proto.writeFieldBegin("count", T_I32, 5);
+    proto.writeI32(static_cast<int32_t>(i % 1000));
+    proto.writeFieldEnd();
+    proto.writeFieldBegin("thumbnail", T_STRING, 6);
+    proto.writeBinary(binary);
+    proto.writeFieldEnd();
+    proto.writeFieldStop();
+    proto.writeStructEnd();
+  }
+  proto.writeListEnd();
+  proto.writeFieldEnd();
+  proto.writeFieldStop();
+  proto.writeStructEnd();
+}
+
+void readResponse(TProtocol& proto) {
+  std::string name;
+  TType type;
+  int16_t id;
+  uint32_t size;
+  proto.readStructBegin(name);
+  proto.readFieldBegin(name, type, id);
+  proto.readListBegin(type, size);
+  std::string str;
+  int64_t i64;
+  int32_t i32;
+  double dub;
+  for (uint32_t i = 0; i < size; ++i) {
+    proto.readStructBegin(name);
+    while (true) {
+      proto.readFieldBegin(name, type, id);
+      if (type == T_STOP) {
+        break;
+      }
+      switch (id) {
+      case 1:
+        proto.readI64(i64);
+        break;
+      case 2:
+      case 3:
+        proto.readString(str);
+        break;
+      case 4:
+        proto.readDouble(dub);
+        break;
+      case 5:
+        proto.readI32(i32);
+        break;
+      case 6:
+        proto.readBinary(str);
+        break;
+      }
+      proto.readFieldEnd();
+    }
+    proto.readStructEnd();
+  }
+  proto.readListEnd();
+  proto.readFieldEnd();
+  proto.readFieldBegin(name, type, id);
+  proto.readStructEnd();
+}
+
+int main(int argc, char** argv) {
+  size_t records = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+  size_t iterations = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10;
+
+  auto buffer = std::make_shared<TMemoryBuffer>();
+  TJSONProtocol proto(buffer);
+  std::chrono::duration<double> writing(0);
+  std::chrono::duration<double> reading(0);
+  uint32_t bytes = 0;
+  for (size_t i = 0; i < iterations; ++i) {
+    buffer->resetBuffer();
+    auto start = std::chrono::steady_clock::now();
+    writeResponse(proto, records);
+    auto middle = std::chrono::steady_clock::now();
+    bytes = buffer->available_read();
+    readResponse(proto);
+    buffer->readEnd();
+    writing += middle - start;
+    reading += std::chrono::steady_clock::now() - middle;
+  }
+
+  double total = static_cast<double>(bytes) * iterations / 1e6;
+  std::cout << records << " records, " << bytes << " bytes of JSON" << '\n';
+  std::cout << "write: " << total / writing.count() << " MB/s" << '\n';
+  std::cout << "read:  " << total / reading.count() << " MB/s" << '\n';
+  return 0;
+}
@@ -0,0 +1,40 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// generated with cpp:lazy, see TLazyFieldTest.cpp
+namespace cpp thrift.test.lazy
+
+struct LazyItem {
+  1: string name,
+  2: i32 count,
+}
+
+struct LazyPayload {
+  1: list<LazyItem> items,
+  2: map<string, list<i32>> index,
+  3: set<binary> blobs,
+}
+
+struct LazyRequest {
+  1: string route,
+  2: LazyPayload payload,
+  3: list<LazyItem> items,
+  4: optional LazyPayload extra,
+  5: map<i32, string> notes (cpp.lazy = "false"),
+}
@@ -23,6 +23,7 @@
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
 #include <boost/thread.hpp>
+#include <algorithm>
 #include <memory>
 #include <openssl/opensslv.h>
 #include <thrift/transport/TSSLServerSocket.h>
@@ -33,6 +34,7 @@
 #include <signal.h>
 #endif
 
+using apache::thrift::transport::TIOVec;
 using apache::thrift::transport::TSSLServerSocket;
 using apache::thrift::transport::TServerTransport;
 using apache::thrift::transport::TSSLSocket;
@@ -288,4 +290,71 @@ BOOST_AUTO_TEST_CASE(ssl_security_matrix)
     }
 }
 
+BOOST_AUTO_TEST_CASE(ssl_kernel_tls)
+{
+    // kTLS is used where OpenSSL, the kernel and the cipher allow it and
+    // skipped elsewhere; either way data must arrive intact, including what
+    // writev() gathers into one send when the kernel does the framing
+    std::vector<uint8_t> payload(1024 * 1024 + 7);
+    for (size_t i = 0; i < payload.size(); ++i)
+    {
+        payload[i] = static_cast<uint8_t>(i * 7 + (i >> 12));
+    }
+
+    shared_ptr<TSSLSocketFactory> pServerSocketFactory(new TSSLSocketFactory());
+    pServerSocketFactory->kernelTLS(true);
+    pServerSocketFactory->loadCertificate(certFile("server.crt").string().c_str());
+    pServerSocketFactory->loadPrivateKey(certFile("server.key").string().c_str());
+    pServerSocketFactory->server(true);
+    TSSLServerSocket serverSocket("localhost", 0, pServerSocketFactory);
+    serverSocket.listen();
+
+    std::string serverError;
+    bool serverKernelSend = false;
+    boost::thread echo([&] {
+        try
+        {
+            shared_ptr<TTransport> accepted = serverSocket.accept();
+            std::vector<uint8_t> buf(payload.size());
+            accepted->readAll(&buf[0], static_cast<uint32_t>(buf.size()));
+            serverKernelSend = std::static_pointer_cast<TSSLSocket>(accepted)->kernelTLSSend();
+            uint8_t header[4] = {'E', 'C', 'H', 'O'};
+            TIOVec iov[2] = {{header, 4}, {&buf[0], static_cast<uint32_t>(buf.size())}};
+            accepted->writev(iov, 2);
+            accepted->flush();
+            accepted->close();
+        }
+        catch (std::exception& ex)
+        {
+            serverError = ex.what();
+        }
+    });
+
+    shared_ptr<TSSLSocketFactory> pClientSocketFactory(new TSSLSocketFactory());
+    pClientSocketFactory->kernelTLS(true);
+    pClientSocketFactory->authenticate(true);
+    pClientSocketFactory->loadCertificate(certFile("client.crt").string().c_str());
+    pClientSocketFactory->loadPrivateKey(certFile("client.key").string().c_str());
+    pClientSocketFactory->loadTrustedCertificates(certFile("CA.pem").string().c_str());
+    shared_ptr<TSSLSocket> pClientSocket = pClientSocketFactory->createSocket("localhost", serverSocket.getPort());
+    pClientSocket->open();
+    uint32_t half = static_cast<uint32_t>(payload.size() / 2);
+    pClientSocket->write(&payload[0], 1000);
+    TIOVec iov[2] = {{&payload[1000], half - 1000},
+                     {&payload[half], static_cast<uint32_t>(payload.size()) - half}};
+    pClientSocket->writev(iov, 2);
+    pClientSocket->flush();
+
+    std::vector<uint8_t> echoed(payload.size() + 4);
+    pClientSocket->readAll(&echoed[0], static_cast<uint32_t>(echoed.size()));
+    echo.join();
+    BOOST_CHECK_EQUAL(serverError, "");
+    BOOST_CHECK_EQUAL(0, memcmp(&echoed[0], "ECHO", 4));
+    BOOST_CHECK(std::equal(payload.begin(), payload.end(), echoed.begin() + 4));
+    BOOST_TEST_MESSAGE(boost::format("kTLS: client send %1% receive %2%, server send %3%")
+        % pClientSocket->kernelTLSSend() % pClientSocket->kernelTLSReceive() % serverKernelSend);
+    pClientSocket->close();
+    serverSocket.close();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,168 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <thrift/TArena.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+
+#include "gen-cpp/ArenaTemplatesTest_types.h"
+#include "gen-cpp/ArenaTest_types.h"
+
+using apache::thrift::TArena;
+using apache::thrift::TArenaScope;
+using apache::thrift::TArenaString;
+using apache::thrift::TArenaVector;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TBinaryProtocolT;
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::protocol::TCompactProtocolT;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::transport::TMemoryBuffer;
+using thrift::test::arena::ArenaItem;
+using thrift::test::arena::ArenaPerf;
+using thrift::test::arena_templates::ArenaTemplatesItem;
+
+BOOST_AUTO_TEST_SUITE(TArenaTest)
+
+BOOST_AUTO_TEST_CASE(test_allocate_align_reset) {
+  TArena arena(64);
+  for (size_t i = 0; i < 1000; ++i) {
+    size_t align = (i % 2) ? 8 : 16;
+    void* p = arena.allocate(i % 37 + 1, align);
+    BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(p) % align, 0u);
+  }
+  arena.allocate(4 * TArena::MAX_BLOCK_SIZE);
+  BOOST_CHECK(arena.getBytesReserved() > 4 * TArena::MAX_BLOCK_SIZE);
+
+  arena.reset();
+  BOOST_CHECK_EQUAL(arena.getBytesAllocated(), 0u);
+  BOOST_CHECK(arena.getBytesReserved() < 4 * TArena::MAX_BLOCK_SIZE);
+  BOOST_CHECK(arena.allocate(10) != nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(test_scope_selects_arena) {
+  TArena arena;
+  BOOST_CHECK(TArena::current() == nullptr);
+  {
+    TArenaScope scope(&arena);
+    BOOST_CHECK(TArena::current() == &arena);
+    TArenaVector<TArenaString> v;
+    v.push_back(TArenaString(100, 'x'));
+    BOOST_CHECK(v.get_allocator().arena() == &arena);
+    BOOST_CHECK(v[0].get_allocator().arena() == &arena);
+    {
+      TArenaScope heap(nullptr);
+      BOOST_CHECK(TArena::current() == nullptr);
+    }
+    BOOST_CHECK(TArena::current() == &arena);
+  }
+  BOOST_CHECK(TArena::current() == nullptr);
+  BOOST_CHECK(arena.getBytesAllocated() > 100u);
+}
+
+static ArenaPerf makePerf() {
+  ArenaPerf perf;
+  for (int i = 0; i < 20; ++i) {
+    ArenaItem item;
+    item.name = "item";
+    item.id = i;
+    item.tags.push_back(TArenaString(40, static_cast<char>('a' + i)));
+    item.tags.push_back("tag");
+    item.counts["count"] = i;
+    item.payload = TArenaString(3, '\0');
+    item.flags.push_back(i % 2 == 0);
+    perf.items.push_back(item);
+  }
+  return perf;
+}
+
+template <typename Protocol_>
+static void checkRoundTrip() {
+  ArenaPerf perf = makePerf();
+  std::shared_ptr<TMemoryBuffer> buf(new TMemoryBuffer());
+  Protocol_ prot(buf);
+  perf.write(&prot);
+
+  TArena arena;
+  ArenaPerf kept;
+  {
+    TArenaScope scope(&arena);
+    ArenaPerf read;
+    read.read(&prot);
+    BOOST_CHECK(read == perf);
+    BOOST_CHECK(read.items[5].name.get_allocator().arena() == &arena);
+    BOOST_CHECK(read.items[5].tags[0].get_allocator().arena() == &arena);
+    BOOST_CHECK(read.items[5].counts.begin()->first.get_allocator().arena() == &arena);
+
+    // assigning into an object keeps its own memory source
+    kept = read;
+    BOOST_CHECK(kept.items.get_allocator().arena() == nullptr);
+    BOOST_CHECK(kept.items[5].name.get_allocator().arena() == nullptr);
+  }
+  BOOST_CHECK(arena.getBytesAllocated() > 0u);
+  arena.reset();
+  BOOST_CHECK(kept == perf);
+}
+
+BOOST_AUTO_TEST_CASE(test_binary_round_trip) {
+  checkRoundTrip<TBinaryProtocol>();
+}
+
+BOOST_AUTO_TEST_CASE(test_compact_round_trip) {
+  checkRoundTrip<TCompactProtocol>();
+}
+
+// cpp:templates,arena code calls the protocol's own string overloads
+template <typename Protocol_>
+static void checkTemplatesRoundTrip() {
+  ArenaTemplatesItem item;
+  item.name = "item";
+  item.id = 7;
+  item.tags.push_back(TArenaString(40, 'x'));
+  item.counts["count"] = 3;
+  item.payload = TArenaString(3, '\0');
+  item.labels.insert("label");
+  std::shared_ptr<TMemoryBuffer> buf(new TMemoryBuffer());
+  Protocol_ prot(buf);
+  item.write(&prot);
+
+  TArena arena;
+  {
+    TArenaScope scope(&arena);
+    ArenaTemplatesItem read;
+    read.read(&prot);
+    BOOST_CHECK(read == item);
+    BOOST_CHECK(read.name.get_allocator().arena() == &arena);
+    BOOST_CHECK(read.labels.begin()->get_allocator().arena() == &arena);
+  }
+  BOOST_CHECK(arena.getBytesAllocated() > 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_templates_binary_round_trip) {
+  checkTemplatesRoundTrip<TBinaryProtocolT<TMemoryBuffer> >();
+}
+
+BOOST_AUTO_TEST_CASE(test_templates_compact_round_trip) {
+  checkTemplatesRoundTrip<TCompactProtocolT<TMemoryBuffer> >();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
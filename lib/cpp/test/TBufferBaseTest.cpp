@@ -19,11 +19,15 @@
 
 #include <algorithm>
 #include <boost/test/unit_test.hpp>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
 #include <thrift/transport/TBufferTransports.h>
 #include <thrift/transport/TShortReadTransport.h>
 #include <memory>
 
 using std::shared_ptr;
+using apache::thrift::protocol::TBinaryProtocolT;
+using apache::thrift::protocol::TCompactProtocolT;
 using apache::thrift::transport::TMemoryBuffer;
 using apache::thrift::transport::TBufferedTransport;
 using apache::thrift::transport::TFramedTransport;
@@ -519,6 +523,92 @@ BOOST_AUTO_TEST_CASE( test_FramedTransport_Write ) {
   }
 }
 
+BOOST_AUTO_TEST_CASE( test_FramedTransport_Write_Reference ) {
+  init_data();
+
+  uint32_t thresholds[] = { 1, 16, 64, 1<<10 };
+
+  for (uint32_t threshold : thresholds) {
+    for (auto & d1 : dist) {
+      shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer(16));
+      TFramedTransport trans(buffer);
+      trans.setReferenceThreshold(threshold);
+
+      int offset = 0;
+      int index = 0;
+      while (offset < 1<<15) {
+        trans.writeReference(&data[offset], d1[index]);
+        offset += d1[index];
+        index++;
+      }
+      BOOST_CHECK_EQUAL(trans.writeEnd(), (uint32_t)(sizeof(int32_t) + (1<<15)));
+      trans.flush();
+
+      int32_t frame_size = -1;
+      buffer->read(reinterpret_cast<uint8_t*>(&frame_size), sizeof(frame_size));
+      frame_size = (int32_t)ntohl((uint32_t)frame_size);
+      BOOST_CHECK_EQUAL(frame_size, 1<<15);
+      string output = buffer->getBufferAsString();
+      BOOST_CHECK_EQUAL(data_str, output);
+
+      // the next frame must not carry any of the references of the last one
+      buffer->resetBuffer();
+      trans.writeReference(&data[0], 8);
+      trans.flush();
+      BOOST_CHECK_EQUAL(buffer->getBufferAsString().size(), 12u);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE( test_FramedTransport_Write_Reference_Protocol ) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  shared_ptr<TFramedTransport> trans(new TFramedTransport(buffer));
+  trans->setReferenceThreshold(4);
+  TBinaryProtocolT<TFramedTransport> prot(trans);
+
+  // Integers are written from stack temporaries and must always be copied.
+  prot.writeI32(0x11223344);
+  prot.writeI32(0x55667788);
+  trans->flush();
+  const uint8_t ints[] = { 0, 0, 0, 8, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88 };
+  BOOST_CHECK_EQUAL(buffer->getBufferAsString(),
+                    string(reinterpret_cast<const char*>(ints), sizeof(ints)));
+
+  // String bodies are referenced, so a change before flush() goes out.
+  buffer->resetBuffer();
+  string str("abcdefgh");
+  prot.writeString(str);
+  str[0] = 'x';
+  trans->flush();
+  const uint8_t strs[] = { 0, 0, 0, 12, 0, 0, 0, 8, 'x', 'b', 'c', 'd', 'e', 'f', 'g', 'h' };
+  BOOST_CHECK_EQUAL(buffer->getBufferAsString(),
+                    string(reinterpret_cast<const char*>(strs), sizeof(strs)));
+
+  // The same holds for the compact protocol, including its packed arrays.
+  buffer->resetBuffer();
+  TCompactProtocolT<TFramedTransport> cprot(trans);
+  const int64_t values[] = { 1, 2, 3 };
+  const int64_t more_values[] = { 4, 5, 6 };
+  cprot.writeI64Array(values, 3);
+  cprot.writeI64Array(more_values, 3);
+  str = "abcdefgh";
+  cprot.writeBinary(str);
+  trans->flush();
+  shared_ptr<TMemoryBuffer> input(new TMemoryBuffer());
+  input->write(reinterpret_cast<const uint8_t*>(buffer->getBufferAsString().data()),
+               static_cast<uint32_t>(buffer->getBufferAsString().size()));
+  TCompactProtocolT<TFramedTransport> rprot(
+      shared_ptr<TFramedTransport>(new TFramedTransport(input)));
+  int64_t read_values[3];
+  rprot.readI64Array(read_values, 3);
+  BOOST_CHECK(std::equal(values, values + 3, read_values));
+  rprot.readI64Array(read_values, 3);
+  BOOST_CHECK(std::equal(more_values, more_values + 3, read_values));
+  string read_str;
+  rprot.readBinary(read_str);
+  BOOST_CHECK_EQUAL(read_str, str);
+}
+
 BOOST_AUTO_TEST_CASE( test_FramedTransport_Read ) {
   init_data();
 
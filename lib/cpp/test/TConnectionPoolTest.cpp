@@ -0,0 +1,162 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <thrift/transport/TConnectionPool.h>
+#include <thrift/transport/TServerSocket.h>
+
+using apache::thrift::transport::TConnectionPool;
+using apache::thrift::transport::TServerSocket;
+using apache::thrift::transport::TSocket;
+using apache::thrift::transport::TTransport;
+using apache::thrift::transport::TTransportException;
+using std::shared_ptr;
+
+BOOST_AUTO_TEST_SUITE(TConnectionPoolTest)
+
+/*
+ * A listening socket.  The connections the pool opens are accepted only
+ * when a test needs the server side of them.
+ */
+struct Server {
+  Server() : socket("localhost", 0) { socket.listen(); }
+
+  int port() { return socket.getPort(); }
+
+  void accept(size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      accepted.push_back(socket.accept());
+    }
+  }
+
+  TServerSocket socket;
+  std::vector<shared_ptr<TTransport> > accepted;
+};
+
+BOOST_AUTO_TEST_CASE(test_reuse_and_warm) {
+  Server server;
+  TConnectionPool pool;
+  pool.addServer("localhost", server.port());
+
+  shared_ptr<TSocket> first = pool.acquire();
+  BOOST_CHECK(first->isOpen());
+  pool.release(first);
+  for (int i = 0; i < 10; ++i) {
+    shared_ptr<TSocket> socket = pool.acquire();
+    BOOST_CHECK(socket == first);
+    pool.release(socket);
+  }
+  BOOST_CHECK_EQUAL(pool.getIdleCount(), 1u);
+
+  pool.warm(3);
+  BOOST_CHECK_EQUAL(pool.getIdleCount(), 3u);
+
+  {
+    // a lease that is not released is taken to be broken
+    TConnectionPool::Lease lease(pool);
+    BOOST_CHECK_EQUAL(pool.getOutstanding("localhost", server.port()), 1u);
+  }
+  BOOST_CHECK_EQUAL(pool.getOutstanding("localhost", server.port()), 0u);
+  BOOST_CHECK_EQUAL(pool.getIdleCount(), 2u);
+  {
+    TConnectionPool::Lease lease(pool);
+    lease.release();
+  }
+  BOOST_CHECK_EQUAL(pool.getIdleCount(), 2u);
+
+  BOOST_CHECK_THROW(pool.release(std::make_shared<TSocket>()), TTransportException);
+}
+
+BOOST_AUTO_TEST_CASE(test_least_outstanding) {
+  Server server1;
+  Server server2;
+  TConnectionPool pool;
+  pool.addServer("localhost", server1.port());
+  pool.addServer("localhost", server2.port());
+
+  std::vector<shared_ptr<TSocket> > leased;
+  for (int i = 0; i < 6; ++i) {
+    leased.push_back(pool.acquire());
+  }
+  BOOST_CHECK_EQUAL(pool.getOutstanding("localhost", server1.port()), 3u);
+  BOOST_CHECK_EQUAL(pool.getOutstanding("localhost", server2.port()), 3u);
+
+  // free up server 2: the next leases go there, to its idle connections
+  for (auto& socket : leased) {
+    if (socket->getPort() == server2.port()) {
+      pool.release(socket);
+    }
+  }
+  for (int i = 0; i < 2; ++i) {
+    shared_ptr<TSocket> socket = pool.acquire();
+    BOOST_CHECK_EQUAL(socket->getPort(), server2.port());
+    BOOST_CHECK(std::find(leased.begin(), leased.end(), socket) != leased.end());
+  }
+  BOOST_CHECK_EQUAL(pool.getOutstanding("localhost", server2.port()), 2u);
+}
+
+BOOST_AUTO_TEST_CASE(test_dead_idle_connection) {
+  Server server;
+  TConnectionPool pool;
+  pool.addServer("localhost", server.port());
+  shared_ptr<TSocket> socket = pool.acquire();
+  server.accept(1);
+  pool.release(socket);
+
+  // the server drops the connection: it is noticed and replaced
+  server.accepted[0]->close();
+  shared_ptr<TSocket> replacement = pool.acquire();
+  BOOST_CHECK(replacement != socket);
+  BOOST_CHECK(replacement->isOpen());
+  BOOST_CHECK(!socket->isOpen());
+  server.accept(1);
+  pool.release(replacement);
+
+  server.accepted[1]->close();
+  pool.checkIdle();
+  BOOST_CHECK_EQUAL(pool.getIdleCount(), 0u);
+  BOOST_CHECK(!replacement->isOpen());
+}
+
+BOOST_AUTO_TEST_CASE(test_server_down) {
+  int deadPort;
+  {
+    TServerSocket dead("localhost", 0);
+    dead.listen();
+    deadPort = dead.getPort();
+  }
+  Server server;
+  TConnectionPool pool;
+  pool.addServer("localhost", deadPort);
+  pool.addServer("localhost", server.port());
+  for (int i = 0; i < 4; ++i) {
+    BOOST_CHECK_EQUAL(pool.acquire()->getPort(), server.port());
+  }
+
+  TConnectionPool empty;
+  empty.addServer("localhost", deadPort);
+  BOOST_CHECK_THROW(empty.acquire(), TTransportException);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
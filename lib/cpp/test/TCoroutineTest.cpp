@@ -0,0 +1,392 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Requires C++20; CMake only builds it when the compiler supports coroutines.
+ */
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <thrift/TApplicationException.h>
+#include <thrift/async/TAsyncProtocolProcessor.h>
+#include <thrift/async/TCoroutine.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+
+#include "gen-cpp/CoroStore.h"
+
+#define BOOST_TEST_MODULE TCoroutineTest
+#include <boost/test/unit_test.hpp>
+
+using apache::thrift::TApplicationException;
+using apache::thrift::async::TAsyncChannel;
+using apache::thrift::async::TAsyncProtocolProcessor;
+using apache::thrift::async::TChannelSend;
+using apache::thrift::async::TChannelSendAndRecv;
+using apache::thrift::async::TTask;
+using apache::thrift::protocol::TBinaryProtocolFactory;
+using apache::thrift::transport::TMemoryBuffer;
+using thrift::test::coro::CoroItem;
+using thrift::test::coro::CoroMissing;
+using thrift::test::coro::CoroStoreAsyncProcessor;
+using thrift::test::coro::CoroStoreCoroClient;
+using thrift::test::coro::CoroStoreCoroSvAdapter;
+using thrift::test::coro::CoroStoreCoroSvIf;
+
+namespace {
+
+/*
+ * A single threaded event loop: callbacks run in the order they were
+ * queued, once the test drains the loop.
+ */
+std::deque<std::function<void()> > pending;
+
+void runPending() {
+  while (!pending.empty()) {
+    std::function<void()> callback = pending.front();
+    pending.pop_front();
+    callback();
+  }
+}
+
+/*
+ * Suspends the awaiting coroutine until the loop resumes it.
+ */
+struct Yield {
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> waiter) {
+    pending.push_back([waiter]() { waiter.resume(); });
+  }
+  void await_resume() const noexcept {}
+};
+
+/*
+ * Answers every message from the loop, either by echoing it back or by
+ * passing it to an async processor.
+ */
+class LoopbackChannel : public TAsyncChannel {
+public:
+  explicit LoopbackChannel(std::shared_ptr<TAsyncProtocolProcessor> processor = nullptr)
+    : processor_(processor), sent_(0) {}
+
+  bool good() const override { return true; }
+  bool error() const override { return false; }
+  bool timedOut() const override { return false; }
+
+  void sendMessage(const VoidCallback& cob, TMemoryBuffer* message) override {
+    deliver(cob, message, nullptr);
+  }
+
+  void recvMessage(const VoidCallback& cob, TMemoryBuffer* message) override {
+    (void)cob;
+    (void)message;
+    BOOST_FAIL("recvMessage() is not used by coroutine clients");
+  }
+
+  void sendAndRecvMessage(const VoidCallback& cob,
+                          TMemoryBuffer* sendBuf,
+                          TMemoryBuffer* recvBuf) override {
+    deliver(cob, sendBuf, recvBuf);
+  }
+
+  int sent() const { return sent_; }
+
+private:
+  void deliver(const VoidCallback& cob, TMemoryBuffer* sendBuf, TMemoryBuffer* recvBuf) {
+    ++sent_;
+    std::string request = sendBuf->getBufferAsString();
+    if (!processor_) {
+      pending.push_back([cob, recvBuf, request]() {
+        if (recvBuf) {
+          recvBuf->resetBuffer();
+          recvBuf->write(reinterpret_cast<const uint8_t*>(request.data()),
+                         static_cast<uint32_t>(request.size()));
+        }
+        cob();
+      });
+      return;
+    }
+
+    std::shared_ptr<TMemoryBuffer> input(new TMemoryBuffer());
+    input->write(reinterpret_cast<const uint8_t*>(request.data()),
+                 static_cast<uint32_t>(request.size()));
+    std::shared_ptr<TMemoryBuffer> output(new TMemoryBuffer());
+    processor_->process(
+        [cob, recvBuf, output](bool) {
+          pending.push_back([cob, recvBuf, output]() {
+            if (recvBuf) {
+              std::string response = output->getBufferAsString();
+              recvBuf->resetBuffer();
+              recvBuf->write(reinterpret_cast<const uint8_t*>(response.data()),
+                             static_cast<uint32_t>(response.size()));
+            }
+            cob();
+          });
+        },
+        input,
+        output);
+  }
+
+  std::shared_ptr<TAsyncProtocolProcessor> processor_;
+  int sent_;
+};
+
+class StoreHandler : public CoroStoreCoroSvIf {
+public:
+  StoreHandler() : forgotten(0) {}
+
+  TTask<int32_t> ping() override { co_return 7; }
+
+  TTask<CoroItem> get(std::string name) override {
+    co_await Yield();
+    auto found = items.find(name);
+    if (found == items.end()) {
+      CoroMissing missing;
+      missing.name = name;
+      throw missing;
+    }
+    co_return found->second;
+  }
+
+  TTask<std::vector<std::string> > names() override {
+    std::vector<std::string> result;
+    for (auto& item : items) {
+      result.push_back(item.first);
+    }
+    co_return result;
+  }
+
+  TTask<void> put(CoroItem item) override {
+    co_await Yield();
+    if (item.count < 0) {
+      throw std::runtime_error("negative count");
+    }
+    items[item.name] = item;
+  }
+
+  TTask<void> forget(std::string name) override {
+    co_await Yield();
+    items.erase(name);
+    ++forgotten;
+  }
+
+  std::map<std::string, CoroItem> items;
+  int forgotten;
+};
+
+TTask<int> answer() {
+  co_return 42;
+}
+
+TTask<int> answerLater() {
+  co_await Yield();
+  co_return 42;
+}
+
+TTask<void> failLater() {
+  co_await Yield();
+  throw std::runtime_error("failed");
+}
+
+TTask<int> sum(int count) {
+  std::vector<TTask<int> > parts;
+  for (int i = 0; i < count; ++i) {
+    parts.push_back(answerLater());
+  }
+  int total = 0;
+  for (auto& part : parts) {
+    total += co_await part;
+  }
+  co_return total;
+}
+
+TTask<bool> catchFailure() {
+  try {
+    co_await failLater();
+  } catch (const std::runtime_error&) {
+    co_return true;
+  }
+  co_return false;
+}
+
+TTask<void> record(int& steps) {
+  ++steps;
+  co_await Yield();
+  ++steps;
+}
+
+CoroItem makeItem(const std::string& name, int32_t count) {
+  CoroItem item;
+  item.name = name;
+  item.count = count;
+  return item;
+}
+}
+
+BOOST_AUTO_TEST_SUITE(TCoroutineTest)
+
+BOOST_AUTO_TEST_CASE(test_task_runs_eagerly) {
+  TTask<int> task = answer();
+  BOOST_CHECK(task.done());
+
+  TTask<int> later = answerLater();
+  BOOST_CHECK(!later.done());
+  runPending();
+  BOOST_CHECK(later.done());
+}
+
+BOOST_AUTO_TEST_CASE(test_task_await) {
+  TTask<int> task = sum(10);
+  BOOST_CHECK(!task.done());
+  runPending();
+  BOOST_REQUIRE(task.done());
+
+  TTask<int> outer = [](TTask<int>& inner) -> TTask<int> { co_return co_await inner; }(task);
+  BOOST_REQUIRE(outer.done());
+  int result = 0;
+  [](TTask<int>& t, int& out) -> TTask<void> { out = co_await t; }(outer, result);
+  BOOST_CHECK_EQUAL(result, 420);
+}
+
+BOOST_AUTO_TEST_CASE(test_task_exception) {
+  TTask<bool> task = catchFailure();
+  runPending();
+  BOOST_REQUIRE(task.done());
+  bool caught = false;
+  [](TTask<bool>& t, bool& out) -> TTask<void> { out = co_await t; }(task, caught);
+  BOOST_CHECK(caught);
+}
+
+BOOST_AUTO_TEST_CASE(test_task_dropped) {
+  int steps = 0;
+  {
+    TTask<void> task = record(steps);
+    BOOST_CHECK_EQUAL(steps, 1);
+  }
+  // the dropped task still runs to completion and frees itself
+  runPending();
+  BOOST_CHECK_EQUAL(steps, 2);
+}
+
+BOOST_AUTO_TEST_CASE(test_channel_awaitables) {
+  LoopbackChannel channel;
+  TMemoryBuffer sendBuf;
+  TMemoryBuffer recvBuf;
+  sendBuf.write(reinterpret_cast<const uint8_t*>("hello"), 5);
+
+  bool sent = false;
+  std::string received;
+  TTask<void> task = [](LoopbackChannel& channel,
+                        TMemoryBuffer& sendBuf,
+                        TMemoryBuffer& recvBuf,
+                        bool& sent,
+                        std::string& received) -> TTask<void> {
+    co_await TChannelSend(channel, &sendBuf);
+    sent = true;
+    co_await TChannelSendAndRecv(channel, &sendBuf, &recvBuf);
+    received = recvBuf.getBufferAsString();
+  }(channel, sendBuf, recvBuf, sent, received);
+
+  // nothing resumes the coroutine before the channel completes
+  BOOST_CHECK(!sent);
+  BOOST_CHECK_EQUAL(channel.sent(), 1);
+  runPending();
+  BOOST_CHECK(task.done());
+  BOOST_CHECK(sent);
+  BOOST_CHECK_EQUAL(channel.sent(), 2);
+  BOOST_CHECK_EQUAL(received, "hello");
+}
+
+BOOST_AUTO_TEST_CASE(test_client_adapter_round_trip) {
+  std::shared_ptr<StoreHandler> handler(new StoreHandler());
+  std::shared_ptr<TBinaryProtocolFactory> protocolFactory(new TBinaryProtocolFactory());
+  std::shared_ptr<TAsyncProtocolProcessor> processor(new TAsyncProtocolProcessor(
+      std::make_shared<CoroStoreAsyncProcessor>(std::make_shared<CoroStoreCoroSvAdapter>(handler)),
+      protocolFactory));
+  std::shared_ptr<LoopbackChannel> channel(new LoopbackChannel(processor));
+  CoroStoreCoroClient client(channel, protocolFactory);
+
+  struct Outcome {
+    int32_t ping = 0;
+    int inFlight = 0;
+    int32_t total = 0;
+    size_t names = 0;
+    std::string missing;
+    std::string undeclared;
+  } outcome;
+
+  TTask<void> task = [](CoroStoreCoroClient& client,
+                        LoopbackChannel& channel,
+                        Outcome& outcome) -> TTask<void> {
+    outcome.ping = co_await client.ping();
+
+    // calls are started back to back and all in flight before any is awaited
+    std::vector<TTask<void> > puts;
+    for (int i = 0; i < 100; ++i) {
+      puts.push_back(client.put(makeItem("item" + std::to_string(i), i)));
+    }
+    outcome.inFlight = channel.sent();
+    for (auto& put : puts) {
+      co_await put;
+    }
+
+    std::vector<TTask<CoroItem> > gets;
+    for (int i = 0; i < 100; ++i) {
+      gets.push_back(client.get("item" + std::to_string(i)));
+    }
+    for (auto& get : gets) {
+      outcome.total += (co_await get).count;
+    }
+
+    outcome.names = (co_await client.names()).size();
+
+    try {
+      co_await client.get("nothing");
+    } catch (const CoroMissing& missing) {
+      outcome.missing = missing.name;
+    }
+
+    try {
+      co_await client.put(makeItem("bad", -1));
+    } catch (const TApplicationException& e) {
+      outcome.undeclared = e.what();
+    }
+
+    co_await client.forget("item0");
+  }(client, *channel, outcome);
+
+  runPending();
+  BOOST_REQUIRE(task.done());
+  BOOST_CHECK_EQUAL(outcome.ping, 7);
+  BOOST_CHECK_EQUAL(outcome.inFlight, 101);
+  BOOST_CHECK_EQUAL(outcome.total, 4950);
+  BOOST_CHECK_EQUAL(outcome.names, 100u);
+  BOOST_CHECK_EQUAL(outcome.missing, "nothing");
+  BOOST_CHECK(outcome.undeclared.find("negative count") != std::string::npos);
+  BOOST_CHECK_EQUAL(handler->forgotten, 1);
+  BOOST_CHECK_EQUAL(handler->items.size(), 99u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -25,10 +25,19 @@
 #ifdef HAVE_SYS_TIME_H
 #include <sys/time.h>
 #endif
+#include <fcntl.h>
 #include <getopt.h>
 #include <boost/test/unit_test.hpp>
-
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <thrift/concurrency/ThreadFactory.h>
+#include <thrift/concurrency/ThreadManager.h>
+#include <thrift/protocol/TBinaryProtocol.h>
 #include <thrift/transport/TFileTransport.h>
+#include <thrift/transport/TMappedFileTransport.h>
 
 #ifdef __MINGW32__
   #include <io.h>
@@ -39,6 +48,13 @@
 #endif
 
 using namespace apache::thrift::transport;
+using apache::thrift::TProcessor;
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::Mutex;
+using apache::thrift::concurrency::ThreadFactory;
+using apache::thrift::concurrency::ThreadManager;
+using apache::thrift::protocol::TBinaryProtocolFactory;
+using apache::thrift::protocol::TProtocol;
 
 /**************************************************************************
  * Global state
@@ -336,6 +352,205 @@ BOOST_AUTO_TEST_CASE(test_noop_flush) {
   }
 }
 
+/**
+ * Writes events from several threads at once and reads them back: every
+ * event must come back whole, each thread's in the order written.
+ */
+void test_concurrent_writers_impl(bool direct_io) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+
+  const int num_threads = 4;
+  const int num_events = 5000;
+  {
+    TFileTransport transport(f.getPath());
+    // small enough for writers to wait on it, and for events to be padded
+    // out of chunk boundaries
+    transport.setWriteBufferSize(4096);
+    transport.setChunkSize(64 * 1024);
+    transport.setDirectIO(direct_io);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+      threads.emplace_back([&transport, t] {
+        for (int i = 0; i < num_events; ++i) {
+          std::string event = std::to_string(t) + ":" + std::to_string(i) + ":"
+                               + std::string(i % 100, 'x');
+          transport.write(reinterpret_cast<const uint8_t*>(event.data()),
+                          static_cast<uint32_t>(event.size()));
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    transport.flush();
+
+    TFileWriterStats stats = transport.getWriterStats();
+    BOOST_CHECK_EQUAL(stats.events, static_cast<uint64_t>(num_threads * num_events));
+    BOOST_CHECK_EQUAL(stats.droppedEvents, 0u);
+    BOOST_CHECK_GE(stats.syncs, 1u);
+    BOOST_CHECK_GE(stats.writes, 1u);
+  }
+
+  TFileTransport reader(f.getPath(), true);
+  reader.setChunkSize(64 * 1024);
+  std::map<int, int> next;
+  uint8_t buf[256];
+  int total = 0;
+  while (uint32_t len = reader.read(buf, sizeof(buf))) {
+    std::string event(reinterpret_cast<char*>(buf), len);
+    size_t colon1 = event.find(':');
+    size_t colon2 = event.find(':', colon1 + 1);
+    int t = std::stoi(event.substr(0, colon1));
+    int i = std::stoi(event.substr(colon1 + 1, colon2 - colon1 - 1));
+    BOOST_CHECK_EQUAL(i, next[t]);
+    BOOST_CHECK_EQUAL(event.size() - colon2 - 1, static_cast<size_t>(i % 100));
+    next[t] = i + 1;
+    ++total;
+  }
+  BOOST_CHECK_EQUAL(total, num_threads * num_events);
+}
+
+BOOST_AUTO_TEST_CASE(test_concurrent_writers) {
+  test_concurrent_writers_impl(false);
+}
+
+BOOST_AUTO_TEST_CASE(test_concurrent_writers_direct_io) {
+#ifdef O_DIRECT
+  // not every file system supports O_DIRECT (tmpfs does not)
+  TempFile probe(tmp_dir, "thrift.TFileTransportTest.");
+  int fd = open(probe.getPath(), O_WRONLY | O_DIRECT);
+  if (fd < 0) {
+    BOOST_TEST_MESSAGE("O_DIRECT is not supported in " << tmp_dir);
+    return;
+  }
+  close(fd);
+  test_concurrent_writers_impl(true);
+#endif
+}
+
+#ifndef _WIN32
+/**
+ * Writes num_events binary encoded i32 events, numbered from 0, with a
+ * chunk size small enough to spread them over several chunks.
+ */
+static const uint32_t mapped_chunk_size = 16 * 1024;
+
+void write_numbered_events(const char* path, int32_t num_events) {
+  TFileTransport transport(path);
+  transport.setChunkSize(mapped_chunk_size);
+  for (int32_t i = 0; i < num_events; ++i) {
+    // vary the size so that events get padded out of chunk boundaries
+    std::string event(5 + i % 61, 'x');
+    for (int b = 0; b < 4; ++b) {
+      event[b] = static_cast<char>(static_cast<uint32_t>(i) >> (24 - 8 * b));
+    }
+    transport.write(reinterpret_cast<const uint8_t*>(event.data()),
+                    static_cast<uint32_t>(event.size()));
+  }
+  transport.flush();
+}
+
+BOOST_AUTO_TEST_CASE(test_mapped_reader) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+  const int32_t num_events = 3000;
+  write_numbered_events(f.getPath(), num_events);
+
+  TMappedFileTransport reader(f.getPath());
+  reader.setChunkSize(mapped_chunk_size);
+  BOOST_CHECK_GT(reader.getNumChunks(), 2u);
+
+  uint8_t buf[128];
+  int32_t count = 0;
+  while (uint32_t len = reader.read(buf, sizeof(buf))) {
+    int32_t value = (buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+    BOOST_REQUIRE_EQUAL(value, count);
+    BOOST_CHECK_EQUAL(len, static_cast<uint32_t>(5 + count % 61));
+    ++count;
+  }
+  BOOST_CHECK_EQUAL(count, num_events);
+
+  // events come back in place, and chunks start where they did when written
+  reader.seekToChunk(1);
+  uint32_t len = 4;
+  const uint8_t* event = reader.borrow(nullptr, &len);
+  BOOST_REQUIRE(event != nullptr);
+  BOOST_CHECK_EQUAL(reader.getCurChunk(), 1u);
+  uint64_t offset = reader.findEvent(mapped_chunk_size);
+  BOOST_CHECK_EQUAL(reader.findEvent(offset), offset);
+  BOOST_CHECK_GT(reader.findEvent(offset + 1), offset);
+
+  reader.seekToEnd();
+  BOOST_CHECK_EQUAL(reader.read(buf, sizeof(buf)), 0u);
+}
+
+/**
+ * Records the number each event carries, and the chunk it was read from.
+ */
+class RecordingProcessor : public TProcessor {
+public:
+  bool process(std::shared_ptr<TProtocol> in,
+               std::shared_ptr<TProtocol> /* out */,
+               void* /* connectionContext */) override {
+    int32_t value;
+    in->readI32(value);
+    auto file = std::dynamic_pointer_cast<TMappedFileTransport>(in->getTransport());
+    uint32_t chunk = file->getCurChunk();
+    // skip the filler that makes events differ in size
+    uint8_t rest[64];
+    file->read(rest, sizeof(rest));
+
+    Guard g(mutex_);
+    events.push_back(std::make_pair(chunk, value));
+    return true;
+  }
+
+  Mutex mutex_;
+  std::vector<std::pair<uint32_t, int32_t> > events;
+};
+
+void test_parallel_replay_impl(bool in_order) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+  const int32_t num_events = 20000;
+  write_numbered_events(f.getPath(), num_events);
+
+  auto reader = std::make_shared<TMappedFileTransport>(f.getPath());
+  reader->setChunkSize(mapped_chunk_size);
+  auto processor = std::make_shared<RecordingProcessor>();
+  TFileProcessor fileProcessor(processor, std::make_shared<TBinaryProtocolFactory>(), reader);
+
+  std::shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(4);
+  threadManager->threadFactory(std::make_shared<ThreadFactory>());
+  threadManager->start();
+  fileProcessor.processParallel(threadManager, in_order);
+  threadManager->stop();
+
+  BOOST_REQUIRE_EQUAL(processor->events.size(), static_cast<size_t>(num_events));
+  std::vector<bool> seen(num_events, false);
+  std::map<uint32_t, int32_t> last;
+  for (auto& event : processor->events) {
+    BOOST_REQUIRE(event.second >= 0 && event.second < num_events);
+    BOOST_CHECK(!seen[event.second]);
+    seen[event.second] = true;
+    if (in_order) {
+      auto i = last.find(event.first);
+      if (i != last.end()) {
+        BOOST_CHECK_LT(i->second, event.second);
+      }
+      last[event.first] = event.second;
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_parallel_replay_in_order) {
+  test_parallel_replay_impl(true);
+}
+
+BOOST_AUTO_TEST_CASE(test_parallel_replay_unordered) {
+  test_parallel_replay_impl(false);
+}
+#endif
+
 /**************************************************************************
  * General Initialization
  **************************************************************************/
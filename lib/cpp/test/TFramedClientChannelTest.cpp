@@ -0,0 +1,283 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#define BOOST_TEST_MODULE TFramedClientChannelTest
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <event2/event.h>
+
+#include "thrift/TProcessor.h"
+#include "thrift/async/TFramedClientChannel.h"
+#include "thrift/concurrency/Monitor.h"
+#include "thrift/concurrency/Thread.h"
+#include "thrift/concurrency/ThreadFactory.h"
+#include "thrift/concurrency/ThreadManager.h"
+#include "thrift/protocol/TBinaryProtocol.h"
+#include "thrift/protocol/THeaderProtocol.h"
+#include "thrift/server/TNonblockingServer.h"
+#include "thrift/transport/TBufferTransports.h"
+#include "thrift/transport/TNonblockingServerSocket.h"
+
+using apache::thrift::TProcessor;
+using apache::thrift::async::TFramedClientChannel;
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::Monitor;
+using apache::thrift::concurrency::Mutex;
+using apache::thrift::concurrency::Runnable;
+using apache::thrift::concurrency::Thread;
+using apache::thrift::concurrency::ThreadFactory;
+using apache::thrift::concurrency::ThreadManager;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TBinaryProtocolFactory;
+using apache::thrift::protocol::THeaderProtocolFactory;
+using apache::thrift::protocol::TMessageType;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::protocol::TProtocolFactory;
+using apache::thrift::server::TNonblockingServer;
+using apache::thrift::server::TServerEventHandler;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TNonblockingServerSocket;
+using apache::thrift::transport::TTransportException;
+using apache::thrift::transport::TTransportFactory;
+using std::make_shared;
+using std::shared_ptr;
+
+/*
+ * Answers each "echo" call with its string argument.  Arguments starting
+ * with "slow" are answered late, and "close" drops the connection.
+ */
+class EchoProcessor : public TProcessor {
+public:
+  bool process(shared_ptr<TProtocol> in, shared_ptr<TProtocol> out, void*) override {
+    std::string name;
+    TMessageType type;
+    int32_t seqid;
+    std::string arg;
+    in->readMessageBegin(name, type, seqid);
+    in->readString(arg);
+    in->readMessageEnd();
+    in->getTransport()->readEnd();
+
+    if (arg == "close") {
+      throw TTransportException(TTransportException::END_OF_FILE, "closing");
+    }
+    if (arg.compare(0, 4, "slow") == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    out->writeMessageBegin(name, apache::thrift::protocol::T_REPLY, seqid);
+    out->writeString(arg);
+    out->writeMessageEnd();
+    out->getTransport()->writeEnd();
+    out->getTransport()->flush();
+    return true;
+  }
+};
+
+class Fixture {
+private:
+  struct ListenEventHandler : public TServerEventHandler {
+    ListenEventHandler() : ready_(false) {}
+
+    void preServe() override {
+      Guard g(monitor_.mutex());
+      ready_ = true;
+      monitor_.notify();
+    }
+
+    Monitor monitor_;
+    bool ready_;
+  };
+
+  struct Runner : public Runnable {
+    shared_ptr<TNonblockingServer> server;
+    void run() override { server->serve(); }
+  };
+
+protected:
+  Fixture() : eb_(event_base_new()), done_(0) {}
+
+  ~Fixture() {
+    channel_.reset();
+    if (server_) {
+      server_->stop();
+    }
+    if (thread_) {
+      thread_->join();
+    }
+    event_base_free(eb_);
+  }
+
+  /**
+   * Starts a single threaded framed server, or a header server processing
+   * up to four requests at once and answering them as they complete.
+   */
+  void startServer(bool header) {
+    shared_ptr<TNonblockingServerSocket> socket(new TNonblockingServerSocket(0));
+    shared_ptr<TProcessor> processor(new EchoProcessor);
+    if (header) {
+      shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(4);
+      threadManager->threadFactory(make_shared<ThreadFactory>());
+      threadManager->start();
+      server_.reset(new TNonblockingServer(processor,
+                                           make_shared<TTransportFactory>(),
+                                           make_shared<TTransportFactory>(),
+                                           make_shared<THeaderProtocolFactory>(),
+                                           shared_ptr<TProtocolFactory>(),
+                                           socket,
+                                           threadManager));
+      server_->setMaxPipelinedRequests(4);
+      server_->setAllowOutOfOrderResponses(true);
+    } else {
+      server_.reset(new TNonblockingServer(processor, make_shared<TBinaryProtocolFactory>(), socket));
+    }
+    shared_ptr<ListenEventHandler> listenHandler(new ListenEventHandler);
+    server_->setServerEventHandler(listenHandler);
+
+    shared_ptr<Runner> runner(new Runner);
+    runner->server = server_;
+    thread_ = ThreadFactory(false).newThread(runner);
+    thread_->start();
+
+    Guard g(listenHandler->monitor_.mutex());
+    while (!listenHandler->ready_) {
+      listenHandler->monitor_.wait();
+    }
+  }
+
+  void connect(TFramedClientChannel::Framing framing) {
+    channel_.reset(new TFramedClientChannel("localhost",
+                                            server_->getListenPort(),
+                                            eb_,
+                                            make_shared<TBinaryProtocolFactory>(),
+                                            framing));
+  }
+
+  /**
+   * Sends an echo call with seqid 0, as the generated cob clients do, and
+   * records the argument it was answered with ("" when it failed).
+   */
+  void call(const std::string& arg) {
+    shared_ptr<TMemoryBuffer> sendBuf(new TMemoryBuffer);
+    shared_ptr<TMemoryBuffer> recvBuf(new TMemoryBuffer);
+    TBinaryProtocol prot(sendBuf);
+    prot.writeMessageBegin("echo", apache::thrift::protocol::T_CALL, 0);
+    prot.writeString(arg);
+    prot.writeMessageEnd();
+
+    size_t index = results_.size();
+    results_.push_back("?");
+    channel_->sendAndRecvMessage(
+        [this, sendBuf, recvBuf, index]() {
+          ++done_;
+          completed_.push_back(index);
+          if (recvBuf->available_read() == 0) {
+            results_[index] = "";
+            return;
+          }
+          TBinaryProtocol prot(recvBuf);
+          std::string name;
+          TMessageType type;
+          int32_t seqid;
+          prot.readMessageBegin(name, type, seqid);
+          BOOST_CHECK_EQUAL(name, "echo");
+          BOOST_CHECK_EQUAL(seqid, 0);
+          prot.readString(results_[index]);
+        },
+        sendBuf.get(),
+        recvBuf.get());
+  }
+
+  /// Runs the event loop until every call made so far has completed
+  void wait() {
+    while (done_ < results_.size()) {
+      BOOST_REQUIRE_EQUAL(event_base_loop(eb_, EVLOOP_ONCE), 0);
+    }
+  }
+
+  event_base* eb_;
+  shared_ptr<TNonblockingServer> server_;
+  shared_ptr<Thread> thread_;
+  std::unique_ptr<TFramedClientChannel> channel_;
+  std::vector<std::string> results_;
+  std::vector<size_t> completed_;
+  size_t done_;
+};
+
+BOOST_FIXTURE_TEST_SUITE(TFramedClientChannelTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(framed_in_flight) {
+  startServer(false);
+  connect(TFramedClientChannel::FRAMED);
+
+  const int numCalls = 200;
+  for (int i = 0; i < numCalls; ++i) {
+    call(std::to_string(i));
+  }
+  BOOST_CHECK_EQUAL(channel_->getPendingCount(), static_cast<size_t>(numCalls));
+  wait();
+
+  BOOST_CHECK_EQUAL(channel_->getPendingCount(), 0u);
+  for (int i = 0; i < numCalls; ++i) {
+    BOOST_CHECK_EQUAL(results_[i], std::to_string(i));
+  }
+  BOOST_CHECK(channel_->good());
+}
+
+BOOST_AUTO_TEST_CASE(header_out_of_order) {
+  startServer(true);
+  connect(TFramedClientChannel::HEADER);
+
+  // the slow call is answered after the ones sent behind it
+  call("slow");
+  for (int i = 0; i < 20; ++i) {
+    call(std::to_string(i));
+  }
+  wait();
+
+  BOOST_CHECK_EQUAL(completed_.back(), 0u);
+  BOOST_CHECK_EQUAL(results_[0], "slow");
+  for (int i = 0; i < 20; ++i) {
+    BOOST_CHECK_EQUAL(results_[i + 1], std::to_string(i));
+  }
+  BOOST_CHECK(channel_->good());
+}
+
+BOOST_AUTO_TEST_CASE(connection_failure) {
+  startServer(false);
+  connect(TFramedClientChannel::FRAMED);
+
+  call("first");
+  call("close");
+  call("never");
+  wait();
+
+  BOOST_CHECK_EQUAL(results_[0], "first");
+  BOOST_CHECK_EQUAL(results_[1], "");
+  BOOST_CHECK_EQUAL(results_[2], "");
+  BOOST_CHECK(channel_->error());
+  BOOST_CHECK_THROW(call("again"), TTransportException);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
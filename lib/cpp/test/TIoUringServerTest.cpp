@@ -0,0 +1,210 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#define BOOST_TEST_MODULE TIoUringServerTest
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <memory>
+#include <string>
+
+#include "thrift/concurrency/Monitor.h"
+#include "thrift/concurrency/Thread.h"
+#include "thrift/concurrency/ThreadManager.h"
+#include "thrift/server/TIoUringServer.h"
+#include "thrift/transport/TNonblockingServerSocket.h"
+
+#include "gen-cpp/ParentService.h"
+
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::Monitor;
+using apache::thrift::concurrency::Mutex;
+using apache::thrift::concurrency::Runnable;
+using apache::thrift::concurrency::Thread;
+using apache::thrift::concurrency::ThreadFactory;
+using apache::thrift::concurrency::ThreadManager;
+using apache::thrift::server::TServerEventHandler;
+using std::make_shared;
+using std::shared_ptr;
+
+using namespace apache::thrift;
+
+struct Handler : public test::ParentServiceIf {
+  void addString(const std::string& s) override {
+    Guard g(mutex_);
+    strings_.push_back(s);
+  }
+  void getStrings(std::vector<std::string>& _return) override {
+    Guard g(mutex_);
+    _return = strings_;
+  }
+  Mutex mutex_;
+  std::vector<std::string> strings_;
+
+  // dummy overrides not used in this test
+  int32_t incrementGeneration() override { return 0; }
+  int32_t getGeneration() override { return 0; }
+  void getDataWait(std::string&, const int32_t) override {}
+  void onewayWait() override {}
+  void exceptionWait(const std::string&) override {}
+  void unexpectedExceptionWait(const std::string&) override {}
+};
+
+class Fixture {
+private:
+  struct ListenEventHandler : public TServerEventHandler {
+    public:
+      ListenEventHandler(Mutex* mutex) : listenMonitor_(mutex), ready_(false) {}
+
+      void preServe() override /* override */ {
+        Guard g(listenMonitor_.mutex());
+        ready_ = true;
+        listenMonitor_.notify();
+      }
+
+      Monitor listenMonitor_;
+      bool ready_;
+  };
+
+  struct Runner : public Runnable {
+    size_t numIOThreads;
+    shared_ptr<ThreadManager> threadManager;
+    shared_ptr<TProcessor> processor;
+    shared_ptr<server::TIoUringServer> server;
+    shared_ptr<ListenEventHandler> listenHandler;
+    shared_ptr<transport::TNonblockingServerSocket> socket;
+    Mutex mutex_;
+
+    Runner() : numIOThreads(1) {
+      listenHandler.reset(new ListenEventHandler(&mutex_));
+    }
+
+    void run() override {
+      socket.reset(new transport::TNonblockingServerSocket(0));
+      server.reset(new server::TIoUringServer(processor, socket, threadManager));
+      server->setNumIOThreads(numIOThreads);
+      server->setServerEventHandler(listenHandler);
+      server->serve();
+    }
+
+    void readyBarrier() {
+      // block until server is listening and ready to accept connections
+      Guard g(mutex_);
+      while (!listenHandler->ready_) {
+        listenHandler->listenMonitor_.wait();
+      }
+    }
+  };
+
+protected:
+  Fixture() : processor(new test::ParentServiceProcessor(make_shared<Handler>())) {}
+
+  ~Fixture() {
+    if (server) {
+      server->stop();
+    }
+    if (thread) {
+      thread->join();
+    }
+    if (threadManager) {
+      threadManager->stop();
+    }
+  }
+
+  void useThreadManager(size_t workers) {
+    threadManager = ThreadManager::newSimpleThreadManager(workers);
+    threadManager->threadFactory(make_shared<ThreadFactory>());
+    threadManager->start();
+  }
+
+  int startServer(size_t numIOThreads = 1) {
+    shared_ptr<Runner> runner(new Runner);
+    runner->numIOThreads = numIOThreads;
+    runner->processor = processor;
+    runner->threadManager = threadManager;
+
+    shared_ptr<ThreadFactory> threadFactory(
+        new ThreadFactory(false));
+    thread = threadFactory->newThread(runner);
+    thread->start();
+    runner->readyBarrier();
+
+    server = runner->server;
+    return server->getListenPort();
+  }
+
+  bool canCommunicate(int serverPort, const std::string& value = "foo") {
+    shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", serverPort));
+    socket->open();
+    test::ParentServiceClient client(make_shared<protocol::TBinaryProtocol>(
+        make_shared<transport::TFramedTransport>(socket)));
+    client.addString(value);
+    std::vector<std::string> strings;
+    client.getStrings(strings);
+    return std::find(strings.begin(), strings.end(), value) != strings.end();
+  }
+
+private:
+  shared_ptr<test::ParentServiceProcessor> processor;
+protected:
+  shared_ptr<ThreadManager> threadManager;
+  shared_ptr<server::TIoUringServer> server;
+private:
+  shared_ptr<apache::thrift::concurrency::Thread> thread;
+
+};
+
+BOOST_AUTO_TEST_SUITE(TIoUringServerTest)
+
+BOOST_FIXTURE_TEST_CASE(get_assigned_port, Fixture) {
+  if (!server::TIoUringServer::isSupported()) {
+    BOOST_TEST_MESSAGE("io_uring is not available, skipping");
+    return;
+  }
+  int assigned_port = startServer();
+  BOOST_REQUIRE_NE(assigned_port, 0);
+  BOOST_CHECK(canCommunicate(assigned_port));
+
+  server->stop();
+}
+
+BOOST_FIXTURE_TEST_CASE(multiple_io_threads, Fixture) {
+  if (!server::TIoUringServer::isSupported()) {
+    BOOST_TEST_MESSAGE("io_uring is not available, skipping");
+    return;
+  }
+  int port = startServer(4);
+  for (int i = 0; i < 16; ++i) {
+    BOOST_CHECK(canCommunicate(port, "foo" + std::to_string(i)));
+  }
+}
+
+BOOST_FIXTURE_TEST_CASE(thread_pool_processing, Fixture) {
+  if (!server::TIoUringServer::isSupported()) {
+    BOOST_TEST_MESSAGE("io_uring is not available, skipping");
+    return;
+  }
+  useThreadManager(4);
+  int port = startServer(2);
+  BOOST_CHECK(server->isThreadPoolProcessing());
+  for (int i = 0; i < 16; ++i) {
+    BOOST_CHECK(canCommunicate(port, "bar" + std::to_string(i)));
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
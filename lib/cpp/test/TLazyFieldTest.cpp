@@ -0,0 +1,176 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <thrift/TLazyField.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/protocol/TJSONProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+
+#include "gen-cpp/LazyTest_types.h"
+
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::protocol::TJSONProtocol;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::protocol::TProtocolException;
+using apache::thrift::transport::TBufferedTransport;
+using apache::thrift::transport::TMemoryBuffer;
+using thrift::test::lazy::LazyItem;
+using thrift::test::lazy::LazyPayload;
+using thrift::test::lazy::LazyRequest;
+
+BOOST_AUTO_TEST_SUITE(TLazyFieldTest)
+
+static LazyPayload makePayload(int n) {
+  LazyPayload payload;
+  std::vector<LazyItem> items;
+  for (int i = 0; i < n; ++i) {
+    LazyItem item;
+    item.name = "item" + std::to_string(i);
+    item.count = i;
+    items.push_back(item);
+  }
+  payload.items = items;
+  payload.index = std::map<std::string, std::vector<int32_t> >{{"a", {1, 2, 3}}, {"b", {}}};
+  payload.blobs = std::set<std::string>{std::string("\0\1\2", 3), "blob"};
+  return payload;
+}
+
+static LazyRequest makeRequest() {
+  LazyRequest request;
+  request.route = "route";
+  request.payload = makePayload(10);
+  request.items = makePayload(3).items.get();
+  request.notes[1] = "one";
+  return request;
+}
+
+template <typename Protocol>
+static std::string serialize(const LazyRequest& request) {
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol proto(buffer);
+  request.write(&proto);
+  return buffer->getBufferAsString();
+}
+
+template <typename Protocol>
+static LazyRequest deserialize(const std::string& data) {
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  buffer->write(reinterpret_cast<const uint8_t*>(data.data()), static_cast<uint32_t>(data.size()));
+  Protocol proto(buffer);
+  LazyRequest request;
+  request.read(&proto);
+  return request;
+}
+
+BOOST_AUTO_TEST_CASE(test_binary_round_trip) {
+  LazyRequest original = makeRequest();
+  std::string data = serialize<TBinaryProtocol>(original);
+
+  LazyRequest request = deserialize<TBinaryProtocol>(data);
+  BOOST_CHECK(request.payload.hasRaw());
+  BOOST_CHECK(!request.payload.isParsed());
+  BOOST_CHECK(!request.items.isParsed());
+  BOOST_CHECK(!request.__isset.extra);
+
+  // written back without ever being parsed
+  BOOST_CHECK(serialize<TBinaryProtocol>(request) == data);
+  BOOST_CHECK(!request.payload.isParsed());
+
+  BOOST_CHECK_EQUAL(request.payload->items->size(), 10u);
+  BOOST_CHECK_EQUAL(request.payload->items.get()[7].name, "item7");
+  BOOST_CHECK(request.payload.isParsed());
+  BOOST_CHECK(request.payload->index == original.payload->index);
+  BOOST_CHECK(request.payload->blobs == original.payload->blobs);
+  BOOST_CHECK(request == original);
+  BOOST_CHECK_EQUAL(request.notes.at(1), "one");
+}
+
+BOOST_AUTO_TEST_CASE(test_mutate_drops_raw) {
+  LazyRequest request = deserialize<TBinaryProtocol>(serialize<TBinaryProtocol>(makeRequest()));
+  request.items.mutate().resize(1);
+  BOOST_CHECK(!request.items.hasRaw());
+  BOOST_CHECK(request.payload.hasRaw());
+
+  LazyRequest copy = deserialize<TBinaryProtocol>(serialize<TBinaryProtocol>(request));
+  BOOST_CHECK_EQUAL(copy.items->size(), 1u);
+  BOOST_CHECK_EQUAL(copy.items.get()[0].name, "item0");
+  BOOST_CHECK(copy == request);
+}
+
+BOOST_AUTO_TEST_CASE(test_compact_and_cross_protocol) {
+  LazyRequest original = makeRequest();
+  std::string compact = serialize<TCompactProtocol>(original);
+  LazyRequest request = deserialize<TCompactProtocol>(compact);
+  BOOST_CHECK(request.payload.hasRaw());
+  BOOST_CHECK(serialize<TCompactProtocol>(request) == compact);
+
+  // a different output encoding parses and re-encodes the value
+  std::string binary = serialize<TBinaryProtocol>(request);
+  BOOST_CHECK(binary == serialize<TBinaryProtocol>(original));
+  BOOST_CHECK(deserialize<TBinaryProtocol>(binary) == original);
+}
+
+BOOST_AUTO_TEST_CASE(test_protocol_settings_change) {
+  LazyRequest original = makeRequest();
+  original.payload.mutate().index.mutate()["a key longer than the limit"] = std::vector<int32_t>();
+  std::string data = serialize<TBinaryProtocol>(original);
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  for (int i = 0; i < 2; ++i) {
+    buffer->write(reinterpret_cast<const uint8_t*>(data.data()),
+                  static_cast<uint32_t>(data.size()));
+  }
+  TBinaryProtocol proto(buffer);
+
+  LazyRequest first;
+  first.read(&proto);
+  BOOST_CHECK(first.payload.hasRaw());
+
+  // the value is scanned under the new limit, not by a clone of the old
+  // settings
+  proto.setStringSizeLimit(8);
+  LazyRequest second;
+  BOOST_CHECK_THROW(second.read(&proto), TProtocolException);
+}
+
+BOOST_AUTO_TEST_CASE(test_eager_fallback) {
+  LazyRequest original = makeRequest();
+
+  // the payload does not fit the read buffer, so it cannot be borrowed
+  std::string data = serialize<TBinaryProtocol>(original);
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  buffer->write(reinterpret_cast<const uint8_t*>(data.data()), static_cast<uint32_t>(data.size()));
+  std::shared_ptr<TBufferedTransport> buffered(new TBufferedTransport(buffer, 16));
+  TBinaryProtocol proto(buffered);
+  LazyRequest request;
+  request.read(&proto);
+  BOOST_CHECK(!request.payload.hasRaw());
+  BOOST_CHECK(request.payload.isParsed());
+  BOOST_CHECK(request == original);
+
+  // JSON cannot be captured at all
+  LazyRequest json = deserialize<TJSONProtocol>(serialize<TJSONProtocol>(original));
+  BOOST_CHECK(!json.payload.hasRaw());
+  BOOST_CHECK(json == original);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
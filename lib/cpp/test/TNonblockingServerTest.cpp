@@ -20,9 +20,13 @@
 #define BOOST_TEST_MODULE TNonblockingServerTest
 #include <boost/test/unit_test.hpp>
 #include <memory>
+#include <string>
+#include <vector>
 
+#include "thrift/concurrency/FunctionRunner.h"
 #include "thrift/concurrency/Monitor.h"
 #include "thrift/concurrency/Thread.h"
+#include "thrift/concurrency/ThreadManager.h"
 #include "thrift/server/TNonblockingServer.h"
 #include "thrift/transport/TNonblockingServerSocket.h"
 
@@ -30,10 +34,12 @@
 
 #include <event.h>
 
+using apache::thrift::concurrency::FunctionRunner;
 using apache::thrift::concurrency::Guard;
 using apache::thrift::concurrency::Monitor;
 using apache::thrift::concurrency::Mutex;
 using apache::thrift::concurrency::ThreadFactory;
+using apache::thrift::concurrency::ThreadManager;
 using apache::thrift::concurrency::Runnable;
 using apache::thrift::concurrency::Thread;
 using apache::thrift::concurrency::ThreadFactory;
@@ -57,6 +63,36 @@ struct Handler : public test::ParentServiceIf {
   void unexpectedExceptionWait(const std::string&) override {}
 };
 
+/*
+ * Takes longer for earlier requests of every four, so pipelined calls
+ * complete out of order, and records how many run at once.
+ */
+struct DelayHandler : public Handler {
+  DelayHandler() : active_(0), peak_(0) {}
+
+  void getDataWait(std::string& _return, const int32_t length) override {
+    {
+      Guard g(mutex_);
+      if (++active_ > peak_) {
+        peak_ = active_;
+      }
+    }
+    THRIFT_SLEEP_USEC((3 - length % 4) * 10000);
+    _return = std::to_string(length);
+    Guard g(mutex_);
+    --active_;
+  }
+
+  int peak() {
+    Guard g(mutex_);
+    return peak_;
+  }
+
+  Mutex mutex_;
+  int active_;
+  int peak_;
+};
+
 class Fixture {
 private:
   struct ListenEventHandler : public TServerEventHandler {
@@ -75,6 +111,11 @@ private:
 
   struct Runner : public Runnable {
     int port;
+    size_t numIOThreads;
+    size_t connectionStackLimit;
+    bool reusePort;
+    size_t maxPipelinedRequests;
+    shared_ptr<ThreadManager> threadManager;
     shared_ptr<event_base> userEventBase;
     shared_ptr<TProcessor> processor;
     shared_ptr<server::TNonblockingServer> server;
@@ -84,6 +125,10 @@ private:
 
     Runner() {
       port = 0;
+      numIOThreads = 0;
+      connectionStackLimit = 0;
+      reusePort = false;
+      maxPipelinedRequests = 1;
       listenHandler.reset(new ListenEventHandler(&mutex_));
     }
 
@@ -104,8 +149,20 @@ private:
     void startServer(int retry_count) {
       try {
         socket.reset(new transport::TNonblockingServerSocket(port));
-        server.reset(new server::TNonblockingServer(processor, socket));
+        socket->setReusePort(reusePort);
+        server.reset(new server::TNonblockingServer(processor,
+                                                    make_shared<protocol::TBinaryProtocolFactory>(),
+                                                    socket,
+                                                    threadManager));
         server->setServerEventHandler(listenHandler);
+        server->setUseReusePortListeners(reusePort);
+        server->setMaxPipelinedRequests(maxPipelinedRequests);
+        if (numIOThreads) {
+          server->setNumIOThreads(numIOThreads);
+        }
+        if (connectionStackLimit) {
+          server->setConnectionStackLimit(connectionStackLimit);
+        }
         if (userEventBase) {
           server->registerEvents(userEventBase.get());
         }
@@ -126,7 +183,12 @@ private:
   };
 
 protected:
-  Fixture() : processor(new test::ParentServiceProcessor(make_shared<Handler>())) {}
+  Fixture()
+    : processor(new test::ParentServiceProcessor(make_shared<Handler>())),
+      numIOThreads_(0),
+      connectionStackLimit_(0),
+      reusePort_(false),
+      maxPipelinedRequests_(1) {}
 
   ~Fixture() {
     if (server) {
@@ -141,11 +203,32 @@ protected:
     userEventBase_.reset(user_event_base, EventDeleter());
   }
 
+  void setNumIOThreads(size_t numIOThreads) { numIOThreads_ = numIOThreads; }
+
+  void setConnectionStackLimit(size_t limit) { connectionStackLimit_ = limit; }
+
+  void setReusePort(bool reusePort) { reusePort_ = reusePort; }
+
+  void setMaxPipelinedRequests(size_t count) { maxPipelinedRequests_ = count; }
+
+  void setHandler(const shared_ptr<test::ParentServiceIf>& handler) {
+    processor.reset(new test::ParentServiceProcessor(handler));
+  }
+
+  void setThreadManager(const shared_ptr<ThreadManager>& threadManager) {
+    threadManager_ = threadManager;
+  }
+
   int startServer(int port) {
     shared_ptr<Runner> runner(new Runner);
     runner->port = port;
     runner->processor = processor;
     runner->userEventBase = userEventBase_;
+    runner->numIOThreads = numIOThreads_;
+    runner->connectionStackLimit = connectionStackLimit_;
+    runner->reusePort = reusePort_;
+    runner->maxPipelinedRequests = maxPipelinedRequests_;
+    runner->threadManager = threadManager_;
 
     shared_ptr<ThreadFactory> threadFactory(
         new ThreadFactory(false));
@@ -168,9 +251,31 @@ protected:
     return strings.size() == 1 && !(strings[0].compare("foo"));
   }
 
+  void callAndClose(int serverPort) {
+    shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", serverPort));
+    socket->open();
+    test::ParentServiceClient client(make_shared<protocol::TBinaryProtocol>(
+        make_shared<transport::TFramedTransport>(socket)));
+    std::vector<std::string> strings;
+    client.getStrings(strings);
+  }
+
+  bool waitForIdle() {
+    // the server notices closed sockets asynchronously
+    for (int i = 0; i < 500 && server->getNumActiveConnections() > 0; ++i) {
+      THRIFT_SLEEP_USEC(10000);
+    }
+    return server->getNumActiveConnections() == 0;
+  }
+
 private:
   shared_ptr<event_base> userEventBase_;
   shared_ptr<test::ParentServiceProcessor> processor;
+  size_t numIOThreads_;
+  size_t connectionStackLimit_;
+  bool reusePort_;
+  size_t maxPipelinedRequests_;
+  shared_ptr<ThreadManager> threadManager_;
 protected:
   shared_ptr<server::TNonblockingServer> server;
 private:
@@ -212,4 +317,148 @@ BOOST_FIXTURE_TEST_CASE(provide_event_base, Fixture) {
 #endif
 }
 
+BOOST_FIXTURE_TEST_CASE(reuse_idle_connections, Fixture) {
+  setNumIOThreads(4);
+  startServer(0);
+  int port = server->getListenPort();
+
+  for (int i = 0; i < 32; ++i) {
+    callAndClose(port);
+  }
+  BOOST_REQUIRE(waitForIdle());
+
+  // closed connections went back to the caches and were picked up again
+  BOOST_CHECK_EQUAL(server->getNumIdleConnections(), server->getNumConnections());
+  BOOST_CHECK_LT(server->getNumConnections(), 32u);
+}
+
+BOOST_FIXTURE_TEST_CASE(limit_idle_connections, Fixture) {
+  setNumIOThreads(4);
+  setConnectionStackLimit(3);
+  startServer(0);
+  int port = server->getListenPort();
+
+  std::vector<shared_ptr<transport::TSocket> > sockets;
+  for (int i = 0; i < 10; ++i) {
+    sockets.push_back(make_shared<transport::TSocket>("localhost", port));
+    sockets.back()->open();
+  }
+  callAndClose(port);
+  BOOST_CHECK_GE(server->getNumConnections(), 10u);
+  sockets.clear();
+  BOOST_REQUIRE(waitForIdle());
+
+  // connections beyond the limit were freed rather than cached
+  BOOST_CHECK_EQUAL(server->getNumIdleConnections(), 3u);
+  BOOST_CHECK_EQUAL(server->getNumConnections(), 3u);
+}
+
+BOOST_FIXTURE_TEST_CASE(reuse_port_listeners, Fixture) {
+  setNumIOThreads(4);
+  setReusePort(true);
+  startServer(0);
+  int port = server->getListenPort();
+
+  // every IO thread accepts on a listener of its own; any of them will do
+  for (int i = 0; i < 32; ++i) {
+    callAndClose(port);
+  }
+  BOOST_CHECK(canCommunicate(port));
+  BOOST_CHECK(waitForIdle());
+}
+
+BOOST_FIXTURE_TEST_CASE(thread_pool_notifications, Fixture) {
+  shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(4);
+  threadManager->threadFactory(make_shared<ThreadFactory>());
+  threadManager->start();
+  setThreadManager(threadManager);
+  setNumIOThreads(2);
+  startServer(0);
+  int port = server->getListenPort();
+
+  // completions from several workers race to wake the same IO threads
+  std::vector<shared_ptr<Thread> > clients;
+  ThreadFactory clientFactory(false);
+  for (int i = 0; i < 8; ++i) {
+    clients.push_back(clientFactory.newThread(FunctionRunner::create([this, port] {
+      for (int j = 0; j < 50; ++j) {
+        callAndClose(port);
+      }
+    })));
+    clients.back()->start();
+  }
+  for (auto& client : clients) {
+    client->join();
+  }
+
+  BOOST_CHECK(waitForIdle());
+  BOOST_CHECK_EQUAL(server->getNumActiveProcessors(), 0u);
+}
+
+BOOST_FIXTURE_TEST_CASE(pipelined_requests, Fixture) {
+  shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(4);
+  threadManager->threadFactory(make_shared<ThreadFactory>());
+  threadManager->start();
+  setThreadManager(threadManager);
+  setMaxPipelinedRequests(4);
+  shared_ptr<DelayHandler> handler(new DelayHandler());
+  setHandler(handler);
+  startServer(0);
+  int port = server->getListenPort();
+
+  shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", port));
+  socket->open();
+  shared_ptr<transport::TFramedTransport> framed(new transport::TFramedTransport(socket));
+  protocol::TBinaryProtocol prot(framed);
+  test::ParentServiceClient client(make_shared<protocol::TBinaryProtocol>(framed));
+
+  // more requests than the server reads ahead, before reading any response
+  const int numRequests = 16;
+  for (int32_t i = 0; i < numRequests; ++i) {
+    test::ParentService_getDataWait_pargs args;
+    args.length = &i;
+    prot.writeMessageBegin("getDataWait", protocol::T_CALL, i);
+    args.write(&prot);
+    prot.writeMessageEnd();
+    framed->writeEnd();
+    framed->flush();
+  }
+
+  // the responses come back in request order, whatever order they completed in
+  for (int32_t i = 0; i < numRequests; ++i) {
+    std::string name;
+    protocol::TMessageType type;
+    int32_t seqid;
+    prot.readMessageBegin(name, type, seqid);
+    BOOST_CHECK_EQUAL(name, "getDataWait");
+    BOOST_CHECK_EQUAL(type, protocol::T_REPLY);
+    BOOST_CHECK_EQUAL(seqid, i);
+    std::string data;
+    test::ParentService_getDataWait_presult result;
+    result.success = &data;
+    result.read(&prot);
+    prot.readMessageEnd();
+    framed->readEnd();
+    BOOST_CHECK_EQUAL(data, std::to_string(i));
+  }
+  BOOST_CHECK_GT(handler->peak(), 1);
+  std::vector<std::string> strings;
+  client.getStrings(strings);
+  BOOST_CHECK(strings.empty());
+
+  // a client that goes away with requests in flight
+  shared_ptr<transport::TSocket> quitter(new transport::TSocket("localhost", port));
+  quitter->open();
+  test::ParentServiceClient quittingClient(make_shared<protocol::TBinaryProtocol>(
+      make_shared<transport::TFramedTransport>(quitter)));
+  for (int i = 0; i < numRequests; ++i) {
+    quittingClient.send_getStrings();
+  }
+  quitter->close();
+
+  socket->close();
+  BOOST_CHECK(waitForIdle());
+  BOOST_CHECK_EQUAL(server->getNumActiveProcessors(), 0u);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,270 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <thrift/TApplicationException.h>
+#include <thrift/processor/TProxyProcessor.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TVirtualTransport.h>
+
+using apache::thrift::TApplicationException;
+using apache::thrift::TProcessor;
+using apache::thrift::processor::TProxyProcessor;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::protocol::TMessageType;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::protocol::TType;
+using apache::thrift::transport::TFramedTransport;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TTransport;
+using apache::thrift::transport::TTransportException;
+using apache::thrift::transport::TVirtualTransport;
+using std::make_shared;
+using std::shared_ptr;
+
+BOOST_AUTO_TEST_SUITE(TProxyProcessorTest)
+
+/*
+ * The arguments and the result of the calls: { 1: string text, 2: list<i32> numbers }
+ */
+struct Payload {
+  std::string text;
+  std::vector<int32_t> numbers;
+};
+
+static void writePayload(TProtocol* prot, int16_t fid, const Payload& payload) {
+  prot->writeStructBegin("outer");
+  prot->writeFieldBegin("payload", apache::thrift::protocol::T_STRUCT, fid);
+  prot->writeStructBegin("Payload");
+  prot->writeFieldBegin("text", apache::thrift::protocol::T_STRING, 1);
+  prot->writeString(payload.text);
+  prot->writeFieldEnd();
+  prot->writeFieldBegin("numbers", apache::thrift::protocol::T_LIST, 2);
+  prot->writeListBegin(apache::thrift::protocol::T_I32, static_cast<uint32_t>(payload.numbers.size()));
+  for (int32_t n : payload.numbers) {
+    prot->writeI32(n);
+  }
+  prot->writeListEnd();
+  prot->writeFieldEnd();
+  prot->writeFieldStop();
+  prot->writeStructEnd();
+  prot->writeFieldEnd();
+  prot->writeFieldStop();
+  prot->writeStructEnd();
+}
+
+static Payload readPayload(TProtocol* prot) {
+  Payload payload;
+  std::string name;
+  TType ftype;
+  int16_t fid;
+  prot->readStructBegin(name);
+  prot->readFieldBegin(name, ftype, fid);
+  prot->readStructBegin(name);
+  while (true) {
+    prot->readFieldBegin(name, ftype, fid);
+    if (ftype == apache::thrift::protocol::T_STOP) {
+      break;
+    }
+    if (fid == 1) {
+      prot->readString(payload.text);
+    } else {
+      TType etype;
+      uint32_t size;
+      prot->readListBegin(etype, size);
+      payload.numbers.resize(size);
+      for (uint32_t i = 0; i < size; ++i) {
+        prot->readI32(payload.numbers[i]);
+      }
+      prot->readListEnd();
+    }
+    prot->readFieldEnd();
+  }
+  prot->readStructEnd();
+  prot->readFieldEnd();
+  prot->readFieldBegin(name, ftype, fid);
+  prot->readStructEnd();
+  return payload;
+}
+
+/*
+ * Answers each call with its arguments.  The text "fail" makes it drop the
+ * connection instead.
+ */
+class EchoProcessor : public TProcessor {
+public:
+  bool process(shared_ptr<TProtocol> in, shared_ptr<TProtocol> out, void*) override {
+    std::string name;
+    TMessageType type;
+    int32_t seqid;
+    in->readMessageBegin(name, type, seqid);
+    Payload payload = readPayload(in.get());
+    in->readMessageEnd();
+    in->getTransport()->readEnd();
+    lastName = name;
+
+    if (payload.text == "fail") {
+      throw TTransportException(TTransportException::END_OF_FILE, "closing");
+    }
+    if (type == apache::thrift::protocol::T_CALL) {
+      out->writeMessageBegin(name, apache::thrift::protocol::T_REPLY, seqid);
+      writePayload(out.get(), 0, payload);
+      out->writeMessageEnd();
+      out->getTransport()->writeEnd();
+      out->getTransport()->flush();
+    }
+    return true;
+  }
+
+  std::string lastName;
+};
+
+/*
+ * A backend connection that runs the echo processor over framed binary
+ * whenever a call is flushed.
+ */
+class Loopback : public TVirtualTransport<Loopback> {
+public:
+  explicit Loopback(shared_ptr<EchoProcessor> processor)
+    : processor_(processor),
+      request_(make_shared<TMemoryBuffer>()),
+      reply_(make_shared<TMemoryBuffer>()) {}
+
+  bool isOpen() const override { return true; }
+  uint32_t read(uint8_t* buf, uint32_t len) { return reply_->read(buf, len); }
+  void write(const uint8_t* buf, uint32_t len) { request_->write(buf, len); }
+
+  void flush() override {
+    processor_->process(make_shared<TBinaryProtocol>(make_shared<TFramedTransport>(request_)),
+                        make_shared<TBinaryProtocol>(make_shared<TFramedTransport>(reply_)),
+                        nullptr);
+  }
+
+private:
+  shared_ptr<EchoProcessor> processor_;
+  shared_ptr<TMemoryBuffer> request_;
+  shared_ptr<TMemoryBuffer> reply_;
+};
+
+struct Fixture {
+  Fixture() : backend(make_shared<EchoProcessor>()), connections(0) {
+    proxy.addRoute("Echo", [this] { return connect(); }, true);
+  }
+
+  shared_ptr<TProtocol> connect() {
+    ++connections;
+    return make_shared<TBinaryProtocol>(make_shared<TFramedTransport>(make_shared<Loopback>(backend)));
+  }
+
+  /*
+   * Sends one call through the proxy with the protocol P on the client side
+   * and returns the reply, or throws the exception it carries.
+   */
+  template <typename P>
+  Payload call(const std::string& name, const Payload& args) {
+    auto request = make_shared<TMemoryBuffer>();
+    auto reply = make_shared<TMemoryBuffer>();
+    P client(make_shared<TFramedTransport>(request));
+    client.writeMessageBegin(name, apache::thrift::protocol::T_CALL, 7);
+    writePayload(&client, 1, args);
+    client.writeMessageEnd();
+    client.getTransport()->flush();
+
+    BOOST_CHECK(proxy.process(make_shared<P>(make_shared<TFramedTransport>(request)),
+                              make_shared<P>(make_shared<TFramedTransport>(reply)),
+                              nullptr));
+
+    P result(make_shared<TFramedTransport>(reply));
+    std::string rname;
+    TMessageType rtype;
+    int32_t rseqid;
+    result.readMessageBegin(rname, rtype, rseqid);
+    BOOST_CHECK_EQUAL(rseqid, 7);
+    if (rtype == apache::thrift::protocol::T_EXCEPTION) {
+      TApplicationException x;
+      x.read(&result);
+      throw x;
+    }
+    return readPayload(&result);
+  }
+
+  TProxyProcessor proxy;
+  shared_ptr<EchoProcessor> backend;
+  int connections;
+};
+
+static Payload makePayload(const std::string& text) {
+  Payload payload;
+  payload.text = text;
+  for (int32_t i = 0; i < 100; ++i) {
+    payload.numbers.push_back(i * 1000);
+  }
+  return payload;
+}
+
+BOOST_FIXTURE_TEST_CASE(test_forward_verbatim, Fixture) {
+  for (int i = 0; i < 3; ++i) {
+    Payload reply = call<TBinaryProtocol>("Echo:echo", makePayload("hello"));
+    BOOST_CHECK_EQUAL(reply.text, "hello");
+    BOOST_CHECK(reply.numbers == makePayload("hello").numbers);
+  }
+  BOOST_CHECK_EQUAL(backend->lastName, "echo");
+  BOOST_CHECK_EQUAL(connections, 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(test_forward_reencoded, Fixture) {
+  // compact on the client side, binary on the backend side
+  Payload reply = call<TCompactProtocol>("Echo:echo", makePayload("compact"));
+  BOOST_CHECK_EQUAL(reply.text, "compact");
+  BOOST_CHECK(reply.numbers == makePayload("compact").numbers);
+}
+
+BOOST_FIXTURE_TEST_CASE(test_routing_errors, Fixture) {
+  try {
+    call<TBinaryProtocol>("Other:echo", makePayload("x"));
+    BOOST_FAIL("expected an exception");
+  } catch (TApplicationException& x) {
+    BOOST_CHECK_EQUAL(x.getType(), TApplicationException::UNKNOWN_METHOD);
+  }
+
+  try {
+    call<TBinaryProtocol>("Echo:echo", makePayload("fail"));
+    BOOST_FAIL("expected an exception");
+  } catch (TApplicationException& x) {
+    BOOST_CHECK_EQUAL(x.getType(), TApplicationException::INTERNAL_ERROR);
+  }
+
+  // the failed connection is not reused
+  BOOST_CHECK_EQUAL(call<TBinaryProtocol>("Echo:echo", makePayload("again")).text, "again");
+  BOOST_CHECK_EQUAL(connections, 2);
+
+  proxy.setDefaultRoute([this] { return connect(); });
+  BOOST_CHECK_EQUAL(call<TBinaryProtocol>("Other:echo", makePayload("x")).text, "x");
+  BOOST_CHECK_EQUAL(backend->lastName, "Other:echo");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
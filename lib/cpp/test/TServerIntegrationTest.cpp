@@ -426,6 +426,18 @@ BOOST_FIXTURE_TEST_CASE(test_threadpool_stress,
   stress(10, boost::posix_time::seconds(3));
 }
 
+BOOST_FIXTURE_TEST_CASE(test_threadpool_reuse_port_acceptors,
+                        TServerIntegrationProcessorTestFixture<TThreadPoolServer>) {
+  pServer->getThreadManager()->threadFactory(
+      shared_ptr<apache::thrift::concurrency::ThreadFactory>(
+          new apache::thrift::concurrency::ThreadFactory));
+  pServer->getThreadManager()->start();
+  std::dynamic_pointer_cast<TServerSocket>(pServer->getServerTransport())->setReusePort(true);
+  pServer->setNumAcceptorThreads(4);
+
+  stress(10, boost::posix_time::seconds(3));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 BOOST_FIXTURE_TEST_SUITE(TServerIntegrationTest,
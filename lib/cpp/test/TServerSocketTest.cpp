@@ -17,13 +17,27 @@
  * under the License.
  */
 
+#include <thrift/thrift-config.h>
+
 #include <boost/test/unit_test.hpp>
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/transport/PlatformSocket.h>
+#include <thrift/transport/TBufferTransports.h>
 #include <thrift/transport/TSocket.h>
 #include <thrift/transport/TServerSocket.h>
 #include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 #include "TTransportCheckThrow.h"
 #include <iostream>
 
+using apache::thrift::protocol::TBinaryProtocolT;
+using apache::thrift::transport::TFramedTransport;
+using apache::thrift::transport::TIOVec;
 using apache::thrift::transport::TServerSocket;
 using apache::thrift::transport::TSocket;
 using apache::thrift::transport::TTransport;
@@ -65,6 +79,133 @@ BOOST_AUTO_TEST_CASE(test_close_before_listen) {
   BOOST_CHECK(!sock1.isOpen());
 }
 
+BOOST_AUTO_TEST_CASE(test_reuse_port_listener) {
+  TServerSocket sock1("localhost", 0);
+  TTRANSPORT_CHECK_THROW(sock1.createReusePortListener(), TTransportException::BAD_ARGS);
+  sock1.setReusePort(true);
+  sock1.listen();
+  int port = sock1.getPort();
+
+  shared_ptr<TServerSocket> sock2
+      = std::dynamic_pointer_cast<TServerSocket>(sock1.createReusePortListener());
+  BOOST_REQUIRE(sock2);
+  BOOST_CHECK_EQUAL(port, sock2->getPort());
+  sock2->listen();
+  BOOST_CHECK(sock2->isOpen());
+
+  // the kernel picks the listener for every client, so drain both
+  std::vector<shared_ptr<TSocket> > clients;
+  for (int i = 0; i < 8; ++i) {
+    clients.push_back(std::make_shared<TSocket>("localhost", port));
+    clients.back()->open();
+  }
+  int accepted = 0;
+  for (int round = 0; round < 100 && accepted < 8; ++round) {
+    for (TServerSocket* sock : {&sock1, sock2.get()}) {
+      struct THRIFT_POLLFD fds[1];
+      fds[0].fd = sock->getSocketFD();
+      fds[0].events = THRIFT_POLLIN;
+      fds[0].revents = 0;
+      if (THRIFT_POLL(fds, 1, 10) > 0) {
+        sock->accept()->close();
+        ++accepted;
+      }
+    }
+  }
+  BOOST_CHECK_EQUAL(8, accepted);
+  sock2->close();
+  sock1.close();
+}
+
+// Sends iovcnt buffers of assorted sizes through TSocket::writev() and checks
+// the peer receives them in order, with and without MSG_ZEROCOPY.
+static void check_writev(uint32_t iovcnt, uint32_t zeroCopyThreshold) {
+  TServerSocket server("localhost", 0);
+  server.listen();
+  TSocket client("localhost", server.getPort());
+  client.setZeroCopyThreshold(zeroCopyThreshold);
+  client.open();
+  shared_ptr<TTransport> accepted = server.accept();
+
+  std::string expected;
+  std::vector<std::string> pieces;
+  for (uint32_t i = 0; i < iovcnt; ++i) {
+    pieces.push_back(std::string(1 + (i * 7919) % 20000, static_cast<char>('a' + i % 26)));
+    expected += pieces.back();
+  }
+  std::vector<TIOVec> iov;
+  for (const std::string& piece : pieces) {
+    iov.push_back(TIOVec{reinterpret_cast<const uint8_t*>(piece.data()),
+                         static_cast<uint32_t>(piece.size())});
+  }
+
+  // read concurrently, the payload is larger than the socket buffers
+  std::string received(expected.size(), '\0');
+  std::thread reader([&] {
+    accepted->readAll(reinterpret_cast<uint8_t*>(&received[0]),
+                      static_cast<uint32_t>(received.size()));
+  });
+  client.writev(iov.data(), static_cast<uint32_t>(iov.size()));
+  reader.join();
+  BOOST_CHECK(expected == received);
+
+  client.close();
+  accepted->close();
+  server.close();
+}
+
+BOOST_AUTO_TEST_CASE(test_writev) {
+  check_writev(1, 0);
+  check_writev(200, 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_writev_zero_copy) {
+  // ignored where the socket does not support MSG_ZEROCOPY
+  check_writev(3, 1);
+  check_writev(200, 64 * 1024);
+}
+
+BOOST_AUTO_TEST_CASE(test_framed_reference_over_socket) {
+  TServerSocket server("localhost", 0);
+  server.listen();
+  shared_ptr<TSocket> client(new TSocket("localhost", server.getPort()));
+  client->setZeroCopyThreshold(64 * 1024);
+  client->open();
+  shared_ptr<TTransport> accepted = server.accept();
+
+  shared_ptr<TFramedTransport> out(new TFramedTransport(client));
+  out->setReferenceThreshold(16);
+  TBinaryProtocolT<TFramedTransport> oprot(out);
+  std::string big(1 << 20, 'x');
+  std::string small("small");
+
+  std::string readBig, readSmall;
+  int32_t readInts[2] = {0, 0};
+  std::thread reader([&] {
+    shared_ptr<TFramedTransport> in(new TFramedTransport(accepted));
+    TBinaryProtocolT<TFramedTransport> iprot(in);
+    iprot.readI32(readInts[0]);
+    iprot.readString(readBig);
+    iprot.readI32(readInts[1]);
+    iprot.readString(readSmall);
+  });
+  oprot.writeI32(1);
+  oprot.writeString(big);
+  oprot.writeI32(2);
+  oprot.writeString(small);
+  out->flush();
+  reader.join();
+
+  BOOST_CHECK_EQUAL(1, readInts[0]);
+  BOOST_CHECK(big == readBig);
+  BOOST_CHECK_EQUAL(2, readInts[1]);
+  BOOST_CHECK_EQUAL(small, readSmall);
+
+  client->close();
+  accepted->close();
+  server.close();
+}
+
 BOOST_AUTO_TEST_CASE(test_get_port) {
   TServerSocket sock1("localHost", 888);
   BOOST_CHECK_EQUAL(888, sock1.getPort());
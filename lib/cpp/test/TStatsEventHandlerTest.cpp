@@ -0,0 +1,159 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <thrift/processor/TStatsEventHandler.h>
+
+using apache::thrift::processor::TLatencyHistogram;
+using apache::thrift::processor::TMethodStats;
+using apache::thrift::processor::TStatsEventHandler;
+
+BOOST_AUTO_TEST_SUITE(TStatsEventHandlerTest)
+
+BOOST_AUTO_TEST_CASE(test_histogram_buckets) {
+  size_t last = 0;
+  for (uint64_t v = 0; v < (1ull << 20); v += 1 + v / 64) {
+    size_t bucket = TLatencyHistogram::bucketOf(v);
+    BOOST_REQUIRE(bucket >= last);
+    BOOST_REQUIRE(v <= TLatencyHistogram::bucketLimit(bucket));
+    BOOST_REQUIRE(bucket == 0 || v > TLatencyHistogram::bucketLimit(bucket - 1));
+    // within 1/16 of the value
+    BOOST_REQUIRE(TLatencyHistogram::bucketLimit(bucket) - v <= v / 16);
+    last = bucket;
+  }
+  BOOST_CHECK_EQUAL(TLatencyHistogram::bucketOf(~0ull), TLatencyHistogram::NUM_BUCKETS - 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_histogram_percentiles) {
+  TLatencyHistogram h;
+  BOOST_CHECK_EQUAL(h.getPercentile(0.99), 0u);
+  for (uint64_t i = 1; i <= 1000; ++i) {
+    h.record(i * 1000);
+  }
+  BOOST_CHECK_EQUAL(h.getCount(), 1000u);
+  BOOST_CHECK_EQUAL(h.getMax(), 1000000u);
+  BOOST_CHECK_EQUAL(h.getMean(), 500500u);
+  uint64_t p50 = h.getPercentile(0.5);
+  uint64_t p99 = h.getPercentile(0.99);
+  BOOST_CHECK(p50 >= 500000 && p50 <= 500000 + 500000 / 16);
+  BOOST_CHECK(p99 >= 990000 && p99 <= 990000 + 990000 / 16);
+  BOOST_CHECK_EQUAL(h.getPercentile(1.0), 1000000u);
+
+  TLatencyHistogram other;
+  other.record(5000000);
+  h.merge(other);
+  BOOST_CHECK_EQUAL(h.getCount(), 1001u);
+  BOOST_CHECK_EQUAL(h.getPercentile(1.0), 5000000u);
+}
+
+/*
+ * Raises the events a generated processor raises for one call.
+ */
+static void call(TStatsEventHandler& handler, const char* method, bool fail) {
+  void* ctx = handler.getContext(method, nullptr);
+  handler.preRead(ctx, method);
+  handler.postRead(ctx, method, 10);
+  if (fail) {
+    handler.handlerError(ctx, method);
+  } else {
+    handler.preWrite(ctx, method);
+    handler.postWrite(ctx, method, 20);
+  }
+  handler.freeContext(ctx, method);
+}
+
+BOOST_AUTO_TEST_CASE(test_per_method_stats) {
+  TStatsEventHandler handler;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&handler] {
+      for (int i = 0; i < 1000; ++i) {
+        call(handler, "Service.ping", false);
+        call(handler, "Service.get", i % 10 == 0);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  std::map<std::string, TMethodStats> stats = handler.getStats();
+  BOOST_REQUIRE_EQUAL(stats.size(), 2u);
+  const TMethodStats& ping = stats["Service.ping"];
+  BOOST_CHECK_EQUAL(ping.calls, 4000u);
+  BOOST_CHECK_EQUAL(ping.errors, 0u);
+  BOOST_CHECK_EQUAL(ping.bytesIn, 40000u);
+  BOOST_CHECK_EQUAL(ping.bytesOut, 80000u);
+  BOOST_CHECK_EQUAL(ping.read.getCount(), 4000u);
+  BOOST_CHECK_EQUAL(ping.handler.getCount(), 4000u);
+  BOOST_CHECK_EQUAL(ping.write.getCount(), 4000u);
+
+  const TMethodStats& get = stats["Service.get"];
+  BOOST_CHECK_EQUAL(get.calls, 4000u);
+  BOOST_CHECK_EQUAL(get.errors, 400u);
+  BOOST_CHECK_EQUAL(get.handler.getCount(), 4000u);
+  BOOST_CHECK_EQUAL(get.write.getCount(), 3600u);
+
+  // a method name that is not a literal is still counted under its text
+  std::string name("Service.ping");
+  call(handler, name.c_str(), false);
+  BOOST_CHECK_EQUAL(handler.getStats()["Service.ping"].calls, 4001u);
+}
+
+BOOST_AUTO_TEST_CASE(test_exited_threads_are_retired) {
+  TStatsEventHandler handler;
+  for (int round = 0; round < 50; ++round) {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&handler] {
+        call(handler, "Service.ping", false);
+        call(handler, "Service.get", true);
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    BOOST_CHECK_EQUAL(handler.getShardCount(), 0u);
+  }
+
+  call(handler, "Service.ping", false);
+  BOOST_CHECK_EQUAL(handler.getShardCount(), 1u);
+  std::map<std::string, TMethodStats> stats = handler.getStats();
+  BOOST_CHECK_EQUAL(stats["Service.ping"].calls, 201u);
+  BOOST_CHECK_EQUAL(stats["Service.ping"].handler.getCount(), 201u);
+  BOOST_CHECK_EQUAL(stats["Service.get"].calls, 200u);
+  BOOST_CHECK_EQUAL(stats["Service.get"].errors, 200u);
+}
+
+BOOST_AUTO_TEST_CASE(test_thread_outlives_handler) {
+  std::unique_ptr<TStatsEventHandler> handler(new TStatsEventHandler());
+  std::thread thread([&handler] {
+    call(*handler, "Service.ping", false);
+    handler.reset();
+  });
+  thread.join();
+  BOOST_CHECK(!handler);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
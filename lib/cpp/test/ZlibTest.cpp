@@ -33,10 +33,15 @@
 #ifdef HAVE_INTTYPES_H
 #include <inttypes.h>
 #endif
+#include <chrono>
 #include <cstddef>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
 
 #include <boost/random.hpp>
 #include <boost/shared_array.hpp>
@@ -44,6 +49,8 @@
 #include <boost/version.hpp>
 
 #include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TCompressedTransport.h>
+#include <thrift/transport/THeaderTransport.h>
 #include <thrift/transport/TZlibTransport.h>
 
 using namespace apache::thrift::transport;
@@ -338,6 +345,255 @@ void test_get_underlying_transport() {
   BOOST_CHECK_EQUAL(membuf.get(), zlib_trans->getUnderlyingTransport().get());
 }
 
+/*
+ * TCompressedTransport
+ */
+
+void test_compressed_read_write_mix(const boost::shared_array<uint8_t> buf,
+                                    uint32_t buf_len,
+                                    const shared_ptr<SizeGenerator>& write_gen,
+                                    const shared_ptr<SizeGenerator>& read_gen) {
+  // Write the data in several frames of random sized writes
+  shared_ptr<TMemoryBuffer> membuf(new TMemoryBuffer());
+  TCompressedTransport w_trans(membuf);
+  uint32_t tot = 0;
+  int frames = 0;
+  while (tot < buf_len) {
+    uint32_t write_len = (std::min)(write_gen->getSize(), buf_len - tot);
+    w_trans.write(buf.get() + tot, write_len);
+    tot += write_len;
+    if (write_len % 3 == 0 || tot == buf_len) {
+      w_trans.flush();
+      ++frames;
+    }
+  }
+  // Random data doesn't compress and goes out as it is
+  BOOST_CHECK_LE(membuf->available_read(), buf_len + frames * 8);
+
+  // Read it back in random sized reads
+  TCompressedTransport r_trans(membuf);
+  boost::shared_array<uint8_t> mirror(new uint8_t[buf_len]);
+  tot = 0;
+  while (tot < buf_len) {
+    uint32_t read_len = (std::min)(read_gen->getSize(), buf_len - tot);
+    uint32_t got = r_trans.read(mirror.get() + tot, read_len);
+    BOOST_REQUIRE_LE(got, read_len);
+    BOOST_REQUIRE_NE(got, (uint32_t)0);
+    tot += got;
+  }
+  BOOST_CHECK_EQUAL(memcmp(mirror.get(), buf.get(), buf_len), 0);
+
+  // Nothing left
+  uint8_t byte;
+  BOOST_CHECK_EQUAL(r_trans.read(&byte, 1), (uint32_t)0);
+}
+
+/*
+ * A small record, as a short Thrift message would carry
+ */
+string gen_message(boost::mt19937& gen) {
+  static const char* const statuses[] = {"active", "archived", "pending", "deleted"};
+  std::ostringstream message;
+  message << "{\"id\":" << gen() % 100000000 << ",\"name\":\"item-" << gen() % 1000
+          << "\",\"status\":\"" << statuses[gen() % 4] << "\",\"region\":\"region-"
+          << gen() % 8 << "\",\"owner\":\"user" << gen() % 50 << "@example.com\"}";
+  return message.str();
+}
+
+/*
+ * A preset dictionary made of sample messages
+ */
+string gen_dictionary() {
+  boost::mt19937 gen(1);
+  string dictionary;
+  while (dictionary.size() < 4096) {
+    dictionary += gen_message(gen);
+  }
+  return dictionary;
+}
+
+void write_messages(TTransport& trans, const std::vector<string>& messages) {
+  for (const auto& message : messages) {
+    trans.write(reinterpret_cast<const uint8_t*>(message.data()),
+                static_cast<uint32_t>(message.size()));
+    trans.flush();
+  }
+}
+
+void read_messages(TTransport& trans, const std::vector<string>& messages) {
+  string mirror;
+  for (const auto& message : messages) {
+    mirror.resize(message.size());
+    trans.readAll(reinterpret_cast<uint8_t*>(&mirror[0]), static_cast<uint32_t>(mirror.size()));
+    trans.readEnd();
+    BOOST_REQUIRE_EQUAL(mirror, message);
+  }
+}
+
+std::vector<string> gen_messages(size_t count) {
+  std::vector<string> messages;
+  for (size_t i = 0; i < count; ++i) {
+    messages.push_back(gen_message(rng));
+  }
+  return messages;
+}
+
+void test_compressed_dictionary() {
+  std::vector<string> messages = gen_messages(100);
+  string dictionary = gen_dictionary();
+  auto pool = std::make_shared<TCompressionPool>(
+      [dictionary] { return std::make_shared<TZlibHeaderTransform>(-1, dictionary); });
+
+  shared_ptr<TMemoryBuffer> plain(new TMemoryBuffer());
+  TCompressedTransport plain_trans(plain);
+  write_messages(plain_trans, messages);
+
+  shared_ptr<TMemoryBuffer> membuf(new TMemoryBuffer());
+  TCompressedTransport w_trans(membuf, pool);
+  write_messages(w_trans, messages);
+
+  // Small messages compress much better with a dictionary
+  BOOST_CHECK_LT(membuf->available_read() * 2, plain->available_read());
+
+  TCompressedTransport r_trans(membuf, pool);
+  read_messages(r_trans, messages);
+
+  // Without the dictionary, frames can't be decompressed
+  write_messages(w_trans, messages);
+  TCompressedTransport no_dict_trans(membuf);
+  uint8_t byte;
+  try {
+    no_dict_trans.read(&byte, 1);
+    BOOST_ERROR("read() without the dictionary did not raise an exception");
+  } catch (TTransportException& ex) {
+    BOOST_CHECK_EQUAL(ex.getType(), TTransportException::CORRUPTED_DATA);
+  }
+}
+
+void test_compressed_zstd() {
+  if (!THeaderTransformRegistry::isRegistered(THeaderTransport::ZSTD_TRANSFORM)) {
+    BOOST_TEST_MESSAGE("Thrift was built without zstd");
+    return;
+  }
+  std::vector<string> messages = gen_messages(100);
+  auto dictionary = std::make_shared<const TZstdDictionary>(gen_dictionary());
+  auto pool = std::make_shared<TCompressionPool>(
+      [dictionary] { return std::make_shared<TZstdHeaderTransform>(1, dictionary); });
+
+  shared_ptr<TMemoryBuffer> membuf(new TMemoryBuffer());
+  TCompressedTransport w_trans(membuf, pool);
+  write_messages(w_trans, messages);
+  TCompressedTransport r_trans(membuf, pool);
+  read_messages(r_trans, messages);
+}
+
+void test_compressed_pool() {
+  auto pool = std::make_shared<TCompressionPool>(
+      [] { return std::make_shared<TZlibHeaderTransform>(); });
+  std::vector<string> messages = gen_messages(10);
+
+  shared_ptr<TMemoryBuffer> membuf(new TMemoryBuffer());
+  {
+    TCompressedTransport w_trans(membuf, pool);
+    TCompressedTransport r_trans(membuf, pool);
+    write_messages(w_trans, messages);
+    read_messages(r_trans, messages);
+
+    // Between messages the transports hold nothing
+    BOOST_CHECK_EQUAL(pool->getIdleCodecs(), 1u);
+    BOOST_CHECK_EQUAL(pool->getIdleBuffers(), 2u);
+  }
+
+  // Others reuse what they handed back
+  std::vector<shared_ptr<TCompressedTransport> > transports;
+  for (int i = 0; i < 10; ++i) {
+    transports.push_back(std::make_shared<TCompressedTransport>(membuf, pool));
+    write_messages(*transports.back(), messages);
+  }
+  BOOST_CHECK_EQUAL(pool->getIdleCodecs(), 1u);
+  BOOST_CHECK_EQUAL(pool->getIdleBuffers(), 2u);
+}
+
+void test_compressed_oversized_frame() {
+  // A frame that claims to decompress to more than the max message size
+  shared_ptr<TMemoryBuffer> membuf(new TMemoryBuffer());
+  uint32_t header[2] = {htonl(16), htonl(0x7fffffff)};
+  membuf->write(reinterpret_cast<uint8_t*>(header), sizeof(header));
+  membuf->write(reinterpret_cast<const uint8_t*>("0123456789abcdef"), 16);
+
+  TCompressedTransport r_trans(membuf);
+  uint8_t byte;
+  try {
+    r_trans.read(&byte, 1);
+    BOOST_ERROR("read() of an oversized frame did not raise an exception");
+  } catch (TTransportException& ex) {
+    BOOST_CHECK_EQUAL(ex.getType(), TTransportException::CORRUPTED_DATA);
+  }
+}
+
+/*
+ * Not a test: how fast small messages get through TZlibTransport and
+ * TCompressedTransport with the different codecs, and how big they get.
+ */
+void measure_throughput(const char* name,
+                        const std::vector<string>& messages,
+                        const std::function<shared_ptr<TTransport>(shared_ptr<TTransport>)>& wrap) {
+  shared_ptr<TMemoryBuffer> membuf(new TMemoryBuffer());
+  shared_ptr<TTransport> w_trans = wrap(membuf);
+  shared_ptr<TTransport> r_trans = wrap(membuf);
+
+  uint64_t bytes = 0;
+  uint64_t wire = 0;
+  size_t count = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed;
+  do {
+    write_messages(*w_trans, messages);
+    wire += membuf->available_read();
+    read_messages(*r_trans, messages);
+    for (const auto& message : messages) {
+      bytes += message.size();
+    }
+    count += messages.size();
+    elapsed = std::chrono::steady_clock::now() - start;
+  } while (elapsed.count() < 0.1);
+
+  std::cout << std::left << std::setw(24) << name << std::right << std::fixed
+            << std::setprecision(1) << std::setw(10) << bytes / elapsed.count() / 1e6 << " MB/s"
+            << std::setw(10) << static_cast<double>(wire) / count << " B/msg (of "
+            << static_cast<double>(bytes) / count << ")" << '\n';
+}
+
+void test_compression_throughput() {
+  std::vector<string> messages = gen_messages(1000);
+  string dictionary = gen_dictionary();
+
+  measure_throughput("TZlibTransport", messages, [](shared_ptr<TTransport> trans) {
+    return std::make_shared<TZlibTransport>(trans);
+  });
+  measure_throughput("compressed zlib", messages, [](shared_ptr<TTransport> trans) {
+    return std::make_shared<TCompressedTransport>(trans);
+  });
+  auto zlib_dict = std::make_shared<TCompressionPool>(
+      [dictionary] { return std::make_shared<TZlibHeaderTransform>(-1, dictionary); });
+  measure_throughput("compressed zlib + dict", messages, [zlib_dict](shared_ptr<TTransport> trans) {
+    return std::make_shared<TCompressedTransport>(trans, zlib_dict);
+  });
+  if (THeaderTransformRegistry::isRegistered(THeaderTransport::ZSTD_TRANSFORM)) {
+    auto zstd = std::make_shared<TCompressionPool>(
+        [] { return std::make_shared<TZstdHeaderTransform>(); });
+    measure_throughput("compressed zstd", messages, [zstd](shared_ptr<TTransport> trans) {
+      return std::make_shared<TCompressedTransport>(trans, zstd);
+    });
+    auto zstd_dictionary = std::make_shared<const TZstdDictionary>(dictionary);
+    auto zstd_dict = std::make_shared<TCompressionPool>(
+        [zstd_dictionary] { return std::make_shared<TZstdHeaderTransform>(1, zstd_dictionary); });
+    measure_throughput("compressed zstd + dict", messages, [zstd_dict](shared_ptr<TTransport> trans) {
+      return std::make_shared<TCompressedTransport>(trans, zstd_dict);
+    });
+  }
+}
+
 /*
  * Initialization
  */
@@ -414,6 +670,22 @@ void add_tests(boost::unit_test::test_suite* suite,
                 buf_len,
                 write_size_gen,
                 read_size_gen);
+
+  ADD_TEST_CASE(suite,
+                name << "-lognormal",
+                test_compressed_read_write_mix,
+                buf,
+                buf_len,
+                size_lognormal,
+                size_lognormal);
+}
+
+void add_compressed_tests(boost::unit_test::test_suite* suite) {
+  suite->add(BOOST_TEST_CASE(test_compressed_dictionary));
+  suite->add(BOOST_TEST_CASE(test_compressed_zstd));
+  suite->add(BOOST_TEST_CASE(test_compressed_pool));
+  suite->add(BOOST_TEST_CASE(test_compressed_oversized_frame));
+  suite->add(BOOST_TEST_CASE(test_compression_throughput));
 }
 
 void print_usage(FILE* f, const char* argv0) {
@@ -441,6 +713,7 @@ bool init_unit_test_suite() {
 
   suite->add(BOOST_TEST_CASE(test_no_write));
   suite->add(BOOST_TEST_CASE(test_get_underlying_transport));
+  add_compressed_tests(suite);
 
   return true;
 }
@@ -467,6 +740,7 @@ boost::unit_test::test_suite* init_unit_test_suite(int argc, char* argv[]) {
   add_tests(suite, gen_random_buffer(buf_len), buf_len, "random");
 
   suite->add(BOOST_TEST_CASE(test_no_write));
+  add_compressed_tests(suite);
 
   return nullptr;
 }
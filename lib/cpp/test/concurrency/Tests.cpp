@@ -150,18 +150,36 @@ int main(int argc, char** argv) {
       std::cerr << "\t\tTimerManager tests FAILED" << '\n';
       return 1;
     }
+
+    std::cout << "\t\tTimerWheelManager test05" << '\n';
+
+    if (!timerManagerTests.test05()) {
+      std::cerr << "\t\tTimerManager tests FAILED" << '\n';
+      return 1;
+    }
+
+    std::cout << "\t\tTimerWheelManager test06" << '\n';
+
+    if (!timerManagerTests.test06()) {
+      std::cerr << "\t\tTimerManager tests FAILED" << '\n';
+      return 1;
+    }
   }
 
   if (runAll || args[0].compare("thread-manager") == 0) {
 
     std::cout << "ThreadManager tests..." << '\n';
 
-    {
+    for (int workStealing = 0; workStealing <= 1; ++workStealing) {
       size_t workerCount = 10 * WEIGHT;
       size_t taskCount = 500 * WEIGHT;
       int64_t delay = 10LL;
 
-      ThreadManagerTests threadManagerTests;
+      ThreadManagerTests threadManagerTests(workStealing != 0);
+
+      if (workStealing) {
+        std::cout << "\tWork stealing ThreadManager tests..." << '\n';
+      }
 
       std::cout << "\t\tThreadManager api test:" << '\n';
 
@@ -50,6 +50,17 @@ static void sleep_(int64_t millisec) {
 class ThreadManagerTests {
 
 public:
+  /**
+   * @param workStealing run the tests against newWorkStealingThreadManager()
+   * instead of newSimpleThreadManager()
+   */
+  ThreadManagerTests(bool workStealing = false) : _workStealing(workStealing) {}
+
+  shared_ptr<ThreadManager> newThreadManager(size_t count, size_t pendingTaskCountMax = 0) {
+    return _workStealing ? ThreadManager::newWorkStealingThreadManager(count, pendingTaskCountMax)
+                         : ThreadManager::newSimpleThreadManager(count, pendingTaskCountMax);
+  }
+
   class Task : public Runnable {
 
   public:
@@ -98,7 +109,7 @@ public:
 
     size_t activeCount = count;
 
-    shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(workerCount);
+    shared_ptr<ThreadManager> threadManager = newThreadManager(workerCount);
 
     shared_ptr<ThreadFactory> threadFactory
         = shared_ptr<ThreadFactory>(new ThreadFactory(false));
@@ -244,7 +255,7 @@ public:
       size_t activeCounts[] = {workerCount, pendingTaskMaxCount, 1};
 
       shared_ptr<ThreadManager> threadManager
-          = ThreadManager::newSimpleThreadManager(workerCount, pendingTaskMaxCount);
+          = newThreadManager(workerCount, pendingTaskMaxCount);
 
       shared_ptr<ThreadFactory> threadFactory
           = shared_ptr<ThreadFactory>(new ThreadFactory());
@@ -393,7 +404,7 @@ public:
 
   bool apiTestWithThreadFactory(shared_ptr<ThreadFactory> threadFactory)
   {
-    shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(1);
+    shared_ptr<ThreadManager> threadManager = newThreadManager(1);
     threadManager->threadFactory(threadFactory);
 
     std::cout << "\t\t\t\tstarting.. " << '\n';
@@ -622,6 +633,9 @@ public:
     threadManager.reset();
     return true;
   }
+
+private:
+  bool _workStealing;
 };
 
 }
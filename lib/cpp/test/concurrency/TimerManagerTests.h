@@ -25,6 +25,7 @@
 #include <chrono>
 #include <thread>
 #include <iostream>
+#include <vector>
 
 namespace apache {
 namespace thrift {
@@ -262,6 +263,120 @@ public:
     return true;
   }
 
+  /**
+   * This test adds tasks to a TimerWheelManager with timeouts spread over the
+   * first two levels of the wheel, cancels every other one and verifies that
+   * the rest run, none of them early, once tasks due in the higher level have
+   * cascaded down.
+   */
+  bool test05(uint64_t timeout = 1000LL) {
+    TimerWheelManager timerManager;
+    timerManager.threadFactory(shared_ptr<ThreadFactory>(new ThreadFactory()));
+    timerManager.start();
+    assert(timerManager.state() == TimerManager::STARTED);
+
+    std::vector<shared_ptr<TimerManagerTests::Task> > tasks;
+    std::vector<TimerManager::Timer> timers;
+    const size_t count = 20;
+    {
+      Synchronized s(_monitor);
+      for (size_t ix = 0; ix < count; ++ix) {
+        // The largest of these is well beyond the 256 ticks of the first level
+        uint64_t taskTimeout = timeout / 10 + ix * timeout / (2 * count);
+        tasks.push_back(shared_ptr<TimerManagerTests::Task>(
+            new TimerManagerTests::Task(_monitor, taskTimeout)));
+        timers.push_back(timerManager.add(tasks.back(), taskTimeout));
+      }
+      if (timerManager.taskCount() != count) {
+        std::cerr << "timerManager has " << timerManager.taskCount() << " tasks, expected "
+                  << count << '\n';
+        return false;
+      }
+      for (size_t ix = 0; ix < count; ix += 2) {
+        timerManager.remove(timers[ix]);
+      }
+      if (timerManager.taskCount() != count / 2) {
+        std::cerr << "timerManager has " << timerManager.taskCount() << " tasks, expected "
+                  << count / 2 << '\n';
+        return false;
+      }
+      while (!tasks.back()->_done) {
+        _monitor.wait(timeout * 2);
+      }
+    }
+
+    for (size_t ix = 0; ix < count; ++ix) {
+      if (tasks[ix]->_done != (ix % 2 == 1)) {
+        std::cerr << "task " << ix << (tasks[ix]->_done ? " ran" : " did not run") << '\n';
+        return false;
+      }
+      if (tasks[ix]->_done && !tasks[ix]->_success) {
+        std::cerr << "task " << ix << " ran early" << '\n';
+        return false;
+      }
+    }
+
+    if (timerManager.taskCount() != 0) {
+      std::cerr << "timerManager has tasks left over" << '\n';
+      return false;
+    }
+
+    return true;
+  }
+
+  /**
+   * This test checks that a TimerWheelManager removes tasks by Runnable and
+   * reports removing unknown or expired tasks like a TimerManager does.
+   */
+  bool test06(uint64_t timeout = 1000LL) {
+    TimerWheelManager timerManager(std::chrono::milliseconds(10));
+    timerManager.threadFactory(shared_ptr<ThreadFactory>(new ThreadFactory()));
+    timerManager.start();
+    assert(timerManager.state() == TimerManager::STARTED);
+
+    Synchronized s(_monitor);
+
+    // Add one task twice, far enough out to land in different levels
+    shared_ptr<TimerManagerTests::Task> taskToRemove
+        = shared_ptr<TimerManagerTests::Task>(new TimerManagerTests::Task(_monitor, timeout / 2));
+    timerManager.add(taskToRemove, taskToRemove->_timeout);
+    timerManager.add(taskToRemove, taskToRemove->_timeout * 10);
+
+    shared_ptr<TimerManagerTests::Task> task
+        = shared_ptr<TimerManagerTests::Task>(new TimerManagerTests::Task(_monitor, timeout));
+    TimerManager::Timer timer = timerManager.add(task, task->_timeout);
+
+    timerManager.remove(taskToRemove);
+    assert(timerManager.taskCount() == 1);
+
+    try {
+      timerManager.remove(taskToRemove);
+      assert(nullptr == "ERROR: This remove should send a NoSuchTaskException exception.");
+    } catch (NoSuchTaskException&) {
+    }
+
+    _monitor.wait(timeout * 2);
+
+    assert(!taskToRemove->_done);
+    assert(task->_done);
+    assert(task->_success);
+    task.reset();
+
+    for (;;) {
+      try {
+        timerManager.remove(timer);
+        assert(nullptr == "ERROR: This remove should throw NoSuchTaskException, or UncancellableTaskException.");
+      } catch (const NoSuchTaskException&) {
+          break;
+      } catch (const UncancellableTaskException&) {
+          // the thread was still exiting; try again...
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+
+    return true;
+  }
+
   friend class TestTask;
 
   Monitor _monitor;